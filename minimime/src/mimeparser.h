@@ -10,12 +10,26 @@ int 	dprintf(const char *, ...);
 int 	mimeparser_yyparse(void);
 int 	mimeparser_yylex(void);
 int	mimeparser_yyerror(const char *);
+int	PARSER_endheaders(void);
+void	PARSER_reset(void);
+
+/* What follows a header section, see PARSER_endheaders() */
+enum parser_sections
+{
+	SECTION_BODY = 0,
+	SECTION_PREAMBLE,
+	SECTION_MESSAGE
+};
 
 struct s_position
 {
 	size_t opaque_start;
 	size_t start;
 	size_t end;
+
+	/* Bodies: the line breaks in the body, and whether it ends with one */
+	int lines;
+	int eol;
 };
 
 #endif /* ! _MIMEPARSER_H_INCLUDED */
@@ -35,7 +35,6 @@
  * TODO:
  *	- honour parse flags passed to us (partly done)
  *	- parse Content-Disposition header (partly done)
- *	- parse Content-Encoding header
  */
 #include <stdio.h>
 #include <stdarg.h>
@@ -50,6 +49,14 @@
 extern int lineno;
 extern int condition;
 
+/* Positions in the message, maintained by the scanner */
+extern size_t current_pos;
+extern size_t header_start;
+extern size_t headers_end;
+extern size_t body_opaque_start;
+
+/* The boundary in effect, i.e. the one of the innermost multipart entity
+ * whose closing boundary has not been found yet */
 char *boundary_string = NULL;
 char *endboundary_string = NULL;
 
@@ -73,10 +80,49 @@ static struct mm_mimepart *current_mimepart = NULL;
 /* Marker for indicating a found Content-Type header */
 static int have_contenttype;
 
+/* Content-Transfer-Encoding of the current MIME part, if any */
+static char *transfer_encoding = NULL;
+
 /* The parse mode */
 static int parsemode;
 
-static char *PARSE_readmessagepart(size_t, size_t, size_t, size_t *);
+/* The parse flags */
+static int parseflags;
+
+/* RFC 2231 parameter segments of the current header, assembled at its end */
+static struct mm_params segments = TAILQ_HEAD_INITIALIZER(segments);
+
+/* The composite MIME parts enclosing the current one, innermost last: 
+ * multipart entities with their boundary lines, and message/rfc822 parts
+ * without. The body of each starts at body_start. */
+struct PARSE_level
+{
+	struct mm_mimepart *part;
+	char *boundary;
+	char *endboundary;
+	int closed;
+	size_t body_start;
+};
+
+static struct PARSE_level *levels = NULL;
+static int nlevels = 0;
+static int maxlevels = 0;
+
+/* Where the entity parsed last ends, see PARSE_setbody() */
+static size_t entity_end = 0;
+
+static char *PARSE_readmessagepart(size_t, size_t, size_t, size_t *, size_t *);
+static int PARSE_setbody(struct s_position *);
+static int PARSE_dispositionparam(const char *, const char *);
+static void PARSE_freesegments(void);
+static void PARSE_headersource(struct mm_mimeheader *);
+static void PARSE_warning(int);
+static void PARSE_enter(const char *);
+static void PARSE_leave(void);
+static void PARSE_setboundary(void);
+static int PARSE_isboundary(const char *);
+static int PARSE_endpart(void);
+static int PARSE_endentity(struct s_position *);
 
 %}
 
@@ -117,6 +163,7 @@ static char *PARSE_readmessagepart(size_t, size_t, size_t, size_t *);
 %type  <string> contenttype_parameter_value
 %type  <string> mimetype
 %type  <string> body
+%type  <position> postamble
 
 %start message
 
@@ -140,6 +187,10 @@ multipart_message:
 	}
 	mimeparts endboundary postamble
 	{
+		/* Drop the MIME part prepared for one more nested part */
+		mm_mimepart_free(current_mimepart);
+		current_mimepart = envelope;
+		PARSE_leave();
 		dprintf("This was a multipart message\n");
 	}
 	;
@@ -163,34 +214,45 @@ headers :
 		 * charset of "us-ascii" can be assumed.
 		 */
 		struct mm_content *ct;
-		struct mm_param *param;
+
+		/* Remember where the header section ends in the source, in
+		 * case the part has no body.
+		 */
+		current_mimepart->src_hdrlen = headers_end - 1 
+		    - current_mimepart->src_offset;
+		current_mimepart->src_length = current_mimepart->src_hdrlen;
 
 		if (!have_contenttype) {
 			ct = mm_content_new();
 			mm_content_settype(ct, "text/plain");
-			
-			param = mm_param_new();
-			param->name = xstrdup("charset");
-			param->value = xstrdup("us-ascii");
-
-			mm_content_attachparam(ct, param);
+			mm_content_addparam(ct, "charset", "us-ascii");
 			mm_mimepart_attachcontenttype(current_mimepart, ct);
 		}	
 		have_contenttype = 0;
+
+		/* The Content-Transfer-Encoding header may appear before
+		 * the Content-Type header, so we can only record it once
+		 * all headers of the MIME part are known. This also resolves
+		 * the codec for the part.
+		 */
+		if (transfer_encoding != NULL) {
+			mm_content_setencoding(current_mimepart->type,
+			    transfer_encoding);
+			xfree(transfer_encoding);
+			transfer_encoding = NULL;
+		}
 	}
-	|
-	header
 	;
 
 preamble:
 	PREAMBLE
 	{
 		char *preamble;
-		size_t offset;
+		size_t offset, length;
 		
 		if ($1.start != $1.end) {
 			preamble = PARSE_readmessagepart(0, $1.start, $1.end,
-			    &offset);
+			    &offset, &length);
 			if (preamble == NULL) {
 				return(-1);
 			}
@@ -204,8 +266,12 @@ preamble:
 postamble:
 	POSTAMBLE
 	{
+		$$ = $1;
 	}
 	|
+	{
+		memset(&$$, 0, sizeof($$));
+	}
 	;
 
 mimeparts:
@@ -215,17 +281,53 @@ mimeparts:
 	;
 
 mimepart:
-	boundary headers body
+	boundary entity
 	{
+		if (PARSE_endpart() == -1)
+			return(-1);
+	}
+	;
 
-		if (mm_context_attachpart(ctx, current_mimepart) == -1) {
-			mm_errno = MM_ERROR_ERRNO;
+/* The contents of a MIME part: a body, MIME parts nested in a multipart
+ * entity, or a message encapsulated in a message/rfc822 part. The scanner
+ * tells them apart at the end of the header section, see 
+ * PARSER_endheaders().
+ */
+entity:
+	headers body
+	|
+	headers PREAMBLE
+	{
+		current_mimepart = mm_mimepart_new();
+	}
+	mimeparts endboundary postamble
+	{
+		/* Drop the MIME part prepared for one more nested part */
+		mm_mimepart_free(current_mimepart);
+		current_mimepart = levels[nlevels - 1].part;
+		if (PARSE_endentity(&$6) == -1)
 			return(-1);
-		}	
+	}
+	|
+	headers
+	{
+		current_mimepart = mm_mimepart_new();
+		current_mimepart->src_offset = body_opaque_start - 1;
+	}
+	entity
+	{
+		struct s_position position;
 
-		tmppart = mm_mimepart_new();
-		current_mimepart = tmppart;
-		mime_parts++;
+		/* The message is the only MIME part nested in the message/rfc822
+		 * part, its body is the whole message */
+		if (mm_mimepart_attachchild(levels[nlevels - 1].part, 
+		    current_mimepart) == -1)
+			return(-1);
+		current_mimepart = levels[nlevels - 1].part;
+		memset(&position, 0, sizeof(position));
+		position.end = entity_end;
+		if (PARSE_endentity(&position) == -1)
+			return(-1);
 	}
 	;
 	
@@ -256,7 +358,7 @@ header	:
 			mm_error_setlineno(lineno);
 			return(-1);
 		} else {
-			/* TODO: attach MM_WARNING_INVHDR */
+			PARSE_warning(MM_WARNING_INVHDR);
 		}
 	}
 	;
@@ -265,8 +367,11 @@ mail_header:
 	MAIL_HEADER COLON WORD EOL
 	{
 		struct mm_mimeheader *hdr;
-		hdr = mm_mimeheader_generate($1, $3);
-		mm_mimepart_attachheader(current_mimepart, hdr);
+		hdr = mm_mimepart_addheader(current_mimepart, $1, $3);
+		if (parseflags & MM_PARSE_DECODEHEADERS) {
+			mm_mimeheader_decode(hdr);
+		}
+		PARSE_headersource(hdr);
 	}
 	|
 	MAIL_HEADER COLON EOL
@@ -279,11 +384,11 @@ mail_header:
 			mm_error_setlineno(lineno);
 			return(-1);
 		} else {
-			/* TODO: attach MM_WARNING_INVHDR */
+			PARSE_warning(MM_WARNING_INVHDR);
 		}	
 		
-		hdr = mm_mimeheader_generate($1, xstrdup(""));
-		mm_mimepart_attachheader(current_mimepart, hdr);
+		hdr = mm_mimepart_addheader(current_mimepart, $1, "");
+		PARSE_headersource(hdr);
 	}
 	;
 
@@ -298,7 +403,35 @@ contenttype_header:
 	|
 	CONTENTTYPE_HEADER COLON mimetype contenttype_parameters EOL
 	{
+		struct mm_params params;
+		struct mm_param *param;
+		char *value;
+
+		/* Reassemble RFC 2231 parameters, e.g. long file names */
+		TAILQ_INIT(&params);
+		mm_rfc2231_assemble(&segments, &params,
+		    parseflags & MM_PARSE_KEEPSEGMENTS);
+		while ((param = TAILQ_FIRST(&params)) != NULL) {
+			TAILQ_REMOVE(&params, param, next);
+			mm_content_attachparam(ctype, param);
+		}
 		mm_content_settype(ctype, "%s", $3);
+
+		/* Nested multipart entities need a boundary of their own */
+		value = mm_content_getparambyname(ctype, "boundary");
+		if (value != NULL 
+		    && mm_content_gettypeid(ctype) == MM_MEDIATYPE_MULTIPART
+		    && PARSE_isboundary(value)) {
+			if (parsemode != MM_PARSE_LOOSE) {
+				mm_errno = MM_ERROR_MIME;
+				mm_error_setmsg("boundary of an enclosing "
+				    "multipart entity");
+				mm_error_setlineno(lineno);
+				return(-1);
+			} else {
+				PARSE_warning(MM_WARNING_DUPPARAM);
+			}
+		}
 		mm_mimepart_attachcontenttype(current_mimepart, ctype);
 		dprintf("Content-Type (P) -> %s\n", $3);
 		ctype = mm_content_new();
@@ -309,10 +442,34 @@ contentdisposition_header:
 	CONTENTDISPOSITION_HEADER COLON content_disposition EOL
 	{
 		dprintf("Content-Disposition -> %s\n", $3);
+		if (current_mimepart->disposition_type == NULL)
+			current_mimepart->disposition_type = xstrdup($3);
 	}
 	|
 	CONTENTDISPOSITION_HEADER COLON content_disposition content_disposition_parameters EOL
 	{
+		struct mm_params params;
+		struct mm_param *param;
+		int ret;
+
+		if (current_mimepart->disposition_type == NULL)
+			current_mimepart->disposition_type = xstrdup($3);
+
+		/* Reassemble RFC 2231 parameters, e.g. long file names */
+		TAILQ_INIT(&params);
+		mm_rfc2231_assemble(&segments, &params, 0);
+
+		ret = 0;
+		while ((param = TAILQ_FIRST(&params)) != NULL) {
+			TAILQ_REMOVE(&params, param, next);
+			if (ret == 0)
+				ret = PARSE_dispositionparam(param->name,
+				    param->value);
+			mm_param_free(param);
+		}
+		if (ret == -1)
+			return -1;
+
 		dprintf("Content-Disposition (P) -> %s\n", $3);
 	}
 	;
@@ -332,9 +489,9 @@ content_disposition:
 				mm_errno = MM_ERROR_MIME;
 				mm_error_setmsg("invalid content-disposition");
 				return(-1);
+			} else {
+				PARSE_warning(MM_WARNING_INVHDR);
 			}	
-		} else {
-			/* TODO: attach MM_WARNING_INVHDR */
 		}	
 		$$ = $1;
 	}
@@ -343,7 +500,28 @@ content_disposition:
 contentencoding_header:
 	CONTENTENCODING_HEADER COLON WORD EOL
 	{
+		size_t len;
+
 		dprintf("Content-Transfer-Encoding -> %s\n", $3);
+
+		/* Only the mechanism counts, strip comments and whitespace */
+		len = strcspn($3, " \t\r\n(;");
+		if (len == 0) {
+			if (parsemode != MM_PARSE_LOOSE) {
+				mm_errno = MM_ERROR_MIME;
+				mm_error_setmsg("invalid Content-Transfer-Encoding");
+				mm_error_setlineno(lineno);
+				return(-1);
+			} else {
+				PARSE_warning(MM_WARNING_INVHDR);
+			}
+		} else {
+			if (transfer_encoding != NULL) {
+				xfree(transfer_encoding);
+			}
+			transfer_encoding = xstrdup($3);
+			transfer_encoding[len] = '\0';
+		}
 	}
 	;
 
@@ -367,7 +545,7 @@ any:
 mimetype:
 	WORD '/' WORD
 	{
-		char type[255];
+		static char type[255];
 		snprintf(type, sizeof(type), "%s/%s", $1, $3);
 		$$ = type;
 	}	
@@ -386,7 +564,7 @@ contenttype_parameters:
 			mm_error_setlineno(lineno);
 			return(-1);
 		} else {
-			/* TODO: attach MM_WARNING_INVHDR */
+			PARSE_warning(MM_WARNING_INVHDR);
 		}	
 	}
 	;
@@ -404,7 +582,7 @@ content_disposition_parameters:
 			mm_error_setlineno(lineno);
 			return(-1);
 		} else {
-			/* TODO: attach MM_WARNING_INVHDR */
+			PARSE_warning(MM_WARNING_INVHDR);
 		}
 	}	
 	;
@@ -413,61 +591,47 @@ contenttype_parameter:
 	WORD EQUAL contenttype_parameter_value
 	{
 		struct mm_param *param;
-		param = mm_param_new();
 		
 		dprintf("Param: '%s', Value: '%s'\n", $1, $3);
-		
-		/* Catch an eventual boundary identifier */
-		if (!strcasecmp($1, "boundary")) {
-			if (boundary_string == NULL) {
-				set_boundary($3);
-			} else {
+
+		/* RFC 2231 segments are assembled at the end of the header */
+		if (strchr($1, '*') != NULL) {
+			param = mm_param_generate($1, $3);
+			TAILQ_INSERT_TAIL(&segments, param, next);
+		} else {
+			/* Catch a duplicate boundary identifier */
+			if (!strcasecmp($1, "boundary") 
+			    && mm_content_getparambyname(ctype, "boundary")
+			    != NULL) {
 				if (parsemode != MM_PARSE_LOOSE) {
 					mm_errno = MM_ERROR_MIME;
-					mm_error_setmsg("duplicate boundary "
-					    "found");
+					mm_error_setmsg("duplicate "
+					    "boundary found");
 					return -1;
 				} else {
-					/* TODO: attach MM_WARNING_DUPPARAM */
+					PARSE_warning(MM_WARNING_DUPPARAM);
 				}
 			}
-		}
-
-		param->name = xstrdup($1);
-		param->value = xstrdup($3);
 
-		mm_content_attachparam(ctype, param);
+			param = mm_content_addparam(ctype, $1, $3);
+			if (parseflags & MM_PARSE_DECODEHEADERS) {
+				mm_param_decode(param);
+			}
+		}
 	}
 	;
 
 content_disposition_parameter:
 	WORD EQUAL contenttype_parameter_value
 	{
-		if (!strcasecmp($3, "filename") 
-		    && current_mimepart->filename == NULL) {
-			current_mimepart->filename = xstrdup($3);
-		} else if (!strcasecmp($3, "creation-date")
-		    && current_mimepart->creation_date == NULL) {
-			current_mimepart->creation_date = xstrdup($3);
-		} else if (!strcasecmp($3, "modification-date")
-		    && current_mimepart->modification_date == NULL) {
-			current_mimepart->modification_date = xstrdup($3);
-		} else if (!strcasecmp($3, "read-date")
-		    && current_mimepart->read_date == NULL) {
-		    	current_mimepart->read_date = xstrdup($3);
-		} else if (!strcasecmp($3, "size")
-		    && current_mimepart->disposition_size == NULL) {
-		    	current_mimepart->disposition_size = xstrdup($3);
-		} else {
-			if (parsemode != MM_PARSE_LOOSE) {
-				mm_errno = MM_ERROR_MIME;
-				mm_error_setmsg("invalid disposition "
-				    "parameter");
-				return -1;
-			} else {
-				/* TODO: attach MM_WARNING_INVPARAM */
-			}	
-		}	
+		struct mm_param *param;
+
+		if (strchr($1, '*') != NULL) {
+			param = mm_param_generate($1, $3);
+			TAILQ_INSERT_TAIL(&segments, param, next);
+		} else if (PARSE_dispositionparam($1, $3) == -1) {
+			return -1;
+		}
 	}
 	;
 
@@ -486,7 +650,7 @@ contenttype_parameter_value:
 			mm_error_setlineno(lineno);
 			return(-1);
 		} else {
-			/* TODO: attach MM_WARNING_INVAL */
+			PARSE_warning(MM_WARNING_INVAL);
 		}	
 		$$ = $1;
 	}
@@ -519,6 +683,8 @@ boundary	:
 			mm_error_setlineno(lineno);
 			return(-1);
 		}
+		/* The MIME part starts right after the boundary line */
+		current_mimepart->src_offset = body_opaque_start - 1;
 		dprintf("New MIME part... (%s)\n", $1);
 	}
 	;
@@ -538,6 +704,9 @@ endboundary	:
 			mm_error_setlineno(lineno);
 			return(-1);
 		}
+		/* The boundary of the enclosing entity is in effect again */
+		levels[nlevels - 1].closed = 1;
+		PARSE_setboundary();
 		dprintf("End of MIME message\n");
 	}
 	;
@@ -545,19 +714,10 @@ endboundary	:
 body:
 	BODY
 	{
-		char *body;
-		size_t offset;
-
 		dprintf("BODY (%d/%d), SIZE %d\n", $1.start, $1.end, $1.end - $1.start);
 
-		body = PARSE_readmessagepart($1.opaque_start, $1.start, $1.end,
-		    &offset);
-
-		if (body == NULL) {
+		if (PARSE_setbody(&$1) == -1)
 			return(-1);
-		}	
-		current_mimepart->opaque_body = body;
-		current_mimepart->body = body + offset;
 	}
 	;
 
@@ -565,10 +725,11 @@ body:
 
 /*
  * This function gets the specified part from the currently parsed message.
+ * The length of the returned (NUL-terminated) part is stored in length.
  */
 static char *
 PARSE_readmessagepart(size_t opaque_start, size_t real_start, size_t end, 
-    size_t *offset)
+    size_t *offset, size_t *length)
 {
 	size_t body_size;
 	size_t current;
@@ -600,19 +761,13 @@ PARSE_readmessagepart(size_t opaque_start, size_t real_start, size_t end,
 		*offset = 0;
 	}
 
-	/* The next three cases should NOT happen anytime */
+	/* The next two cases should NOT happen anytime */
 	if (end <= start) {
 		mm_errno = MM_ERROR_PARSE;
 		mm_error_setmsg("internal incosistency,2");
 		mm_error_setlineno(lineno);
 		return(NULL);
 	}
-	if (start < *offset) {
-		mm_errno = MM_ERROR_PARSE;
-		mm_error_setmsg("internal incosistency, S:%d,O:%d,L:%d", start, offset, lineno);
-		mm_error_setlineno(lineno);
-		return(NULL);
-	}	
 	if (start < 0 || end < 0) {
 		mm_errno = MM_ERROR_PARSE;
 		mm_error_setmsg("internal incosistency,4");
@@ -647,14 +802,284 @@ PARSE_readmessagepart(size_t opaque_start, size_t real_start, size_t end,
 		fseek(curin, start - 1, SEEK_SET);
 		fread(body, body_size - 1, 1, curin);
 		fseek(curin, current, SEEK_SET);
+		body[body_size - 1] = '\0';
 	} else if (message_buffer != NULL) {
 		strlcpy(body, message_buffer + start - 1, body_size);
 	} 
+
+	*length = body_size - 1;
 	
 	return(body);
 
 }
 
+/*
+ * Sets the body of the current MIME part, from the start of the part up to
+ * the end of the body given by position. The line break before a boundary
+ * is not part of the body.
+ */
+static int
+PARSE_setbody(struct s_position *position)
+{
+	char *body;
+	size_t offset, length;
+	int lines;
+
+	body = PARSE_readmessagepart(position->opaque_start, position->start, 
+	    position->end, &offset, &length);
+
+	if (body == NULL) {
+		return(-1);
+	}	
+	current_mimepart->opaque_body = body;
+	current_mimepart->opaque_length = length;
+	current_mimepart->body = body + offset;
+	current_mimepart->length = length - offset;
+	current_mimepart->src_length = position->end - 2 
+	    - current_mimepart->src_offset;
+	/* A line break before a boundary belongs to the boundary */
+	if (length > offset && body[length - 1] == '\r')
+		current_mimepart->src_length--;
+	entity_end = position->end;
+
+	/* Lines of the body as counted by the lexer, without the line break
+	 * before a boundary, but with an unterminated last line. The lines of
+	 * composite MIME parts are counted here, with that line break as the
+	 * lexer does.
+	 */
+	lines = position->lines;
+	if (lines < 0)
+		lines = count_lines(body + offset) + 1;
+	if (boundary_string != NULL) {
+		if (lines > 0)
+			lines--;
+		if (current_mimepart->src_length 
+		    > current_mimepart->src_hdrlen
+		    && body[offset + current_mimepart->src_length 
+		    - current_mimepart->src_hdrlen - 1] != '\n')
+			lines++;
+	} else if (!position->eol && position->end > position->start) {
+		lines++;
+	}
+	current_mimepart->lines = lines;
+
+	return 0;
+}
+
+/*
+ * Attaches the MIME part which has just been parsed to the multipart entity
+ * enclosing it and prepares the next one. The parts of the envelope are the
+ * ones of the context.
+ */
+static int
+PARSE_endpart(void)
+{
+	struct mm_mimepart *parent;
+
+	parent = levels[nlevels - 1].part;
+	if (parent == envelope) {
+		if (mm_context_attachpart(ctx, current_mimepart) == -1) {
+			mm_errno = MM_ERROR_ERRNO;
+			return(-1);
+		}
+	} else if (mm_mimepart_attachchild(parent, current_mimepart) == -1) {
+		return(-1);
+	}
+
+	tmppart = mm_mimepart_new();
+	current_mimepart = tmppart;
+	mime_parts++;
+
+	return(0);
+}
+
+/*
+ * Ends the composite MIME part enclosing the parts just parsed, which 
+ * becomes the current one again. Its body reaches up to the boundary line
+ * found at the end of position.
+ */
+static int
+PARSE_endentity(struct s_position *position)
+{
+	if (position->end == 0) {
+		mm_errno = MM_ERROR_PARSE;
+		mm_error_setmsg("missing boundary after nested MIME parts");
+		mm_error_setlineno(lineno);
+		return(-1);
+	}
+
+	position->opaque_start = current_mimepart->src_offset + 1;
+	position->start = levels[nlevels - 1].body_start;
+	position->lines = -1;
+	position->eol = 1;
+	PARSE_leave();
+
+	return PARSE_setbody(position);
+}
+
+/*
+ * Enters the composite MIME part whose header section has just been parsed.
+ * Multipart entities come with a boundary, message/rfc822 parts without.
+ */
+static void
+PARSE_enter(const char *boundary)
+{
+	struct PARSE_level *level;
+	size_t blen;
+
+	if (nlevels == maxlevels) {
+		maxlevels = maxlevels ? maxlevels * 2 : 4;
+		levels = (struct PARSE_level *)xrealloc(levels, 
+		    maxlevels * sizeof(struct PARSE_level));
+	}
+	level = &levels[nlevels++];
+	level->part = current_mimepart;
+	level->boundary = NULL;
+	level->endboundary = NULL;
+	level->closed = 0;
+	level->body_start = headers_end;
+
+	if (boundary != NULL) {
+		blen = strlen(boundary);
+		level->boundary = (char *)xmalloc(blen + 3);
+		level->endboundary = (char *)xmalloc(blen + 5);
+		snprintf(level->boundary, blen + 3, "--%s", boundary);
+		snprintf(level->endboundary, blen + 5, "--%s--", boundary);
+		if (current_mimepart == envelope)
+			ctx->boundary = xstrdup(boundary);
+	}
+
+	PARSE_setboundary();
+}
+
+/*
+ * Leaves the innermost composite MIME part
+ */
+static void
+PARSE_leave(void)
+{
+	struct PARSE_level *level;
+
+	level = &levels[--nlevels];
+	if (level->boundary != NULL) {
+		xfree(level->boundary);
+		xfree(level->endboundary);
+	}
+
+	PARSE_setboundary();
+}
+
+/*
+ * Puts the boundary of the innermost multipart entity which has not been 
+ * closed yet in effect
+ */
+static void
+PARSE_setboundary(void)
+{
+	int i;
+
+	boundary_string = NULL;
+	endboundary_string = NULL;
+
+	for (i = nlevels - 1; i >= 0; i--) {
+		if (levels[i].boundary != NULL && !levels[i].closed) {
+			boundary_string = levels[i].boundary;
+			endboundary_string = levels[i].endboundary;
+			break;
+		}
+	}
+}
+
+/*
+ * Checks whether a boundary is the one of an enclosing multipart entity
+ */
+static int
+PARSE_isboundary(const char *boundary)
+{
+	int i;
+
+	for (i = 0; i < nlevels; i++) {
+		if (levels[i].boundary != NULL && !levels[i].closed
+		    && !strcmp(levels[i].boundary + 2, boundary))
+			return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Stores a Content-Disposition parameter in the current MIME part. Returns
+ * -1 if the parameter is invalid and we're parsing in strict mode.
+ */
+static int
+PARSE_dispositionparam(const char *name, const char *value)
+{
+	if (!strcasecmp(name, "filename") 
+	    && current_mimepart->filename == NULL) {
+		current_mimepart->filename = xstrdup(value);
+	} else if (!strcasecmp(name, "creation-date")
+	    && current_mimepart->creation_date == NULL) {
+		current_mimepart->creation_date = xstrdup(value);
+	} else if (!strcasecmp(name, "modification-date")
+	    && current_mimepart->modification_date == NULL) {
+		current_mimepart->modification_date = xstrdup(value);
+	} else if (!strcasecmp(name, "read-date")
+	    && current_mimepart->read_date == NULL) {
+		current_mimepart->read_date = xstrdup(value);
+	} else if (!strcasecmp(name, "size")
+	    && current_mimepart->disposition_size == NULL) {
+		current_mimepart->disposition_size = xstrdup(value);
+	} else {
+		if (parsemode != MM_PARSE_LOOSE) {
+			mm_errno = MM_ERROR_MIME;
+			mm_error_setmsg("invalid disposition parameter");
+			return -1;
+		} else {
+			PARSE_warning(MM_WARNING_INVPARAM);
+		}	
+	}
+
+	return 0;
+}
+
+/*
+ * Records where a header field which has just been parsed is found in the 
+ * message, from the start of its name up to and including the line break.
+ */
+static void
+PARSE_headersource(struct mm_mimeheader *hdr)
+{
+	hdr->src_offset = header_start - 1;
+	hdr->src_length = current_pos - header_start;
+	current_mimepart->src_headers++;
+}
+
+/*
+ * Records a warning about the header field being parsed in the current
+ * MIME part. The current part is attached to the context once its body
+ * has been parsed, so its number is the number of parts attached so far.
+ */
+static void
+PARSE_warning(int code)
+{
+	mm_warning_add(ctx, code, ctx->nparts, 
+	    header_start > 0 ? header_start - 1 : 0, lineno);
+}
+
+/*
+ * Releases RFC 2231 segments left over from an aborted parse.
+ */
+static void
+PARSE_freesegments(void)
+{
+	struct mm_param *param;
+
+	while ((param = TAILQ_FIRST(&segments)) != NULL) {
+		TAILQ_REMOVE(&segments, param, next);
+		mm_param_free(param);
+	}
+}
+
 int
 mimeparser_yyerror(const char *str)
 {
@@ -671,34 +1096,43 @@ mimeparser_yywrap(void)
 }
 
 /**
- * Sets the boundary value for the current message
+ * Tells the scanner what follows the header section which has just been
+ * parsed: the body of the current MIME part, the preamble of the parts
+ * nested in it, whose boundary is in effect from now on, or the header
+ * section of the message it encapsulates. Only messages which are not 
+ * encoded are parsed.
  */
-int 
-set_boundary(char *str)
+int
+PARSER_endheaders(void)
 {
-	size_t blen;
-
-	blen = strlen(str);
-
-	boundary_string = (char *)malloc(blen + 3);
-	endboundary_string = (char *)malloc(blen + 5);
-
-	if (boundary_string == NULL || endboundary_string == NULL) {
-		if (boundary_string != NULL) {
-			free(boundary_string);
-		}
-		if (endboundary_string != NULL) {
-			free(endboundary_string);
-		}	
-		return -1;
+	struct mm_content *ct;
+	const char *boundary;
+
+	ct = current_mimepart->type;
+	if (ct == NULL)
+		return SECTION_BODY;
+
+	if (mm_content_gettypeid(ct) == MM_MEDIATYPE_MULTIPART) {
+		boundary = mm_content_getparambyname(ct, "boundary");
+		if (boundary == NULL || *boundary == '\0' 
+		    || PARSE_isboundary(boundary))
+			return SECTION_BODY;
+		PARSE_enter(boundary);
+		return SECTION_PREAMBLE;
 	}
-	
-	ctx->boundary = xstrdup(str);
 
-	snprintf(boundary_string, blen + 3, "--%s", str);
-	snprintf(endboundary_string, blen + 5, "--%s--", str);
+	if (current_mimepart != envelope 
+	    && mm_content_gettypeid(ct) == MM_MEDIATYPE_MESSAGE
+	    && mm_content_getsubtypeid(ct) == MM_MEDIASUBTYPE_RFC822
+	    && (transfer_encoding == NULL 
+	    || !strcasecmp(transfer_encoding, "7bit")
+	    || !strcasecmp(transfer_encoding, "8bit")
+	    || !strcasecmp(transfer_encoding, "binary"))) {
+		PARSE_enter(NULL);
+		return SECTION_MESSAGE;
+	}
 
-	return 0;
+	return SECTION_BODY;
 }
 
 /**
@@ -726,23 +1160,24 @@ dprintf(const char *fmt, ...)
  * Initializes the parser engine.
  */
 int
-PARSER_initialize(MM_CTX *newctx, int mode)
+PARSER_initialize(MM_CTX *newctx, int mode, int flags)
 {
-	if (ctx != NULL) {
-		xfree(ctx);
-		ctx = NULL;
-	}
-	if (envelope != NULL) {
-		xfree(envelope);
-		envelope = NULL;
-	}	
+	/* The context and envelope of a previous message belong to the 
+	 * application */
+	ctx = NULL;
+	envelope = NULL;
 	if (ctype != NULL) {
-		xfree(ctype);
+		mm_content_free(ctype);
 		ctype = NULL;
 	}	
+	while (nlevels > 0)
+		PARSE_leave();
+	entity_end = 0;
+	PARSER_reset();
 
 	ctx = newctx;
 	parsemode = mode;
+	parseflags = flags;
 
 	envelope = mm_mimepart_new();
 	current_mimepart = envelope;
@@ -750,6 +1185,13 @@ PARSER_initialize(MM_CTX *newctx, int mode)
 
 	have_contenttype = 0;
 
+	if (transfer_encoding != NULL) {
+		xfree(transfer_encoding);
+		transfer_encoding = NULL;
+	}
+
+	PARSE_freesegments();
+
 	curin = mimeparser_yyin;
 
 	return 1;
@@ -59,6 +59,7 @@ main(int argc, char **argv)
 	MM_CTX *ctx;
 	struct mm_mimeheader *header, *lastheader;
 	struct mm_warning *warning, *lastwarning;
+	char text[256];
 	struct mm_mimepart *part;
 	struct mm_content *ct;
 	int parts, i;
@@ -215,7 +216,8 @@ main(int argc, char **argv)
 			fprintf(stderr, "WARNINGS:\n");
 			while ((warning = mm_warning_next(ctx, &lastwarning)) 
 			    != NULL) {
-				fprintf(stderr, " -> %s\n", warning->message);
+				mm_warning_format(warning, text, sizeof(text));
+				fprintf(stderr, " -> %s\n", text);
 			}
 		}
 
@@ -36,12 +36,18 @@
 #define _MM_H_INCLUDED
 
 #include <sys/types.h>
+#include <stdio.h>
 #include <assert.h>
 #include "mm_queue.h"
 #include "mm_mem.h"
 
 #define MM_MIME_LINELEN 998
 #define MM_BASE64_LINELEN 76
+#define MM_QP_LINELEN 76
+
+/* UTF-8 takes at most three bytes for each byte of text we convert */
+#define MM_CHARSET_MAXEXPAND 3
+#define MM_CHARSET_MAXPENDING 8
 
 TAILQ_HEAD(mm_mimeheaders, mm_mimeheader);
 TAILQ_HEAD(mm_mimeparts, mm_mimepart);
@@ -66,7 +72,13 @@ enum mm_parsemodes
 enum mm_parseflags
 {
 	MM_PARSE_NONE = (1L << 0),
-	MM_PARSE_STRIPCOMMENTS = (1L << 1)
+	MM_PARSE_STRIPCOMMENTS = (1L << 1),
+	/** Decode RFC 2047 encoded words in header fields while parsing */
+	MM_PARSE_DECODEHEADERS = (1L << 2),
+	/** Keep the raw segments of RFC 2231 parameters */
+	MM_PARSE_KEEPSEGMENTS = (1L << 3),
+	/** Keep the message source to write unmodified parts verbatim */
+	MM_PARSE_KEEPSOURCE = (1L << 4)
 };
 
 /*
@@ -77,9 +89,107 @@ enum mm_encoding
 	MM_ENCODING_NONE = 0,
 	MM_ENCODING_BASE64,
 	MM_ENCODING_QUOTEDPRINTABLE,
+	MM_ENCODING_7BIT,
+	MM_ENCODING_8BIT,
+	MM_ENCODING_BINARY,
 	MM_ENCODING_UNKNOWN
 };
 
+/*
+ * Media types of a Content-Type, see mm_content_gettypeid()
+ */
+enum mm_mediatypes
+{
+	MM_MEDIATYPE_OTHER = 0,
+	MM_MEDIATYPE_TEXT,
+	MM_MEDIATYPE_IMAGE,
+	MM_MEDIATYPE_AUDIO,
+	MM_MEDIATYPE_VIDEO,
+	MM_MEDIATYPE_APPLICATION,
+	MM_MEDIATYPE_MULTIPART,
+	MM_MEDIATYPE_MESSAGE,
+	MM_MEDIATYPE_FONT,
+	MM_MEDIATYPE_MODEL
+};
+
+/*
+ * Common media subtypes of a Content-Type, see mm_content_getsubtypeid().
+ * Subtypes are told by their name alone, whatever the media type is.
+ */
+enum mm_mediasubtypes
+{
+	/** Matches any subtype in mm_content_istype() */
+	MM_MEDIASUBTYPE_ANY = -1,
+	MM_MEDIASUBTYPE_OTHER = 0,
+	MM_MEDIASUBTYPE_PLAIN,
+	MM_MEDIASUBTYPE_HTML,
+	MM_MEDIASUBTYPE_ENRICHED,
+	MM_MEDIASUBTYPE_CALENDAR,
+	MM_MEDIASUBTYPE_MIXED,
+	MM_MEDIASUBTYPE_ALTERNATIVE,
+	MM_MEDIASUBTYPE_RELATED,
+	MM_MEDIASUBTYPE_DIGEST,
+	MM_MEDIASUBTYPE_PARALLEL,
+	MM_MEDIASUBTYPE_SIGNED,
+	MM_MEDIASUBTYPE_ENCRYPTED,
+	MM_MEDIASUBTYPE_REPORT,
+	MM_MEDIASUBTYPE_RFC822,
+	MM_MEDIASUBTYPE_GLOBAL,
+	MM_MEDIASUBTYPE_PARTIAL,
+	MM_MEDIASUBTYPE_EXTERNALBODY,
+	MM_MEDIASUBTYPE_DELIVERYSTATUS,
+	MM_MEDIASUBTYPE_DISPOSITIONNOTIFICATION,
+	MM_MEDIASUBTYPE_OCTETSTREAM,
+	MM_MEDIASUBTYPE_PDF,
+	MM_MEDIASUBTYPE_PKCS7MIME,
+	MM_MEDIASUBTYPE_PKCS7SIGNATURE,
+	MM_MEDIASUBTYPE_PGPSIGNATURE,
+	MM_MEDIASUBTYPE_PGPENCRYPTED,
+	MM_MEDIASUBTYPE_MSTNEF,
+	MM_MEDIASUBTYPE_JPEG,
+	MM_MEDIASUBTYPE_PNG,
+	MM_MEDIASUBTYPE_GIF
+};
+
+/*
+ * Charsets, see mm_charset_getid()
+ */
+enum mm_charset_ids
+{
+	/** No charset was given */
+	MM_CHARSETID_NONE = 0,
+	/** A charset MiniMIME has no ID for */
+	MM_CHARSETID_OTHER,
+	MM_CHARSETID_USASCII,
+	MM_CHARSETID_UTF8,
+	MM_CHARSETID_ISO8859_1,
+	MM_CHARSETID_ISO8859_2,
+	MM_CHARSETID_ISO8859_3,
+	MM_CHARSETID_ISO8859_4,
+	MM_CHARSETID_ISO8859_5,
+	MM_CHARSETID_ISO8859_6,
+	MM_CHARSETID_ISO8859_7,
+	MM_CHARSETID_ISO8859_8,
+	MM_CHARSETID_ISO8859_9,
+	MM_CHARSETID_ISO8859_10,
+	MM_CHARSETID_ISO8859_11,
+	MM_CHARSETID_ISO8859_13,
+	MM_CHARSETID_ISO8859_14,
+	MM_CHARSETID_ISO8859_15,
+	MM_CHARSETID_ISO8859_16,
+	MM_CHARSETID_WINDOWS1250,
+	MM_CHARSETID_WINDOWS1251,
+	MM_CHARSETID_WINDOWS1252,
+	MM_CHARSETID_WINDOWS1253,
+	MM_CHARSETID_WINDOWS1254,
+	MM_CHARSETID_WINDOWS1255,
+	MM_CHARSETID_WINDOWS1256,
+	MM_CHARSETID_WINDOWS1257,
+	MM_CHARSETID_WINDOWS1258,
+	MM_CHARSETID_KOI8R,
+	MM_CHARSETID_KOI8U
+};
+
 /*
  * Message type
  */
@@ -122,6 +232,29 @@ enum mm_addressfields {
 	MM_ADDR_REPLY_TO
 };
 
+/*
+ * Flags of MIME parts
+ */
+enum mm_mimepart_flags {
+	MM_MIMEPART_NONE = 0,
+	/** The body is not encoded yet, encode it when writing the part */
+	MM_MIMEPART_ENCODE = (1L << 0)
+};
+
+/*
+ * What has been modified in a parsed message, see mm_mimepart_setdirty()
+ */
+enum mm_dirty_flags {
+	MM_DIRTY_NONE = 0,
+	/** Header fields or the Content-Type of a MIME part */
+	MM_DIRTY_HEADERS = (1L << 0),
+	/** The body of a MIME part */
+	MM_DIRTY_BODY = (1L << 1),
+	/** The MIME parts, boundary or preamble of a context, or the parts
+	 *  nested in a MIME part */
+	MM_DIRTY_STRUCTURE = (1L << 2)
+};
+
 enum mm_flatten_flags {
 	MM_FLATTEN_NONE = 0,
 	MM_FLATTEN_SKIPENVELOPE = (1L << 1),
@@ -143,19 +276,35 @@ struct mm_error_data
 extern int mm_errno;
 extern struct mm_error_data mm_error;
 
+/*
+ * What a parser warning is about, see mm_warning_string()
+ */
 enum mm_warning_code
 {
 	MM_WARNING_NONE = 0,
+	/** A header field which is malformed or has an invalid value */
 	MM_WARNING_INVHDR,
+	/** A parameter given more than once */
+	MM_WARNING_DUPPARAM,
+	/** A parameter value which should have been quoted */
+	MM_WARNING_INVAL,
+	/** An unknown parameter */
+	MM_WARNING_INVPARAM
 };
 
 /*
- * A parser warning
+ * A parser warning, see mm_warning_add()
  */
 struct mm_warning
 {
 	enum mm_warning_code warning;
 	u_int32_t lineno;
+
+	/* The number of the MIME part, or -1, and where in the message the
+	 * problem was found */
+	int part;
+	size_t offset;
+
 	SLIST_ENTRY(mm_warning) next;
 };
 
@@ -170,7 +319,35 @@ struct mm_codec
 	char *(*encoder)(char *, u_int32_t);
 	char *(*decoder)(char *);
 
+	/* Optional non-allocating decoder kernels */
+	size_t (*decoded_size)(const char *, size_t);
+	int (*decode_into)(const char *, size_t, char *, size_t, size_t *);
+
+	/* Optional kernel for the exact decoded size, without decoding */
+	size_t (*decoded_length)(const char *, size_t);
+
+	/* Optional streaming encoder kernel */
+	int (*encode_chunk)(const char *, size_t, int, char *, size_t, int *,
+	    size_t *, size_t *);
+
 	SLIST_ENTRY(mm_codec) next;
+	/* Chain in the codec name hash */
+	SLIST_ENTRY(mm_codec) hnext;
+};
+
+/*
+ * Storage the header fields of a MIME part or the parameters of a 
+ * Content-Type are allocated from, in blocks of growing size, see 
+ * mm_mimepart_addheader() and mm_content_addparam()
+ */
+struct mm_arena
+{
+	struct mm_arenablock *first;
+	struct mm_arenablock *current;
+	size_t size;
+
+	/* Memory given back for reuse, see mm_arena_release() */
+	struct mm_arenafree *free;
 };
 
 /*
@@ -181,9 +358,80 @@ struct mm_mimeheader
 	char *name; 
 	char *value;
 
+	/* Value with RFC 2047 encoded words decoded, see 
+	 * mm_mimeheader_getdecoded(). Points to value if there was nothing 
+	 * to decode. */
+	char *decoded;
+
+	/* Where the header field is found in the message source, including
+	 * folded lines and the line break. src_length is 0 for header fields
+	 * which were not parsed or have been modified. */
+	size_t src_offset;
+	size_t src_length;
+
+	/* The message source the header field was parsed from. The MIME part
+	 * holds the reference. */
+	struct mm_body *source;
+
+	/* The next header field of the same name in the MIME part, if the
+	 * header fields of the part are indexed */
+	struct mm_mimeheader *samename;
+
+	/* Which of the header field, its name and its value are held in 
+	 * the storage of the MIME part, see mm_mimepart_addheader(), and the
+	 * storage */
+	int stored;
+	struct mm_arena *store;
+
+	/* The value parsed by mm_mimeheader_getdate() and friends, kept until
+	 * the value is changed */
+	struct mm_headercache *cache;
+
 	TAILQ_ENTRY(mm_mimeheader) next;
 };
 
+/*
+ * An address of an address list header field, see 
+ * mm_mimeheader_getaddresses()
+ */
+struct mm_address
+{
+	/* The display name, or NULL */
+	const char *name;
+	/* local@domain */
+	const char *mailbox;
+	/* The name of the group the address is in, or NULL */
+	const char *group;
+};
+
+/*
+ * The header fields of a MIME part which have the same name, chained 
+ * through their samename member
+ */
+struct mm_headerchain
+{
+	struct mm_mimeheader *first;
+	struct mm_mimeheader *last;
+	int count;
+	u_int32_t hash;
+
+	struct mm_headerchain *hnext;
+};
+
+#define MM_HEADERINDEX_SIZE 64
+
+/*
+ * Index of the header fields of a MIME part by their (case insensitive)
+ * name, see mm_mimepart_getheaderbyname()
+ */
+struct mm_headerindex
+{
+	struct mm_headerchain *hash[MM_HEADERINDEX_SIZE];
+
+	/* Number of header fields of the part */
+	int count;
+};
+
 /*
  * Representation of a MIME Content-Type parameter
  */
@@ -192,6 +440,24 @@ struct mm_param
 	char *name; 
 	char *value; 
 
+	/* Value with RFC 2047 encoded words decoded, see 
+	 * mm_param_getdecoded(). Points to value if there was nothing to 
+	 * decode. */
+	char *decoded;
+
+	/* The raw RFC 2231 segments this parameter was assembled from, if
+	 * kept by the parser (see MM_PARSE_KEEPSEGMENTS). */
+	struct mm_params *segments;
+
+	/* Which of the parameter, its name and its value are held in the
+	 * storage of the Content-Type, see mm_content_addparam(), and the
+	 * storage */
+	int stored;
+	struct mm_arena *store;
+
+	/* The Content-Type the parameter is attached to, or NULL */
+	struct mm_content *content;
+
 	TAILQ_ENTRY(mm_param) next;
 };
 
@@ -203,10 +469,46 @@ struct mm_content
 	char *maintype;
 	char *subtype;
 
+	/* The media type, subtype and charset, classified when they are set,
+	 * see mm_content_classify() */
+	int mediatype;
+	int mediasubtype;
+	int charsetid;
+
 	struct mm_params params;
 
+	/* Storage of the parameters */
+	struct mm_arena store;
+
 	char *encstring;
 	enum mm_encoding encoding;
+
+	/* Codec resolved for this encoding, valid as long as codec_gen
+	 * matches the library's codec generation */
+	struct mm_codec *codec;
+	u_int32_t codec_gen;
+
+	/* Set when the Content-Type is modified */
+	int dirty;
+};
+
+/*
+ * A reference counted body, which may be shared by many MIME parts, see
+ * mm_body_new()
+ */
+struct mm_body
+{
+	char *data;
+	size_t length;
+	int refcount;
+
+	/* Releases borrowed data, see mm_body_borrow() */
+	void (*release)(char *, size_t, void *);
+	void *arg;
+
+	/* Hash of the data, computed once by the encoded payload cache */
+	u_int32_t hash;
+	int hashed;
 };
 
 /*
@@ -215,6 +517,12 @@ struct mm_content
 struct mm_mimepart
 {
 	struct mm_mimeheaders headers;
+
+	/* Built on the first lookup of a header field by name */
+	struct mm_headerindex *hindex;
+
+	/* Storage of the header fields */
+	struct mm_arena store;
 	
 	size_t opaque_length;
 	char *opaque_body;
@@ -222,6 +530,13 @@ struct mm_mimepart
 	size_t length;
 	char *body;
 
+	/* The number of lines of the body as counted by the parser, or -1 */
+	int lines;
+
+	/* The shared body which body points into, if any, see 
+	 * mm_mimepart_attachbody() */
+	struct mm_body *shared;
+
 	struct mm_content *type;
 
 	char *disposition_type;
@@ -230,22 +545,394 @@ struct mm_mimepart
 	char *modification_date;
 	char *read_date;
 	char *disposition_size;
+
+	/* See enum mm_mimepart_flags */
+	int flags;
+
+	/* A file the body is read from when writing the part, given by name
+	 * or descriptor, see mm_mimepart_setbodyfile(). The body starts at
+	 * body_offset and is length bytes long. */
+	char *body_path;
+	int body_fd;
+	off_t body_offset;
+
+	/* The message source the part was parsed from, if kept (see
+	 * MM_PARSE_KEEPSOURCE), and where the part is found in it. The
+	 * header section is src_hdrlen bytes long including the empty line,
+	 * the part src_length bytes. src_headers is the number of header 
+	 * fields parsed into the headers list. */
+	struct mm_body *source;
+	size_t src_offset;
+	size_t src_hdrlen;
+	size_t src_length;
+	int src_headers;
+
+	/* See enum mm_dirty_flags */
+	int dirty;
+
+	/* The encoded body taken from an encoded payload cache, and the codec
+	 * it was encoded with, see mm_context_setcache() */
+	struct mm_body *encoded;
+	struct mm_codec *encoded_codec;
+
+	/* The part this one is nested in, and the parts nested in this one,
+	 * in order and by number, see mm_mimepart_attachchild(). The MIME 
+	 * parts of a context are nested in its envelope, but are kept in the
+	 * context's list of parts. */
+	struct mm_mimepart *parent;
+	struct mm_mimeparts children;
+	struct mm_mimepart **childindex;
+	int nchildren;
+	int childindex_size;
 	
 	TAILQ_ENTRY(mm_mimepart) next;
 };
 
+/*
+ * Flags for mm_view_new()
+ */
+enum mm_view_flags
+{
+	MM_VIEW_NONE = 0,
+	/** Copy the message into the view */
+	MM_VIEW_COPY = (1L << 0)
+};
+
+/*
+ * A range of the message a view was made of
+ */
+struct mm_viewspan
+{
+	size_t offset;
+	size_t length;
+};
+
+struct mm_viewheader
+{
+	struct mm_viewspan name;
+	struct mm_viewspan value;
+};
+
+struct mm_viewparam
+{
+	struct mm_viewspan name;
+	struct mm_viewspan value;
+};
+
+/*
+ * A MIME part of a message view. Header fields and parameters are given
+ * by the number of the first one in the view's arrays and their count, 
+ * related parts by their number, or -1.
+ */
+struct mm_viewpart
+{
+	/* Where the part is found in the message, as in struct mm_mimepart */
+	size_t offset;
+	size_t hdrlen;
+	size_t length;
+
+	/* Of the Content-Type, empty if there is none */
+	struct mm_viewspan type;
+	struct mm_viewspan subtype;
+
+	int headers;
+	int nheaders;
+	int params;
+	int nparams;
+
+	/* The parts nested in this one are numbered from children up to 
+	 * end, and linked by next */
+	int parent;
+	int children;
+	int nchildren;
+	int next;
+	int end;
+};
+
+/*
+ * A read-only view of a message, allocated in one block, see mm_view_new()
+ */
+struct mm_view
+{
+	const char *data;
+	size_t length;
+
+	struct mm_viewpart *parts;
+	int nparts;
+	struct mm_viewheader *headers;
+	int nheaders;
+	struct mm_viewparam *params;
+	int nparams;
+};
+
+/*
+ * Flags for mm_imap_bodystructure()
+ */
+enum mm_imap_flags
+{
+	MM_IMAP_NONE = 0,
+	/** Leave out extension data, which gives the BODY data item */
+	MM_IMAP_NOEXTENSIONS = (1L << 0)
+};
+
+/*
+ * An entry of the attachment manifest of a message, see
+ * mm_context_attachments()
+ */
+struct mm_attachment
+{
+	struct mm_mimepart *part;
+	/* The number of the MIME part in the context, or -1 for parts nested
+	 * with mm_mimepart_attachchild() */
+	int number;
+
+	/* The file name, or NULL */
+	const char *filename;
+	/* See enum mm_mediatypes and enum mm_mediasubtypes */
+	int mediatype;
+	int mediasubtype;
+	const char *maintype;
+	const char *subtype;
+	/* The Content-Disposition, e.g. "attachment", or NULL */
+	const char *disposition;
+	/* See enum mm_encoding */
+	int encoding;
+
+	/* The size of the body as written, i.e. encoded, and decoded */
+	size_t encoded_size;
+	size_t decoded_size;
+
+	/* Where the part and its body start in the parsed message */
+	size_t offset;
+	size_t body_offset;
+};
+
+/*
+ * Orders of walking a tree of MIME parts, see mm_walk_init()
+ */
+enum mm_walk_order
+{
+	MM_WALK_DEPTHFIRST = 0,
+	MM_WALK_BREADTHFIRST
+};
+
+/*
+ * State of a walk over a tree of MIME parts, see mm_walk_init()
+ */
+struct mm_walk
+{
+	struct mm_context *ctx;
+	struct mm_mimepart *root;
+	int order;
+
+	/* The part returned last, and its depth below root */
+	struct mm_mimepart *current;
+	int depth;
+
+	/* Breadth first: the depth being walked, and whether a part on it 
+	 * has children */
+	int level;
+	int deeper;
+};
+
+/*
+ * State of a charset conversion to UTF-8, see mm_charset_open()
+ */
+struct mm_charset_state
+{
+	int type;
+	const u_int16_t *table;
+	void *cd;
+
+	/* An incomplete multibyte sequence at the end of the last chunk */
+	unsigned char pending[MM_CHARSET_MAXPENDING];
+	size_t pending_len;
+};
+
+/*
+ * A sink receiving serialized messages, see mm_context_write()
+ */
+struct mm_sink
+{
+	/* Stores len bytes of data, returns 0 on success or -1 on error */
+	int (*write)(struct mm_sink *, const char *, size_t);
+	void *arg;
+
+	/* Used by the file descriptor sink */
+	int fd;
+
+	/* Used by the buffer sink */
+	char *buf;
+	size_t length;
+	size_t size;
+};
+
+/*
+ * A slot of a message template: the value of slot number index is 
+ * inserted at offset of the template's data, in the body numbered body
+ * or -1 for slots outside of encoded bodies
+ */
+struct mm_template_slot
+{
+	size_t offset;
+	int index;
+	int body;
+};
+
+/*
+ * A body of a message template which is kept unencoded from start to end
+ * of the template's data, and encoded with codec when rendered
+ */
+struct mm_template_body
+{
+	size_t start;
+	size_t end;
+	struct mm_codec *codec;
+};
+
+/*
+ * An encoded body in an encoded payload cache
+ */
+struct mm_cache_entry
+{
+	/* The body before and after encoding. Bodies read from a file have
+	 * no plain form, the range of the file is kept instead. */
+	struct mm_body *plain;
+	struct mm_body *encoded;
+	struct mm_codec *codec;
+	u_int32_t hash;
+
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	long mtime_nsec;
+	time_t ctime;
+	off_t offset;
+	size_t length;
+
+	SLIST_ENTRY(mm_cache_entry) hnext;
+	TAILQ_ENTRY(mm_cache_entry) next;
+};
+
+SLIST_HEAD(mm_cache_bucket, mm_cache_entry);
+TAILQ_HEAD(mm_cache_entries, mm_cache_entry);
+
+#define MM_CACHE_HASHSIZE 256
+
+/*
+ * A cache of encoded bodies, which may be shared by many contexts, see
+ * mm_cache_new()
+ */
+struct mm_cache
+{
+	struct mm_cache_bucket hash[MM_CACHE_HASHSIZE];
+
+	/* Most recently used entries first */
+	struct mm_cache_entries entries;
+
+	/* Bytes kept by the cache, and at most how many */
+	size_t used;
+	size_t budget;
+
+	unsigned long hits;
+	unsigned long misses;
+};
+
+/*
+ * An edit of a message source: length bytes at offset are replaced by
+ * datalen bytes of data
+ */
+struct mm_rewrite_edit
+{
+	size_t offset;
+	size_t length;
+	char *data;
+	size_t datalen;
+
+	TAILQ_ENTRY(mm_rewrite_edit) next;
+};
+
+TAILQ_HEAD(mm_rewrite_edits, mm_rewrite_edit);
+
+/*
+ * A piece of a rewritten message: either a range of the source, at 
+ * offset, or inserted data, with offset -1
+ */
+struct mm_splice
+{
+	const char *data;
+	size_t length;
+	off_t offset;
+};
+
+/*
+ * Header field edits of a parsed message, see mm_rewrite_new()
+ */
+struct mm_rewrite
+{
+	struct mm_body *source;
+
+	/* Sorted by offset */
+	struct mm_rewrite_edits edits;
+
+	/* Built by mm_rewrite_getsplices() */
+	struct mm_splice *splices;
+	int nsplices;
+};
+
+/*
+ * A pre-serialized message with substitution slots, see mm_template.c
+ */
+struct mm_template
+{
+	/* The serialized message, with the slot markers cut out */
+	char *data;
+	size_t length;
+
+	/* Where slots are, in ascending order */
+	struct mm_template_slot *slots;
+	int nslots;
+
+	/* Bodies encoded when rendered, in ascending order */
+	struct mm_template_body *bodies;
+	int nbodies;
+
+	/* Slot names, indexed by slot number */
+	char **names;
+	int nnames;
+};
+
 /*
  * Represantation of a MiniMIME context
  */
 struct mm_context
 {
 	struct mm_mimeparts parts;
+
+	/* The parts in order, for access by number, and how many there are */
+	struct mm_mimepart **index;
+	int nparts;
+	int index_size;
+
 	enum mm_messagetype messagetype;
 	struct mm_warnings warnings;
+	/* The last of the warnings, for appending, and how many there are */
+	struct mm_warning *lastwarning;
+	int nwarnings;
+	/* Whether warnings are recorded, see mm_context_setwarnings() */
+	int collectwarnings;
 	struct mm_codecs codecs;
 	char *boundary;
 	char *preamble;
 	size_t max_message_size;
+
+	/* The message source, if kept by the parser */
+	struct mm_body *source;
+	/* See enum mm_dirty_flags */
+	int dirty;
+
+	/* Encoded payload cache used when writing, not owned by the context */
+	struct mm_cache *cache;
 };
 
 typedef struct mm_context MM_CTX;
@@ -258,6 +945,17 @@ char *mm_addchars(char *, char *, u_int16_t);
 int mm_gendate(char **);
 void mm_striptrailing(char **, const char *);
 int mm_mimeutil_genboundary(char *, size_t, char **);
+int mm_rfc2047_decode(const char *, char **);
+
+int mm_charset_open(struct mm_charset_state *, const char *);
+int mm_charset_getid(const char *);
+void mm_charset_close(struct mm_charset_state *);
+size_t mm_charset_toutf8_size(size_t);
+int mm_charset_toutf8(struct mm_charset_state *, const char *, size_t, char *,
+    size_t, size_t *);
+int mm_charset_finish(struct mm_charset_state *, char *, size_t, size_t *);
+int mm_charset_isascii(const char *, size_t);
+int mm_charset_isutf8(const char *, size_t);
 
 int mm_library_init(void);
 int mm_library_isinitialized(void);
@@ -268,27 +966,102 @@ int mm_parse_file(MM_CTX *, const char *, int, int);
 MM_CTX *mm_context_new(void);
 void mm_context_free(MM_CTX *);
 int mm_context_attachpart(MM_CTX *, struct mm_mimepart *);
+int mm_context_attachpart_after(MM_CTX *, struct mm_mimepart *, int);
 int mm_context_deletepart(MM_CTX *, int, int);
 int mm_context_countparts(MM_CTX *);
 struct mm_mimepart *mm_context_getpart(MM_CTX *, int);
+struct mm_mimepart *mm_context_getpartbypath(MM_CTX *, const char *);
 int mm_context_iscomposite(MM_CTX *);
 int mm_context_haswarnings(MM_CTX *);
+int mm_context_countwarnings(MM_CTX *);
+int mm_context_attachments(MM_CTX *, struct mm_attachment **, int *);
+int mm_context_setwarnings(MM_CTX *, int);
 int mm_context_flatten(MM_CTX *, char **, size_t *, int);
+int mm_context_write_fd(MM_CTX *, int, int);
+int mm_context_write(MM_CTX *, struct mm_sink *, int);
+
+void mm_sink_file(struct mm_sink *, FILE *);
+void mm_sink_fd(struct mm_sink *, int);
+void mm_sink_buffer(struct mm_sink *);
+int mm_context_generateboundary(MM_CTX *);
+void mm_context_setdirty(MM_CTX *, int);
+int mm_context_getdirty(MM_CTX *);
+void mm_context_setcache(MM_CTX *, struct mm_cache *);
+struct mm_cache *mm_context_getcache(MM_CTX *);
+int mm_context_setpreamble(MM_CTX *, char *);
+char *mm_context_getpreamble(MM_CTX *);
 
 int mm_envelope_getheaders(MM_CTX *, char **, size_t *);
 int mm_envelope_setheader(MM_CTX *, const char *, const char *, ...);
 
+int mm_imap_bodystructure(MM_CTX *, struct mm_mimepart *, char *, size_t,
+    size_t *, int);
+int mm_imap_envelope(MM_CTX *, char *, size_t, size_t *);
+
+struct mm_view *mm_view_new(const char *, size_t, int);
+void mm_view_free(struct mm_view *);
+int mm_view_countparts(struct mm_view *);
+const struct mm_viewpart *mm_view_getpart(struct mm_view *, int);
+const struct mm_viewheader *mm_view_getheader(struct mm_view *, int, int);
+const char *mm_view_getheadervalue(struct mm_view *, int, const char *, int,
+    size_t *);
+const char *mm_view_getparamvalue(struct mm_view *, int, const char *, 
+    size_t *);
+const char *mm_view_getbody(struct mm_view *, int, size_t *);
+
+struct mm_cache *mm_cache_new(size_t);
+void mm_cache_free(struct mm_cache *);
+
+struct mm_rewrite *mm_rewrite_new(MM_CTX *);
+void mm_rewrite_free(struct mm_rewrite *);
+int mm_rewrite_insert(struct mm_rewrite *, struct mm_mimepart *, 
+    struct mm_mimeheader *, const char *, const char *);
+int mm_rewrite_delete(struct mm_rewrite *, struct mm_mimeheader *);
+int mm_rewrite_replace(struct mm_rewrite *, struct mm_mimeheader *, 
+    const char *);
+int mm_rewrite_getsplices(struct mm_rewrite *, struct mm_splice **, int *);
+int mm_rewrite_flatten(struct mm_rewrite *, char **, size_t *);
+int mm_rewrite_write_fd(struct mm_rewrite *, int);
+int mm_rewrite_write(struct mm_rewrite *, struct mm_sink *);
+
+struct mm_template *mm_template_new(MM_CTX *, int);
+void mm_template_free(struct mm_template *);
+int mm_template_countslots(struct mm_template *);
+int mm_template_getslot(struct mm_template *, const char *);
+const char *mm_template_getslotname(struct mm_template *, int);
+int mm_template_render(struct mm_template *, const char **, char **, size_t *);
+int mm_template_write_fd(struct mm_template *, const char **, int);
+int mm_template_write(struct mm_template *, const char **, struct mm_sink *);
+
 struct mm_mimeheader *mm_mimeheader_new(void);
 void mm_mimeheader_free(struct mm_mimeheader *);
 struct mm_mimeheader *mm_mimeheader_generate(const char *, const char *);
+int mm_mimeheader_getdate(struct mm_mimeheader *, time_t *, int *);
+int mm_mimeheader_getmsgids(struct mm_mimeheader *, const char * const **,
+    int *);
+int mm_mimeheader_getaddresses(struct mm_mimeheader *, 
+    const struct mm_address **, int *);
 int mm_mimeheader_uncomment(struct mm_mimeheader *);
 int mm_mimeheader_uncommentbyname(struct mm_mimepart *, const char *);
 int mm_mimeheader_uncommentall(struct mm_mimepart *);
 int mm_mimeheader_tostring(struct mm_mimeheader *);
+int mm_mimeheader_decode(struct mm_mimeheader *);
+const char *mm_mimeheader_getdecoded(struct mm_mimeheader *);
+int mm_mimeheader_setvalue(struct mm_mimeheader *, const char *);
 
 struct mm_mimepart *mm_mimepart_new(void);
 void mm_mimepart_free(struct mm_mimepart *);
 int mm_mimepart_attachheader(struct mm_mimepart *, struct mm_mimeheader *);
+struct mm_mimeheader *mm_mimepart_addheader(struct mm_mimepart *, 
+    const char *, const char *);
+int mm_mimepart_getdate(struct mm_mimepart *, const char *, time_t *, 
+    int *);
+int mm_mimepart_getmsgids(struct mm_mimepart *, const char *, 
+    const char * const **, int *);
+int mm_mimepart_getaddresses(struct mm_mimepart *, const char *, 
+    const struct mm_address **, int *);
+void mm_mimepart_reindexheaders(struct mm_mimepart *);
+int mm_mimepart_removeheader(struct mm_mimepart *, struct mm_mimeheader *);
 int mm_mimepart_countheaders(struct mm_mimepart *part);
 int mm_mimepart_countheaderbyname(struct mm_mimepart *, const char *);
 struct mm_mimeheader *mm_mimepart_getheaderbyname(struct mm_mimepart *, const char *, int);
@@ -296,17 +1069,48 @@ const char *mm_mimepart_getheadervalue(struct mm_mimepart *, const char *, int);
 int mm_mimepart_headers_start(struct mm_mimepart *, struct mm_mimeheader **);
 struct mm_mimeheader *mm_mimepart_headers_next(struct mm_mimepart *, struct mm_mimeheader **);
 char *mm_mimepart_decode(struct mm_mimepart *);
+size_t mm_mimepart_decoded_size(struct mm_mimepart *);
+size_t mm_mimepart_decoded_length(struct mm_mimepart *);
+int mm_mimepart_decode_into(struct mm_mimepart *, char *, size_t, size_t *);
+char *mm_mimepart_decode_utf8(struct mm_mimepart *, size_t *);
 struct mm_content *mm_mimepart_gettype(struct mm_mimepart *);
 size_t mm_mimepart_getlength(struct mm_mimepart *);
 char *mm_mimepart_getbody(struct mm_mimepart *, int);
+void mm_mimepart_setbody(struct mm_mimepart *, const char *, int);
+int mm_mimepart_attachbody(struct mm_mimepart *, struct mm_body *);
+struct mm_body *mm_mimepart_getbodyobj(struct mm_mimepart *);
+int mm_mimepart_setbodyfile(struct mm_mimepart *, const char *, off_t, size_t);
+int mm_mimepart_setbodyfd(struct mm_mimepart *, int, off_t, size_t);
 void mm_mimepart_attachcontenttype(struct mm_mimepart *, struct mm_content *);
 int mm_mimepart_setdefaultcontenttype(struct mm_mimepart *, int);
 int mm_mimepart_flatten(struct mm_mimepart *, char **, size_t *, int);
+int mm_mimepart_write(struct mm_mimepart *, struct mm_sink *, int);
+void mm_mimepart_setflags(struct mm_mimepart *, int);
+int mm_mimepart_getflags(struct mm_mimepart *);
+void mm_mimepart_setdirty(struct mm_mimepart *, int);
+int mm_mimepart_getdirty(struct mm_mimepart *);
 struct mm_mimepart *mm_mimepart_fromfile(const char *);
+int mm_mimepart_attachchild(struct mm_mimepart *, struct mm_mimepart *);
+int mm_mimepart_deletechild(struct mm_mimepart *, int, int);
+int mm_mimepart_countchildren(struct mm_mimepart *);
+struct mm_mimepart *mm_mimepart_getchild(struct mm_mimepart *, int);
+struct mm_mimepart *mm_mimepart_getparent(struct mm_mimepart *);
+
+void mm_walk_init(struct mm_walk *, MM_CTX *, struct mm_mimepart *, int);
+struct mm_mimepart *mm_walk_next(struct mm_walk *);
+int mm_walk_depth(struct mm_walk *);
+
+struct mm_body *mm_body_new(const char *, size_t);
+struct mm_body *mm_body_borrow(const char *, size_t, 
+    void (*)(char *, size_t, void *), void *);
+struct mm_body *mm_body_ref(struct mm_body *);
+void mm_body_unref(struct mm_body *);
 
 struct mm_content *mm_content_new(void);
 void mm_content_free(struct mm_content *);
 int mm_content_attachparam(struct mm_content *, struct mm_param *);
+struct mm_param *mm_content_addparam(struct mm_content *, const char *,
+    const char *);
 struct mm_content *mm_content_parse(const char *, int);
 char *mm_content_getparambyname(struct mm_content *, const char *);
 struct mm_param *mm_content_getparamobjbyname(struct mm_content *, const char *);
@@ -317,13 +1121,26 @@ char *mm_content_getmaintype(struct mm_content *);
 char *mm_content_getsubtype(struct mm_content *);
 char *mm_content_gettype(struct mm_content *);
 int mm_content_iscomposite(struct mm_content *);
+void mm_content_classify(struct mm_content *);
+int mm_content_gettypeid(struct mm_content *);
+int mm_content_getsubtypeid(struct mm_content *);
+int mm_content_getcharsetid(struct mm_content *);
+int mm_content_istype(struct mm_content *, int, int);
 int mm_content_isvalidencoding(const char *);
 int mm_content_setencoding(struct mm_content *, const char *);
+int mm_content_getencoding(struct mm_content *, const char *);
+struct mm_codec *mm_content_getcodec(struct mm_content *);
 char *mm_content_paramstostring(struct mm_content *);
 char *mm_content_tostring(struct mm_content *);
 
 struct mm_param *mm_param_new(void);
 void mm_param_free(struct mm_param *);
+struct mm_param *mm_param_generate(const char *, const char *);
+char *mm_param_setname(struct mm_param *, const char *, int);
+char *mm_param_setvalue(struct mm_param *, const char *, int);
+int mm_param_decode(struct mm_param *);
+const char *mm_param_getdecoded(struct mm_param *);
+struct mm_param *mm_param_getsegment(struct mm_param *, int);
 
 char *mm_flatten_mimepart(struct mm_mimepart *);
 char *mm_flatten_context(MM_CTX *);
@@ -334,10 +1151,25 @@ int mm_codec_hasencoder(const char *);
 int mm_codec_register(const char *, char *(*encoder)(char *, u_int32_t), char *(*decoder)(char *));
 int mm_codec_unregister(const char *);
 int mm_codec_unregisterall(void);
+struct mm_codec *mm_codec_lookup(enum mm_encoding, const char *);
 void mm_codec_registerdefaultcodecs(void);
 
 char *mm_base64_decode(char *);
 char *mm_base64_encode(char *, u_int32_t);
+size_t mm_base64_decoded_size(const char *, size_t);
+size_t mm_base64_decoded_length(const char *, size_t);
+int mm_base64_decode_into(const char *, size_t, char *, size_t, size_t *);
+int mm_base64_encode_chunk(const char *, size_t, int, char *, size_t, int *,
+    size_t *, size_t *);
+
+char *mm_qp_decode(char *);
+char *mm_qp_encode(char *, u_int32_t);
+size_t mm_qp_decoded_size(const char *, size_t);
+size_t mm_qp_decoded_length(const char *, size_t);
+int mm_qp_decode_into(const char *, size_t, char *, size_t, size_t *);
+int mm_qp_encode_chunk(const char *, size_t, int, char *, size_t, int *,
+    size_t *, size_t *);
+int mm_qp_decode_q(const char *, size_t, char *, size_t, size_t *);
 
 void mm_error_init(void);
 void mm_error_setmsg(const char *, ...);
@@ -345,8 +1177,10 @@ void mm_error_setlineno(int lineno);
 char *mm_error_string(void);
 int mm_error_lineno(void);
 
-void mm_warning_add(MM_CTX *, int, const char *, ...);
+void mm_warning_add(MM_CTX *, int, int, size_t, int);
 struct mm_warning *mm_warning_next(MM_CTX *, struct mm_warning **);
+const char *mm_warning_string(int);
+int mm_warning_format(struct mm_warning *, char *, size_t);
 
 #ifndef HAVE_STRLCPY
 size_t strlcpy(char *, const char *, size_t);
@@ -0,0 +1,303 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_arena.c
+ *
+ * Storage for the header fields of a MIME part and the parameters of a
+ * Content-Type. The objects and their strings are allocated one after 
+ * the other in blocks of growing size, so that a part's header fields are
+ * close together in memory and take a handful of allocations instead of
+ * three each. Objects in the storage are never moved, so pointers to them
+ * stay valid until the storage is released with its owner.
+ *
+ * Header fields and parameters which are removed, and names and values
+ * which are replaced, give their memory back to the storage. It is kept 
+ * on a free list and reused, first fit, for later objects and strings of
+ * the same size or smaller, so that storage does not grow when header 
+ * fields are added and removed over and over. Freed pieces are not merged,
+ * and blocks are only released together with the storage.
+ */
+
+#define MM_ARENA_MINBLOCK	256
+#define MM_ARENA_MAXBLOCK	16384
+#define MM_ARENA_ALIGN		sizeof(void *)
+
+/*
+ * A block of storage, the data follows the block header
+ */
+struct mm_arenablock
+{
+	struct mm_arenablock *next;
+	size_t size;
+	size_t used;
+};
+
+#define MM_ARENA_HDRSIZE \
+	((sizeof(struct mm_arenablock) + MM_ARENA_ALIGN - 1) \
+	    & ~(MM_ARENA_ALIGN - 1))
+#define MM_ARENA_DATA(block) ((char *)(block) + MM_ARENA_HDRSIZE)
+
+/*
+ * A piece of memory given back to the storage. Every allocation is large 
+ * enough to hold one.
+ */
+struct mm_arenafree
+{
+	struct mm_arenafree *next;
+	size_t size;
+};
+
+#define MM_ARENA_SIZE(size) \
+	((size) < sizeof(struct mm_arenafree) ? sizeof(struct mm_arenafree) \
+	    : ((size) + MM_ARENA_ALIGN - 1) & ~(MM_ARENA_ALIGN - 1))
+
+static struct mm_arenablock *mm_arena_grow(struct mm_arena *, size_t);
+static void *mm_arena_reuse(struct mm_arena *, size_t);
+
+/** @{
+ * @name Storage for header fields and parameters
+ */
+
+/**
+ * Initializes an empty storage
+ *
+ * @param arena The storage to initialize
+ * @return Nothing
+ */
+void
+mm_arena_init(struct mm_arena *arena)
+{
+	assert(arena != NULL);
+
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->size = 0;
+	arena->free = NULL;
+}
+
+/**
+ * Releases all memory of a storage
+ *
+ * @param arena A valid storage
+ * @return Nothing
+ *
+ * Everything allocated from the storage becomes invalid.
+ */
+void
+mm_arena_free(struct mm_arena *arena)
+{
+	struct mm_arenablock *block, *next;
+
+	assert(arena != NULL);
+
+	for (block = arena->first; block != NULL; block = next) {
+		next = block->next;
+		xfree(block);
+	}
+	mm_arena_init(arena);
+}
+
+/**
+ * Allocates memory from a storage
+ *
+ * @param arena A valid storage
+ * @param size The number of bytes to allocate
+ * @return A pointer to the memory, aligned for any object
+ *
+ * The memory is released with the storage, or given back to it for reuse
+ * with mm_arena_release().
+ */
+void *
+mm_arena_alloc(struct mm_arena *arena, size_t size)
+{
+	struct mm_arenablock *block;
+	char *p;
+
+	assert(arena != NULL);
+
+	size = MM_ARENA_SIZE(size);
+
+	if (arena->free != NULL && (p = mm_arena_reuse(arena, size)) != NULL)
+		return p;
+
+	block = arena->current;
+	if (block == NULL || block->size - block->used < size)
+		block = mm_arena_grow(arena, size);
+
+	p = MM_ARENA_DATA(block) + block->used;
+	block->used += size;
+
+	return p;
+}
+
+/**
+ * Copies a string into a storage
+ *
+ * @param arena A valid storage
+ * @param s The string to copy
+ * @return The copy of s
+ */
+char *
+mm_arena_strdup(struct mm_arena *arena, const char *s)
+{
+	size_t len;
+	char *p;
+
+	assert(s != NULL);
+
+	len = strlen(s);
+	p = mm_arena_alloc(arena, len + 1);
+	memcpy(p, s, len + 1);
+
+	return p;
+}
+
+/**
+ * Gives memory allocated from a storage back to it
+ *
+ * @param arena The storage p was allocated from
+ * @param p The memory
+ * @param size The number of bytes allocated, or less
+ * @return Nothing
+ *
+ * The memory is reused by later allocations from the storage.
+ */
+void
+mm_arena_release(struct mm_arena *arena, void *p, size_t size)
+{
+	struct mm_arenafree *piece;
+
+	assert(arena != NULL);
+	assert(p != NULL);
+
+	piece = (struct mm_arenafree *)p;
+	piece->size = MM_ARENA_SIZE(size);
+	piece->next = arena->free;
+	arena->free = piece;
+}
+
+/**
+ * Gives a string copied into a storage back to it
+ *
+ * @param arena The storage s was copied into
+ * @param s The string
+ * @return Nothing
+ */
+void
+mm_arena_strfree(struct mm_arena *arena, char *s)
+{
+	assert(s != NULL);
+
+	mm_arena_release(arena, s, strlen(s) + 1);
+}
+
+/** @} */
+
+/*
+ * Takes size bytes from the first piece on the free list of a storage 
+ * which is large enough. What is left of the piece stays on the list if 
+ * it can still be used.
+ */
+static void *
+mm_arena_reuse(struct mm_arena *arena, size_t size)
+{
+	struct mm_arenafree **prev, *piece, *rest;
+
+	for (prev = &arena->free; (piece = *prev) != NULL; 
+	    prev = &piece->next) {
+		if (piece->size < size)
+			continue;
+
+		if (piece->size - size >= sizeof(struct mm_arenafree)) {
+			rest = (struct mm_arenafree *)((char *)piece + size);
+			rest->size = piece->size - size;
+			rest->next = piece->next;
+			*prev = rest;
+		} else {
+			*prev = piece->next;
+		}
+		return piece;
+	}
+
+	return NULL;
+}
+
+/*
+ * Adds a block with room for at least size bytes to a storage. Blocks 
+ * double in size up to MM_ARENA_MAXBLOCK, larger objects get a block of
+ * their own which is kept behind the current one, so that the rest of the
+ * current block is still used.
+ */
+static struct mm_arenablock *
+mm_arena_grow(struct mm_arena *arena, size_t size)
+{
+	struct mm_arenablock *block;
+	size_t want;
+	int own;
+
+	want = arena->size == 0 ? MM_ARENA_MINBLOCK : arena->size * 2;
+	if (want > MM_ARENA_MAXBLOCK)
+		want = MM_ARENA_MAXBLOCK;
+
+	own = size > want && arena->current != NULL;
+	if (size > want)
+		want = size;
+
+	block = xmalloc(MM_ARENA_HDRSIZE + want);
+	block->size = want;
+	block->used = 0;
+
+	if (arena->current != NULL) {
+		block->next = arena->current->next;
+		arena->current->next = block;
+	} else {
+		block->next = NULL;
+		arena->first = block;
+	}
+
+	if (!own) {
+		arena->current = block;
+		if (want <= MM_ARENA_MAXBLOCK)
+			arena->size = want;
+	}
+
+	return block;
+}
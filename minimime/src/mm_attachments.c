@@ -0,0 +1,171 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_attachments.c
+ *
+ * The attachment manifest lists the attachments of a message with their
+ * names, types and sizes, as needed to present them to a user. It is 
+ * computed from the MIME parts in one walk over the tree: the decoded size
+ * of each attachment is counted from its encoded body by the codec's 
+ * length kernel, no body is decoded. Bodies which are still to be encoded
+ * are counted by encoding them, see mm_emit_bodysize().
+ */
+
+static int mm_attachment_isattachment(struct mm_mimepart *);
+
+/** @{
+ * @name Attachment manifests
+ */
+
+/**
+ * Gets the attachments of a message
+ *
+ * @param ctx A valid MiniMIME context
+ * @param attachments Where to store the array of attachments
+ * @param count Where to store the number of attachments
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ *
+ * A MIME part is an attachment if its Content-Disposition is "attachment",
+ * or if it gives a file name, either as filename parameter of its
+ * Content-Disposition or as name parameter of its Content-Type. Multipart
+ * containers are never attachments. The attachments are listed in depth
+ * first order of the tree of MIME parts, including parts nested with 
+ * mm_mimepart_attachchild(), see mm_walk_init(). Their encoded size is 
+ * the size of the body as it is written, which fails if it is stored in a 
+ * file which cannot be read.
+ *
+ * The array is collected in the same walk, it grows by doubling and must
+ * be freed by the caller with free(). It is NULL if there are no 
+ * attachments. The strings it points
+ * to belong to the MIME parts and remain valid as long as these are not
+ * changed or freed.
+ */
+int
+mm_context_attachments(MM_CTX *ctx, struct mm_attachment **attachments,
+    int *count)
+{
+	struct mm_attachment *list, *a;
+	struct mm_mimepart *part;
+	struct mm_walk walk;
+	int i, n, size, number;
+
+	assert(ctx != NULL);
+	assert(attachments != NULL);
+	assert(count != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	*attachments = NULL;
+	*count = 0;
+
+	if (mm_context_countparts(ctx) == 0)
+		return 0;
+
+	list = NULL;
+	n = size = 0;
+
+	/* The parts of the context come in order, those nested in them with
+	 * mm_mimepart_attachchild() have no number */
+	i = 0;
+	mm_walk_init(&walk, ctx, NULL, MM_WALK_DEPTHFIRST);
+	while ((part = mm_walk_next(&walk)) != NULL) {
+		number = -1;
+		if (part == mm_context_getpart(ctx, i))
+			number = i++;
+		if (!mm_attachment_isattachment(part))
+			continue;
+
+		if (n == size) {
+			size = size ? size * 2 : 4;
+			list = (struct mm_attachment *)xrealloc(list, 
+			    size * sizeof(*list));
+		}
+		a = &list[n++];
+		a->part = part;
+		a->number = number;
+		a->filename = part->filename;
+		if (a->filename == NULL)
+			a->filename = mm_content_getparambyname(part->type, 
+			    "name");
+		a->mediatype = mm_content_gettypeid(part->type);
+		a->mediasubtype = mm_content_getsubtypeid(part->type);
+		a->maintype = part->type->maintype;
+		a->subtype = part->type->subtype;
+		a->disposition = part->disposition_type;
+		a->encoding = part->type->encoding;
+		if (mm_emit_bodysize(part, &a->encoded_size) == -1) {
+			xfree(list);
+			return -1;
+		}
+		a->decoded_size = mm_mimepart_decoded_length(part);
+		a->offset = part->src_offset;
+		a->body_offset = part->src_offset + part->src_hdrlen;
+	}
+
+	*attachments = list;
+	*count = n;
+
+	return 0;
+}
+
+/** @} */
+
+/*
+ * Tells whether a MIME part is an attachment, see mm_context_attachments()
+ */
+static int
+mm_attachment_isattachment(struct mm_mimepart *part)
+{
+	if (part->type == NULL 
+	    || mm_content_gettypeid(part->type) == MM_MEDIATYPE_MULTIPART)
+		return 0;
+
+	if (part->disposition_type != NULL
+	    && !strcasecmp(part->disposition_type, "attachment"))
+		return 1;
+
+	if (part->filename != NULL 
+	    || mm_content_getparambyname(part->type, "name") != NULL)
+		return 1;
+
+	return 0;
+}
@@ -34,13 +34,13 @@ OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 ******************************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 
 #include "mm_internal.h"
 
 #define XX 127
 
-static int _mm_base64_decode(char *);
 static char *_mm_base64_encode(char *, u_int32_t);
 
 /*
@@ -81,17 +81,132 @@ char *
 mm_base64_decode(char *data)
 {
 	char *buf;
+	size_t len, size, written;
 
 	assert(data != NULL);
 
-	buf = mm_stripchars(data, "\r\n");
-	assert(buf != NULL);
+	len = strlen(data);
+	size = mm_base64_decoded_size(data, len);
+
+	buf = (char *)xmalloc(size + 1);
+	if (mm_base64_decode_into(data, len, buf, size, &written) == -1) {
+		xfree(buf);
+		return(NULL);
+	}
+	buf[written] = '\0';
 
-	_mm_base64_decode(buf);
-	assert(buf != NULL);
 	return(buf);
 }
 
+/*
+ * mm_base64_decoded_size()
+ *
+ * Returns the maximum number of bytes 'len' bytes of BASE64 encoded data
+ * pointed to by 'data' can decode to. The size is computed from the encoded
+ * length only, line breaks and padding are not accounted for.
+ *
+ */
+size_t
+mm_base64_decoded_size(const char *data, size_t len)
+{
+	return ((len + 3) / 4) * 3;
+}
+
+/*
+ * mm_base64_decoded_length()
+ *
+ * Returns the exact number of bytes 'len' bytes of BASE64 encoded data
+ * pointed to by 'data' decode to with mm_base64_decode_into(). Counts the
+ * characters of the BASE64 alphabet up to the first pad character, nothing
+ * is decoded.
+ *
+ */
+size_t
+mm_base64_decoded_length(const char *data, size_t len)
+{
+	const unsigned char *input, *end;
+	size_t n;
+
+	assert(data != NULL);
+
+	input = (const unsigned char *)data;
+	end = input + len;
+	n = 0;
+
+	while (input < end && *input != '=') {
+		if (CHAR64(*input++) != XX)
+			n++;
+	}
+
+	return (n / 4) * 3 + (n % 4 > 1 ? n % 4 - 1 : 0);
+}
+
+/*
+ * mm_base64_decode_into()
+ *
+ * Decodes 'len' bytes of BASE64 encoded data pointed to by 'data' into the
+ * buffer 'buf', which can hold 'size' bytes. No memory is allocated. Line
+ * breaks and other characters which are not part of the BASE64 alphabet
+ * are skipped, decoding stops at the first pad character. Stores the number
+ * of decoded bytes in 'written' and returns 0 on success, or -1 if 'buf'
+ * is too small (sets mm_errno).
+ *
+ */
+int
+mm_base64_decode_into(const char *data, size_t len, char *buf, size_t size,
+    size_t *written)
+{
+	const unsigned char *input, *end;
+	unsigned char *output;
+	u_int32_t quad;
+	int c, n;
+
+	assert(data != NULL);
+	assert(written != NULL);
+
+	input = (const unsigned char *)data;
+	end = input + len;
+	output = (unsigned char *)buf;
+	quad = 0;
+	n = 0;
+
+	*written = 0;
+
+	while (input < end && *input != '=') {
+		if ((c = CHAR64(*input++)) == XX)
+			continue;
+		quad = (quad << 6) | c;
+		if (++n < 4)
+			continue;
+		if (size - *written < 3)
+			goto toosmall;
+		*output++ = (quad >> 16) & 0xff;
+		*output++ = (quad >> 8) & 0xff;
+		*output++ = quad & 0xff;
+		*written += 3;
+		quad = 0;
+		n = 0;
+	}
+
+	/* Flush what's left of an incomplete (i.e. padded) quantum */
+	if (n > 1) {
+		if (size - *written < n - 1)
+			goto toosmall;
+		quad <<= 6 * (4 - n);
+		*output++ = (quad >> 16) & 0xff;
+		if (n > 2)
+			*output++ = (quad >> 8) & 0xff;
+		*written += n - 1;
+	}
+
+	return(0);
+
+toosmall:
+	mm_errno = MM_ERROR_CODEC;
+	mm_error_setmsg("base64: output buffer too small");
+	return(-1);
+}
+
 /*
  * mm_base64_encode()
  *
@@ -119,37 +234,59 @@ mm_base64_encode(char *data, u_int32_t len) {
 }
 
 /*
- * Decode in-place the base64 data in 'input'.  Returns the length
- * of the decoded data, or -1 if there was an error.
+ * mm_base64_encode_chunk()
+ *
+ * Encodes a chunk of the 'len' bytes pointed to by 'data' into 'buf', which
+ * can hold 'size' bytes, with lines broken at MM_BASE64_LINELEN characters.
+ * 'col' holds the column of the output line between calls and must be 0
+ * for the first chunk. Only whole groups of three bytes are encoded unless
+ * 'final' is set, and encoding stops when 'buf' is full. Stores the number
+ * of bytes encoded in 'consumed' and the number of characters stored in
+ * 'written'. The caller passes the remaining data again with the next
+ * chunk. Always returns 0.
+ *
  */
-static int
-_mm_base64_decode(char *input)
+int
+mm_base64_encode_chunk(const char *data, size_t len, int final, char *buf,
+    size_t size, int *col, size_t *consumed, size_t *written)
 {
-	u_int32_t len = 0;
-	unsigned char *output = (unsigned char *)input;
-	int c1, c2, c3, c4;
-
-	while (*input) {
-		c1 = *input++;
-		if (CHAR64(c1) == XX) return -1;
-		c2 = *input++;
-		if (CHAR64(c2) == XX) return -1;
-		c3 = *input++;
-		if (c3 != '=' && CHAR64(c3) == XX) return -1; 
-		c4 = *input++;
-		if (c4 != '=' && CHAR64(c4) == XX) return -1;
-		*output++ = (CHAR64(c1) << 2) | (CHAR64(c2) >> 4);
-		++len;
-		if (c3 == '=') break;
-		*output++ = ((CHAR64(c2) << 4) & 0xf0) | (CHAR64(c3) >> 2);
-		++len;
-		if (c4 == '=') break;
-		*output++ = ((CHAR64(c3) << 6) & 0xc0) | CHAR64(c4);
-		++len;
+	const unsigned char *input;
+	size_t i, w;
+	int c1, c2, c3;
+
+	assert(data != NULL || len == 0);
+	assert(col != NULL);
+
+	input = (const unsigned char *)data;
+	i = 0;
+	w = 0;
+
+	/* A group takes at most four characters and a line break */
+	while ((i + 3 <= len || (final && i < len)) && size - w >= 6) {
+		if (*col >= MM_BASE64_LINELEN) {
+			buf[w++] = '\r';
+			buf[w++] = '\n';
+			*col = 0;
+		}
+
+		c1 = input[i];
+		c2 = i + 1 < len ? input[i + 1] : 0;
+		c3 = i + 2 < len ? input[i + 2] : 0;
+
+		buf[w++] = basis_64[c1 >> 2];
+		buf[w++] = basis_64[((c1 & 0x3) << 4) | ((c2 & 0xf0) >> 4)];
+		buf[w++] = i + 1 < len ? 
+		    basis_64[((c2 & 0xf) << 2) | ((c3 & 0xc0) >> 6)] : '=';
+		buf[w++] = i + 2 < len ? basis_64[c3 & 0x3f] : '=';
+
+		*col += 4;
+		i += (len - i < 3) ? len - i : 3;
 	}
-	*output = 0;
 
-	return len;
+	*consumed = i;
+	*written = w;
+
+	return 0;
 }
 
 /*
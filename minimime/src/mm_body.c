@@ -0,0 +1,227 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_body.c
+ *
+ * Reference counted body buffers, which can be shared by any number of MIME
+ * parts and contexts. The parser also uses them to keep the source of
+ * messages (see MM_PARSE_KEEPSOURCE), shared by the context and its MIME
+ * parts.
+ */
+
+/** @{
+ * @name Shared bodies
+ */
+
+/**
+ * Creates a shared body holding a copy of some data
+ *
+ * @param data The data to copy
+ * @param length The length of the data
+ * @return A new body object with a reference count of 1
+ * @see mm_body_unref
+ * @see mm_mimepart_attachbody
+ *
+ * The body is stored in a single allocation together with the object and
+ * is NUL-terminated. Once created, the data of a body must not be changed.
+ */
+struct mm_body *
+mm_body_new(const char *data, size_t length)
+{
+	struct mm_body *body;
+
+	assert(data != NULL || length == 0);
+
+	body = (struct mm_body *)xmalloc(sizeof(struct mm_body) + length + 1);
+	body->data = (char *)(body + 1);
+	body->length = length;
+	body->refcount = 1;
+	body->release = NULL;
+	body->arg = NULL;
+	body->hashed = 0;
+
+	if (length > 0)
+		memcpy(body->data, data, length);
+	body->data[length] = '\0';
+
+	return body;
+}
+
+/**
+ * Creates a shared body referring to memory owned by the caller
+ *
+ * @param data The data
+ * @param length The length of the data
+ * @param release Function to call when the body is released, may be NULL
+ * @param arg Passed on to release
+ * @return A new body object with a reference count of 1
+ * @see mm_body_unref
+ *
+ * The data is not copied, so it must stay valid and unchanged until the
+ * last reference to the body is dropped. release is then called with the
+ * data, its length and arg, e.g. to free or unmap it. The data need not be
+ * NUL-terminated.
+ */
+struct mm_body *
+mm_body_borrow(const char *data, size_t length, 
+    void (*release)(char *, size_t, void *), void *arg)
+{
+	struct mm_body *body;
+
+	assert(data != NULL || length == 0);
+
+	body = (struct mm_body *)xmalloc(sizeof(struct mm_body));
+	body->data = (char *)data;
+	body->length = length;
+	body->refcount = 1;
+	body->release = release;
+	body->arg = arg;
+	body->hashed = 0;
+
+	return body;
+}
+
+/**
+ * Gets another reference to a shared body
+ *
+ * @param body A valid body object
+ * @return body
+ */
+struct mm_body *
+mm_body_ref(struct mm_body *body)
+{
+	assert(body != NULL && body->refcount > 0);
+
+	body->refcount++;
+	return body;
+}
+
+/**
+ * Drops a reference to a shared body
+ *
+ * @param body A valid body object
+ * @return Nothing
+ *
+ * The body is released together with the last reference. Reference 
+ * counting is not atomic, so bodies shared between threads must be 
+ * protected by the application.
+ */
+void
+mm_body_unref(struct mm_body *body)
+{
+	assert(body != NULL && body->refcount > 0);
+
+	if (--body->refcount > 0)
+		return;
+
+	if (body->release != NULL)
+		body->release(body->data, body->length, body->arg);
+	xfree(body);
+}
+
+/** @} */
+
+/*
+ * Creates a body from the whole contents of a stream
+ */
+struct mm_body *
+mm_body_fromfile(FILE *fp)
+{
+	struct mm_body *body;
+	struct stat st;
+	size_t length;
+
+	if (fstat(fileno(fp), &st) == -1 || fseek(fp, 0, SEEK_SET) == -1) {
+		mm_errno = MM_ERROR_ERRNO;
+		return NULL;
+	}
+
+	body = (struct mm_body *)xmalloc(sizeof(struct mm_body) 
+	    + st.st_size + 1);
+	body->data = (char *)(body + 1);
+	body->refcount = 1;
+	body->release = NULL;
+	body->arg = NULL;
+	body->hashed = 0;
+
+	length = fread(body->data, 1, st.st_size, fp);
+	if (ferror(fp)) {
+		mm_errno = MM_ERROR_ERRNO;
+		xfree(body);
+		return NULL;
+	}
+	body->data[length] = '\0';
+	body->length = length;
+
+	return body;
+}
+
+/*
+ * Attaches the source of a freshly parsed message to the context and its
+ * MIME parts, taking over the reference passed in. Everything the parser
+ * did to the context is not a modification, so all dirty flags are reset.
+ */
+void
+mm_body_attachsource(MM_CTX *ctx, struct mm_body *source)
+{
+	struct mm_mimepart *part;
+	struct mm_mimeheader *hdr;
+	struct mm_walk walk;
+
+	/* Nested MIME parts come from the same source */
+	mm_walk_init(&walk, ctx, NULL, MM_WALK_DEPTHFIRST);
+	while ((part = mm_walk_next(&walk)) != NULL) {
+		if (part->source != NULL)
+			mm_body_unref(part->source);
+		part->source = mm_body_ref(source);
+		TAILQ_FOREACH(hdr, &part->headers, next)
+			hdr->source = source;
+		part->dirty = MM_DIRTY_NONE;
+		if (part->type != NULL)
+			part->type->dirty = 0;
+	}
+
+	if (ctx->source != NULL)
+		mm_body_unref(ctx->source);
+	ctx->source = source;
+	ctx->dirty = MM_DIRTY_NONE;
+}
@@ -0,0 +1,394 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_cache.c
+ *
+ * An encoded payload cache keeps the encoded form of bodies which are 
+ * written many times, such as an attachment sent with every message of a
+ * mailing. Bodies are looked up by a hash of their content, their length
+ * and the codec, and compared before a cached form is used. The hash of a
+ * shared body is kept with it, and a part using the very body a cached
+ * form was made from is served without looking at its content. Bodies 
+ * stored in files are looked up by the file, the range they take in it 
+ * and its modification and status change times instead, and read only 
+ * when they are not found. The modification time is compared to the 
+ * nanosecond where struct stat has it (HAVE_STMTIM), and the status 
+ * change time catches files rewritten within the same second and files
+ * whose modification time was set back. The least recently used entries are dropped when the cache holds
+ * more than its budget. Encoded forms are reference counted, so MIME parts
+ * which still use a dropped entry keep it until they are done with it.
+ */
+
+#define MM_CACHE_FNVBASIS 2166136261U
+
+#ifdef HAVE_STMTIM
+#define MM_CACHE_MTIMENSEC(st) ((long)(st)->st_mtim.tv_nsec)
+#else
+#define MM_CACHE_MTIMENSEC(st) 0L
+#endif
+
+static struct mm_body *mm_cache_encodefile(struct mm_cache *, 
+    struct mm_mimepart *, struct mm_codec *);
+static struct mm_body *mm_cache_hit(struct mm_cache *, 
+    struct mm_cache_entry *);
+static struct mm_body *mm_cache_run(struct mm_codec *, char *, size_t);
+static struct mm_cache_entry *mm_cache_insert(struct mm_cache *, 
+    struct mm_codec *, u_int32_t, struct mm_body *);
+static void mm_cache_trim(struct mm_cache *);
+static u_int32_t mm_cache_hash(u_int32_t, const char *, size_t);
+static void mm_cache_drop(struct mm_cache *, struct mm_cache_entry *);
+static void mm_cache_release(char *, size_t, void *);
+
+/** @{
+ * @name Encoded payload caches
+ */
+
+/**
+ * Creates an encoded payload cache
+ *
+ * @param budget How many bytes the cache may hold
+ * @return A new cache
+ * @see mm_context_setcache
+ *
+ * The budget counts the bodies before and after encoding, or only after
+ * encoding for bodies stored in files. Bodies which are larger than the 
+ * budget on their own are encoded but not cached.
+ */
+struct mm_cache *
+mm_cache_new(size_t budget)
+{
+	struct mm_cache *cache;
+	int i;
+
+	cache = (struct mm_cache *)xmalloc(sizeof(struct mm_cache));
+
+	for (i = 0; i < MM_CACHE_HASHSIZE; i++)
+		SLIST_INIT(&cache->hash[i]);
+	TAILQ_INIT(&cache->entries);
+	cache->used = 0;
+	cache->budget = budget;
+	cache->hits = 0;
+	cache->misses = 0;
+
+	return cache;
+}
+
+/**
+ * Frees an encoded payload cache
+ *
+ * @param cache A valid cache
+ * @return Nothing
+ *
+ * Contexts using the cache must not be written any more afterwards, or be
+ * given another cache with mm_context_setcache() first.
+ */
+void
+mm_cache_free(struct mm_cache *cache)
+{
+	assert(cache != NULL);
+
+	while (!TAILQ_EMPTY(&cache->entries))
+		mm_cache_drop(cache, TAILQ_FIRST(&cache->entries));
+
+	xfree(cache);
+}
+
+/** @} */
+
+/*
+ * Gets the body of part encoded with codec from the cache, encoding and
+ * storing it first if it is not there. Returns a new reference to the 
+ * encoded body, or NULL if encoding failed.
+ */
+struct mm_body *
+mm_cache_encode(struct mm_cache *cache, struct mm_mimepart *part, 
+    struct mm_codec *codec)
+{
+	struct mm_cache_entry *entry;
+	struct mm_cache_bucket *bucket;
+	struct mm_body *encoded;
+	u_int32_t hash;
+
+	if (MM_MIMEPART_HASFILE(part))
+		return mm_cache_encodefile(cache, part, codec);
+
+	/* Shared bodies never change, so they are hashed only once */
+	if (part->shared != NULL) {
+		if (!part->shared->hashed) {
+			part->shared->hash = mm_cache_hash(MM_CACHE_FNVBASIS,
+			    part->shared->data, part->shared->length);
+			part->shared->hashed = 1;
+		}
+		hash = part->shared->hash;
+	} else
+		hash = mm_cache_hash(MM_CACHE_FNVBASIS, part->body, 
+		    part->length);
+	bucket = &cache->hash[hash % MM_CACHE_HASHSIZE];
+
+	SLIST_FOREACH(entry, bucket, hnext) {
+		if (entry->hash == hash && entry->codec == codec
+		    && entry->plain != NULL 
+		    && entry->plain->length == part->length
+		    && (entry->plain == part->shared
+		    || !memcmp(entry->plain->data, part->body, part->length)))
+			return mm_cache_hit(cache, entry);
+	}
+
+	cache->misses++;
+
+	if ((encoded = mm_cache_run(codec, part->body, part->length)) == NULL)
+		return NULL;
+
+	if (part->length + encoded->length > cache->budget)
+		return encoded;
+
+	entry = mm_cache_insert(cache, codec, hash, encoded);
+	if (part->shared != NULL) {
+		entry->plain = part->shared;
+		mm_body_ref(entry->plain);
+	} else {
+		entry->plain = mm_body_new(part->body, part->length);
+		entry->plain->hash = hash;
+		entry->plain->hashed = 1;
+	}
+	cache->used += part->length;
+	mm_cache_trim(cache);
+
+	return encoded;
+}
+
+/*
+ * Like mm_cache_encode(), for a part whose body is stored in a file. The
+ * body is looked up by the file and range it is stored in, so it is only 
+ * read when it is not in the cache.
+ */
+static struct mm_body *
+mm_cache_encodefile(struct mm_cache *cache, struct mm_mimepart *part,
+    struct mm_codec *codec)
+{
+	struct mm_cache_entry *entry;
+	struct mm_cache_bucket *bucket;
+	struct mm_body *encoded;
+	struct stat st;
+	u_int32_t hash;
+	char *data;
+	size_t n;
+	int fd, ret;
+
+	if ((fd = mm_mimepart_openbody(part)) == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1) {
+		mm_errno = MM_ERROR_ERRNO;
+		mm_mimepart_closebody(part, fd);
+		return NULL;
+	}
+
+	hash = mm_cache_hash(MM_CACHE_FNVBASIS, (char *)&st.st_dev, 
+	    sizeof(st.st_dev));
+	hash = mm_cache_hash(hash, (char *)&st.st_ino, sizeof(st.st_ino));
+	hash = mm_cache_hash(hash, (char *)&part->body_offset, 
+	    sizeof(part->body_offset));
+	hash = mm_cache_hash(hash, (char *)&part->length, 
+	    sizeof(part->length));
+	bucket = &cache->hash[hash % MM_CACHE_HASHSIZE];
+
+	SLIST_FOREACH(entry, bucket, hnext) {
+		if (entry->hash == hash && entry->codec == codec
+		    && entry->plain == NULL && entry->dev == st.st_dev
+		    && entry->ino == st.st_ino && entry->mtime == st.st_mtime
+		    && entry->mtime_nsec == MM_CACHE_MTIMENSEC(&st)
+		    && entry->ctime == st.st_ctime
+		    && entry->offset == part->body_offset
+		    && entry->length == part->length) {
+			mm_mimepart_closebody(part, fd);
+			return mm_cache_hit(cache, entry);
+		}
+	}
+
+	cache->misses++;
+
+	data = (char *)xmalloc(part->length + 1);
+	ret = mm_mimepart_readbody(part, fd, 0, data, part->length, &n);
+	mm_mimepart_closebody(part, fd);
+	if (ret == -1) {
+		xfree(data);
+		return NULL;
+	}
+	data[n] = '\0';
+	encoded = mm_cache_run(codec, data, n);
+	xfree(data);
+	if (encoded == NULL)
+		return NULL;
+
+	if (encoded->length > cache->budget)
+		return encoded;
+
+	entry = mm_cache_insert(cache, codec, hash, encoded);
+	entry->plain = NULL;
+	entry->dev = st.st_dev;
+	entry->ino = st.st_ino;
+	entry->mtime = st.st_mtime;
+	entry->mtime_nsec = MM_CACHE_MTIMENSEC(&st);
+	entry->ctime = st.st_ctime;
+	entry->offset = part->body_offset;
+	entry->length = part->length;
+	mm_cache_trim(cache);
+
+	return encoded;
+}
+
+/*
+ * Moves an entry found in the cache to the front and returns a new 
+ * reference to its encoded body
+ */
+static struct mm_body *
+mm_cache_hit(struct mm_cache *cache, struct mm_cache_entry *entry)
+{
+	TAILQ_REMOVE(&cache->entries, entry, next);
+	TAILQ_INSERT_HEAD(&cache->entries, entry, next);
+	cache->hits++;
+	mm_body_ref(entry->encoded);
+
+	return entry->encoded;
+}
+
+/*
+ * Encodes len bytes of data, which must be NUL-terminated, with codec
+ */
+static struct mm_body *
+mm_cache_run(struct mm_codec *codec, char *data, size_t len)
+{
+	char *encoded;
+
+	if (codec->encoder == NULL) {
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("codec %s cannot encode", codec->encoding);
+		return NULL;
+	}
+	encoded = codec->encoder(data, len);
+	if (encoded == NULL) {
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("could not encode MIME part");
+		return NULL;
+	}
+
+	return mm_body_borrow(encoded, strlen(encoded), mm_cache_release, 
+	    NULL);
+}
+
+/*
+ * Stores an encoded body in the cache. The caller sets up the key of the
+ * new entry, adds the plain body to the bytes used and trims the cache.
+ */
+static struct mm_cache_entry *
+mm_cache_insert(struct mm_cache *cache, struct mm_codec *codec, 
+    u_int32_t hash, struct mm_body *encoded)
+{
+	struct mm_cache_entry *entry;
+
+	entry = (struct mm_cache_entry *)xmalloc(sizeof(struct mm_cache_entry));
+	entry->encoded = encoded;
+	mm_body_ref(encoded);
+	entry->codec = codec;
+	entry->hash = hash;
+
+	SLIST_INSERT_HEAD(&cache->hash[hash % MM_CACHE_HASHSIZE], entry, 
+	    hnext);
+	TAILQ_INSERT_HEAD(&cache->entries, entry, next);
+	cache->used += encoded->length;
+
+	return entry;
+}
+
+/*
+ * Drops the least recently used entries until the cache fits its budget
+ */
+static void
+mm_cache_trim(struct mm_cache *cache)
+{
+	while (cache->used > cache->budget)
+		mm_cache_drop(cache, TAILQ_LAST(&cache->entries, 
+		    mm_cache_entries));
+}
+
+/*
+ * FNV-1a hash of len bytes of data, continuing from hash
+ */
+static u_int32_t
+mm_cache_hash(u_int32_t hash, const char *data, size_t len)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)data[i];
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+/*
+ * Removes an entry from the cache and drops its references
+ */
+static void
+mm_cache_drop(struct mm_cache *cache, struct mm_cache_entry *entry)
+{
+	SLIST_REMOVE(&cache->hash[entry->hash % MM_CACHE_HASHSIZE], entry,
+	    mm_cache_entry, hnext);
+	TAILQ_REMOVE(&cache->entries, entry, next);
+	cache->used -= entry->encoded->length;
+	if (entry->plain != NULL) {
+		cache->used -= entry->plain->length;
+		mm_body_unref(entry->plain);
+	}
+	mm_body_unref(entry->encoded);
+	xfree(entry);
+}
+
+/*
+ * Frees encoded data when the last reference to it is dropped
+ */
+static void
+mm_cache_release(char *data, size_t len, void *arg)
+{
+	xfree(data);
+}
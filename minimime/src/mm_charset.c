@@ -0,0 +1,777 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifdef HAVE_ICONV
+#include <iconv.h>
+#endif
+
+#include "mm_internal.h"
+#include "mm_charset_tables.h"
+
+/** @file mm_charset.c
+ *
+ * This module converts text in various charsets to UTF-8. The single byte
+ * charsets most often found in mail (ISO-8859-x, Windows-125x and KOI8)
+ * are converted with built-in tables, all other charsets are converted
+ * with iconv(3) if MiniMIME was built with HAVE_ICONV.
+ */
+
+#define MM_CHARSET_ASCII	1
+#define MM_CHARSET_UTF8		2
+#define MM_CHARSET_LATIN1	3
+#define MM_CHARSET_TABLE	4
+#define MM_CHARSET_ICONV	5
+
+/* Longest charset name we look up in our tables */
+#define MM_CHARSET_NAMELEN	32
+
+struct mm_charset
+{
+	const char *name;
+	int type;
+	const u_int16_t *table;
+	int id;
+};
+
+/* 
+ * Names are stored lowercase and without '-', '_' and ' ', so that
+ * "ISO-8859-2", "iso_8859-2" and "iso88592" all match.
+ */
+static const struct mm_charset mm_charsets[] = {
+	{ "usascii", MM_CHARSET_ASCII, NULL, MM_CHARSETID_USASCII },
+	{ "ascii", MM_CHARSET_ASCII, NULL, MM_CHARSETID_USASCII },
+	{ "utf8", MM_CHARSET_UTF8, NULL, MM_CHARSETID_UTF8 },
+	{ "iso88591", MM_CHARSET_LATIN1, NULL, MM_CHARSETID_ISO8859_1 },
+	{ "latin1", MM_CHARSET_LATIN1, NULL, MM_CHARSETID_ISO8859_1 },
+	{ "iso88592", MM_CHARSET_TABLE, mm_charset_iso_8859_2,
+	    MM_CHARSETID_ISO8859_2 },
+	{ "latin2", MM_CHARSET_TABLE, mm_charset_iso_8859_2,
+	    MM_CHARSETID_ISO8859_2 },
+	{ "iso88593", MM_CHARSET_TABLE, mm_charset_iso_8859_3,
+	    MM_CHARSETID_ISO8859_3 },
+	{ "latin3", MM_CHARSET_TABLE, mm_charset_iso_8859_3,
+	    MM_CHARSETID_ISO8859_3 },
+	{ "iso88594", MM_CHARSET_TABLE, mm_charset_iso_8859_4,
+	    MM_CHARSETID_ISO8859_4 },
+	{ "latin4", MM_CHARSET_TABLE, mm_charset_iso_8859_4,
+	    MM_CHARSETID_ISO8859_4 },
+	{ "iso88595", MM_CHARSET_TABLE, mm_charset_iso_8859_5,
+	    MM_CHARSETID_ISO8859_5 },
+	{ "iso88596", MM_CHARSET_TABLE, mm_charset_iso_8859_6,
+	    MM_CHARSETID_ISO8859_6 },
+	{ "iso88597", MM_CHARSET_TABLE, mm_charset_iso_8859_7,
+	    MM_CHARSETID_ISO8859_7 },
+	{ "iso88598", MM_CHARSET_TABLE, mm_charset_iso_8859_8,
+	    MM_CHARSETID_ISO8859_8 },
+	{ "iso88599", MM_CHARSET_TABLE, mm_charset_iso_8859_9,
+	    MM_CHARSETID_ISO8859_9 },
+	{ "latin5", MM_CHARSET_TABLE, mm_charset_iso_8859_9,
+	    MM_CHARSETID_ISO8859_9 },
+	{ "iso885910", MM_CHARSET_TABLE, mm_charset_iso_8859_10,
+	    MM_CHARSETID_ISO8859_10 },
+	{ "latin6", MM_CHARSET_TABLE, mm_charset_iso_8859_10,
+	    MM_CHARSETID_ISO8859_10 },
+	{ "iso885911", MM_CHARSET_TABLE, mm_charset_iso_8859_11,
+	    MM_CHARSETID_ISO8859_11 },
+	{ "iso885913", MM_CHARSET_TABLE, mm_charset_iso_8859_13,
+	    MM_CHARSETID_ISO8859_13 },
+	{ "latin7", MM_CHARSET_TABLE, mm_charset_iso_8859_13,
+	    MM_CHARSETID_ISO8859_13 },
+	{ "iso885914", MM_CHARSET_TABLE, mm_charset_iso_8859_14,
+	    MM_CHARSETID_ISO8859_14 },
+	{ "latin8", MM_CHARSET_TABLE, mm_charset_iso_8859_14,
+	    MM_CHARSETID_ISO8859_14 },
+	{ "iso885915", MM_CHARSET_TABLE, mm_charset_iso_8859_15,
+	    MM_CHARSETID_ISO8859_15 },
+	{ "latin9", MM_CHARSET_TABLE, mm_charset_iso_8859_15,
+	    MM_CHARSETID_ISO8859_15 },
+	{ "iso885916", MM_CHARSET_TABLE, mm_charset_iso_8859_16,
+	    MM_CHARSETID_ISO8859_16 },
+	{ "latin10", MM_CHARSET_TABLE, mm_charset_iso_8859_16,
+	    MM_CHARSETID_ISO8859_16 },
+	{ "windows1250", MM_CHARSET_TABLE, mm_charset_windows_1250,
+	    MM_CHARSETID_WINDOWS1250 },
+	{ "cp1250", MM_CHARSET_TABLE, mm_charset_windows_1250,
+	    MM_CHARSETID_WINDOWS1250 },
+	{ "windows1251", MM_CHARSET_TABLE, mm_charset_windows_1251,
+	    MM_CHARSETID_WINDOWS1251 },
+	{ "cp1251", MM_CHARSET_TABLE, mm_charset_windows_1251,
+	    MM_CHARSETID_WINDOWS1251 },
+	{ "windows1252", MM_CHARSET_TABLE, mm_charset_windows_1252,
+	    MM_CHARSETID_WINDOWS1252 },
+	{ "cp1252", MM_CHARSET_TABLE, mm_charset_windows_1252,
+	    MM_CHARSETID_WINDOWS1252 },
+	{ "windows1253", MM_CHARSET_TABLE, mm_charset_windows_1253,
+	    MM_CHARSETID_WINDOWS1253 },
+	{ "cp1253", MM_CHARSET_TABLE, mm_charset_windows_1253,
+	    MM_CHARSETID_WINDOWS1253 },
+	{ "windows1254", MM_CHARSET_TABLE, mm_charset_windows_1254,
+	    MM_CHARSETID_WINDOWS1254 },
+	{ "cp1254", MM_CHARSET_TABLE, mm_charset_windows_1254,
+	    MM_CHARSETID_WINDOWS1254 },
+	{ "windows1255", MM_CHARSET_TABLE, mm_charset_windows_1255,
+	    MM_CHARSETID_WINDOWS1255 },
+	{ "cp1255", MM_CHARSET_TABLE, mm_charset_windows_1255,
+	    MM_CHARSETID_WINDOWS1255 },
+	{ "windows1256", MM_CHARSET_TABLE, mm_charset_windows_1256,
+	    MM_CHARSETID_WINDOWS1256 },
+	{ "cp1256", MM_CHARSET_TABLE, mm_charset_windows_1256,
+	    MM_CHARSETID_WINDOWS1256 },
+	{ "windows1257", MM_CHARSET_TABLE, mm_charset_windows_1257,
+	    MM_CHARSETID_WINDOWS1257 },
+	{ "cp1257", MM_CHARSET_TABLE, mm_charset_windows_1257,
+	    MM_CHARSETID_WINDOWS1257 },
+	{ "windows1258", MM_CHARSET_TABLE, mm_charset_windows_1258,
+	    MM_CHARSETID_WINDOWS1258 },
+	{ "cp1258", MM_CHARSET_TABLE, mm_charset_windows_1258,
+	    MM_CHARSETID_WINDOWS1258 },
+	{ "koi8r", MM_CHARSET_TABLE, mm_charset_koi8_r, MM_CHARSETID_KOI8R },
+	{ "koi8u", MM_CHARSET_TABLE, mm_charset_koi8_u, MM_CHARSETID_KOI8U },
+	{ NULL, 0, NULL, MM_CHARSETID_OTHER }
+};
+
+static int mm_charset_openn(struct mm_charset_state *, const char *, size_t);
+static const struct mm_charset *mm_charset_lookup(const char *, size_t);
+static size_t mm_charset_asciilen(const unsigned char *, size_t);
+static int mm_charset_utf8seq(const unsigned char *, size_t);
+static char *mm_charset_pututf8(char *, u_int32_t);
+#ifdef HAVE_ICONV
+static int mm_charset_iconv(struct mm_charset_state *, const char *, size_t,
+    char **, size_t *);
+static size_t mm_charset_iconvbuf(iconv_t, char **, size_t *, char **,
+    size_t *);
+#endif
+
+/** @{
+ * @name Converting text to UTF-8
+ */
+
+/**
+ * Prepares the conversion of text in the given charset to UTF-8
+ *
+ * @param state The conversion state to initialize
+ * @param charset The name of the source charset
+ * @return 0 on success or -1 if the charset is not supported
+ * @note Sets mm_errno on error
+ * @see mm_charset_toutf8
+ * @see mm_charset_close
+ * @ingroup mimeutil
+ *
+ * The conversion state keeps incomplete multibyte sequences at the end of a
+ * chunk, so text can be converted chunk by chunk, e.g. while it is being
+ * transfer decoded. A state must be released with mm_charset_close().
+ */
+int
+mm_charset_open(struct mm_charset_state *state, const char *charset)
+{
+	assert(state != NULL);
+	assert(charset != NULL);
+
+	if (mm_charset_openn(state, charset, strlen(charset)) == -1) {
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("unsupported charset: %s", charset);
+		return -1;
+	}
+
+	return 0;
+}
+
+/**
+ * Identifies a charset by its name
+ *
+ * @param charset The name of a charset
+ * @return The ID of the charset (see enum mm_charset_ids), or 
+ *         MM_CHARSETID_OTHER if it is not one MiniMIME knows
+ * @ingroup mimeutil
+ *
+ * Different spellings and aliases of a charset, such as "ISO-8859-1", 
+ * "iso_8859-1" and "latin1", have the same ID.
+ */
+int
+mm_charset_getid(const char *charset)
+{
+	const struct mm_charset *cs;
+
+	assert(charset != NULL);
+
+	cs = mm_charset_lookup(charset, strlen(charset));
+
+	return cs != NULL ? cs->id : MM_CHARSETID_OTHER;
+}
+
+/**
+ * Releases a conversion state
+ *
+ * @param state A conversion state initialized with mm_charset_open()
+ * @return Nothing
+ * @ingroup mimeutil
+ */
+void
+mm_charset_close(struct mm_charset_state *state)
+{
+	assert(state != NULL);
+
+#ifdef HAVE_ICONV
+	if (state->cd != NULL)
+		iconv_close((iconv_t)state->cd);
+#endif
+	state->cd = NULL;
+	state->pending_len = 0;
+}
+
+/**
+ * Gets the size of the output buffer needed to convert text to UTF-8
+ *
+ * @param len The length of the text to convert
+ * @return The size of the output buffer in byte
+ * @ingroup mimeutil
+ *
+ * The size returned is large enough for mm_charset_toutf8() converting a
+ * chunk of len bytes plus an incomplete sequence left over from a previous
+ * chunk, and for mm_charset_finish().
+ */
+size_t
+mm_charset_toutf8_size(size_t len)
+{
+	return (len + MM_CHARSET_MAXPENDING) * MM_CHARSET_MAXEXPAND;
+}
+
+/**
+ * Converts a chunk of text to UTF-8
+ *
+ * @param state A conversion state initialized with mm_charset_open()
+ * @param text The text to convert
+ * @param len The length of text
+ * @param buf The buffer where to store the UTF-8 text
+ * @param size The size of buf
+ * @param written Where to store the number of bytes stored in buf
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on error
+ * @see mm_charset_toutf8_size
+ * @ingroup mimeutil
+ *
+ * Converts len bytes of text into buf, which must have room for at least
+ * mm_charset_toutf8_size(len) bytes. Bytes which are not valid in the
+ * source charset are replaced by U+FFFD. A multibyte sequence which is
+ * incomplete at the end of text is kept in the state and completed by the
+ * next chunk; call mm_charset_finish() after the last chunk. Text which is
+ * plain ASCII is copied word by word. The output is not NUL-terminated.
+ *
+ * The conversion may be done in place: text may lie within buf, as long as
+ * it starts at least mm_charset_toutf8_size(len) - len bytes behind buf.
+ * The converted text then never overtakes the text still to be converted.
+ */
+int
+mm_charset_toutf8(struct mm_charset_state *state, const char *text,
+    size_t len, char *buf, size_t size, size_t *written)
+{
+	const unsigned char *in;
+	const u_int16_t *table;
+	char *out;
+	size_t i, n;
+	int seq;
+
+	assert(state != NULL);
+	assert(written != NULL);
+
+	*written = 0;
+
+	if (size < (len + state->pending_len) * MM_CHARSET_MAXEXPAND) {
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("charset: output buffer too small");
+		return -1;
+	}
+
+#ifdef HAVE_ICONV
+	if (state->type == MM_CHARSET_ICONV) {
+		out = buf;
+		if (mm_charset_iconv(state, text, len, &out, &size) == -1)
+			return -1;
+		*written = out - buf;
+		return 0;
+	}
+#endif
+
+	in = (const unsigned char *)text;
+	out = buf;
+	table = state->table;
+	i = 0;
+
+	/* Complete a sequence left over from the previous chunk */
+	while (state->pending_len > 0 && i < len) {
+		state->pending[state->pending_len++] = in[i++];
+		seq = mm_charset_utf8seq(state->pending, state->pending_len);
+		if (seq == 0)
+			continue;
+		if (seq > 0) {
+			memmove(out, state->pending, seq);
+			out += seq;
+		} else {
+			/* The byte just added doesn't fit, it starts over */
+			out = mm_charset_pututf8(out, 0xfffd);
+			i--;
+		}
+		state->pending_len = 0;
+	}
+
+	while (i < len) {
+		n = mm_charset_asciilen(in + i, len - i);
+		if (n > 0) {
+			memmove(out, in + i, n);
+			out += n;
+			i += n;
+			continue;
+		}
+
+		switch (state->type) {
+		case MM_CHARSET_UTF8:
+			seq = mm_charset_utf8seq(in + i, len - i);
+			if (seq > 0) {
+				memmove(out, in + i, seq);
+				out += seq;
+				i += seq;
+			} else if (seq < 0) {
+				out = mm_charset_pututf8(out, 0xfffd);
+				i += -seq;
+			} else {
+				memcpy(state->pending, in + i, len - i);
+				state->pending_len = len - i;
+				i = len;
+			}
+			break;
+		case MM_CHARSET_LATIN1:
+			out = mm_charset_pututf8(out, in[i++]);
+			break;
+		case MM_CHARSET_TABLE:
+			out = mm_charset_pututf8(out, table[in[i++] - 0x80]);
+			break;
+		default:
+			out = mm_charset_pututf8(out, 0xfffd);
+			i++;
+			break;
+		}
+	}
+
+	*written = out - buf;
+
+	return 0;
+}
+
+/**
+ * Finishes the conversion of text to UTF-8
+ *
+ * @param state A conversion state initialized with mm_charset_open()
+ * @param buf The buffer where to store the remaining UTF-8 text
+ * @param size The size of buf
+ * @param written Where to store the number of bytes stored in buf
+ * @return 0 on success or -1 on failure
+ * @ingroup mimeutil
+ *
+ * An incomplete multibyte sequence at the end of the converted text is
+ * replaced by U+FFFD. buf must have room for at least 
+ * mm_charset_toutf8_size(0) bytes.
+ */
+int
+mm_charset_finish(struct mm_charset_state *state, char *buf, size_t size,
+    size_t *written)
+{
+	assert(state != NULL);
+	assert(written != NULL);
+
+	*written = 0;
+	if (state->pending_len == 0)
+		return 0;
+
+	if (size < MM_CHARSET_MAXEXPAND) {
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("charset: output buffer too small");
+		return -1;
+	}
+
+	*written = mm_charset_pututf8(buf, 0xfffd) - buf;
+	state->pending_len = 0;
+
+	return 0;
+}
+
+/**
+ * Checks whether text consists of US-ASCII characters only
+ *
+ * @param text The text to check
+ * @param len The length of text
+ * @return 1 if text is US-ASCII or 0 if not
+ * @ingroup mimeutil
+ */
+int
+mm_charset_isascii(const char *text, size_t len)
+{
+	assert(text != NULL || len == 0);
+
+	return mm_charset_asciilen((const unsigned char *)text, len) == len;
+}
+
+/**
+ * Checks whether text is valid UTF-8
+ *
+ * @param text The text to check
+ * @param len The length of text
+ * @return 1 if text is valid UTF-8 or 0 if not
+ * @ingroup mimeutil
+ *
+ * Overlong sequences, surrogates and code points beyond U+10FFFF are not
+ * valid UTF-8.
+ */
+int
+mm_charset_isutf8(const char *text, size_t len)
+{
+	const unsigned char *in;
+	size_t i;
+	int seq;
+
+	assert(text != NULL || len == 0);
+
+	in = (const unsigned char *)text;
+	i = 0;
+	while (i < len) {
+		i += mm_charset_asciilen(in + i, len - i);
+		if (i == len)
+			break;
+		if ((seq = mm_charset_utf8seq(in + i, len - i)) <= 0)
+			return 0;
+		i += seq;
+	}
+
+	return 1;
+}
+
+/** @} */
+
+/*
+ * Converts len bytes of text in the charset named by the first charset_len
+ * bytes of charset to UTF-8, stores the result in output and returns the
+ * number of bytes stored. output must have room for len * 
+ * MM_CHARSET_MAXEXPAND bytes. Text in charsets we don't know how to convert
+ * is copied as-is.
+ */
+size_t
+mm_charset_convert(const char *charset, size_t charset_len, const char *text,
+    size_t len, char *output)
+{
+	struct mm_charset_state state;
+	size_t n, m;
+
+	if (mm_charset_openn(&state, charset, charset_len) == -1) {
+		memcpy(output, text, len);
+		return len;
+	}
+
+	if (mm_charset_toutf8(&state, text, len, output, 
+	    len * MM_CHARSET_MAXEXPAND, &n) == -1) {
+		mm_charset_close(&state);
+		memcpy(output, text, len);
+		return len;
+	}
+	mm_charset_finish(&state, output + n, len * MM_CHARSET_MAXEXPAND - n,
+	    &m);
+	mm_charset_close(&state);
+
+	return n + m;
+}
+
+/*
+ * Initializes state for the charset named by the first len bytes of
+ * charset. Returns -1 if the charset is not supported.
+ */
+static int
+mm_charset_openn(struct mm_charset_state *state, const char *charset,
+    size_t len)
+{
+	const struct mm_charset *cs;
+#ifdef HAVE_ICONV
+	char name[MM_CHARSET_NAMELEN];
+	iconv_t cd;
+#endif
+
+	state->type = 0;
+	state->table = NULL;
+	state->cd = NULL;
+	state->pending_len = 0;
+
+	cs = mm_charset_lookup(charset, len);
+	if (cs != NULL) {
+		state->type = cs->type;
+		state->table = cs->table;
+		return 0;
+	}
+
+#ifdef HAVE_ICONV
+	/* iconv wants a NUL-terminated name */
+	if (len < sizeof(name)) {
+		memcpy(name, charset, len);
+		name[len] = '\0';
+		cd = iconv_open("UTF-8", name);
+		if (cd != (iconv_t)-1) {
+			state->type = MM_CHARSET_ICONV;
+			state->cd = (void *)cd;
+			return 0;
+		}
+	}
+#endif
+
+	return -1;
+}
+
+/*
+ * Looks up the charset named by the first len bytes of charset in the
+ * built-in table. Returns NULL if it is not found there.
+ */
+static const struct mm_charset *
+mm_charset_lookup(const char *charset, size_t len)
+{
+	char name[MM_CHARSET_NAMELEN];
+	size_t i, j;
+
+	for (i = 0, j = 0; i < len && j < sizeof(name) - 1; i++) {
+		if (charset[i] == '-' || charset[i] == '_' 
+		    || charset[i] == ' ')
+			continue;
+		name[j++] = tolower((unsigned char)charset[i]);
+	}
+	name[j] = '\0';
+
+	if (i < len)
+		return NULL;
+
+	for (i = 0; mm_charsets[i].name != NULL; i++) {
+		if (!strcmp(mm_charsets[i].name, name))
+			return &mm_charsets[i];
+	}
+
+	return NULL;
+}
+
+/*
+ * Returns the number of US-ASCII bytes at the start of s. Looks at a
+ * machine word at a time, which is as fast as it gets in portable C.
+ */
+static size_t
+mm_charset_asciilen(const unsigned char *s, size_t len)
+{
+	unsigned long word, mask;
+	size_t i;
+
+	/* 0x8080...80 */
+	mask = (~0UL / 0xff) * 0x80;
+
+	for (i = 0; i + sizeof(word) <= len; i += sizeof(word)) {
+		memcpy(&word, s + i, sizeof(word));
+		if (word & mask)
+			break;
+	}
+	while (i < len && s[i] < 0x80)
+		i++;
+
+	return i;
+}
+
+/*
+ * Checks the UTF-8 sequence at the start of s, which must not be an ASCII
+ * character. Returns the length of the sequence if it is valid, 0 if it is
+ * valid but incomplete, or the negated number of bytes to skip (at least 1)
+ * if it is invalid.
+ */
+static int
+mm_charset_utf8seq(const unsigned char *s, size_t len)
+{
+	unsigned char lo, hi;
+	int need, i;
+
+	if (s[0] >= 0xc2 && s[0] <= 0xdf) {
+		need = 2;
+	} else if (s[0] >= 0xe0 && s[0] <= 0xef) {
+		need = 3;
+	} else if (s[0] >= 0xf0 && s[0] <= 0xf4) {
+		need = 4;
+	} else {
+		return -1;
+	}
+
+	/* The second byte is restricted to rule out overlong sequences,
+	 * surrogates and code points beyond U+10FFFF. */
+	lo = 0x80;
+	hi = 0xbf;
+	if (s[0] == 0xe0)
+		lo = 0xa0;
+	else if (s[0] == 0xed)
+		hi = 0x9f;
+	else if (s[0] == 0xf0)
+		lo = 0x90;
+	else if (s[0] == 0xf4)
+		hi = 0x8f;
+
+	for (i = 1; i < need; i++) {
+		if ((size_t)i >= len)
+			return 0;
+		if (s[i] < lo || s[i] > hi)
+			return -i;
+		lo = 0x80;
+		hi = 0xbf;
+	}
+
+	return need;
+}
+
+/*
+ * Stores the UTF-8 encoding of the code point cp, which must be in the
+ * Basic Multilingual Plane, at out and returns a pointer past it.
+ */
+static char *
+mm_charset_pututf8(char *out, u_int32_t cp)
+{
+	if (cp < 0x80) {
+		*out++ = cp;
+	} else if (cp < 0x800) {
+		*out++ = 0xc0 | (cp >> 6);
+		*out++ = 0x80 | (cp & 0x3f);
+	} else {
+		*out++ = 0xe0 | (cp >> 12);
+		*out++ = 0x80 | ((cp >> 6) & 0x3f);
+		*out++ = 0x80 | (cp & 0x3f);
+	}
+
+	return out;
+}
+
+#ifdef HAVE_ICONV
+/*
+ * Converts text with iconv(3). Incomplete sequences at the end of text are
+ * kept in the state, invalid ones are replaced by U+FFFD.
+ */
+static int
+mm_charset_iconv(struct mm_charset_state *state, const char *text, size_t len,
+    char **out, size_t *outleft)
+{
+	iconv_t cd;
+	char *in;
+	size_t inleft;
+
+	cd = (iconv_t)state->cd;
+
+	/* Complete a sequence left over from the previous chunk */
+	while (state->pending_len > 0 && len > 0) {
+		state->pending[state->pending_len++] = *text++;
+		len--;
+		in = (char *)state->pending;
+		inleft = state->pending_len;
+		if (mm_charset_iconvbuf(cd, &in, &inleft, out, outleft) 
+		    != (size_t)-1) {
+			state->pending_len = 0;
+		} else if (errno == EILSEQ 
+		    || state->pending_len == MM_CHARSET_MAXPENDING) {
+			*out = mm_charset_pututf8(*out, 0xfffd);
+			*outleft -= MM_CHARSET_MAXEXPAND;
+			state->pending_len = 0;
+		} else if (errno != EINVAL) {
+			goto error;
+		}
+	}
+
+	in = (char *)text;
+	inleft = len;
+	while (inleft > 0) {
+		if (mm_charset_iconvbuf(cd, &in, &inleft, out, outleft) 
+		    != (size_t)-1)
+			break;
+		if (errno == EILSEQ) {
+			*out = mm_charset_pututf8(*out, 0xfffd);
+			*outleft -= MM_CHARSET_MAXEXPAND;
+			in++;
+			inleft--;
+		} else if (errno == EINVAL && inleft < MM_CHARSET_MAXPENDING) {
+			memcpy(state->pending, in, inleft);
+			state->pending_len = inleft;
+			break;
+		} else {
+			goto error;
+		}
+	}
+
+	return 0;
+
+error:
+	mm_errno = MM_ERROR_CODEC;
+	mm_error_setmsg("charset: %s", strerror(errno));
+	return -1;
+}
+
+/*
+ * Calls iconv(3) through a small buffer, so that the conversion may be done
+ * in place (iconv itself doesn't promise that).
+ */
+static size_t
+mm_charset_iconvbuf(iconv_t cd, char **in, size_t *inleft, char **out,
+    size_t *outleft)
+{
+	char tmp[256], *p;
+	size_t left, n, ret;
+	int saved_errno;
+
+	do {
+		p = tmp;
+		left = sizeof(tmp);
+		ret = iconv(cd, in, inleft, &p, &left);
+		saved_errno = errno;
+
+		n = p - tmp;
+		if (n > *outleft) {
+			errno = E2BIG;
+			return (size_t)-1;
+		}
+		memmove(*out, tmp, n);
+		*out += n;
+		*outleft -= n;
+
+		errno = saved_errno;
+	} while (ret == (size_t)-1 && errno == E2BIG && n > 0);
+
+	return ret;
+}
+#endif
@@ -38,19 +38,60 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <string.h>
+#include <ctype.h>
 #include <assert.h>
 
 #include "mm_internal.h"
 #include "mm_util.h"
 
 extern struct mm_codecs codecs;
+extern u_int32_t codecs_generation;
 
 /** @file mm_codecs.c
  *
  * This module contains functions to manipulate MiniMIME codecs
  *
+ * Codecs are kept in three places: the global list of codecs (in order of
+ * registration), a table indexed by the numerical ID of the encodings
+ * MiniMIME knows about, and a small hash keyed by the (case insensitive)
+ * encoding name, which also serves custom codecs. Every change to the set
+ * of registered codecs bumps codecs_generation, which invalidates codec
+ * pointers cached in Content-Type objects.
  */
 
+#define MM_CODEC_HASHSIZE 16
+
+static struct mm_codec *codecs_byid[MM_ENCODING_UNKNOWN];
+static struct mm_codecs codecs_hash[MM_CODEC_HASHSIZE];
+
+static u_int32_t
+mm_codec_hash(const char *encoding)
+{
+	u_int32_t hash;
+
+	for (hash = 5381; *encoding != '\0'; encoding++) {
+		hash = ((hash << 5) + hash) 
+		    + (u_int32_t)tolower((unsigned char)*encoding);
+	}
+
+	return hash % MM_CODEC_HASHSIZE;
+}
+
+static struct mm_codec *
+mm_codec_byname(const char *encoding)
+{
+	struct mm_codec *codec;
+
+	SLIST_FOREACH(codec, &codecs_hash[mm_codec_hash(encoding)], hnext) {
+		assert(codec->encoding != NULL);
+		if (!strcasecmp(codec->encoding, encoding)) {
+			return codec;
+		}
+	}
+
+	return NULL;
+}
+
 /** @defgroup codecs Manipulating MiniMIME codecs */
 
 /** @{
@@ -71,15 +112,9 @@ mm_codec_hasdecoder(const char *encoding)
 
 	assert(encoding != NULL);
 
-	SLIST_FOREACH(codec, &codecs, next) {
-		assert(codec->encoding != NULL);
-		if (!strcasecmp(codec->encoding, encoding)) {
-			if (codec->decoder != NULL)
-				return 1;
-			else
-				return 0;
-		}
-	}
+	codec = mm_codec_byname(encoding);
+	if (codec != NULL && codec->decoder != NULL)
+		return 1;
 
 	return 0;
 }
@@ -99,15 +134,9 @@ mm_codec_hasencoder(const char *encoding)
 
 	assert(encoding != NULL);
 
-	SLIST_FOREACH(codec, &codecs, next) {
-		assert(codec->encoding != NULL);
-		if (!strcasecmp(codec->encoding, encoding)) {
-			if (codec->encoder != NULL)
-				return 1;
-			else
-				return 0;
-		}
-	}
+	codec = mm_codec_byname(encoding);
+	if (codec != NULL && codec->encoder != NULL)
+		return 1;
 
 	return 0;
 }
@@ -122,19 +151,40 @@ mm_codec_hasencoder(const char *encoding)
 int
 mm_codec_isregistered(const char *encoding)
 {
-	struct mm_codec *codec;
-
 	assert(encoding != NULL);
 
-	SLIST_FOREACH(codec, &codecs, next) {
-		if (!strcasecmp(codec->encoding, encoding)) {
-			return 1;
-		}
-	}
+	if (mm_codec_byname(encoding) != NULL)
+		return 1;
 
 	return 0;
 }
 
+/**
+ * Finds the codec responsible for an encoding
+ *
+ * @param id The numerical ID of the encoding
+ * @param encoding The encoding specifier, used if id is MM_ENCODING_UNKNOWN
+ *	(may be NULL)
+ * @return A pointer to the codec or NULL if no codec is registered
+ * @ingroup codecs
+ *
+ * Encodings known to MiniMIME are looked up by their ID in constant time,
+ * all others by their name through the codec hash. Callers which need the
+ * codec of a Content-Type object repeatedly should use
+ * mm_content_getcodec(), which caches the result.
+ */
+struct mm_codec *
+mm_codec_lookup(enum mm_encoding id, const char *encoding)
+{
+	if (id > MM_ENCODING_NONE && id < MM_ENCODING_UNKNOWN)
+		return codecs_byid[id];
+
+	if (encoding != NULL)
+		return mm_codec_byname(encoding);
+
+	return NULL;
+}
+
 /**
  * Registers a codec with the MiniMIME library
  *
@@ -161,13 +211,17 @@ mm_codec_register(const char *encoding,
 	
 	codec = (struct mm_codec *)xmalloc(sizeof(struct mm_codec));
 
+	codec->id = mm_content_getencoding(NULL, encoding);
 	codec->encoding = xstrdup(encoding);
 	codec->encoder = encoder;
 	codec->decoder = decoder;
+	codec->decoded_size = NULL;
+	codec->decode_into = NULL;
+	codec->decoded_length = NULL;
+	codec->encode_chunk = NULL;
 
 	if (SLIST_EMPTY(&codecs)) {
 		SLIST_INSERT_HEAD(&codecs, codec, next);
-		return 1;
 	} else {
 		struct mm_codec *lcodec, *tcodec;
 		tcodec = NULL;
@@ -177,10 +231,14 @@ mm_codec_register(const char *encoding,
 		}
 		assert(tcodec != NULL);
 		SLIST_INSERT_AFTER(tcodec, codec, next);
-		return 1;
 	}
-	
-	return 0;
+
+	SLIST_INSERT_HEAD(&codecs_hash[mm_codec_hash(encoding)], codec, hnext);
+	if (codec->id < MM_ENCODING_UNKNOWN)
+		codecs_byid[codec->id] = codec;
+	codecs_generation++;
+
+	return 1;
 }
 
 /**
@@ -197,16 +255,22 @@ mm_codec_unregister(const char *encoding)
 
 	assert(encoding != NULL);
 
-	SLIST_FOREACH(codec, &codecs, next) {
-		if (!strcasecmp(codec->encoding, encoding)) {
-			xfree(codec->encoding);
-			xfree(codec);
-			codec = NULL;
-			return 0;
-		}
-	}
+	codec = mm_codec_byname(encoding);
+	if (codec == NULL)
+		return -1;
+
+	SLIST_REMOVE(&codecs, codec, mm_codec, next);
+	SLIST_REMOVE(&codecs_hash[mm_codec_hash(codec->encoding)], codec, 
+	    mm_codec, hnext);
+	if (codec->id < MM_ENCODING_UNKNOWN && codecs_byid[codec->id] == codec)
+		codecs_byid[codec->id] = NULL;
+	codecs_generation++;
 
-	return -1;
+	xfree(codec->encoding);
+	xfree(codec);
+	codec = NULL;
+
+	return 0;
 }
 
 /**
@@ -222,7 +286,7 @@ mm_codec_unregisterall(void)
 {
 	struct mm_codec *codec;
 
-	SLIST_FOREACH(codec, &codecs, next) {
+	while ((codec = SLIST_FIRST(&codecs)) != NULL) {
 		if (mm_codec_unregister(codec->encoding) == -1) {
 			return -1;
 		}
@@ -238,12 +302,30 @@ mm_codec_unregisterall(void)
  * MiniMIME context:
  *
  *	- Base64
- *	- (TODO:) Quoted-Printable
+ *	- Quoted-Printable
+ *
+ * Both come with non-allocating decoder kernels, which are used by
+ * mm_mimepart_decode_into(), and kernels for the exact decoded size, which
+ * are used by mm_mimepart_decoded_length().
  */
 void
 mm_codec_registerdefaultcodecs(void)
 {
+	struct mm_codec *codec;
+
 	mm_codec_register("base64", mm_base64_encode, mm_base64_decode);
+	codec = mm_codec_lookup(MM_ENCODING_BASE64, NULL);
+	codec->decoded_size = mm_base64_decoded_size;
+	codec->decode_into = mm_base64_decode_into;
+	codec->decoded_length = mm_base64_decoded_length;
+	codec->encode_chunk = mm_base64_encode_chunk;
+
+	mm_codec_register("quoted-printable", mm_qp_encode, mm_qp_decode);
+	codec = mm_codec_lookup(MM_ENCODING_QUOTEDPRINTABLE, NULL);
+	codec->decoded_size = mm_qp_decoded_size;
+	codec->decode_into = mm_qp_decode_into;
+	codec->decoded_length = mm_qp_decoded_length;
+	codec->encode_chunk = mm_qp_encode_chunk;
 }
 
 
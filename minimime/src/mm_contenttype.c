@@ -59,13 +59,64 @@ struct mm_encoding_mappings {
 static struct mm_encoding_mappings mm_content_enctypes[] = {
 	{ "Base64", MM_ENCODING_BASE64 },
 	{ "Quoted-Printable", MM_ENCODING_QUOTEDPRINTABLE },
+	{ "7bit", MM_ENCODING_7BIT },
+	{ "8bit", MM_ENCODING_8BIT },
+	{ "binary", MM_ENCODING_BINARY },
 	{ NULL, - 1},
 };
 
-static const char *mm_composite_maintypes[] = {
-	"multipart",
-	"message",
-	NULL,
+struct mm_mediatype_mappings {
+	const char *name;
+	int id;
+};
+
+static const struct mm_mediatype_mappings mm_content_mediatypes[] = {
+	{ "text", MM_MEDIATYPE_TEXT },
+	{ "image", MM_MEDIATYPE_IMAGE },
+	{ "audio", MM_MEDIATYPE_AUDIO },
+	{ "video", MM_MEDIATYPE_VIDEO },
+	{ "application", MM_MEDIATYPE_APPLICATION },
+	{ "multipart", MM_MEDIATYPE_MULTIPART },
+	{ "message", MM_MEDIATYPE_MESSAGE },
+	{ "font", MM_MEDIATYPE_FONT },
+	{ "model", MM_MEDIATYPE_MODEL },
+	{ NULL, MM_MEDIATYPE_OTHER },
+};
+
+static const struct mm_mediatype_mappings mm_content_mediasubtypes[] = {
+	{ "plain", MM_MEDIASUBTYPE_PLAIN },
+	{ "html", MM_MEDIASUBTYPE_HTML },
+	{ "enriched", MM_MEDIASUBTYPE_ENRICHED },
+	{ "calendar", MM_MEDIASUBTYPE_CALENDAR },
+	{ "mixed", MM_MEDIASUBTYPE_MIXED },
+	{ "alternative", MM_MEDIASUBTYPE_ALTERNATIVE },
+	{ "related", MM_MEDIASUBTYPE_RELATED },
+	{ "digest", MM_MEDIASUBTYPE_DIGEST },
+	{ "parallel", MM_MEDIASUBTYPE_PARALLEL },
+	{ "signed", MM_MEDIASUBTYPE_SIGNED },
+	{ "encrypted", MM_MEDIASUBTYPE_ENCRYPTED },
+	{ "report", MM_MEDIASUBTYPE_REPORT },
+	{ "rfc822", MM_MEDIASUBTYPE_RFC822 },
+	{ "global", MM_MEDIASUBTYPE_GLOBAL },
+	{ "partial", MM_MEDIASUBTYPE_PARTIAL },
+	{ "external-body", MM_MEDIASUBTYPE_EXTERNALBODY },
+	{ "delivery-status", MM_MEDIASUBTYPE_DELIVERYSTATUS },
+	{ "disposition-notification", MM_MEDIASUBTYPE_DISPOSITIONNOTIFICATION },
+	{ "octet-stream", MM_MEDIASUBTYPE_OCTETSTREAM },
+	{ "pdf", MM_MEDIASUBTYPE_PDF },
+	{ "pkcs7-mime", MM_MEDIASUBTYPE_PKCS7MIME },
+	{ "x-pkcs7-mime", MM_MEDIASUBTYPE_PKCS7MIME },
+	{ "pkcs7-signature", MM_MEDIASUBTYPE_PKCS7SIGNATURE },
+	{ "x-pkcs7-signature", MM_MEDIASUBTYPE_PKCS7SIGNATURE },
+	{ "pgp-signature", MM_MEDIASUBTYPE_PGPSIGNATURE },
+	{ "pgp-encrypted", MM_MEDIASUBTYPE_PGPENCRYPTED },
+	{ "ms-tnef", MM_MEDIASUBTYPE_MSTNEF },
+	{ "vnd.ms-tnef", MM_MEDIASUBTYPE_MSTNEF },
+	{ "jpeg", MM_MEDIASUBTYPE_JPEG },
+	{ "pjpeg", MM_MEDIASUBTYPE_JPEG },
+	{ "png", MM_MEDIASUBTYPE_PNG },
+	{ "gif", MM_MEDIASUBTYPE_GIF },
+	{ NULL, MM_MEDIASUBTYPE_OTHER },
 };
 
 static const char *mm_composite_encodings[] = {
@@ -75,6 +126,11 @@ static const char *mm_composite_encodings[] = {
 	NULL,
 };		
 
+static int mm_content_lookuptype(const struct mm_mediatype_mappings *, 
+    const char *);
+static void mm_content_classifytype(struct mm_content *);
+static void mm_content_classifycharset(struct mm_content *);
+
 /** @{
  * @name Functions for manipulating Content-Type objects
  */
@@ -97,11 +153,21 @@ mm_content_new(void)
 	ct->maintype = NULL;
 	ct->subtype = NULL;
 
+	ct->mediatype = MM_MEDIATYPE_OTHER;
+	ct->mediasubtype = MM_MEDIASUBTYPE_OTHER;
+	ct->charsetid = MM_CHARSETID_NONE;
+
 	TAILQ_INIT(&ct->params);
+	mm_arena_init(&ct->store);
 
 	ct->encoding = MM_ENCODING_NONE;
 	ct->encstring = NULL;
 
+	ct->codec = NULL;
+	ct->codec_gen = 0;
+
+	ct->dirty = 0;
+
 	return ct;
 }
 
@@ -132,10 +198,11 @@ mm_content_free(struct mm_content *ct)
 		ct->encstring = NULL;
 	}
 
-	TAILQ_FOREACH(param, &ct->params, next) {
+	while ((param = TAILQ_FIRST(&ct->params)) != NULL) {
 		TAILQ_REMOVE(&ct->params, param, next);
 		mm_param_free(param);
 	}	
+	mm_arena_free(&ct->store);
 
 	xfree(ct);
 }
@@ -159,10 +226,54 @@ mm_content_attachparam(struct mm_content *ct, struct mm_param *param)
 	} else {
 		TAILQ_INSERT_TAIL(&ct->params, param, next);
 	}
+	param->content = ct;
+	if (ct->charsetid == MM_CHARSETID_NONE && param->name != NULL 
+	    && param->value != NULL && !strcasecmp(param->name, "charset"))
+		ct->charsetid = mm_charset_getid(param->value);
+	ct->dirty = 1;
 
 	return 0;
 }		
 
+/**
+ * Adds a parameter to a Content-Type object
+ *
+ * @param ct The target Content-Type object
+ * @param name The name of the parameter
+ * @param value The value of the parameter
+ * @return The new parameter
+ * @ingroup contenttype
+ *
+ * Like mm_content_attachparam() with a parameter from mm_param_generate(),
+ * but the parameter, its name and its value are kept in the storage of 
+ * the Content-Type instead of being allocated one by one. The parameter
+ * belongs to the Content-Type, and must not be attached to another one.
+ * When it is freed, or its name or value replaced, the memory is given
+ * back to the storage and reused for later parameters.
+ */
+struct mm_param *
+mm_content_addparam(struct mm_content *ct, const char *name, 
+    const char *value)
+{
+	struct mm_param *param;
+
+	assert(ct != NULL);
+	assert(name != NULL && value != NULL);
+
+	param = mm_arena_alloc(&ct->store, sizeof(struct mm_param));
+	param->name = mm_arena_strdup(&ct->store, name);
+	param->value = mm_arena_strdup(&ct->store, value);
+	param->decoded = NULL;
+	param->segments = NULL;
+	param->stored = MM_STORED_OBJECT | MM_STORED_NAME | MM_STORED_VALUE;
+	param->store = &ct->store;
+	param->content = NULL;
+
+	mm_content_attachparam(ct, param);
+
+	return param;
+}
+
 
 /**
  * Gets a parameter value from a Content-Type object.
@@ -230,6 +341,8 @@ mm_content_setmaintype(struct mm_content *ct, char *value, int copy)
 	} else {
 		ct->maintype = value;
 	}
+	mm_content_classifytype(ct);
+	ct->dirty = 1;
 
 	return 0;
 }
@@ -301,6 +414,8 @@ mm_content_setsubtype(struct mm_content *ct, char *value, int copy)
 	} else {
 		ct->subtype = value;
 	}
+	mm_content_classifytype(ct);
+	ct->dirty = 1;
 
 	return 0;
 }
@@ -330,15 +445,23 @@ mm_content_settype(struct mm_content *ct, const char *fmt, ...)
 		mm_error_setmsg("Invalid type specifier: %s", buf);
 		return -1;
 	}
+	if (ct->maintype != NULL)
+		xfree(ct->maintype);
 	ct->maintype = xstrdup(maint);
+	ct->dirty = 1;
 
 	subt = strsep(&parse, "");
 	if (subt == NULL) {
+		/* The main type is kept, so its ID must match it */
+		mm_content_classifytype(ct);
 		mm_errno = MM_ERROR_PARSE;
 		mm_error_setmsg("Invalid type specifier: %s", buf);
 		return -1;
 	}
+	if (ct->subtype != NULL)
+		xfree(ct->subtype);
 	ct->subtype = xstrdup(subt);
+	mm_content_classifytype(ct);
 	
 	return 0;
 }
@@ -353,16 +476,112 @@ mm_content_settype(struct mm_content *ct, const char *fmt, ...)
 int
 mm_content_iscomposite(struct mm_content *ct)
 {
-	int i;
+	assert(ct != NULL);
 
-	for (i = 0; mm_composite_maintypes[i] != NULL; i++) {
-		if (!strcasecmp(ct->maintype, mm_composite_maintypes[i])) {
-			return 1;
-		}
-	}
+	return ct->mediatype == MM_MEDIATYPE_MULTIPART 
+	    || ct->mediatype == MM_MEDIATYPE_MESSAGE;
+}
 
-	/* Not found */
-	return 0;
+/**
+ * Classifies the media type, subtype and charset of a Content-Type again
+ *
+ * @param ct A valid Content-Type object
+ * @return Nothing
+ *
+ * The media type and subtype are classified when they are set, and the
+ * charset when the charset parameter is attached or changed with 
+ * mm_param_setvalue() or mm_param_setname(). Applications which change
+ * the strings or parameters of a Content-Type directly must call this 
+ * function afterwards.
+ */
+void
+mm_content_classify(struct mm_content *ct)
+{
+	assert(ct != NULL);
+
+	mm_content_classifytype(ct);
+	mm_content_classifycharset(ct);
+}
+
+/**
+ * Notes that a parameter of a Content-Type object was changed
+ *
+ * @param ct A valid Content-Type object
+ * @return Nothing
+ *
+ * Called by mm_param_setname() and mm_param_setvalue() for parameters
+ * attached to ct, the charset is classified again.
+ */
+void
+mm_content_paramchanged(struct mm_content *ct)
+{
+	assert(ct != NULL);
+
+	mm_content_classifycharset(ct);
+	ct->dirty = 1;
+}
+
+/**
+ * Gets the media type of a Content-Type object
+ *
+ * @param ct A valid Content-Type object
+ * @return The media type, see enum mm_mediatypes
+ */
+int
+mm_content_gettypeid(struct mm_content *ct)
+{
+	assert(ct != NULL);
+
+	return ct->mediatype;
+}
+
+/**
+ * Gets the media subtype of a Content-Type object
+ *
+ * @param ct A valid Content-Type object
+ * @return The media subtype, see enum mm_mediasubtypes
+ */
+int
+mm_content_getsubtypeid(struct mm_content *ct)
+{
+	assert(ct != NULL);
+
+	return ct->mediasubtype;
+}
+
+/**
+ * Gets the charset of a Content-Type object
+ *
+ * @param ct A valid Content-Type object
+ * @return The charset, see enum mm_charset_ids
+ */
+int
+mm_content_getcharsetid(struct mm_content *ct)
+{
+	assert(ct != NULL);
+
+	return ct->charsetid;
+}
+
+/**
+ * Checks the media type and subtype of a Content-Type object
+ *
+ * @param ct A valid Content-Type object
+ * @param type A media type, see enum mm_mediatypes
+ * @param subtype A media subtype, see enum mm_mediasubtypes, or 
+ *        MM_MEDIASUBTYPE_ANY
+ * @return 1 if the Content-Type is of the given type, or 0 if not
+ *
+ * E.g. mm_content_istype(ct, MM_MEDIATYPE_TEXT, MM_MEDIASUBTYPE_HTML) is
+ * true for "text/html" only.
+ */
+int
+mm_content_istype(struct mm_content *ct, int type, int subtype)
+{
+	assert(ct != NULL);
+
+	return ct->mediatype == type 
+	    && (subtype == MM_MEDIASUBTYPE_ANY || ct->mediasubtype == subtype);
 }
 
 /**
@@ -392,34 +611,40 @@ mm_content_isvalidencoding(const char *encoding)
  *
  * @param ct A valid content type object
  * @param encoding A string representing the content encoding
- * @return 0 if successfull or -1 if not (i.e. unknown content encoding)
+ * @return 0 if successfull or 1 if the encoding is not known to MiniMIME
+ *
+ * Unknown encodings are still recorded as MM_ENCODING_UNKNOWN together with
+ * their name, so that custom codecs can be found for them. The codec for the
+ * encoding is resolved right away.
  */
 int
 mm_content_setencoding(struct mm_content *ct, const char *encoding)
 {
-	int i;
-
 	assert(ct != NULL);
 	assert(encoding != NULL);
 
-	for (i = 0; mm_content_enctypes[i].idstring != NULL; i++) {
-		if (!strcasecmp(mm_content_enctypes[i].idstring, encoding)) {
-			ct->encoding = mm_content_enctypes[i].type;
-			ct->encstring = xstrdup(encoding);
-			return 0;
-		}
+	if (ct->encstring != NULL) {
+		xfree(ct->encstring);
+		ct->encstring = NULL;
 	}
 
-	/* If we didn't find a mapping, set the encoding to unknown */
-	ct->encoding = MM_ENCODING_UNKNOWN;
-	ct->encstring = NULL;
-	return 1;
+	ct->encoding = mm_content_getencoding(ct, encoding);
+	ct->encstring = xstrdup(encoding);
+
+	ct->codec_gen = 0;
+	mm_content_getcodec(ct);
+	ct->dirty = 1;
+
+	if (ct->encoding == MM_ENCODING_UNKNOWN)
+		return 1;
+
+	return 0;
 }
 
 /**
  * Gets the numerical ID of a content encoding identifier
  *
- * @param ct A valid Content Type object
+ * @param ct A valid Content Type object (currently unused, may be NULL)
  * @param encoding A string representing the content encoding identifier
  * @return The numerical ID of the content encoding
  */ 
@@ -428,7 +653,7 @@ mm_content_getencoding(struct mm_content *ct, const char *encoding)
 {
 	int i;
 
-	assert(ct != NULL);
+	assert(encoding != NULL);
 
 	for (i = 0; mm_content_enctypes[i].idstring != NULL; i++) {
 		if (!strcasecmp(mm_content_enctypes[i].idstring, encoding)) {
@@ -440,94 +665,89 @@ mm_content_getencoding(struct mm_content *ct, const char *encoding)
 	return MM_ENCODING_UNKNOWN;
 }
 
+/**
+ * Gets the codec responsible for the encoding of a Content-Type object
+ *
+ * @param ct A valid Content-Type object
+ * @return The codec for the object's encoding or NULL if there is none
+ *
+ * The codec is looked up once and cached within the Content-Type object.
+ * The cached pointer is only looked up again when codecs were registered or
+ * unregistered in the meantime.
+ */
+struct mm_codec *
+mm_content_getcodec(struct mm_content *ct)
+{
+	extern u_int32_t codecs_generation;
+
+	assert(ct != NULL);
+
+	if (ct->codec_gen != codecs_generation) {
+		ct->codec = mm_codec_lookup(ct->encoding, ct->encstring);
+		ct->codec_gen = codecs_generation;
+	}
+
+	return ct->codec;
+}
+
 /**
  * Constructs a MIME conform string of Content-Type parameters.
  *
  * @param ct A valid Content Type object
  * @return A pointer to a string representing the Content-Type parameters
  *         in MIME terminology, or NULL if either the Content-Type object
- *         is invalid, has no parameters or no memory could be allocated.
+ *         is invalid or no memory could be allocated.
  *
  * This function constructs a MIME conform string including all the parameters
- * associated with the given Content-Type object. It should NOT be used if
- * you need an opaque copy of the current MIME part (e.g. for PGP purposes).
+ * associated with the given Content-Type object. Long parameter lists are 
+ * folded as they would be in the Content-Type header field. It should NOT be
+ * used if you need an opaque copy of the current MIME part (e.g. for PGP
+ * purposes). The result is allocated dynamically and must be freed by the
+ * caller.
  */
 char *
 mm_content_paramstostring(struct mm_content *ct)
 {
-	size_t size, new_size;
-	struct mm_param *param;
-	char *param_string, *cur_param;
+	struct mm_emitter emitter;
+	size_t start, col;
 	char *buf;
 
-	size = 1;
-	param_string = NULL;
-	cur_param = NULL;
-
-	param_string = (char *) xmalloc(size);
-	*param_string = '\0';
-
-	/* Concatenate all Content-Type parameters attached to the current
-	 * Content-Type object to a single string.
-	 */
-	TAILQ_FOREACH(param, &ct->params, next) {
-		if (asprintf(&cur_param, "; %s=\"%s\"", param->name, 
-		    param->value) == -1) {
-			goto cleanup;
-		}
+	if (ct == NULL)
+		return NULL;
 
-		new_size = size + strlen(cur_param) + 1;
-		
-		if (new_size < 0 || new_size > 1000) {
-			size = 0;
-			goto cleanup;
-		}	
-
-		buf = (char *) xrealloc(param_string, new_size);
-		if (buf == NULL) {
-			size = 0;
-			goto cleanup;
-		}
+	start = strlen("Content-Type: ") + 1;
+	if (ct->maintype != NULL && ct->subtype != NULL)
+		start += strlen(ct->maintype) + strlen(ct->subtype);
 
-		param_string = buf;
-		size = new_size;
-		strlcat(param_string, cur_param, size);
-		
-		xfree(cur_param);
-		cur_param = NULL;
-	}
+	col = start;
+	mm_emitter_count(&emitter);
+	if (mm_emit_params(&emitter, ct, &col) == -1)
+		return NULL;
 
-	return param_string;
+	buf = (char *)xmalloc(emitter.length + 1);
+	mm_emitter_buffer(&emitter, buf, emitter.length);
+	col = start;
+	mm_emit_params(&emitter, ct, &col);
+	buf[emitter.length] = '\0';
 
-cleanup:
-	if (param_string != NULL) {
-		xfree(param_string);
-		param_string = NULL;
-	}
-	if (cur_param != NULL) {
-		xfree(cur_param);
-		cur_param = NULL;
-	}	
-	return NULL;
+	return buf;
 }
 
 /**
  * Creates a Content-Type header according to the object given
  *
  * @param ct A valid Content-Type object
+ * @return The Content-Type header field, without the terminating CRLF, or
+ *         NULL if ct is incomplete
  *
+ * The header field is folded at column 78 and built with a single
+ * allocation, which must be freed by the caller.
  */
 char *
 mm_content_tostring(struct mm_content *ct)
 {
-	char *paramstring;
+	struct mm_emitter emitter;
 	char *buf;
-	char *headerstring;
-	size_t size;
-
-	paramstring = NULL;
-	headerstring = NULL;
-	buf = NULL;
 
 	if (ct == NULL) {
 		return NULL;
@@ -536,45 +756,60 @@ mm_content_tostring(struct mm_content *ct)
 		return NULL;
 	}	
 
-	size = strlen(ct->maintype) + strlen(ct->subtype) + 2;
-	headerstring = (char *)xmalloc(size);
-	snprintf(headerstring, size, "%s/%s", ct->maintype, ct->subtype);
-
-	paramstring = mm_content_paramstostring(ct);
-	if (paramstring == NULL) {
-		goto cleanup;
-	}
+	mm_emitter_count(&emitter);
+	if (mm_emit_contenttype(&emitter, ct) == -1)
+		return NULL;
 
-	size += strlen(paramstring) + strlen("Content-Type: ") + 1;
-	buf = (char *)malloc(size);
-	if (buf == NULL) {
-		goto cleanup;
-	}
+	buf = (char *)xmalloc(emitter.length + 1);
+	mm_emitter_buffer(&emitter, buf, emitter.length);
+	mm_emit_contenttype(&emitter, ct);
 
-	snprintf(buf, size, "Content-Type: %s%s", headerstring, paramstring);
+	/* Strip the CRLF ending the header field */
+	buf[emitter.length - 2] = '\0';
 
-	xfree(headerstring);
-	xfree(paramstring);
+	return buf;
+}
 
-	headerstring = NULL;
-	paramstring = NULL;
+/** @} */
 
-	return buf;
+/*
+ * Looks up the ID of a media type or subtype name
+ */
+static int
+mm_content_lookuptype(const struct mm_mediatype_mappings *map, 
+    const char *name)
+{
+	int i;
 
-cleanup:
-	if (paramstring != NULL) {
-		xfree(paramstring);
-		paramstring = NULL;
+	for (i = 0; map[i].name != NULL; i++) {
+		if (!strcasecmp(map[i].name, name))
+			return map[i].id;
 	}
-	if (headerstring != NULL) {
-		xfree(headerstring);
-		headerstring = NULL;
-	}	
-	if (buf != NULL) {
-		xfree(buf);
-		buf = NULL;
-	}	
-	return NULL;
+
+	return map[i].id;
 }
 
-/** @} */
+/*
+ * Sets the media type and subtype IDs from the strings
+ */
+static void
+mm_content_classifytype(struct mm_content *ct)
+{
+	ct->mediatype = ct->maintype != NULL ? mm_content_lookuptype(
+	    mm_content_mediatypes, ct->maintype) : MM_MEDIATYPE_OTHER;
+	ct->mediasubtype = ct->subtype != NULL ? mm_content_lookuptype(
+	    mm_content_mediasubtypes, ct->subtype) : MM_MEDIASUBTYPE_OTHER;
+}
+
+/*
+ * Sets the charset ID from the first charset parameter
+ */
+static void
+mm_content_classifycharset(struct mm_content *ct)
+{
+	const char *charset;
+
+	charset = mm_content_getparambyname(ct, "charset");
+	ct->charsetid = charset != NULL ? mm_charset_getid(charset) 
+	    : MM_CHARSETID_NONE;
+}
@@ -35,10 +35,14 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <ctype.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "mm_internal.h"
 
+static void mm_context_growindex(MM_CTX *);
+
 /** @file mm_context.c
  *
  * Modules for manipulating MiniMIME contexts
@@ -84,6 +88,17 @@ mm_context_new(void)
 
 	TAILQ_INIT(&ctx->parts);
 	SLIST_INIT(&ctx->warnings);
+	ctx->lastwarning = NULL;
+	ctx->nwarnings = 0;
+	ctx->collectwarnings = 1;
+
+	ctx->index = NULL;
+	ctx->nparts = 0;
+	ctx->index_size = 0;
+
+	ctx->source = NULL;
+	ctx->dirty = MM_DIRTY_NONE;
+	ctx->cache = NULL;
 
 	return ctx;
 }
@@ -107,11 +122,16 @@ mm_context_free(MM_CTX *ctx)
 	
 	assert(ctx != NULL);
 
-	TAILQ_FOREACH(part, &ctx->parts, next) {
+	while ((part = TAILQ_FIRST(&ctx->parts)) != NULL) {
 		TAILQ_REMOVE(&ctx->parts, part, next);
 		mm_mimepart_free(part);
 	}
 
+	if (ctx->index != NULL) {
+		xfree(ctx->index);
+		ctx->index = NULL;
+	}
+
 	if (ctx->boundary != NULL) {
 		xfree(ctx->boundary);
 		ctx->boundary = NULL;
@@ -130,6 +150,13 @@ mm_context_free(MM_CTX *ctx)
 		xfree(warning);
 		warning = NULL;
 	}
+	ctx->lastwarning = NULL;
+	ctx->nwarnings = 0;
+
+	if (ctx->source != NULL) {
+		mm_body_unref(ctx->source);
+		ctx->source = NULL;
+	}
 
 	xfree(ctx);
 	ctx = NULL;
@@ -146,19 +173,31 @@ mm_context_free(MM_CTX *ctx)
  * of the message. 
  *
  * The MIME part should be initialized before attaching it using 
- * mm_mimepart_new().
+ * mm_mimepart_new(). The first MIME part attached is the envelope, all
+ * others are nested in it (see mm_mimepart_getparent()), and must not
+ * be nested in another MIME part already.
  */
 int
 mm_context_attachpart(MM_CTX *ctx, struct mm_mimepart *part)
 {
 	assert(ctx != NULL);
 	assert(part != NULL);
+
+	if (part->parent != NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("MIME part is nested already");
+		return -1;
+	}
 	
 	if (TAILQ_EMPTY(&ctx->parts)) {
 		TAILQ_INSERT_HEAD(&ctx->parts, part, next);
 	} else {
 		TAILQ_INSERT_TAIL(&ctx->parts, part, next);
+		part->parent = ctx->index[0];
 	}
+	mm_context_growindex(ctx);
+	ctx->index[ctx->nparts++] = part;
+	ctx->dirty |= MM_DIRTY_STRUCTURE;
 
 	return 0;
 }
@@ -182,23 +221,22 @@ mm_context_attachpart(MM_CTX *ctx, struct mm_mimepart *part)
 int
 mm_context_attachpart_after(MM_CTX *ctx, struct mm_mimepart *part, int pos)
 {
-	struct mm_mimepart *p;
-	int where;
-
-	where = 0;
-	p = NULL;
-
-	TAILQ_FOREACH(part, &ctx->parts, next) {
-		if (where == pos) {
-			p = part;
-		}	
-	}
+	assert(ctx != NULL);
+	assert(part != NULL);
 
-	if (p == NULL) {
+	if (pos < 0 || pos >= ctx->nparts || part->parent != NULL) {
 		return(-1);
 	}
 
-	TAILQ_INSERT_AFTER(&ctx->parts, p, part, next);
+	TAILQ_INSERT_AFTER(&ctx->parts, ctx->index[pos], part, next);
+	part->parent = ctx->index[0];
+
+	mm_context_growindex(ctx);
+	memmove(&ctx->index[pos + 2], &ctx->index[pos + 1], 
+	    (ctx->nparts - pos - 1) * sizeof(struct mm_mimepart *));
+	ctx->index[pos + 1] = part;
+	ctx->nparts++;
+	ctx->dirty |= MM_DIRTY_STRUCTURE;
 
 	return(0);
 }
@@ -223,24 +261,32 @@ int
 mm_context_deletepart(MM_CTX *ctx, int which, int freemem)
 {
 	struct mm_mimepart *part;
-	int cur;
+	int i;
 
 	assert(ctx != NULL);
 	assert(which >= 0);
 
-	cur = 0;
+	if (which >= ctx->nparts)
+		return -1;
 
-	TAILQ_FOREACH(part, &ctx->parts, next) {
-		if (cur == which) {
-			TAILQ_REMOVE(&ctx->parts, part, next);
-			if (freemem)
-				mm_mimepart_free(part);
-			return 0;
-		}
-		cur++;
+	part = ctx->index[which];
+	TAILQ_REMOVE(&ctx->parts, part, next);
+	memmove(&ctx->index[which], &ctx->index[which + 1],
+	    (ctx->nparts - which - 1) * sizeof(struct mm_mimepart *));
+	ctx->nparts--;
+	part->parent = NULL;
+
+	/* The next part becomes the envelope, and the others nest in it */
+	if (which == 0) {
+		for (i = 0; i < ctx->nparts; i++)
+			ctx->index[i]->parent = i > 0 ? ctx->index[0] : NULL;
 	}
 
-	return -1;
+	if (freemem)
+		mm_mimepart_free(part);
+	ctx->dirty |= MM_DIRTY_STRUCTURE;
+
+	return 0;
 }
 
 /**
@@ -252,24 +298,9 @@ mm_context_deletepart(MM_CTX *ctx, int which, int freemem)
 int
 mm_context_countparts(MM_CTX *ctx)
 {
-	int count;
-	struct mm_mimepart *part;
-	
 	assert(ctx != NULL);
 
-	count = 0;
-
-	if (TAILQ_EMPTY(&ctx->parts)) {
-		return 0;
-	} else {
-		TAILQ_FOREACH(part, &ctx->parts, next) {
-			count++;
-		}
-	}
-
-	assert(count > -1);
-
-	return count;
+	return ctx->nparts;
 }
 
 /**
@@ -283,21 +314,89 @@ mm_context_countparts(MM_CTX *ctx)
 struct mm_mimepart *
 mm_context_getpart(MM_CTX *ctx, int which)
 {
-	struct mm_mimepart *part;
-	int cur;
-	
 	assert(ctx != NULL);
 
-	cur = 0;
-	
-	TAILQ_FOREACH(part, &ctx->parts, next) {
-		if (cur == which) {
-			return part;
+	if (which < 0 || which >= ctx->nparts)
+		return NULL;
+
+	return ctx->index[which];
+}
+
+/**
+ * Gets a MIME part object by its IMAP section path
+ *
+ * @param ctx The MiniMIME context
+ * @param path The section path, a list of part numbers separated by dots,
+ *        for example "1.2.3"
+ * @return The requested MIME part object on success or a NULL pointer if
+ *         there is no such part. Sets mm_errno if the path is invalid.
+ *
+ * Section paths address MIME parts as in IMAP FETCH (RFC 3501): "1" is 
+ * the first MIME part of a multipart message, or the envelope of a single
+ * part message, and "1.2" is the second part nested in the first one. 
+ * The parts of a message encapsulated in a message/rfc822 part are 
+ * numbered the same way, below the number of that part.
+ * Each number is looked up in constant time, so the lookup takes time
+ * proportional to the depth of the path, see mm_mimepart_attachchild().
+ */
+struct mm_mimepart *
+mm_context_getpartbypath(MM_CTX *ctx, const char *path)
+{
+	struct mm_mimepart *part, *root;
+	unsigned long n;
+	char *end;
+
+	assert(ctx != NULL);
+	assert(path != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+	part = NULL;
+
+	do {
+		if (!isdigit((unsigned char)*path)) {
+			mm_errno = MM_ERROR_PROGRAM;
+			mm_error_setmsg("invalid section path");
+			return NULL;
+		}
+		n = strtoul(path, &end, 10);
+		if (n == 0 || n > INT_MAX) 
+			return NULL;
+
+		if (part != NULL && part->type != NULL 
+		    && part->type->mediatype == MM_MEDIATYPE_MESSAGE
+		    && part->nchildren == 1) {
+			root = mm_mimepart_getchild(part, 0);
+			if (root->nchildren > 0)
+				part = mm_mimepart_getchild(root, n - 1);
+			else
+				part = (n == 1) ? root : NULL;
+		} else if (part != NULL) {
+			part = mm_mimepart_getchild(part, n - 1);
+		} else if (ctx->nparts > 1 
+		    || (ctx->nparts == 1 && ctx->index[0]->nchildren > 0)) {
+			/* The parts nested in the envelope follow those of
+			 * the context */
+			if (n < (unsigned long)ctx->nparts)
+				part = mm_context_getpart(ctx, n);
+			else
+				part = mm_mimepart_getchild(ctx->index[0], 
+				    n - ctx->nparts);
+		} else if (n == 1) {
+			part = mm_context_getpart(ctx, 0);
 		}
-		cur++;
+		if (part == NULL)
+			return NULL;
+
+		path = end;
+	} while (*path++ == '.');
+
+	if (*--path != '\0') {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("invalid section path");
+		return NULL;
 	}
 
-	return NULL;
+	return part;
 }
 
 /**
@@ -333,6 +432,44 @@ mm_context_haswarnings(MM_CTX *ctx)
 	}
 }
 
+/**
+ * Counts the warnings associated with a given context
+ *
+ * @param ctx A valid MiniMIME context
+ * @return The number of warnings
+ */
+int
+mm_context_countwarnings(MM_CTX *ctx)
+{
+	assert(ctx != NULL);
+
+	return ctx->nwarnings;
+}
+
+/**
+ * Turns the collection of warnings on or off
+ *
+ * @param ctx A valid MiniMIME context
+ * @param collect 0 to drop warnings, 1 to record them
+ * @return Whether warnings were recorded before
+ *
+ * Warnings are recorded by default. Applications which do not look at 
+ * them can turn them off, so that messages with problems are parsed as
+ * quickly as others. Warnings recorded already are kept.
+ */
+int
+mm_context_setwarnings(MM_CTX *ctx, int collect)
+{
+	int old;
+
+	assert(ctx != NULL);
+
+	old = ctx->collectwarnings;
+	ctx->collectwarnings = collect ? 1 : 0;
+
+	return old;
+}
+
 /**
  * Generates a generic boundary string for a given context
  *
@@ -345,7 +482,7 @@ mm_context_haswarnings(MM_CTX *ctx)
 int
 mm_context_generateboundary(MM_CTX *ctx)
 {
-	char *boundary;
+	char *boundary, *buf;
 	struct mm_mimepart *part;
 	struct mm_param *param;
 	
@@ -368,20 +505,17 @@ mm_context_generateboundary(MM_CTX *ctx)
 	if (part->type != NULL) {
 		param = mm_content_getparamobjbyname(part->type, "boundary");
 		if (param == NULL) {
-			param = mm_param_new();
-			param->name = xstrdup("boundary");
-			param->value = xstrdup(boundary);
-			mm_content_attachparam(part->type, param);
+			mm_content_addparam(part->type, "boundary", boundary);
 		} else {
-			if (param->value != NULL) {
-				xfree(param->value);
-				param->value = NULL;
-			}
-			param->value = xstrdup(boundary);
+			buf = mm_param_setvalue(param, boundary, 1);
+			if (buf != NULL)
+				xfree(buf);
 		}	
+		part->type->dirty = 1;
 	}
 
 	ctx->boundary = boundary;
+	ctx->dirty |= MM_DIRTY_STRUCTURE;
 	return(0);
 }
 
@@ -409,8 +543,12 @@ mm_context_setpreamble(MM_CTX *ctx, char *preamble)
 		}
 		ctx->preamble = NULL;
 	} else {	
+		if (ctx->preamble != NULL) {
+			xfree(ctx->preamble);
+		}
 		ctx->preamble = xstrdup(preamble);
 	}	
+	ctx->dirty |= MM_DIRTY_STRUCTURE;
 	return(0);
 }
 
@@ -423,11 +561,85 @@ mm_context_getpreamble(MM_CTX *ctx)
 	return(ctx->preamble);	
 }
 
+/**
+ * Marks the structure of a parsed message as modified
+ *
+ * @param ctx A valid MiniMIME context
+ * @param dirty What has been modified, see enum mm_dirty_flags
+ * @return Nothing
+ * @see mm_mimepart_setdirty
+ *
+ * If the source of a message is kept by the parser (MM_PARSE_KEEPSOURCE),
+ * the boundary lines, preamble and epilogue of an unmodified message are
+ * written out verbatim. Applications which change the boundary or the 
+ * preamble of the context directly must call this function with 
+ * MM_DIRTY_STRUCTURE afterwards. The MiniMIME functions which attach, delete
+ * or modify MIME parts of a context do so themselves.
+ */
+void
+mm_context_setdirty(MM_CTX *ctx, int dirty)
+{
+	assert(ctx != NULL);
+
+	ctx->dirty |= dirty;
+}
+
+/**
+ * Gets what has been modified in the structure of a parsed message
+ *
+ * @param ctx A valid MiniMIME context
+ * @return The modifications, see enum mm_dirty_flags
+ */
+int
+mm_context_getdirty(MM_CTX *ctx)
+{
+	assert(ctx != NULL);
+
+	return ctx->dirty;
+}
+
+/**
+ * Sets the encoded payload cache of a context
+ *
+ * @param ctx A valid MiniMIME context
+ * @param cache The cache to use, or NULL to not use one
+ * @return Nothing
+ * @see mm_cache_new
+ *
+ * Bodies of MIME parts flagged with MM_MIMEPART_ENCODE, and bodies stored
+ * in files which fit the budget of the cache, are taken from the cache 
+ * when the context is flattened or written, and encoded and stored in it 
+ * if they are not found. The same cache may be used by any number of
+ * contexts, and must not be freed before them.
+ */
+void
+mm_context_setcache(MM_CTX *ctx, struct mm_cache *cache)
+{
+	assert(ctx != NULL);
+
+	ctx->cache = cache;
+}
+
+/**
+ * Gets the encoded payload cache of a context
+ *
+ * @param ctx A valid MiniMIME context
+ * @return The cache or NULL if the context has none
+ */
+struct mm_cache *
+mm_context_getcache(MM_CTX *ctx)
+{
+	assert(ctx != NULL);
+
+	return ctx->cache;
+}
+
 /**
  * Creates an ASCII message of the specified context
  *
  * @param ctx A valid MiniMIME context object
  * @param flat Where to store the message
+ * @param length Where to store the length of the message
  * @param flags Flags that affect the flattening process
  *
  * This function ``flattens'' a MiniMIME context, that is, it creates an ASCII
@@ -438,167 +650,152 @@ mm_context_getpreamble(MM_CTX *ctx)
  * - MM_FLATTEN_SKIPENVELOPE : do not flatten the envelope part
  *
  * Great care is taken to not produce invalid MIME output.
+ *
+ * The message is created in two passes: the first one computes the exact
+ * size of the message, the second one writes it into a single allocation.
+ * The message is NUL-terminated, length does not include the NUL byte.
  */
 int
 mm_context_flatten(MM_CTX *ctx, char **flat, size_t *length, int flags)
 {
-	struct mm_mimepart *part;
+	struct mm_emitter emitter;
 	char *message;
-	char *flatpart;
-	char *buf;
-	char *envelope_headers;
 	size_t message_size;
-	size_t tmp_size;
-	char envelope;
 
 	mm_errno = MM_ERROR_NONE;
-	envelope = 1;
 
-	message = NULL;
-	message_size = 0;
+	*flat = NULL;
+	*length = 0;
 
-	if (ctx->boundary == NULL) {
-		if (mm_context_iscomposite(ctx)) {
-			mm_context_generateboundary(ctx);
-		}
-	}
+	if (mm_emit_prepare(ctx, flags) == -1)
+		return -1;
 
-	TAILQ_FOREACH(part, &ctx->parts, next) {
-		if (envelope) {
-			if (flags & MM_FLATTEN_SKIPENVELOPE) {
-				envelope = 0;
-				if ((message = (char *) malloc(1)) == NULL) {
-					mm_errno = MM_ERROR_ERRNO;
-					goto cleanup;
-				}
-				*message = '\0';
-				continue;
-			}
-	
-			if (part->type == NULL && mm_context_countparts(ctx) > 1) {
-				if (mm_mimepart_setdefaultcontenttype(part, 1) 
-				    == -1) {
-					goto cleanup;
-				}	
-				if (mm_context_generateboundary(ctx) == -1) {
-					goto cleanup;
-				}	
-				ctx->messagetype = MM_MSGTYPE_MULTIPART;
-			}
-			
-			if (mm_envelope_getheaders(ctx, &envelope_headers,
-			    &tmp_size) == -1) {
-			    	return -1;
-			}
-			
-			message = envelope_headers;
-			message_size = tmp_size;
-			envelope = 0;
-
-			if (ctx->preamble != NULL 
-			    && mm_context_iscomposite(ctx) 
-			    && !(flags & MM_FLATTEN_NOPREAMBLE)) {
-				tmp_size += strlen(ctx->preamble) 
-				    + (strlen("\r\n") * 2);
-				buf = (char *)xrealloc(message, tmp_size);
-				if (buf == NULL) {
-					goto cleanup;
-				}
-				message_size += tmp_size;
-				message = buf;
-				strlcat(message, "\r\n", message_size);
-				strlcat(message, ctx->preamble, message_size);
-				strlcat(message, "\r\n", message_size);
-			}
-		} else {
-			/* Enforce Content-Type if none exist */
-			if (part->type == NULL) {
-				if (mm_mimepart_setdefaultcontenttype(part, 0) 
-				    == -1) {
-					goto cleanup;
-				}	
-			}
-
-			/* Append a boundary if necessary */
-			if (ctx->boundary != NULL) {
-				tmp_size = strlen(ctx->boundary) + 
-				    (strlen("\r\n") * 2) + strlen("--");
-
-				if (tmp_size < 1) {
-					return(-1);
-				}	
-				if (message_size + tmp_size < 1) {
-					return(-1);
-				}
-
-				buf = (char *)xrealloc(message, message_size
-				    + tmp_size);
-				if (buf == NULL) {
-					goto cleanup;
-				}
-				message_size += tmp_size;
-				message = buf;
-				strlcat(message, "\r\n", message_size);
-				strlcat(message, "--", message_size);
-				strlcat(message, ctx->boundary, message_size);
-				strlcat(message, "\r\n", message_size);
-			}
-
-			if (mm_mimepart_flatten(part, &flatpart, &tmp_size, 
-			    (flags & MM_FLATTEN_OPAQUE)) == -1) {
-				goto cleanup;
-			}
-			
-			if (tmp_size < 1) {
-				goto cleanup;
-			}
-			
-			buf = (char *) xrealloc(message, message_size 
-			    + tmp_size);
-			if (buf == NULL) {
-				goto cleanup;
-			}
-			
-			message_size += tmp_size;
-			message = buf;
-			
-			strlcat(message, flatpart, message_size);
-			xfree(flatpart);
-			flatpart = NULL;
-		}	
-	}
-	
-	/* Append end boundary */
-	if (ctx->boundary != NULL && mm_context_iscomposite(ctx)) {
-		tmp_size = strlen(ctx->boundary) + (strlen("\r\n") * 2) 
-		    + (strlen("--") * 2);
-		buf = (char *)xrealloc(message, message_size + tmp_size);
-		if (buf == NULL) {
-			goto cleanup;
-		}
-		
-		message_size += tmp_size;
-		message = buf;
-		if (message[strlen(message)-1] != 13)
-			strlcat(message, "\r", message_size);
-		strlcat(message, "\n", message_size);
-		strlcat(message, "--", message_size);
-		strlcat(message, ctx->boundary, message_size);
-		strlcat(message, "--", message_size);
-		strlcat(message, "\r\n", message_size);
+	mm_emitter_count(&emitter);
+	if (mm_emit_context(&emitter, ctx, flags) == -1)
+		return -1;
+	message_size = emitter.length;
+
+	message = (char *)xmalloc(message_size + 1);
+	mm_emitter_buffer(&emitter, message, message_size);
+	if (mm_emit_context(&emitter, ctx, flags) == -1) {
+		xfree(message);
+		return -1;
 	}
+	message[emitter.length] = '\0';
 
 	*flat = message;
-	*length = message_size;
+	*length = emitter.length;
 
 	return 0;
+}
 
-cleanup:
-	if (message != NULL) {
-		xfree(message);
-		message = NULL;
-	}	
-	return -1;
+/**
+ * Writes the message of the specified context to a file descriptor
+ *
+ * @param ctx A valid MiniMIME context object
+ * @param fd The file descriptor to write to
+ * @param flags Flags that affect the flattening process
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on error
+ * @see mm_context_flatten
+ *
+ * This function writes the same message that mm_context_flatten() would
+ * create to fd. It does not build the message in memory. Instead, it
+ * collects pointers to the header fields, boundary lines and bodies of the
+ * context and writes them with writev(2). The flags are the same as for
+ * mm_context_flatten().
+ */
+int
+mm_context_write_fd(MM_CTX *ctx, int fd, int flags)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (mm_emit_prepare(ctx, flags) == -1)
+		return -1;
+
+	mm_emitter_writev(&emitter, fd);
+	ret = mm_emit_context(&emitter, ctx, flags);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return ret;
+}
+
+/**
+ * Writes the message of the specified context to a sink
+ *
+ * @param ctx A valid MiniMIME context object
+ * @param sink The sink to write to
+ * @param flags Flags that affect the flattening process
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on error
+ * @see mm_context_flatten
+ * @see mm_sink_file
+ * @see mm_sink_fd
+ * @see mm_sink_buffer
+ *
+ * This function writes the same message that mm_context_flatten() would
+ * create to the given sink, envelope, preamble, boundaries and parts one
+ * after the other. The data is passed to the sink in pieces through a 
+ * staging buffer of fixed size, and bodies of MIME parts flagged with 
+ * MM_MIMEPART_ENCODE are encoded on the fly, so the memory used does not 
+ * depend on the size of the message. The flags are the same as for
+ * mm_context_flatten().
+ */
+int
+mm_context_write(MM_CTX *ctx, struct mm_sink *sink, int flags)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	assert(ctx != NULL);
+	assert(sink != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (mm_emit_prepare(ctx, flags) == -1)
+		return -1;
+
+	mm_emitter_sink(&emitter, sink);
+	ret = mm_emit_context(&emitter, ctx, flags);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return ret;
 }
 
 /** @} */
+
+/*
+ * Gets the MIME part following part among those nested in the envelope of
+ * a context: the other parts of the context, and then the parts nested in
+ * the envelope with mm_mimepart_attachchild(). Starts with the first of
+ * them when part is the envelope.
+ */
+struct mm_mimepart *
+mm_context_nextpart(MM_CTX *ctx, struct mm_mimepart *part)
+{
+	if (part == TAILQ_LAST(&ctx->parts, mm_mimeparts))
+		return TAILQ_FIRST(&TAILQ_FIRST(&ctx->parts)->children);
+
+	return TAILQ_NEXT(part, next);
+}
+
+/*
+ * Makes room for one more MIME part in the part index of a context
+ */
+static void
+mm_context_growindex(MM_CTX *ctx)
+{
+	if (ctx->nparts < ctx->index_size)
+		return;
+
+	ctx->index_size = ctx->index_size ? ctx->index_size * 2 : 8;
+	ctx->index = (struct mm_mimepart **)xrealloc(ctx->index, 
+	    ctx->index_size * sizeof(struct mm_mimepart *));
+}
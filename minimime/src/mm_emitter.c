@@ -0,0 +1,1438 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_emitter.c
+ *
+ * This module serializes MiniMIME objects through an emitter, which either
+ * counts the bytes it is handed, stores them in a buffer, collects them
+ * for writev(2) or passes them on to a sink through a fixed-size staging
+ * buffer. Flattening is done in two passes with the same code: the first
+ * pass computes the exact size of the output, the second one writes it
+ * into a single allocation.
+ *
+ * The mm_emit functions mostly hand out pointers to memory that lives as
+ * long as the objects being serialized (header fields, bodies, the
+ * boundary) or to string constants, so emitters may keep those pointers
+ * around instead of copying the data. Bodies which are encoded while they
+ * are written go through a reused work buffer instead, and are handed out
+ * with mm_emit_transient().
+ *
+ * If the parser kept the source of a message, everything which has not
+ * been modified since is emitted as a reference into the source instead of
+ * being regenerated: whole header sections (followed by any header fields
+ * appended since), bodies, and if the structure of the message is 
+ * unchanged, the preamble, boundary lines and epilogue.
+ */
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/* Size of the staging buffer of sink emitters */
+#define MM_EMITTER_BUFSIZE 8192
+
+/* Generated header fields are folded before they exceed this column */
+#define MM_EMITTER_FOLDCOL 78
+
+/* Header fields kept apart from those attached to a MIME part */
+enum mm_emit_fields
+{
+	MM_EMIT_CONTENTTYPE = 1,
+	MM_EMIT_ENCODING = 2,
+	MM_EMIT_DISPOSITION = 4,
+	MM_EMIT_MIMEVERSION = 8
+};
+
+static int mm_emitter_docount(struct mm_emitter *, const char *, size_t);
+static int mm_emitter_dobuffer(struct mm_emitter *, const char *, size_t);
+static int mm_emitter_dowritev(struct mm_emitter *, const char *, size_t);
+static int mm_emitter_dosink(struct mm_emitter *, const char *, size_t);
+static int mm_emit_bodydata(struct mm_emitter *, struct mm_mimepart *, int);
+static int mm_emit_cached(struct mm_emitter *, struct mm_mimepart *,
+    struct mm_codec *);
+static int mm_emit_file(struct mm_emitter *, struct mm_mimepart *,
+    struct mm_codec *);
+static int mm_emit_fold(struct mm_emitter *, size_t *, size_t);
+static int mm_emit_extvalue(struct mm_emitter *, const char *);
+static int mm_emit_quotedpairs(struct mm_emitter *, const char *);
+static int mm_emit_fields(struct mm_emitter *, struct mm_mimepart *, int *);
+static int mm_emit_srcfields(struct mm_emitter *, struct mm_mimepart *, 
+    size_t, size_t, int *);
+static int mm_emit_hasrawheaders(struct mm_mimepart *);
+static int mm_emit_hasrawstructure(MM_CTX *, int);
+static int mm_emit_hasrawchildren(struct mm_mimepart *);
+static int mm_emit_rawchildren(struct mm_emitter *, struct mm_mimepart *,
+    int);
+static int mm_emit_children(struct mm_emitter *, struct mm_mimepart *, int);
+static int mm_emit_preparenested(struct mm_mimepart *);
+static int mm_emit_ismessage(struct mm_mimepart *);
+
+/*
+ * Percent escapes of all bytes, for mm_emit_extvalue(). The emitter may
+ * keep pointers to what it is given, so escapes are not built on the stack.
+ */
+static const char mm_emit_escapes[] =
+	"%00%01%02%03%04%05%06%07%08%09%0A%0B%0C%0D%0E%0F"
+	"%10%11%12%13%14%15%16%17%18%19%1A%1B%1C%1D%1E%1F"
+	"%20%21%22%23%24%25%26%27%28%29%2A%2B%2C%2D%2E%2F"
+	"%30%31%32%33%34%35%36%37%38%39%3A%3B%3C%3D%3E%3F"
+	"%40%41%42%43%44%45%46%47%48%49%4A%4B%4C%4D%4E%4F"
+	"%50%51%52%53%54%55%56%57%58%59%5A%5B%5C%5D%5E%5F"
+	"%60%61%62%63%64%65%66%67%68%69%6A%6B%6C%6D%6E%6F"
+	"%70%71%72%73%74%75%76%77%78%79%7A%7B%7C%7D%7E%7F"
+	"%80%81%82%83%84%85%86%87%88%89%8A%8B%8C%8D%8E%8F"
+	"%90%91%92%93%94%95%96%97%98%99%9A%9B%9C%9D%9E%9F"
+	"%A0%A1%A2%A3%A4%A5%A6%A7%A8%A9%AA%AB%AC%AD%AE%AF"
+	"%B0%B1%B2%B3%B4%B5%B6%B7%B8%B9%BA%BB%BC%BD%BE%BF"
+	"%C0%C1%C2%C3%C4%C5%C6%C7%C8%C9%CA%CB%CC%CD%CE%CF"
+	"%D0%D1%D2%D3%D4%D5%D6%D7%D8%D9%DA%DB%DC%DD%DE%DF"
+	"%E0%E1%E2%E3%E4%E5%E6%E7%E8%E9%EA%EB%EC%ED%EE%EF"
+	"%F0%F1%F2%F3%F4%F5%F6%F7%F8%F9%FA%FB%FC%FD%FE%FF";
+
+/*
+ * Initializes an emitter which only counts the bytes emitted
+ */
+void
+mm_emitter_count(struct mm_emitter *emitter)
+{
+	assert(emitter != NULL);
+
+	emitter->emit = mm_emitter_docount;
+	emitter->length = 0;
+	emitter->buf = NULL;
+	emitter->size = 0;
+	emitter->iov = NULL;
+	emitter->iovcnt = 0;
+	emitter->sink = NULL;
+	emitter->fill = 0;
+	emitter->cache = NULL;
+	emitter->mark = NULL;
+	emitter->arg = NULL;
+}
+
+/*
+ * Initializes an emitter which stores the bytes emitted in buf, which is
+ * size bytes large.
+ */
+void
+mm_emitter_buffer(struct mm_emitter *emitter, char *buf, size_t size)
+{
+	assert(emitter != NULL);
+
+	emitter->emit = mm_emitter_dobuffer;
+	emitter->length = 0;
+	emitter->buf = buf;
+	emitter->size = size;
+	emitter->iov = NULL;
+	emitter->iovcnt = 0;
+	emitter->sink = NULL;
+	emitter->fill = 0;
+	emitter->cache = NULL;
+	emitter->mark = NULL;
+	emitter->arg = NULL;
+}
+
+/*
+ * Initializes an emitter which writes the bytes emitted to fd with
+ * writev(2), IOV_MAX pieces at a time. The data is not copied. Call 
+ * mm_emitter_flush() to write out the remaining pieces and 
+ * mm_emitter_close() to release the emitter.
+ */
+int
+mm_emitter_writev(struct mm_emitter *emitter, int fd)
+{
+	assert(emitter != NULL);
+
+	emitter->emit = mm_emitter_dowritev;
+	emitter->length = 0;
+	emitter->buf = NULL;
+	emitter->size = 0;
+	emitter->fd = fd;
+	emitter->iov = (struct iovec *)xmalloc(IOV_MAX * sizeof(struct iovec));
+	emitter->iovcnt = 0;
+	emitter->sink = NULL;
+	emitter->fill = 0;
+	emitter->cache = NULL;
+	emitter->mark = NULL;
+	emitter->arg = NULL;
+
+	return 0;
+}
+
+/*
+ * Initializes an emitter which passes the bytes emitted on to sink. Small
+ * pieces are collected in a staging buffer of MM_EMITTER_BUFSIZE bytes,
+ * so the memory used does not depend on the size of the output. Call
+ * mm_emitter_flush() to write out the staged data and mm_emitter_close()
+ * to release the emitter.
+ */
+void
+mm_emitter_sink(struct mm_emitter *emitter, struct mm_sink *sink)
+{
+	assert(emitter != NULL);
+	assert(sink != NULL && sink->write != NULL);
+
+	emitter->emit = mm_emitter_dosink;
+	emitter->length = 0;
+	emitter->buf = (char *)xmalloc(MM_EMITTER_BUFSIZE);
+	emitter->size = MM_EMITTER_BUFSIZE;
+	emitter->iov = NULL;
+	emitter->iovcnt = 0;
+	emitter->sink = sink;
+	emitter->fill = 0;
+	emitter->cache = NULL;
+	emitter->mark = NULL;
+	emitter->arg = NULL;
+}
+
+/*
+ * Writes out all pieces collected by a writev emitter, or the data staged
+ * by a sink emitter
+ */
+int
+mm_emitter_flush(struct mm_emitter *emitter)
+{
+	struct iovec *iov;
+	ssize_t n;
+	int iovcnt;
+
+	if (emitter->sink != NULL) {
+		if (emitter->fill > 0 && emitter->sink->write(emitter->sink,
+		    emitter->buf, emitter->fill) == -1)
+			return -1;
+		emitter->fill = 0;
+		return 0;
+	}
+
+	iov = emitter->iov;
+	iovcnt = emitter->iovcnt;
+
+	while (iovcnt > 0) {
+		n = writev(emitter->fd, iov, iovcnt);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			mm_errno = MM_ERROR_ERRNO;
+			return -1;
+		}
+
+		/* Skip what has been written, a piece may be partially
+		 * written.
+		 */
+		while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	emitter->iovcnt = 0;
+
+	return 0;
+}
+
+/*
+ * Releases the resources held by an emitter
+ */
+void
+mm_emitter_close(struct mm_emitter *emitter)
+{
+	if (emitter->iov != NULL) {
+		xfree(emitter->iov);
+		emitter->iov = NULL;
+	}
+	emitter->iovcnt = 0;
+
+	if (emitter->sink != NULL) {
+		xfree(emitter->buf);
+		emitter->buf = NULL;
+		emitter->sink = NULL;
+	}
+	emitter->fill = 0;
+}
+
+/*
+ * Emits len bytes of data
+ */
+int
+mm_emit(struct mm_emitter *emitter, const char *data, size_t len)
+{
+	return emitter->emit(emitter, data, len);
+}
+
+/*
+ * Emits len bytes of data from a buffer which is reused once this function
+ * returns. Writev emitters, which keep pointers to the data, write it out
+ * right away.
+ */
+int
+mm_emit_transient(struct mm_emitter *emitter, const char *data, size_t len)
+{
+	if (emitter->emit(emitter, data, len) == -1)
+		return -1;
+
+	if (emitter->iov != NULL)
+		return mm_emitter_flush(emitter);
+
+	return 0;
+}
+
+/*
+ * Emits a NUL-terminated string
+ */
+int
+mm_emit_string(struct mm_emitter *emitter, const char *s)
+{
+	return emitter->emit(emitter, s, strlen(s));
+}
+
+/*
+ * Emits the value of a header field, which starts at column *col. Lines
+ * are folded at the whitespace before words which would end past column
+ * MM_EMITTER_FOLDCOL, so unfolding gives back the original value. Words 
+ * longer than a line are not broken up, and line breaks already present
+ * in the value are kept.
+ */
+int
+mm_emit_value(struct mm_emitter *emitter, size_t *col, const char *value)
+{
+	const char *word, *end;
+	int newline;
+
+	word = value;
+	while (*word != '\0') {
+		end = word;
+		while (*end == ' ' || *end == '\t')
+			end++;
+		while (*end != '\0' && *end != ' ' && *end != '\t' 
+		    && *end != '\n')
+			end++;
+		newline = (*end == '\n');
+		if (newline)
+			end++;
+
+		if (word != value && !newline && end[-1] != ' ' 
+		    && end[-1] != '\t' && (*word == ' ' || *word == '\t')
+		    && mm_emit_fold(emitter, col, end - word) == -1)
+			return -1;
+		if (mm_emit(emitter, word, end - word) == -1)
+			return -1;
+
+		*col = newline ? 0 : *col + (end - word);
+		word = end;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits a header field of the form "name: value\r\n", folded as needed
+ */
+int
+mm_emit_header(struct mm_emitter *emitter, const char *name, 
+    const char *value)
+{
+	size_t col;
+
+	col = strlen(name) + 2;
+	if (mm_emit(emitter, name, col - 2) == -1
+	    || mm_emit(emitter, ": ", 2) == -1
+	    || mm_emit_value(emitter, &col, value) == -1
+	    || mm_emit(emitter, "\r\n", 2) == -1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Emits the parameters of ct as "; name=\"value\"" each, starting at
+ * column *col, with quotes and backslashes in the value escaped as quoted
+ * pairs. Lines are folded between parameters. Values which can't be
+ * sent as quoted string, e.g. reassembled RFC 2231 values, are emitted as
+ * "; name*=utf-8''value" with percent escapes.
+ */
+int
+mm_emit_params(struct mm_emitter *emitter, struct mm_content *ct, 
+    size_t *col)
+{
+	struct mm_param *param;
+	size_t namelen, valuelen;
+
+	TAILQ_FOREACH(param, &ct->params, next) {
+		namelen = strlen(param->name);
+		valuelen = mm_rfc2231_encodedlength(param->value);
+
+		if (mm_emit(emitter, ";", 1) == -1)
+			return -1;
+		*col += 1;
+		if (valuelen > 0) {
+			if (mm_emit_fold(emitter, col, namelen + valuelen + 3)
+			    == -1
+			    || mm_emit(emitter, " ", 1) == -1
+			    || mm_emit(emitter, param->name, namelen) == -1
+			    || mm_emit(emitter, "*=", 2) == -1
+			    || mm_emit_extvalue(emitter, param->value) == -1)
+				return -1;
+			*col += namelen + valuelen + 3;
+			continue;
+		}
+
+		valuelen = strlen(param->value) 
+		    + mm_emit_quotedpairs(NULL, param->value);
+		if (mm_emit_fold(emitter, col, namelen + valuelen + 4) == -1
+		    || mm_emit(emitter, " ", 1) == -1
+		    || mm_emit(emitter, param->name, namelen) == -1
+		    || mm_emit(emitter, "=\"", 2) == -1
+		    || mm_emit_quotedpairs(emitter, param->value) == -1
+		    || mm_emit(emitter, "\"", 1) == -1)
+			return -1;
+		*col += namelen + valuelen + 4;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits the Content-Type header field of ct, including its parameters.
+ * Nothing is emitted if ct is incomplete.
+ */
+int
+mm_emit_contenttype(struct mm_emitter *emitter, struct mm_content *ct)
+{
+	size_t col;
+
+	if (ct->maintype == NULL || ct->subtype == NULL)
+		return 0;
+
+	col = strlen(ct->maintype) + strlen(ct->subtype) + 15;
+	if (mm_emit(emitter, "Content-Type: ", 14) == -1
+	    || mm_emit_string(emitter, ct->maintype) == -1
+	    || mm_emit(emitter, "/", 1) == -1
+	    || mm_emit_string(emitter, ct->subtype) == -1
+	    || mm_emit_params(emitter, ct, &col) == -1)
+		return -1;
+
+	return mm_emit(emitter, "\r\n", 2);
+}
+
+/*
+ * Emits the header fields of a MIME part: all headers attached to it,
+ * followed by Content-Type and Content-Transfer-Encoding. Fields of parsed
+ * parts which have not been modified are emitted from the source, 
+ * including Content-Disposition and MIME-Version. The empty line 
+ * separating headers and body is not emitted.
+ */
+int
+mm_emit_headers(struct mm_emitter *emitter, struct mm_mimepart *part)
+{
+	return mm_emit_fields(emitter, part, NULL);
+}
+
+/*
+ * Emits the header section of a MIME part, including the empty line which
+ * ends it. Envelopes get a MIME-Version header field if they need one.
+ * Header sections which are unmodified in the source are emitted from 
+ * there, followed by the header fields appended since. Otherwise only the
+ * fields which have been modified are generated, see mm_emit_fields().
+ */
+int
+mm_emit_headersection(struct mm_emitter *emitter, struct mm_mimepart *part,
+    int envelope)
+{
+	struct mm_mimeheader *hdr;
+	const char *src;
+	size_t blank;
+	int fields;
+
+	if (emitter->mark != NULL)
+		emitter->mark(emitter, part, MM_EMIT_HEADERS);
+
+	if (mm_emit_hasrawheaders(part)) {
+		src = part->source->data + part->src_offset;
+		blank = (part->src_hdrlen >= 2 
+		    && src[part->src_hdrlen - 2] == '\r') ? 2 : 1;
+
+		if (mm_emit(emitter, src, part->src_hdrlen - blank) == -1)
+			return -1;
+		TAILQ_FOREACH(hdr, &part->headers, next) {
+			if (hdr->src_length == 0 && mm_emit_header(emitter, 
+			    hdr->name, hdr->value) == -1)
+				return -1;
+		}
+		return mm_emit(emitter, src + part->src_hdrlen - blank, blank);
+	}
+
+	if (mm_emit_fields(emitter, part, &fields) == -1)
+		return -1;
+	if (envelope && part->type != NULL 
+	    && !(fields & MM_EMIT_MIMEVERSION)
+	    && mm_mimepart_getheaderbyname(part, "MIME-Version", 0) == NULL
+	    && mm_emit_header(emitter, "MIME-Version", "1.0") == -1)
+		return -1;
+
+	/* The empty line keeps the line break of the source */
+	if (part->source != NULL && part->src_hdrlen > 0
+	    && part->src_offset + part->src_hdrlen <= part->source->length) {
+		src = part->source->data + part->src_offset;
+		blank = (part->src_hdrlen >= 2 
+		    && src[part->src_hdrlen - 2] == '\r') ? 2 : 1;
+		return mm_emit(emitter, src + part->src_hdrlen - blank, blank);
+	}
+
+	return mm_emit(emitter, "\r\n", 2);
+}
+
+/*
+ * Emits the body of a MIME part. Bodies of parts flagged with 
+ * MM_MIMEPART_ENCODE and bodies stored in files are encoded according to
+ * the part's Content-Transfer-Encoding, a chunk of MM_EMITTER_CHUNKSIZE 
+ * bytes at a time if the codec has a streaming kernel. If the context has
+ * an encoded payload cache, bodies are encoded through it instead, and 
+ * emitted from there, except for bodies in files larger than its budget.
+ * Bodies the mark function of the emitter asks for as is are not encoded.
+ */
+int
+mm_emit_body(struct mm_emitter *emitter, struct mm_mimepart *part)
+{
+	int raw;
+
+	raw = 0;
+	if (emitter->mark != NULL)
+		raw = emitter->mark(emitter, part, MM_EMIT_BODY);
+
+	if (mm_emit_bodydata(emitter, part, raw) == -1)
+		return -1;
+
+	if (emitter->mark != NULL)
+		emitter->mark(emitter, part, MM_EMIT_BODYEND);
+
+	return 0;
+}
+
+/*
+ * Counts the bytes mm_emit_body() emits for the body of a MIME part, i.e.
+ * the size of the body once encoded. Fails if the body is stored in a file
+ * which cannot be read.
+ */
+int
+mm_emit_bodysize(struct mm_mimepart *part, size_t *size)
+{
+	struct mm_emitter emitter;
+
+	mm_emitter_count(&emitter);
+	if (mm_emit_body(&emitter, part) == -1)
+		return -1;
+	*size = emitter.length;
+
+	return 0;
+}
+
+/*
+ * Initializes the state for encoding data passed in pieces with the 
+ * streaming kernel of codec
+ */
+void
+mm_emitter_encoder_init(struct mm_emitter_encoder *enc, 
+    struct mm_codec *codec)
+{
+	assert(codec != NULL && codec->encode_chunk != NULL);
+
+	enc->codec = codec;
+	enc->have = 0;
+	enc->col = 0;
+}
+
+/*
+ * Encodes a piece of data and emits the result. The codec may leave some
+ * bytes of each piece, which are encoded with the next one. The last piece
+ * of the data, which may be empty, is passed with final set.
+ */
+int
+mm_emit_encode(struct mm_emitter *emitter, struct mm_emitter_encoder *enc,
+    const char *data, size_t len, int final)
+{
+	char out[MM_EMITTER_CHUNKSIZE];
+	size_t n, done, consumed, written;
+	int last;
+
+	do {
+		n = sizeof(enc->in) - enc->have;
+		if (n > len)
+			n = len;
+		if (n > 0) {
+			memcpy(enc->in + enc->have, data, n);
+			enc->have += n;
+			data += n;
+			len -= n;
+		}
+		last = final && len == 0;
+
+		done = 0;
+		while (done < enc->have) {
+			enc->codec->encode_chunk(enc->in + done, 
+			    enc->have - done, last, out, sizeof(out), 
+			    &enc->col, &consumed, &written);
+			if (mm_emit_transient(emitter, out, written) == -1)
+				return -1;
+			done += consumed;
+			if (consumed > 0 || written > 0)
+				continue;
+
+			/* The codec waits for more data. If what is left 
+			 * fills the buffer, e.g. a long run of whitespace, it
+			 * is encoded as if the data ended here. */
+			if (last || done > 0)
+				break;
+			if (enc->have < sizeof(enc->in))
+				break;
+			last = 1;
+		}
+
+		memmove(enc->in, enc->in + done, enc->have - done);
+		enc->have -= done;
+	} while (len > 0);
+
+	return 0;
+}
+
+/*
+ * Emits the data of a body for mm_emit_body(), as is if raw is set
+ */
+static int
+mm_emit_bodydata(struct mm_emitter *emitter, struct mm_mimepart *part, 
+    int raw)
+{
+	struct mm_codec *codec;
+	char chunk[MM_EMITTER_CHUNKSIZE];
+	char *encoded;
+	size_t offset, consumed, written;
+	int col, ret;
+
+	if (MM_MIMEPART_HASFILE(part)) {
+		codec = NULL;
+		if (part->type != NULL && !raw)
+			codec = mm_content_getcodec(part->type);
+		if (codec != NULL && emitter->cache != NULL
+		    && part->length <= emitter->cache->budget)
+			return mm_emit_cached(emitter, part, codec);
+		return mm_emit_file(emitter, part, codec);
+	}
+
+	if (part->body == NULL)
+		return 0;
+
+	if (raw)
+		return mm_emit(emitter, part->body, part->length);
+
+	if (part->source != NULL && !(part->dirty & MM_DIRTY_BODY)
+	    && !(part->flags & MM_MIMEPART_ENCODE)
+	    && part->src_offset + part->src_length <= part->source->length) {
+		return mm_emit(emitter, part->source->data + part->src_offset
+		    + part->src_hdrlen, part->src_length - part->src_hdrlen);
+	}
+
+	codec = NULL;
+	if ((part->flags & MM_MIMEPART_ENCODE) && part->type != NULL)
+		codec = mm_content_getcodec(part->type);
+
+	if (codec != NULL && emitter->cache != NULL)
+		return mm_emit_cached(emitter, part, codec);
+
+	if (codec != NULL && codec->encode_chunk != NULL) {
+		col = 0;
+		offset = 0;
+		do {
+			codec->encode_chunk(part->body + offset, 
+			    part->length - offset, 1, chunk, sizeof(chunk),
+			    &col, &consumed, &written);
+			if (mm_emit_transient(emitter, chunk, written) == -1)
+				return -1;
+			offset += consumed;
+		} while (offset < part->length);
+
+		return 0;
+	}
+
+	if (codec != NULL && codec->encoder != NULL) {
+		encoded = codec->encoder(part->body, part->length);
+		if (encoded == NULL) {
+			mm_errno = MM_ERROR_CODEC;
+			mm_error_setmsg("could not encode MIME part");
+			return -1;
+		}
+		ret = mm_emit_transient(emitter, encoded, strlen(encoded));
+		xfree(encoded);
+		return ret;
+	}
+
+	return mm_emit(emitter, part->body, part->length);
+}
+
+/*
+ * Emits the body of a MIME part encoded through the encoded payload cache.
+ * The part keeps a reference to the cached form while it is used.
+ */
+static int
+mm_emit_cached(struct mm_emitter *emitter, struct mm_mimepart *part,
+    struct mm_codec *codec)
+{
+	if (part->encoded == NULL || part->encoded_codec != codec) {
+		if (part->encoded != NULL)
+			mm_body_unref(part->encoded);
+		part->encoded = mm_cache_encode(emitter->cache, part, codec);
+		part->encoded_codec = codec;
+		if (part->encoded == NULL)
+			return -1;
+	}
+
+	return mm_emit(emitter, part->encoded->data, part->encoded->length);
+}
+
+/*
+ * Emits a body stored in a file, reading and encoding it a chunk at a time.
+ * Codecs without a streaming kernel get the whole body at once.
+ */
+static int
+mm_emit_file(struct mm_emitter *emitter, struct mm_mimepart *part,
+    struct mm_codec *codec)
+{
+	char in[MM_EMITTER_CHUNKSIZE], out[MM_EMITTER_CHUNKSIZE];
+	char *data, *encoded;
+	size_t pos, have, done, n, consumed, written;
+	int fd, col, final, ret;
+
+	if ((fd = mm_mimepart_openbody(part)) == -1)
+		return -1;
+
+	if (codec != NULL && codec->encode_chunk == NULL 
+	    && codec->encoder != NULL) {
+		data = (char *)xmalloc(part->length + 1);
+		ret = mm_mimepart_readbody(part, fd, 0, data, part->length, &n);
+		mm_mimepart_closebody(part, fd);
+		if (ret == -1) {
+			xfree(data);
+			return -1;
+		}
+		data[n] = '\0';
+		encoded = codec->encoder(data, n);
+		xfree(data);
+		if (encoded == NULL) {
+			mm_errno = MM_ERROR_CODEC;
+			mm_error_setmsg("could not encode MIME part");
+			return -1;
+		}
+		ret = mm_emit_transient(emitter, encoded, strlen(encoded));
+		xfree(encoded);
+		return ret;
+	}
+
+	pos = 0;
+	have = 0;
+	col = 0;
+	ret = 0;
+
+	do {
+		if (mm_mimepart_readbody(part, fd, pos, in + have, 
+		    sizeof(in) - have, &n) == -1) {
+			ret = -1;
+			break;
+		}
+		pos += n;
+		have += n;
+		final = (pos == part->length);
+
+		if (codec == NULL || codec->encode_chunk == NULL) {
+			if (mm_emit_transient(emitter, in, have) == -1) {
+				ret = -1;
+				break;
+			}
+			have = 0;
+			continue;
+		}
+
+		/* Unless this is the last chunk, the codec may leave some
+		 * bytes, which are carried over to the next chunk.
+		 */
+		done = 0;
+		do {
+			codec->encode_chunk(in + done, have - done, final, out,
+			    sizeof(out), &col, &consumed, &written);
+			if (mm_emit_transient(emitter, out, written) == -1) {
+				ret = -1;
+				break;
+			}
+			done += consumed;
+		} while (done < have && written > 0);
+		if (ret == -1)
+			break;
+
+		memmove(in, in + done, have - done);
+		have -= done;
+	} while (!final || have > 0);
+
+	mm_mimepart_closebody(part, fd);
+
+	return ret;
+}
+
+/*
+ * Emits a MIME part, i.e. its headers, an empty line and its body. If
+ * opaque is set and the part has an opaque body, the opaque body is
+ * emitted as-is instead, unless the body is still to be encoded. Nested
+ * MIME parts take the place of the body, with everything between them 
+ * from the source if their structure has not been modified.
+ */
+int
+mm_emit_mimepart(struct mm_emitter *emitter, struct mm_mimepart *part,
+    int opaque)
+{
+	if (opaque && part->opaque_body != NULL 
+	    && !(part->flags & MM_MIMEPART_ENCODE)
+	    && TAILQ_EMPTY(&part->children))
+		return mm_emit(emitter, part->opaque_body, part->opaque_length);
+
+	if (mm_emit_headersection(emitter, part, 0) == -1)
+		return -1;
+
+	if (!TAILQ_EMPTY(&part->children)) {
+		if (mm_emit_hasrawchildren(part))
+			return mm_emit_rawchildren(emitter, part, opaque);
+		return mm_emit_children(emitter, part, opaque);
+	}
+
+	return mm_emit_body(emitter, part);
+}
+
+/*
+ * Makes sure a context can be flattened: every MIME part gets a default
+ * Content-Type if it has none, and composite messages and MIME parts with
+ * nested parts get a boundary.
+ * Called once before emitting the context, because it may change it.
+ */
+int
+mm_emit_prepare(MM_CTX *ctx, int flags)
+{
+	struct mm_mimepart *part, *envelope;
+	struct mm_walk walk;
+
+	if (ctx->boundary == NULL && mm_context_iscomposite(ctx)) {
+		if (mm_context_generateboundary(ctx) == -1)
+			return -1;
+	}
+
+	envelope = mm_context_getpart(ctx, 0);
+	if (envelope == NULL)
+		return 0;
+
+	if (!(flags & MM_FLATTEN_SKIPENVELOPE) && envelope->type == NULL
+	    && (mm_context_countparts(ctx) > 1 || envelope->nchildren > 0)) {
+		if (mm_mimepart_setdefaultcontenttype(envelope, 1) == -1)
+			return -1;
+		if (mm_context_generateboundary(ctx) == -1)
+			return -1;
+		ctx->messagetype = MM_MSGTYPE_MULTIPART;
+	}
+
+	/* The boundary of the envelope is the one of the context. Nested 
+	 * MIME parts get a multipart Content-Type and a boundary of their 
+	 * own. */
+	mm_walk_init(&walk, ctx, envelope, MM_WALK_DEPTHFIRST);
+	while ((part = mm_walk_next(&walk)) != NULL) {
+		if (part == envelope)
+			continue;
+		if (part->type == NULL && mm_mimepart_setdefaultcontenttype(
+		    part, part->nchildren > 0) == -1)
+			return -1;
+		if (part->nchildren > 0 && mm_emit_preparenested(part) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits a whole context prepared by mm_emit_prepare(). The envelope is
+ * followed by the preamble and the MIME parts, each introduced by a 
+ * boundary line, and the closing boundary line. Single part messages are
+ * emitted with the body of the envelope.
+ */
+int
+mm_emit_context(struct mm_emitter *emitter, MM_CTX *ctx, int flags)
+{
+	struct mm_mimepart *part, *envelope;
+	size_t blen, pos;
+
+	envelope = TAILQ_FIRST(&ctx->parts);
+	if (envelope == NULL)
+		return 0;
+
+	emitter->cache = ctx->cache;
+
+	/* Everything between the parts comes from the source */
+	if (mm_emit_hasrawstructure(ctx, flags)) {
+		pos = 0;
+		TAILQ_FOREACH(part, &ctx->parts, next) {
+			if (mm_emit(emitter, ctx->source->data + pos, 
+			    part->src_offset - pos) == -1)
+				return -1;
+			if (part == envelope) {
+				if (mm_emit_headersection(emitter, part, 1) 
+				    == -1 || mm_emit_body(emitter, part) == -1)
+					return -1;
+			} else if (mm_emit_mimepart(emitter, part, 
+			    flags & MM_FLATTEN_OPAQUE) == -1)
+				return -1;
+			pos = part->src_offset + part->src_length;
+		}
+		return mm_emit(emitter, ctx->source->data + pos, 
+		    ctx->source->length - pos);
+	}
+
+	if (!(flags & MM_FLATTEN_SKIPENVELOPE)) {
+		if (mm_emit_headersection(emitter, envelope, 1) == -1)
+			return -1;
+
+		if (!mm_context_iscomposite(ctx))
+			return mm_emit_body(emitter, envelope);
+
+		if (ctx->preamble != NULL && !(flags & MM_FLATTEN_NOPREAMBLE)
+		    && mm_emit_string(emitter, ctx->preamble) == -1)
+			return -1;
+	}
+
+	blen = ctx->boundary != NULL ? strlen(ctx->boundary) : 0;
+
+	/* The MIME parts of the context are followed by those nested in the
+	 * envelope */
+	for (part = mm_context_nextpart(ctx, envelope); part != NULL; 
+	    part = mm_context_nextpart(ctx, part)) {
+		if (ctx->boundary != NULL) {
+			if (mm_emit(emitter, "\r\n--", 4) == -1
+			    || mm_emit(emitter, ctx->boundary, blen) == -1
+			    || mm_emit(emitter, "\r\n", 2) == -1)
+				return -1;
+		}
+		if (mm_emit_mimepart(emitter, part, flags & MM_FLATTEN_OPAQUE)
+		    == -1)
+			return -1;
+	}
+
+	if (ctx->boundary != NULL && mm_context_iscomposite(ctx)) {
+		if (mm_emit(emitter, "\r\n--", 4) == -1
+		    || mm_emit(emitter, ctx->boundary, blen) == -1
+		    || mm_emit(emitter, "--\r\n", 4) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Starts a continuation line if len more bytes, beginning with whitespace,
+ * would not fit on the current line any more
+ */
+static int
+mm_emit_fold(struct mm_emitter *emitter, size_t *col, size_t len)
+{
+	if (*col == 0 || *col + len <= MM_EMITTER_FOLDCOL)
+		return 0;
+
+	*col = 0;
+	return mm_emit(emitter, "\r\n", 2);
+}
+
+/*
+ * Emits an UTF-8 parameter value in the extended notation of RFC 2231,
+ * i.e. as utf-8'' followed by the value with every byte which is not an
+ * attribute-char percent encoded.
+ */
+static int
+mm_emit_extvalue(struct mm_emitter *emitter, const char *value)
+{
+	const unsigned char *p, *run;
+
+	if (mm_emit(emitter, "utf-8''", 7) == -1)
+		return -1;
+
+	for (p = run = (const unsigned char *)value; *p != '\0'; p++) {
+		if (mm_rfc2231_isattrchar(*p))
+			continue;
+		if (p > run && mm_emit(emitter, (const char *)run, p - run)
+		    == -1)
+			return -1;
+		if (mm_emit(emitter, mm_emit_escapes + 3 * *p, 3) == -1)
+			return -1;
+		run = p + 1;
+	}
+	if (p > run && mm_emit(emitter, (const char *)run, p - run) == -1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Emits a value for a quoted string, with a backslash before every quote
+ * and backslash in it. Without an emitter, the backslashes needed are 
+ * counted instead.
+ */
+static int
+mm_emit_quotedpairs(struct mm_emitter *emitter, const char *value)
+{
+	const char *p, *run;
+	int n;
+
+	n = 0;
+	for (p = run = value; *p != '\0'; p++) {
+		if (*p != '"' && *p != '\\')
+			continue;
+		n++;
+		if (emitter == NULL)
+			continue;
+		if (mm_emit(emitter, run, p - run) == -1
+		    || mm_emit(emitter, "\\", 1) == -1)
+			return -1;
+		run = p;
+	}
+	if (emitter == NULL)
+		return n;
+
+	return mm_emit(emitter, run, p - run);
+}
+
+/*
+ * Emits the header fields of a MIME part. Header fields which are not 
+ * modified are emitted from the source, in their place among the others:
+ * those attached to the part, and those the parser keeps elsewhere, see
+ * mm_emit_srcfields(). Content-Type and Content-Transfer-Encoding are
+ * generated if they are not found there. The fields of enum 
+ * mm_emit_fields emitted are stored in fields unless it is NULL.
+ */
+static int
+mm_emit_fields(struct mm_emitter *emitter, struct mm_mimepart *part, 
+    int *fields)
+{
+	struct mm_mimeheader *hdr;
+	size_t pos, end;
+	int found;
+
+	found = 0;
+	pos = end = 0;
+	if (part->source != NULL && part->src_hdrlen > 0
+	    && part->src_offset + part->src_hdrlen <= part->source->length) {
+		pos = part->src_offset;
+		end = part->src_offset + part->src_hdrlen;
+	}
+
+	TAILQ_FOREACH(hdr, &part->headers, next) {
+		if (hdr->source == part->source && hdr->src_offset >= pos
+		    && hdr->src_offset < end) {
+			if (mm_emit_srcfields(emitter, part, pos, 
+			    hdr->src_offset, &found) == -1)
+				return -1;
+			pos = hdr->src_offset;
+		}
+		if (part->source != NULL && hdr->src_length > 0
+		    && hdr->src_offset + hdr->src_length 
+		    <= part->source->length) {
+			if (mm_emit(emitter, part->source->data 
+			    + hdr->src_offset, hdr->src_length) == -1)
+				return -1;
+		} else if (mm_emit_header(emitter, hdr->name, hdr->value)
+		    == -1)
+			return -1;
+	}
+	if (pos < end && mm_emit_srcfields(emitter, part, pos, end, &found) 
+	    == -1)
+		return -1;
+
+	if (part->type != NULL) {
+		if (!(found & MM_EMIT_CONTENTTYPE)
+		    && mm_emit_contenttype(emitter, part->type) == -1)
+			return -1;
+		if (!(found & MM_EMIT_ENCODING) && part->type->encstring != NULL
+		    && mm_emit_header(emitter, "Content-Transfer-Encoding",
+		    part->type->encstring) == -1)
+			return -1;
+	}
+
+	if (fields != NULL)
+		*fields = found;
+
+	return 0;
+}
+
+/*
+ * Emits the header fields between start and end in the source which the
+ * parser does not attach to the part as header fields: Content-Type,
+ * Content-Transfer-Encoding, Content-Disposition and MIME-Version. The 
+ * first two are generated in their place if the Content-Type has been
+ * modified. The fields emitted are added to found.
+ */
+static int
+mm_emit_srcfields(struct mm_emitter *emitter, struct mm_mimepart *part,
+    size_t start, size_t end, int *found)
+{
+	const char *p, *line, *stop, *colon;
+	size_t len;
+	int field;
+
+	p = part->source->data + start;
+	stop = part->source->data + end;
+	while (p < stop) {
+		/* A header field and its folded lines */
+		line = p;
+		do {
+			p = memchr(p, '\n', stop - p);
+			p = (p == NULL) ? stop : p + 1;
+		} while (p < stop && (*p == ' ' || *p == '\t'));
+
+		colon = memchr(line, ':', p - line);
+		if (colon == NULL)
+			continue;
+		len = colon - line;
+		if (len == 12 && !strncasecmp(line, "Content-Type", len))
+			field = MM_EMIT_CONTENTTYPE;
+		else if (len == 25 
+		    && !strncasecmp(line, "Content-Transfer-Encoding", len))
+			field = MM_EMIT_ENCODING;
+		else if (len == 19 
+		    && !strncasecmp(line, "Content-Disposition", len))
+			field = MM_EMIT_DISPOSITION;
+		else if (len == 12 && !strncasecmp(line, "MIME-Version", len))
+			field = MM_EMIT_MIMEVERSION;
+		else
+			continue;
+		if (*found & field)
+			continue;
+		*found |= field;
+
+		if (part->type == NULL || !part->type->dirty 
+		    || field == MM_EMIT_DISPOSITION 
+		    || field == MM_EMIT_MIMEVERSION) {
+			if (mm_emit(emitter, line, p - line) == -1)
+				return -1;
+		} else if (field == MM_EMIT_CONTENTTYPE) {
+			if (mm_emit_contenttype(emitter, part->type) == -1)
+				return -1;
+		} else if (part->type->encstring != NULL
+		    && mm_emit_header(emitter, "Content-Transfer-Encoding",
+		    part->type->encstring) == -1) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Checks whether the header section of a MIME part can be emitted from the
+ * source: neither the header fields parsed nor the Content-Type have been
+ * modified, and header fields added since all follow the parsed ones.
+ */
+static int
+mm_emit_hasrawheaders(struct mm_mimepart *part)
+{
+	struct mm_mimeheader *hdr;
+	int parsed, appended;
+
+	if (part->source == NULL || part->src_hdrlen == 0
+	    || (part->dirty & MM_DIRTY_HEADERS)
+	    || (part->type != NULL && part->type->dirty)
+	    || part->src_offset + part->src_hdrlen > part->source->length)
+		return 0;
+
+	parsed = 0;
+	appended = 0;
+	TAILQ_FOREACH(hdr, &part->headers, next) {
+		if (hdr->src_length > 0) {
+			if (appended)
+				return 0;
+			parsed++;
+		} else {
+			appended++;
+		}
+	}
+
+	return parsed == part->src_headers;
+}
+
+/*
+ * Checks whether the structure of a context can be emitted from the source:
+ * it has not been modified, and its MIME parts are the ones parsed, in the
+ * original order.
+ */
+static int
+mm_emit_hasrawstructure(MM_CTX *ctx, int flags)
+{
+	struct mm_mimepart *part;
+	size_t pos;
+
+	if (ctx->source == NULL || (ctx->dirty & MM_DIRTY_STRUCTURE)
+	    || (flags & (MM_FLATTEN_SKIPENVELOPE | MM_FLATTEN_NOPREAMBLE))
+	    || !TAILQ_EMPTY(&TAILQ_FIRST(&ctx->parts)->children))
+		return 0;
+
+	pos = 0;
+	TAILQ_FOREACH(part, &ctx->parts, next) {
+		if (part->source != ctx->source || part->src_offset < pos
+		    || part->src_offset + part->src_length 
+		    > ctx->source->length)
+			return 0;
+		pos = part->src_offset + part->src_length;
+	}
+
+	return 1;
+}
+
+/*
+ * Checks whether the structure of the MIME parts nested in a part can be
+ * emitted from the source: neither they nor the Content-Type of the part
+ * have been modified, and they are the ones parsed, in the original order.
+ */
+static int
+mm_emit_hasrawchildren(struct mm_mimepart *part)
+{
+	struct mm_mimepart *child;
+	size_t pos, end;
+
+	if (part->source == NULL || (part->dirty & MM_DIRTY_STRUCTURE)
+	    || (part->type != NULL && part->type->dirty)
+	    || part->src_offset + part->src_length > part->source->length)
+		return 0;
+
+	pos = part->src_offset + part->src_hdrlen;
+	end = part->src_offset + part->src_length;
+	TAILQ_FOREACH(child, &part->children, next) {
+		if (child->source != part->source || child->src_offset < pos
+		    || child->src_offset + child->src_length > end)
+			return 0;
+		pos = child->src_offset + child->src_length;
+	}
+
+	return 1;
+}
+
+/*
+ * Emits the MIME parts nested in a part in place of its body, with the 
+ * boundary lines, preamble and postamble around them from the source
+ */
+static int
+mm_emit_rawchildren(struct mm_emitter *emitter, struct mm_mimepart *part,
+    int opaque)
+{
+	struct mm_mimepart *child;
+	size_t pos;
+
+	pos = part->src_offset + part->src_hdrlen;
+	TAILQ_FOREACH(child, &part->children, next) {
+		if (mm_emit(emitter, part->source->data + pos, 
+		    child->src_offset - pos) == -1
+		    || mm_emit_mimepart(emitter, child, opaque) == -1)
+			return -1;
+		pos = child->src_offset + child->src_length;
+	}
+
+	return mm_emit(emitter, part->source->data + pos, 
+	    part->src_offset + part->src_length - pos);
+}
+
+/*
+ * Emits the MIME parts nested in a part in place of its body, each 
+ * introduced by a boundary line, and the closing boundary line. The 
+ * message encapsulated in a message/rfc822 part needs no boundary.
+ */
+static int
+mm_emit_children(struct mm_emitter *emitter, struct mm_mimepart *part,
+    int opaque)
+{
+	struct mm_mimepart *child;
+	const char *boundary;
+	size_t blen;
+
+	if (mm_emit_ismessage(part))
+		return mm_emit_mimepart(emitter, TAILQ_FIRST(&part->children),
+		    opaque);
+
+	boundary = NULL;
+	if (part->type != NULL)
+		boundary = mm_content_getparambyname(part->type, "boundary");
+	if (boundary == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("no boundary for nested MIME parts");
+		return -1;
+	}
+	blen = strlen(boundary);
+
+	TAILQ_FOREACH(child, &part->children, next) {
+		if (mm_emit(emitter, "\r\n--", 4) == -1
+		    || mm_emit(emitter, boundary, blen) == -1
+		    || mm_emit(emitter, "\r\n", 2) == -1
+		    || mm_emit_mimepart(emitter, child, opaque) == -1)
+			return -1;
+	}
+
+	if (mm_emit(emitter, "\r\n--", 4) == -1
+	    || mm_emit(emitter, boundary, blen) == -1
+	    || mm_emit(emitter, "--", 2) == -1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Gives a MIME part with nested parts a multipart Content-Type with a 
+ * boundary if it has none. The nested parts replace the body, so any other
+ * Content-Type is replaced by multipart/mixed, except for message parts
+ * encapsulating a single message.
+ */
+static int
+mm_emit_preparenested(struct mm_mimepart *part)
+{
+	char *boundary;
+
+	if (mm_emit_ismessage(part))
+		return 0;
+
+	if ((part->type == NULL 
+	    || part->type->mediatype != MM_MEDIATYPE_MULTIPART)
+	    && mm_mimepart_setdefaultcontenttype(part, 1) == -1)
+		return -1;
+
+	if (mm_content_getparambyname(part->type, "boundary") == NULL) {
+		if (mm_mimeutil_genboundary("++MiniMIME++", 20, &boundary) 
+		    == -1)
+			return -1;
+		mm_content_addparam(part->type, "boundary", boundary);
+		xfree(boundary);
+		part->type->dirty = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Checks whether a MIME part is a message part encapsulating a single
+ * message, e.g. one parsed from a message/rfc822 part
+ */
+static int
+mm_emit_ismessage(struct mm_mimepart *part)
+{
+	return part->type != NULL 
+	    && part->type->mediatype == MM_MEDIATYPE_MESSAGE
+	    && part->nchildren == 1;
+}
+
+static int
+mm_emitter_docount(struct mm_emitter *emitter, const char *data, size_t len)
+{
+	emitter->length += len;
+	return 0;
+}
+
+static int
+mm_emitter_dobuffer(struct mm_emitter *emitter, const char *data, size_t len)
+{
+	if (len > emitter->size - emitter->length) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("emitter: output buffer too small");
+		return -1;
+	}
+
+	memcpy(emitter->buf + emitter->length, data, len);
+	emitter->length += len;
+
+	return 0;
+}
+
+static int
+mm_emitter_dowritev(struct mm_emitter *emitter, const char *data, size_t len)
+{
+	struct iovec *last;
+
+	if (len == 0)
+		return 0;
+
+	/* Pieces which are adjacent in memory are written as one */
+	if (emitter->iovcnt > 0) {
+		last = &emitter->iov[emitter->iovcnt - 1];
+		if ((const char *)last->iov_base + last->iov_len == data) {
+			last->iov_len += len;
+			emitter->length += len;
+			return 0;
+		}
+	}
+
+	if (emitter->iovcnt == IOV_MAX && mm_emitter_flush(emitter) == -1)
+		return -1;
+
+	emitter->iov[emitter->iovcnt].iov_base = (void *)data;
+	emitter->iov[emitter->iovcnt].iov_len = len;
+	emitter->iovcnt++;
+	emitter->length += len;
+
+	return 0;
+}
+
+static int
+mm_emitter_dosink(struct mm_emitter *emitter, const char *data, size_t len)
+{
+	emitter->length += len;
+
+	if (len > emitter->size - emitter->fill) {
+		if (mm_emitter_flush(emitter) == -1)
+			return -1;
+		/* Large pieces are not worth copying */
+		if (len >= emitter->size)
+			return emitter->sink->write(emitter->sink, data, len);
+	}
+
+	memcpy(emitter->buf + emitter->fill, data, len);
+	emitter->fill += len;
+
+	return 0;
+}
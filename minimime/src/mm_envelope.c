@@ -65,8 +65,8 @@
  *
  * This is mainly a convinience function. It constructs an ASCII representation
  * from all of the message's envelope headers and stores the result in headers.
- * Memory is allocated dynamically, and the total length of the result is
- * stored in length. This function takes care that the output is MIME conform,
+ * Memory is allocated dynamically, and the total length of the result, not
+ * counting the terminating NUL, is stored in length. This function takes care that the output is MIME conform,
  * and folds long lines according to the MIME standard at position 78 of the
  * string. It also nicely formats all MIME related header fields, such as
  * the Content-Type header.
@@ -81,79 +81,34 @@ int
 mm_envelope_getheaders(MM_CTX *ctx, char **result, size_t *length)
 {
 	struct mm_mimepart *part;
-	struct mm_mimeheader *hdr;
-	char *buf, *hdrbuf;
-	size_t headers_length, tmp_length;
+	struct mm_emitter emitter;
+	char *buf;
 
-	headers_length = 1;
-	buf = NULL;
+	*result = NULL;
+	*length = 0;
 
 	part = mm_context_getpart(ctx, 0);
 	if (part == NULL) {
 		return -1;
 	}	
 
-	/* Initialize our buffer */
-	if ((buf = (char *)xmalloc(headers_length)) == NULL) {
-		mm_errno = MM_ERROR_ERRNO;
-		goto cleanup;
-	}	
-	*buf = '\0';
-
-	/* Store each envelope header */
-	TAILQ_FOREACH(hdr, &part->headers, next) {
-		tmp_length = strlen(hdr->name) + strlen(hdr->value) 
-		    + strlen(": \r\n");
-		hdrbuf = (char *) xrealloc(buf, headers_length + tmp_length);
-		if (hdrbuf == NULL) {
-			mm_errno = MM_ERROR_ERRNO;
-			goto cleanup;
-		}
-
-		headers_length += tmp_length;
-		buf = hdrbuf;
-
-		strlcat(buf, hdr->name, headers_length);
-		strlcat(buf, ": ", headers_length);
-		strlcat(buf, hdr->value, headers_length);
-		strlcat(buf, "\r\n", headers_length);
+	mm_emitter_count(&emitter);
+	if (mm_emit_headers(&emitter, part) == -1) {
+		return -1;
 	}
 
-	/* Construct and store MIME headers */
-	if (part->type != NULL) {
-		char *typebuf;
-		typebuf = mm_content_tostring(part->type);
-		if (typebuf == NULL) {
-			goto cleanup;
-		}
-		tmp_length = strlen(typebuf) + strlen("\r\n");
-
-		hdrbuf = (char *) xrealloc(buf, headers_length + tmp_length);
-		if (hdrbuf == NULL) {
-			mm_errno = MM_ERROR_ERRNO;
-			goto cleanup;
-		}
-
-		headers_length += tmp_length;
-		buf = hdrbuf;
-		
-		strlcat(buf, typebuf, headers_length);
-		strlcat(buf, "\r\n", headers_length);
+	buf = (char *)xmalloc(emitter.length + 1);
+	mm_emitter_buffer(&emitter, buf, emitter.length);
+	if (mm_emit_headers(&emitter, part) == -1) {
+		xfree(buf);
+		return -1;
 	}
+	buf[emitter.length] = '\0';
 
 	*result = buf;
-	*length = headers_length;
+	*length = emitter.length;
 
 	return 0;
-
-cleanup:
-	if (buf != NULL) {
-		xfree(buf);
-		buf = NULL;
-	}
-	*result = NULL;
-	*length = 0;
-	return -1;
 }
 
 /**
@@ -167,55 +122,33 @@ cleanup:
  * This function generates a new MIME header and attaches it to the first
  * MIME part (the envelope) found in the given context. If no part is
  * attached already, the function will return an error. The function will
- * store a copy of ``name'' as the header's name field, and dynamically
- * allocate the memory needed to build the format string.
+ * store a copy of ``name'' and of the formatted value in the storage of the
+ * envelope, see mm_mimepart_addheader().
  */
 int
 mm_envelope_setheader(MM_CTX *ctx, const char *name, const char *fmt, ...)
 {
 	va_list ap;
 	char *buf;
-	struct mm_mimeheader *hdr;
 	struct mm_mimepart *part;
+	int ret;
 
 	part = mm_context_getpart(ctx, 0);
 	if (part == NULL) {
 		return(-1);
 	}	
 
-	hdr = mm_mimeheader_new();
-	if (hdr == NULL) {
-		return(-1);
-	}
-
-	hdr->name = xstrdup(name);
-
 	va_start(ap, fmt);
-	if (vasprintf(&buf, fmt, ap) == -1) {
-		goto cleanup;
-	}	
+	ret = vasprintf(&buf, fmt, ap);
 	va_end(ap);
-
-	hdr->value = buf;
-
-	if (mm_mimepart_attachheader(part, hdr) == -1) {
-		goto cleanup;
+	if (ret == -1) {
+		return(-1);
 	}	
 
-	return(0);
+	mm_mimepart_addheader(part, name, buf);
+	free(buf);
 
-cleanup:
-	if (hdr != NULL) {
-		if (hdr->name != NULL) {
-			xfree(hdr->name);
-			hdr->name = NULL;
-		}
-		if (hdr->value != NULL) {
-			xfree(hdr->value);
-			hdr->value = NULL;
-		}
-	}	
-	return(-1);
+	return(0);
 }
 
 /**
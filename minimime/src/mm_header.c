@@ -64,6 +64,15 @@ mm_mimeheader_new(void)
 	
 	header->name = NULL;
 	header->value = NULL;
+	header->decoded = NULL;
+
+	header->src_offset = 0;
+	header->src_length = 0;
+	header->source = NULL;
+	header->samename = NULL;
+	header->stored = 0;
+	header->store = NULL;
+	header->cache = NULL;
 
 	return header;
 }
@@ -78,17 +87,28 @@ mm_mimeheader_free(struct mm_mimeheader *header)
 {
 	assert(header != NULL);
 
-	if (header->name != NULL) {
-		xfree(header->name);
-		header->name = NULL;
+	mm_header_dropcache(header);
+	if (header->decoded != NULL && header->decoded != header->value) {
+		xfree(header->decoded);
+		header->decoded = NULL;
 	}
-	if (header->value != NULL) {
+	if (header->name != NULL && !(header->stored & MM_STORED_NAME))
+		xfree(header->name);
+	else if (header->name != NULL)
+		mm_arena_strfree(header->store, header->name);
+	header->name = NULL;
+	if (header->value != NULL && !(header->stored & MM_STORED_VALUE))
 		xfree(header->value);
-		header->value = NULL;
-	}
+	else if (header->value != NULL)
+		mm_arena_strfree(header->store, header->value);
+	header->value = NULL;
 
-	xfree(header);
-	header = NULL;
+	/* Header fields in the storage of a MIME part go back to it */
+	if (!(header->stored & MM_STORED_OBJECT))
+		xfree(header);
+	else
+		mm_arena_release(header->store, header, 
+		    sizeof(struct mm_mimeheader));
 }
 
 /**
@@ -120,8 +140,58 @@ mm_mimeheader_uncomment(struct mm_mimeheader *header)
 	if (new == NULL)
 		return -1;
 
-	xfree(header->value);
+	if (header->decoded != NULL && header->decoded != header->value)
+		xfree(header->decoded);
+	header->decoded = NULL;
+
+	if (!(header->stored & MM_STORED_VALUE))
+		xfree(header->value);
+	else
+		mm_arena_strfree(header->store, header->value);
+	header->stored &= ~MM_STORED_VALUE;
+	header->value = new;
+	mm_header_dropcache(header);
+
+	/* The source does not match the header field anymore */
+	header->src_length = 0;
+
+	return 0;
+}
+
+/**
+ * Sets the value of a MIME header object
+ *
+ * @param header A valid MIME header object
+ * @param value The new value
+ * @return 0 on success or -1 on failure
+ *
+ * This function replaces the value of a header field. Header fields of
+ * parsed messages whose value is set are no longer written out verbatim
+ * from the message source (see MM_PARSE_KEEPSOURCE).
+ */
+int
+mm_mimeheader_setvalue(struct mm_mimeheader *header, const char *value)
+{
+	char *new;
+
+	assert(header != NULL);
+	assert(value != NULL);
+
+	new = xstrdup(value);
+
+	if (header->decoded != NULL && header->decoded != header->value)
+		xfree(header->decoded);
+	header->decoded = NULL;
+
+	if (header->value != NULL && !(header->stored & MM_STORED_VALUE))
+		xfree(header->value);
+	else if (header->value != NULL)
+		mm_arena_strfree(header->store, header->value);
+	header->stored &= ~MM_STORED_VALUE;
 	header->value = new;
+	mm_header_dropcache(header);
+
+	header->src_length = 0;
 
 	return 0;
 }
@@ -131,14 +201,11 @@ mm_mimeheader_uncommentbyname(struct mm_mimepart *part, const char *name)
 {
 	struct mm_mimeheader *header;
 
-	TAILQ_FOREACH(header, &part->headers, next) {
-		if (!strcasecmp(header->name, name)) {
-			return mm_mimeheader_uncomment(header);
-		}
-	}
+	header = mm_mimepart_getheaderbyname(part, name, 0);
+	if (header == NULL)
+		return -1;
 
-	/* Not found */
-	return -1;
+	return mm_mimeheader_uncomment(header);
 }
 
 int
@@ -157,3 +224,61 @@ mm_mimeheader_uncommentall(struct mm_mimepart *part)
 
 	return ret;
 }
+
+/**
+ * Decodes RFC 2047 encoded words in the value of a MIME header
+ *
+ * @param header A valid MIME header object
+ * @return 0 on success or -1 on failure
+ * @see mm_mimeheader_getdecoded
+ *
+ * This function decodes the header's value into UTF-8 and stores the result
+ * within the header object, where it can be retrieved with 
+ * mm_mimeheader_getdecoded(). If the value does not contain any encoded 
+ * words, no memory is allocated. The parser calls this function for each
+ * header if the MM_PARSE_DECODEHEADERS flag is given.
+ */
+int
+mm_mimeheader_decode(struct mm_mimeheader *header)
+{
+	char *decoded;
+
+	assert(header != NULL);
+	assert(header->value != NULL);
+
+	if (header->decoded != NULL)
+		return 0;
+
+	switch (mm_rfc2047_decode(header->value, &decoded)) {
+	case -1:
+		return -1;
+	case 0:
+		header->decoded = header->value;
+		break;
+	default:
+		header->decoded = decoded;
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Gets the decoded value of a MIME header
+ *
+ * @param header A valid MIME header object
+ * @return The header's value with RFC 2047 encoded words decoded to UTF-8
+ *
+ * The value is decoded on first access and cached in the header object.
+ * If the value can not be decoded, the raw value is returned.
+ */
+const char *
+mm_mimeheader_getdecoded(struct mm_mimeheader *header)
+{
+	assert(header != NULL);
+
+	if (header->decoded == NULL && mm_mimeheader_decode(header) == -1)
+		return header->value;
+
+	return header->decoded;
+}
@@ -0,0 +1,827 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_headertypes.c
+ *
+ * Parses the values of header fields which have a structure, such as 
+ * dates, message IDs and address lists. A value is parsed when it is
+ * first asked for, and the result is kept with the header field until the
+ * value is changed, so asking again costs nothing. The result is kept in
+ * a single allocation.
+ */
+
+enum mm_headercache_types
+{
+	MM_HEADERCACHE_DATE = 1,
+	MM_HEADERCACHE_MSGIDS,
+	MM_HEADERCACHE_ADDRESSES
+};
+
+/*
+ * The parsed value of a header field. The arrays of message IDs or 
+ * addresses follow the structure, the strings they point to follow them.
+ */
+struct mm_headercache
+{
+	int type;
+	/* 0 if the value could not be parsed */
+	int valid;
+
+	time_t date;
+	int zone;
+
+	int count;
+	const char **ids;
+	struct mm_address *addresses;
+};
+
+static struct mm_headercache *mm_header_getcache(struct mm_mimeheader *, int);
+static struct mm_headercache *mm_header_newcache(struct mm_mimeheader *, int,
+    size_t);
+static int mm_header_parsedate(const char *, time_t *, int *);
+static int mm_header_parsemsgids(const char *, struct mm_headercache *, 
+    size_t *);
+static int mm_header_parseaddresses(const char *, struct mm_headercache *,
+    size_t *);
+static const char *mm_header_skipcfws(const char *);
+static const char *mm_header_number(const char *, int, long *, int *);
+static char *mm_header_copy(char *, const char *, const char *, int);
+static long mm_header_days(long, long, long);
+static long mm_header_monthdays(long, long);
+
+/** @{
+ * @name Structured header field values
+ */
+
+/**
+ * Gets the date of a header field
+ *
+ * @param header A valid MIME header object
+ * @param when Where to store the date as seconds since the epoch
+ * @param zone Where to store the time zone of the date, in minutes east of
+ *        UTC, or NULL
+ * @return 0 on success or -1 if the value is not a valid date
+ * @note Sets mm_errno on failure
+ *
+ * Dates are as in RFC 2822, obsolete forms such as two digit years and 
+ * named time zones are accepted. The date is parsed once and kept with 
+ * the header field until its value is changed.
+ */
+int
+mm_mimeheader_getdate(struct mm_mimeheader *header, time_t *when, int *zone)
+{
+	struct mm_headercache *cache;
+
+	assert(header != NULL);
+	assert(when != NULL);
+
+	cache = mm_header_getcache(header, MM_HEADERCACHE_DATE);
+	if (cache == NULL) {
+		cache = mm_header_newcache(header, MM_HEADERCACHE_DATE, 0);
+		cache->valid = header->value != NULL && mm_header_parsedate(
+		    header->value, &cache->date, &cache->zone) == 0;
+	}
+
+	if (!cache->valid) {
+		mm_errno = MM_ERROR_PARSE;
+		mm_error_setmsg("invalid date");
+		return -1;
+	}
+
+	*when = cache->date;
+	if (zone != NULL)
+		*zone = cache->zone;
+
+	return 0;
+}
+
+/**
+ * Gets the message IDs of a header field
+ *
+ * @param header A valid MIME header object
+ * @param ids Where to store the array of message IDs
+ * @param count Where to store the number of message IDs
+ * @return 0 on success or -1 on failure
+ *
+ * For Message-ID, In-Reply-To, References and similar header fields. The
+ * message IDs are given without the angle brackets and without folding
+ * whitespace, in the order they appear. Anything between them, such as
+ * comments or phrases, is skipped. The IDs are parsed once and belong to
+ * the header field, they stay valid until its value is changed.
+ */
+int
+mm_mimeheader_getmsgids(struct mm_mimeheader *header, 
+    const char * const **ids, int *count)
+{
+	struct mm_headercache *cache;
+	size_t bytes;
+	int n;
+
+	assert(header != NULL);
+	assert(ids != NULL && count != NULL);
+
+	cache = mm_header_getcache(header, MM_HEADERCACHE_MSGIDS);
+	if (cache == NULL) {
+		bytes = 0;
+		n = header->value != NULL ? 
+		    mm_header_parsemsgids(header->value, NULL, &bytes) : 0;
+
+		cache = mm_header_newcache(header, MM_HEADERCACHE_MSGIDS,
+		    n * sizeof(char *) + bytes);
+		cache->count = n;
+		cache->ids = (const char **)(cache + 1);
+		if (n > 0)
+			mm_header_parsemsgids(header->value, cache, &bytes);
+	}
+
+	*ids = (const char * const *)cache->ids;
+	*count = cache->count;
+
+	return 0;
+}
+
+/**
+ * Gets the addresses of a header field
+ *
+ * @param header A valid MIME header object
+ * @param addresses Where to store the array of addresses
+ * @param count Where to store the number of addresses
+ * @return 0 on success or -1 on failure
+ *
+ * For From, To, Cc and other header fields holding an address list. The
+ * names of addresses and groups are unquoted, but encoded words in them
+ * are not decoded. Groups are resolved into their members, which have the
+ * group's name set. The addresses are parsed once and belong to the
+ * header field, they stay valid until its value is changed.
+ */
+int
+mm_mimeheader_getaddresses(struct mm_mimeheader *header,
+    const struct mm_address **addresses, int *count)
+{
+	struct mm_headercache *cache;
+	size_t bytes;
+	int n;
+
+	assert(header != NULL);
+	assert(addresses != NULL && count != NULL);
+
+	cache = mm_header_getcache(header, MM_HEADERCACHE_ADDRESSES);
+	if (cache == NULL) {
+		bytes = 0;
+		n = header->value != NULL ? 
+		    mm_header_parseaddresses(header->value, NULL, &bytes) : 0;
+
+		cache = mm_header_newcache(header, MM_HEADERCACHE_ADDRESSES,
+		    n * sizeof(struct mm_address) + bytes);
+		cache->count = n;
+		cache->addresses = (struct mm_address *)(cache + 1);
+		if (n > 0)
+			mm_header_parseaddresses(header->value, cache, &bytes);
+	}
+
+	*addresses = cache->addresses;
+	*count = cache->count;
+
+	return 0;
+}
+
+/**
+ * Gets the date of a header field of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @param name The name of the header field, or NULL for "Date"
+ * @param when Where to store the date as seconds since the epoch
+ * @param zone Where to store the time zone of the date, or NULL
+ * @return 0 on success or -1 if there is no such header field or it is 
+ *         not a valid date
+ * @note Sets mm_errno on failure
+ * @see mm_mimeheader_getdate
+ *
+ * The first header field of the given name is used.
+ */
+int
+mm_mimepart_getdate(struct mm_mimepart *part, const char *name, time_t *when,
+    int *zone)
+{
+	struct mm_mimeheader *header;
+
+	assert(part != NULL);
+
+	header = mm_mimepart_getheaderbyname(part, name ? name : "Date", 0);
+	if (header == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("no such header field");
+		return -1;
+	}
+
+	return mm_mimeheader_getdate(header, when, zone);
+}
+
+/**
+ * Gets the message IDs of a header field of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @param name The name of the header field, e.g. "References"
+ * @param ids Where to store the array of message IDs
+ * @param count Where to store the number of message IDs
+ * @return 0 on success or -1 if there is no such header field
+ * @note Sets mm_errno on failure
+ * @see mm_mimeheader_getmsgids
+ */
+int
+mm_mimepart_getmsgids(struct mm_mimepart *part, const char *name,
+    const char * const **ids, int *count)
+{
+	struct mm_mimeheader *header;
+
+	assert(part != NULL);
+	assert(name != NULL);
+
+	header = mm_mimepart_getheaderbyname(part, name, 0);
+	if (header == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("no such header field");
+		return -1;
+	}
+
+	return mm_mimeheader_getmsgids(header, ids, count);
+}
+
+/**
+ * Gets the addresses of a header field of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @param name The name of the header field, e.g. "From"
+ * @param addresses Where to store the array of addresses
+ * @param count Where to store the number of addresses
+ * @return 0 on success or -1 if there is no such header field
+ * @note Sets mm_errno on failure
+ * @see mm_mimeheader_getaddresses
+ */
+int
+mm_mimepart_getaddresses(struct mm_mimepart *part, const char *name,
+    const struct mm_address **addresses, int *count)
+{
+	struct mm_mimeheader *header;
+
+	assert(part != NULL);
+	assert(name != NULL);
+
+	header = mm_mimepart_getheaderbyname(part, name, 0);
+	if (header == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("no such header field");
+		return -1;
+	}
+
+	return mm_mimeheader_getaddresses(header, addresses, count);
+}
+
+/** @} */
+
+/**
+ * Releases the parsed value of a header field
+ *
+ * @param header A valid MIME header object
+ * @return Nothing
+ *
+ * Must be called whenever the value of a header field changes.
+ */
+void
+mm_header_dropcache(struct mm_mimeheader *header)
+{
+	if (header->cache != NULL) {
+		xfree(header->cache);
+		header->cache = NULL;
+	}
+}
+
+/**
+ * Finds a character in a header field value
+ *
+ * @param s Where to start
+ * @param end Where to stop
+ * @param stop The characters to look for
+ * @return The first of the characters in stop between s and end which is 
+ *         neither quoted, nor in a comment, nor in angle brackets (unless
+ *         stop is the closing bracket), or end if there is none
+ */
+const char *
+mm_header_scan(const char *s, const char *end, const char *stop)
+{
+	int quoted, comment, angle;
+
+	quoted = comment = angle = 0;
+	for (; s < end; s++) {
+		if (*s == '\\' && (quoted || comment)) {
+			if (s + 1 < end)
+				s++;
+		} else if (quoted) {
+			if (*s == '"')
+				quoted = 0;
+		} else if (comment) {
+			if (*s == '(')
+				comment++;
+			else if (*s == ')')
+				comment--;
+		} else if (angle && *s != '>') {
+			continue;
+		} else if (strchr(stop, *s) != NULL) {
+			return s;
+		} else if (*s == '"') {
+			quoted = 1;
+		} else if (*s == '(') {
+			comment = 1;
+		} else if (*s == '<') {
+			angle = 1;
+		} else if (*s == '>') {
+			angle = 0;
+		}
+	}
+
+	return end;
+}
+
+/**
+ * Splits an address into its pieces
+ *
+ * @param s The start of the address
+ * @param end The end of the address
+ * @param a Where to store the pieces
+ * @return 1 if there is an address between s and end, or 0 if it is empty
+ *         or has no mailbox, as in "Name <" or "Name <>"
+ *
+ * Takes "Name <@route:local@domain>" and "local@domain (Name)". The domain
+ * follows the last @ outside of quotes. Pieces which are not there are 
+ * NULL, whitespace around the pieces is left out.
+ */
+int
+mm_header_splitaddress(const char *s, const char *end, struct mm_addrspan *a)
+{
+	const char *p;
+
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+	while (end > s && isspace((unsigned char)end[-1]))
+		end--;
+	if (s == end)
+		return 0;
+
+	a->name = a->name_end = NULL;
+	a->route = a->route_end = NULL;
+
+	p = mm_header_scan(s, end, "<");
+	if (p < end) {
+		/* Name <@route:local@domain> */
+		a->name = s;
+		a->name_end = p;
+		s = p + 1;
+		end = mm_header_scan(s, end, ">");
+		if (*s == '@') {
+			p = mm_header_scan(s, end, ":");
+			if (p < end) {
+				a->route = s;
+				a->route_end = p;
+				s = p + 1;
+			}
+		}
+	} else if (end[-1] == ')') {
+		/* local@domain (Name) */
+		for (p = end - 1; p > s && *p != '('; p--)
+			;
+		if (*p == '(') {
+			a->name = p + 1;
+			a->name_end = end - 1;
+			end = p;
+		}
+	}
+
+	if (a->name != NULL) {
+		while (a->name < a->name_end 
+		    && isspace((unsigned char)*a->name))
+			a->name++;
+		while (a->name_end > a->name 
+		    && isspace((unsigned char)a->name_end[-1]))
+			a->name_end--;
+	}
+	while (s < end && isspace((unsigned char)*s))
+		s++;
+	while (end > s && isspace((unsigned char)end[-1]))
+		end--;
+	if (s == end)
+		return 0;
+
+	a->at = NULL;
+	for (p = mm_header_scan(s, end, "@"); p < end; 
+	    p = mm_header_scan(p + 1, end, "@"))
+		a->at = p;
+
+	a->mailbox = s;
+	a->end = end;
+
+	return 1;
+}
+
+/*
+ * Returns the parsed value of a header field if it is of the given type
+ */
+static struct mm_headercache *
+mm_header_getcache(struct mm_mimeheader *header, int type)
+{
+	if (header->cache != NULL && header->cache->type == type)
+		return header->cache;
+
+	return NULL;
+}
+
+/*
+ * Replaces the parsed value of a header field with an empty one of the 
+ * given type, which has size bytes of room behind it
+ */
+static struct mm_headercache *
+mm_header_newcache(struct mm_mimeheader *header, int type, size_t size)
+{
+	struct mm_headercache *cache;
+
+	mm_header_dropcache(header);
+
+	cache = xmalloc(sizeof(struct mm_headercache) + size);
+	cache->type = type;
+	cache->valid = 1;
+	cache->date = 0;
+	cache->zone = 0;
+	cache->count = 0;
+	cache->ids = NULL;
+	cache->addresses = NULL;
+
+	header->cache = cache;
+
+	return cache;
+}
+
+/*
+ * Parses a date as in RFC 2822, section 3.3 and 4.3:
+ * [day-of-week ","] day month year hour ":" minute [":" second] zone
+ */
+static int
+mm_header_parsedate(const char *s, time_t *when, int *zone)
+{
+	static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+	static const struct {
+		const char *name;
+		int zone;
+	} zones[] = {
+		{ "ut", 0 }, { "gmt", 0 }, { "z", 0 },
+		{ "est", -300 }, { "edt", -240 },
+		{ "cst", -360 }, { "cdt", -300 },
+		{ "mst", -420 }, { "mdt", -360 },
+		{ "pst", -480 }, { "pdt", -420 },
+		{ NULL, 0 }
+	};
+	long day, month, year, hour, minute, second, tz;
+	char name[4];
+	const char *p;
+	int i, n;
+
+	s = mm_header_skipcfws(s);
+
+	/* The day of the week is redundant */
+	if (isalpha((unsigned char)*s)) {
+		while (isalpha((unsigned char)*s))
+			s++;
+		s = mm_header_skipcfws(s);
+		if (*s == ',')
+			s = mm_header_skipcfws(s + 1);
+	}
+
+	s = mm_header_number(s, 2, &day, &n);
+	if (n == 0)
+		return -1;
+	s = mm_header_skipcfws(s);
+	if (*s == '-')
+		s = mm_header_skipcfws(s + 1);
+
+	for (i = 0; i < 3 && isalpha((unsigned char)s[i]); i++)
+		name[i] = tolower((unsigned char)s[i]);
+	name[i] = '\0';
+	if (i < 3 || (p = strstr(months, name)) == NULL 
+	    || (p - months) % 3 != 0)
+		return -1;
+	month = (p - months) / 3 + 1;
+	while (isalpha((unsigned char)*s))
+		s++;
+	s = mm_header_skipcfws(s);
+	if (*s == '-')
+		s = mm_header_skipcfws(s + 1);
+
+	/* Obsolete two and three digit years, RFC 2822 section 4.3 */
+	s = mm_header_number(s, 4, &year, &n);
+	if (n < 2)
+		return -1;
+	if (n == 2)
+		year += year < 50 ? 2000 : 1900;
+	else if (n == 3)
+		year += 1900;
+	s = mm_header_skipcfws(s);
+
+	s = mm_header_number(s, 2, &hour, &n);
+	if (n == 0)
+		return -1;
+	s = mm_header_skipcfws(s);
+	if (*s != ':')
+		return -1;
+	s = mm_header_number(mm_header_skipcfws(s + 1), 2, &minute, &n);
+	if (n == 0)
+		return -1;
+	second = 0;
+	p = mm_header_skipcfws(s);
+	if (*p == ':') {
+		s = mm_header_number(mm_header_skipcfws(p + 1), 2, &second, 
+		    &n);
+		if (n == 0)
+			return -1;
+	}
+	s = mm_header_skipcfws(s);
+
+	/* A missing or unknown zone is taken as -0000, which is UTC */
+	tz = 0;
+	if ((*s == '+' || *s == '-') && isdigit((unsigned char)s[1])) {
+		p = mm_header_number(s + 1, 4, &tz, &n);
+		if (n != 4 || tz % 100 > 59)
+			return -1;
+		tz = (tz / 100) * 60 + tz % 100;
+		if (*s == '-')
+			tz = -tz;
+	} else if (isalpha((unsigned char)*s)) {
+		for (i = 0; i < 3 && isalpha((unsigned char)s[i]); i++)
+			name[i] = tolower((unsigned char)s[i]);
+		name[i] = '\0';
+		for (i = 0; zones[i].name != NULL; i++) {
+			if (!strcmp(zones[i].name, name)) {
+				tz = zones[i].zone;
+				break;
+			}
+		}
+	}
+
+	if (day < 1 || day > mm_header_monthdays(year, month) || hour > 23 
+	    || minute > 59 || second > 60)
+		return -1;
+
+	*when = (time_t)mm_header_days(year, month, day) * 86400 
+	    + hour * 3600 + minute * 60 + second - tz * 60;
+	*zone = (int)tz;
+
+	return 0;
+}
+
+/*
+ * Finds the message IDs in value. Returns their number and adds the room
+ * needed for them to *bytes. If cache is given, stores them in cache, 
+ * which has room for them.
+ */
+static int
+mm_header_parsemsgids(const char *value, struct mm_headercache *cache, 
+    size_t *bytes)
+{
+	const char *s, *e;
+	char *p;
+	size_t len;
+	int n;
+
+	n = 0;
+	p = cache != NULL ? (char *)(cache->ids + cache->count) : NULL;
+
+	for (s = value; *s != '\0'; s++) {
+		if (*s == '(' || *s == '"') {
+			e = mm_header_scan(s, s + strlen(s), "<");
+			if (*e == '\0')
+				break;
+			s = e;
+		}
+		if (*s != '<')
+			continue;
+
+		for (e = s + 1, len = 0; *e != '\0' && *e != '>'; e++)
+			if (!isspace((unsigned char)*e))
+				len++;
+		if (*e == '\0')
+			break;
+
+		if (len > 0) {
+			if (cache != NULL) {
+				cache->ids[n] = p;
+				for (s++; s < e; s++)
+					if (!isspace((unsigned char)*s))
+						*p++ = *s;
+				*p++ = '\0';
+			}
+			*bytes += len + 1;
+			n++;
+		}
+		s = e;
+	}
+
+	return n;
+}
+
+/*
+ * Finds the addresses in an address list. Returns their number and adds
+ * the room needed for their strings to *bytes. If cache is given, stores
+ * them in cache, which has room for them.
+ */
+static int
+mm_header_parseaddresses(const char *value, struct mm_headercache *cache,
+    size_t *bytes)
+{
+	struct mm_addrspan a;
+	const char *s, *e, *end, *item, *group;
+	char *p;
+	int n, ingroup;
+
+	n = 0;
+	ingroup = 0;
+	group = NULL;
+	p = cache != NULL ? (char *)(cache->addresses + cache->count) : NULL;
+
+	end = value + strlen(value);
+	for (s = value; s < end; s++) {
+		item = s;
+		s = mm_header_scan(s, end, ingroup ? ",;" : ",:");
+
+		if (s < end && *s == ':') {
+			while (item < s && isspace((unsigned char)*item))
+				item++;
+			for (e = s; e > item && isspace((unsigned char)e[-1]); 
+			    e--)
+				;
+			if (cache != NULL) {
+				group = p;
+				p = mm_header_copy(p, item, e, 1);
+			}
+			*bytes += e - item + 1;
+			ingroup = 1;
+			continue;
+		}
+
+		if (mm_header_splitaddress(item, s, &a)) {
+			if (cache != NULL) {
+				cache->addresses[n].name = NULL;
+				if (a.name != NULL && a.name < a.name_end) {
+					cache->addresses[n].name = p;
+					p = mm_header_copy(p, a.name, 
+					    a.name_end, 1);
+				}
+				cache->addresses[n].mailbox = p;
+				p = mm_header_copy(p, a.mailbox, a.end, 0);
+				cache->addresses[n].group = group;
+			}
+			if (a.name != NULL)
+				*bytes += a.name_end - a.name + 1;
+			*bytes += a.end - a.mailbox + 1;
+			n++;
+		}
+
+		if (s < end && *s == ';') {
+			ingroup = 0;
+			group = NULL;
+		}
+	}
+
+	return n;
+}
+
+/*
+ * Skips whitespace and comments
+ */
+static const char *
+mm_header_skipcfws(const char *s)
+{
+	int comment;
+
+	for (;;) {
+		while (isspace((unsigned char)*s))
+			s++;
+		if (*s != '(')
+			return s;
+
+		for (comment = 0; *s != '\0'; s++) {
+			if (*s == '\\' && s[1] != '\0')
+				s++;
+			else if (*s == '(')
+				comment++;
+			else if (*s == ')' && --comment == 0) {
+				s++;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Reads a number of at most max digits, *n is set to the number of digits
+ * read
+ */
+static const char *
+mm_header_number(const char *s, int max, long *value, int *n)
+{
+	*value = 0;
+	for (*n = 0; *n < max && isdigit((unsigned char)*s); (*n)++, s++)
+		*value = *value * 10 + (*s - '0');
+
+	return s;
+}
+
+/*
+ * Copies the bytes from s to end to p and terminates them. If unquote is
+ * set, quotes are left out and quoted pairs resolved. Returns where the 
+ * next string goes.
+ */
+static char *
+mm_header_copy(char *p, const char *s, const char *end, int unquote)
+{
+	for (; s < end; s++) {
+		if (unquote && *s == '"')
+			continue;
+		if (unquote && *s == '\\' && s + 1 < end)
+			s++;
+		*p++ = *s;
+	}
+	*p++ = '\0';
+
+	return p;
+}
+
+/*
+ * Returns the number of days from 1970-01-01 to the given date of the
+ * proleptic Gregorian calendar
+ */
+static long
+mm_header_days(long year, long month, long day)
+{
+	long era, yoe, doy, doe;
+
+	if (month <= 2)
+		year--;
+	era = (year >= 0 ? year : year - 399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + doe - 719468;
+}
+
+/*
+ * Returns the number of days in the given month of the proleptic 
+ * Gregorian calendar
+ */
+static long
+mm_header_monthdays(long year, long month)
+{
+	static const long days[] = { 
+	    31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+	if (month == 2 && year % 4 == 0 && (year % 100 != 0 || year % 400 == 0))
+		return 29;
+
+	return days[month - 1];
+}
@@ -0,0 +1,740 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_imap.c
+ *
+ * Generates the BODYSTRUCTURE and ENVELOPE data items of IMAP (RFC 3501)
+ * from a parsed message. Sizes and line counts of bodies are taken from
+ * the parser, which records where every MIME part is found in the message
+ * and counts the lines of the bodies while scanning them, so bodies need
+ * not be looked at again. Header fields are looked up through the header
+ * index of each part, which is built on the first lookup. The output is 
+ * written into a buffer supplied by the caller. Messages encapsulated in
+ * message/rfc822 parts are described by the MIME part the parser nested 
+ * in them. Sizes of bodies which are still to be encoded are counted by
+ * encoding them.
+ */
+
+/* Size of the chunks file bodies are read in to count their lines */
+#define MM_IMAP_CHUNKSIZE 4096
+
+typedef int (*mm_imap_generator)(struct mm_emitter *, MM_CTX *, 
+    struct mm_mimepart *, int);
+
+static int mm_imap_run(mm_imap_generator, MM_CTX *, struct mm_mimepart *,
+    int, char *, size_t, size_t *);
+static int mm_imap_body(struct mm_emitter *, MM_CTX *, struct mm_mimepart *,
+    int);
+static int mm_imap_basic(struct mm_emitter *, struct mm_mimepart *, int);
+static int mm_imap_message(struct mm_emitter *, struct mm_mimepart *, int);
+static int mm_imap_ismessage(struct mm_mimepart *);
+static int mm_imap_extension(struct mm_emitter *, struct mm_mimepart *);
+static int mm_imap_envelopeof(struct mm_emitter *, MM_CTX *, 
+    struct mm_mimepart *, int);
+static int mm_imap_addresses(struct mm_emitter *, const char *);
+static int mm_imap_address(struct mm_emitter *, const char *, const char *,
+    int *);
+static int mm_imap_params(struct mm_emitter *, struct mm_content *);
+static int mm_imap_nstring(struct mm_emitter *, const char *);
+static int mm_imap_string(struct mm_emitter *, const char *, size_t, int);
+static int mm_imap_number(struct mm_emitter *, size_t);
+static int mm_imap_octets(struct mm_mimepart *, size_t *);
+static size_t mm_imap_lines(struct mm_mimepart *);
+
+/** @{
+ * @name Generating IMAP data items
+ */
+
+/**
+ * Generates the IMAP BODYSTRUCTURE of a message or MIME part
+ *
+ * @param ctx A valid MiniMIME context
+ * @param part The MIME part to describe, or NULL for the whole message
+ * @param buf Where to store the BODYSTRUCTURE
+ * @param size The size of buf
+ * @param length Where to store the length of the BODYSTRUCTURE
+ * @param flags See enum mm_imap_flags
+ * @return 0 on success or -1 on failure. Sets mm_errno on failure.
+ *
+ * This function writes the parenthesized list which describes the MIME
+ * structure of a message in an IMAP FETCH response, starting with the 
+ * opening parenthesis. It is not NUL-terminated. With MM_IMAP_NOEXTENSIONS
+ * the extension data is left out, which gives the BODY data item.
+ *
+ * Sizes and line counts of MIME parts parsed from a message are those of
+ * the message source, as recorded by the parser. Parts with modified or 
+ * new bodies are described by the body held in memory. Their size is the
+ * size of the encoded body if it is still to be encoded, i.e. flagged with
+ * MM_MIMEPART_ENCODE or stored in a file. The envelope and structure of
+ * a message/rfc822 part are those of the message nested in it, which the
+ * parser does for messages which are not encoded. Other message/rfc822 
+ * parts are described as empty. Multipart entities without nested parts
+ * cannot be described.
+ *
+ * If buf is NULL or too small, length is set to the size needed and the
+ * function returns -1.
+ */
+int
+mm_imap_bodystructure(MM_CTX *ctx, struct mm_mimepart *part, char *buf, 
+    size_t size, size_t *length, int flags)
+{
+	assert(ctx != NULL);
+	assert(length != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (part == NULL && (part = mm_context_getpart(ctx, 0)) == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("context has no envelope");
+		return -1;
+	}
+
+	return mm_imap_run(mm_imap_body, ctx, part, flags, buf, size, length);
+}
+
+/**
+ * Generates the IMAP ENVELOPE of a message
+ *
+ * @param ctx A valid MiniMIME context
+ * @param buf Where to store the ENVELOPE
+ * @param size The size of buf
+ * @param length Where to store the length of the ENVELOPE
+ * @return 0 on success or -1 on failure. Sets mm_errno on failure.
+ *
+ * This function writes the parenthesized list of the date, subject, 
+ * address and reference header fields of a message, as in an IMAP FETCH
+ * response, starting with the opening parenthesis. It is not 
+ * NUL-terminated. Address lists are split into their addresses, with 
+ * groups in the form given by RFC 3501.
+ *
+ * If buf is NULL or too small, length is set to the size needed and the
+ * function returns -1.
+ */
+int
+mm_imap_envelope(MM_CTX *ctx, char *buf, size_t size, size_t *length)
+{
+	struct mm_mimepart *envelope;
+
+	assert(ctx != NULL);
+	assert(length != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if ((envelope = mm_context_getpart(ctx, 0)) == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("context has no envelope");
+		return -1;
+	}
+
+	return mm_imap_run(mm_imap_envelopeof, ctx, envelope, 0, buf, size,
+	    length);
+}
+
+/** @} */
+
+/*
+ * Runs a generator into buf. If that fails for lack of space, it is run 
+ * again to count the bytes needed.
+ */
+static int
+mm_imap_run(mm_imap_generator generate, MM_CTX *ctx, 
+    struct mm_mimepart *part, int flags, char *buf, size_t size, 
+    size_t *length)
+{
+	struct mm_emitter emitter;
+
+	if (buf != NULL) {
+		mm_emitter_buffer(&emitter, buf, size);
+		if (generate(&emitter, ctx, part, flags) == 0) {
+			*length = emitter.length;
+			return 0;
+		}
+	}
+
+	mm_emitter_count(&emitter);
+	if (generate(&emitter, ctx, part, flags) == -1)
+		return -1;
+	*length = emitter.length;
+
+	mm_errno = MM_ERROR_PROGRAM;
+	mm_error_setmsg("output buffer too small");
+	return -1;
+}
+
+/*
+ * Emits the body structure of a part. The parts of a multipart context 
+ * are nested in its envelope. The message nested in a message/rfc822 part
+ * is described with the fields of the part.
+ */
+static int
+mm_imap_body(struct mm_emitter *emitter, MM_CTX *ctx, 
+    struct mm_mimepart *part, int flags)
+{
+	struct mm_mimepart *child;
+	const char *subtype;
+	int envelope, nested;
+
+	envelope = ctx != NULL && part == mm_context_getpart(ctx, 0);
+	if (envelope)
+		nested = mm_context_iscomposite(ctx) 
+		    && mm_context_nextpart(ctx, part) != NULL;
+	else
+		nested = part->nchildren > 0 && !mm_imap_ismessage(part);
+
+	if (!nested) {
+		if (part->type != NULL 
+		    && part->type->mediatype == MM_MEDIATYPE_MULTIPART) {
+			mm_errno = MM_ERROR_MIME;
+			mm_error_setmsg("multipart entity without nested "
+			    "MIME parts");
+			return -1;
+		}
+		if (mm_emit(emitter, "(", 1) == -1
+		    || mm_imap_basic(emitter, part, flags) == -1)
+			return -1;
+		return mm_emit(emitter, ")", 1);
+	}
+
+	if (mm_emit(emitter, "(", 1) == -1)
+		return -1;
+	if (envelope) {
+		for (child = mm_context_nextpart(ctx, part); child != NULL;
+		    child = mm_context_nextpart(ctx, child))
+			if (mm_imap_body(emitter, NULL, child, flags) == -1)
+				return -1;
+	} else {
+		TAILQ_FOREACH(child, &part->children, next)
+			if (mm_imap_body(emitter, NULL, child, flags) == -1)
+				return -1;
+	}
+
+	subtype = part->type != NULL && part->type->subtype != NULL ?
+	    part->type->subtype : "MIXED";
+	if (mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_string(emitter, subtype, strlen(subtype), 0) == -1)
+		return -1;
+
+	if (!(flags & MM_IMAP_NOEXTENSIONS)) {
+		if (mm_emit(emitter, " ", 1) == -1
+		    || mm_imap_params(emitter, part->type) == -1
+		    || mm_imap_extension(emitter, part) == -1)
+			return -1;
+	}
+
+	return mm_emit(emitter, ")", 1);
+}
+
+/*
+ * Emits the fields of a part which is not a multipart entity, without the
+ * parentheses around them
+ */
+static int
+mm_imap_basic(struct mm_emitter *emitter, struct mm_mimepart *part, 
+    int flags)
+{
+	struct mm_content *ct;
+	const char *maintype, *subtype, *encoding;
+	size_t octets;
+
+	ct = part->type;
+	maintype = ct != NULL && ct->maintype != NULL ? ct->maintype : "TEXT";
+	subtype = ct != NULL && ct->subtype != NULL ? ct->subtype : "PLAIN";
+	encoding = ct != NULL && ct->encstring != NULL ? ct->encstring : "7BIT";
+
+	if (mm_imap_string(emitter, maintype, strlen(maintype), 0) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_string(emitter, subtype, strlen(subtype), 0) == -1
+	    || mm_emit(emitter, " ", 1) == -1)
+		return -1;
+
+	if (ct == NULL) {
+		if (mm_emit_string(emitter, "(\"CHARSET\" \"US-ASCII\")") == -1)
+			return -1;
+	} else if (mm_imap_params(emitter, ct) == -1) {
+		return -1;
+	}
+
+	if (mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Content-ID", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Content-Description", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_string(emitter, encoding, strlen(encoding), 0) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_octets(part, &octets) == -1
+	    || mm_imap_number(emitter, octets) == -1)
+		return -1;
+
+	if (ct != NULL && mm_content_istype(ct, MM_MEDIATYPE_MESSAGE, 
+	    MM_MEDIASUBTYPE_RFC822)) {
+		if (mm_emit(emitter, " ", 1) == -1
+		    || mm_imap_message(emitter, part, flags) == -1
+		    || mm_emit(emitter, " ", 1) == -1
+		    || mm_imap_number(emitter, mm_imap_lines(part)) == -1)
+			return -1;
+	} else if (ct == NULL || ct->maintype == NULL 
+	    || ct->mediatype == MM_MEDIATYPE_TEXT) {
+		if (mm_emit(emitter, " ", 1) == -1
+		    || mm_imap_number(emitter, mm_imap_lines(part)) == -1)
+			return -1;
+	}
+
+	if (!(flags & MM_IMAP_NOEXTENSIONS)) {
+		if (mm_emit(emitter, " ", 1) == -1
+		    || mm_imap_nstring(emitter, 
+		    mm_mimepart_getheadervalue(part, "Content-MD5", 0)) == -1
+		    || mm_imap_extension(emitter, part) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits the envelope and body structure of the message encapsulated in a
+ * message/rfc822 part, i.e. of the MIME part nested in it. Messages which
+ * have not been parsed are described as empty.
+ */
+static int
+mm_imap_message(struct mm_emitter *emitter, struct mm_mimepart *part, 
+    int flags)
+{
+	struct mm_mimepart *message;
+
+	if (!mm_imap_ismessage(part)) {
+		return mm_emit_string(emitter, "(NIL NIL NIL NIL NIL NIL NIL NIL "
+		    "NIL NIL) (\"TEXT\" \"PLAIN\" NIL NIL NIL \"7BIT\" 0 0)");
+	}
+
+	message = TAILQ_FIRST(&part->children);
+	if (mm_imap_envelopeof(emitter, NULL, message, flags) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_body(emitter, NULL, message, flags) == -1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Checks whether a part is a message/rfc822 part with the message it
+ * encapsulates nested in it
+ */
+static int
+mm_imap_ismessage(struct mm_mimepart *part)
+{
+	return part->type != NULL && part->nchildren == 1
+	    && mm_content_istype(part->type, MM_MEDIATYPE_MESSAGE, 
+	    MM_MEDIASUBTYPE_RFC822);
+}
+
+/*
+ * Emits the extension data shared by all parts: the disposition with its
+ * parameters, the language and the location of the body
+ */
+static int
+mm_imap_extension(struct mm_emitter *emitter, struct mm_mimepart *part)
+{
+	const char *names[] = { "FILENAME", "CREATION-DATE", 
+	    "MODIFICATION-DATE", "READ-DATE", "SIZE" };
+	const char *values[5];
+	int i, n;
+
+	if (mm_emit(emitter, " ", 1) == -1)
+		return -1;
+
+	if (part->disposition_type == NULL) {
+		if (mm_emit(emitter, "NIL", 3) == -1)
+			return -1;
+	} else {
+		values[0] = part->filename;
+		values[1] = part->creation_date;
+		values[2] = part->modification_date;
+		values[3] = part->read_date;
+		values[4] = part->disposition_size;
+
+		if (mm_emit(emitter, "(", 1) == -1
+		    || mm_imap_nstring(emitter, part->disposition_type) == -1
+		    || mm_emit(emitter, " ", 1) == -1)
+			return -1;
+		n = 0;
+		for (i = 0; i < 5; i++) {
+			if (values[i] == NULL)
+				continue;
+			if (mm_emit(emitter, n++ ? " " : "(", 1) == -1
+			    || mm_imap_nstring(emitter, names[i]) == -1
+			    || mm_emit(emitter, " ", 1) == -1
+			    || mm_imap_nstring(emitter, values[i]) == -1)
+				return -1;
+		}
+		if (mm_emit_string(emitter, n ? "))" : "NIL)") == -1)
+			return -1;
+	}
+
+	if (mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Content-Language", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Content-Location", 0)) == -1)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Emits the envelope of a message. Sender and Reply-To default to From.
+ */
+static int
+mm_imap_envelopeof(struct mm_emitter *emitter, MM_CTX *ctx, 
+    struct mm_mimepart *part, int flags)
+{
+	const char *from, *sender, *replyto;
+
+	from = mm_mimepart_getheadervalue(part, "From", 0);
+	sender = mm_mimepart_getheadervalue(part, "Sender", 0);
+	replyto = mm_mimepart_getheadervalue(part, "Reply-To", 0);
+
+	if (mm_emit(emitter, "(", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Date", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Subject", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_addresses(emitter, from) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_addresses(emitter, sender ? sender : from) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_addresses(emitter, replyto ? replyto : from) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_addresses(emitter, 
+	    mm_mimepart_getheadervalue(part, "To", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_addresses(emitter, 
+	    mm_mimepart_getheadervalue(part, "Cc", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_addresses(emitter, 
+	    mm_mimepart_getheadervalue(part, "Bcc", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "In-Reply-To", 0)) == -1
+	    || mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_nstring(emitter, 
+	    mm_mimepart_getheadervalue(part, "Message-ID", 0)) == -1)
+		return -1;
+
+	return mm_emit(emitter, ")", 1);
+}
+
+/*
+ * Emits an address list as a list of addresses, or NIL if it is empty. A
+ * group is given as an address with only a mailbox, the group's name, 
+ * followed by its members and an address of NILs.
+ */
+static int
+mm_imap_addresses(struct mm_emitter *emitter, const char *value)
+{
+	const char *s, *end, *item;
+	int n, group;
+
+	if (value == NULL)
+		return mm_emit(emitter, "NIL", 3);
+
+	n = 0;
+	group = 0;
+	end = value + strlen(value);
+	for (s = value; s < end; s++) {
+		item = s;
+		s = mm_header_scan(s, end, group ? ",;" : ",:");
+
+		if (s < end && *s == ':') {
+			while (item < s && isspace((unsigned char)*item))
+				item++;
+			if (mm_emit_string(emitter, n++ ? "" : "(") == -1
+			    || mm_emit_string(emitter, "(NIL NIL ") == -1
+			    || mm_imap_string(emitter, item, s - item, 1) == -1
+			    || mm_emit_string(emitter, " NIL)") == -1)
+				return -1;
+			group = 1;
+			continue;
+		}
+
+		if (mm_imap_address(emitter, item, s, &n) == -1)
+			return -1;
+
+		if (s < end && *s == ';') {
+			if (mm_emit_string(emitter, "(NIL NIL NIL NIL)") == -1)
+				return -1;
+			group = 0;
+		}
+	}
+
+	if (group && mm_emit_string(emitter, "(NIL NIL NIL NIL)") == -1)
+		return -1;
+
+	return mm_emit_string(emitter, n ? ")" : "NIL");
+}
+
+/*
+ * Emits one address of an address list, "Name <local@domain>" or 
+ * "local@domain (Name)", if it is not empty. *n counts the addresses 
+ * emitted.
+ */
+static int
+mm_imap_address(struct mm_emitter *emitter, const char *s, const char *end,
+    int *n)
+{
+	struct mm_addrspan a;
+
+	if (mm_header_splitaddress(s, end, &a) == 0)
+		return 0;
+
+	if (mm_emit_string(emitter, (*n)++ ? "(" : "((") == -1)
+		return -1;
+
+	if (a.name == NULL || a.name == a.name_end) {
+		if (mm_emit(emitter, "NIL", 3) == -1)
+			return -1;
+	} else if (mm_imap_string(emitter, a.name, a.name_end - a.name, 1) 
+	    == -1) {
+		return -1;
+	}
+
+	if (mm_emit(emitter, " ", 1) == -1)
+		return -1;
+	if (a.route == NULL) {
+		if (mm_emit(emitter, "NIL", 3) == -1)
+			return -1;
+	} else if (mm_imap_string(emitter, a.route, a.route_end - a.route, 0)
+	    == -1) {
+		return -1;
+	}
+
+	if (mm_emit(emitter, " ", 1) == -1
+	    || mm_imap_string(emitter, a.mailbox, 
+	    (a.at ? a.at : a.end) - a.mailbox, 1) == -1
+	    || mm_emit(emitter, " ", 1) == -1)
+		return -1;
+	if (a.at == NULL) {
+		if (mm_emit(emitter, "\"\"", 2) == -1)
+			return -1;
+	} else if (mm_imap_string(emitter, a.at + 1, a.end - a.at - 1, 0) 
+	    == -1) {
+		return -1;
+	}
+
+	return mm_emit(emitter, ")", 1);
+}
+
+/*
+ * Emits the parameters of a Content-Type as a list of names and values, 
+ * or NIL if there are none
+ */
+static int
+mm_imap_params(struct mm_emitter *emitter, struct mm_content *ct)
+{
+	struct mm_param *param;
+	int n;
+
+	n = 0;
+	if (ct != NULL) {
+		TAILQ_FOREACH(param, &ct->params, next) {
+			if (param->name == NULL || param->value == NULL)
+				continue;
+			if (mm_emit(emitter, n++ ? " " : "(", 1) == -1
+			    || mm_imap_nstring(emitter, param->name) == -1
+			    || mm_emit(emitter, " ", 1) == -1
+			    || mm_imap_nstring(emitter, param->value) == -1)
+				return -1;
+		}
+	}
+
+	return mm_emit_string(emitter, n ? ")" : "NIL");
+}
+
+/*
+ * Emits a string, or NIL for NULL
+ */
+static int
+mm_imap_nstring(struct mm_emitter *emitter, const char *s)
+{
+	if (s == NULL)
+		return mm_emit(emitter, "NIL", 3);
+
+	return mm_imap_string(emitter, s, strlen(s), 0);
+}
+
+/*
+ * Emits len bytes at s as a quoted string, or as a literal if they contain
+ * line breaks or 8-bit characters. If unquote is set, the bytes are taken
+ * to be of a header field, and quotes and quoted pairs are resolved.
+ */
+static int
+mm_imap_string(struct mm_emitter *emitter, const char *s, size_t len, 
+    int unquote)
+{
+	char prefix[32];
+	size_t i, start, n;
+	int literal, escaped;
+
+	n = 0;
+	literal = 0;
+	escaped = 0;
+	for (i = 0; i < len; i++) {
+		if (unquote && !escaped && (s[i] == '"' || s[i] == '\\')) {
+			escaped = s[i] == '\\';
+			continue;
+		}
+		escaped = 0;
+		if (s[i] == '\r' || s[i] == '\n' || s[i] == '\0' 
+		    || (unsigned char)s[i] >= 0x80)
+			literal = 1;
+		n++;
+	}
+
+	if (literal) {
+		snprintf(prefix, sizeof(prefix), "{%lu}\r\n", (unsigned long)n);
+		if (mm_emit_transient(emitter, prefix, strlen(prefix)) == -1)
+			return -1;
+	} else if (mm_emit(emitter, "\"", 1) == -1) {
+		return -1;
+	}
+
+	/* Copy runs of plain characters, leaving out or escaping the others */
+	escaped = 0;
+	for (i = start = 0; i < len; i++) {
+		if (unquote && !escaped && (s[i] == '"' || s[i] == '\\')) {
+			if (mm_emit(emitter, s + start, i - start) == -1)
+				return -1;
+			start = i + 1;
+			escaped = s[i] == '\\';
+			continue;
+		}
+		escaped = 0;
+		if (!literal && (s[i] == '"' || s[i] == '\\')) {
+			if (mm_emit(emitter, s + start, i - start) == -1
+			    || mm_emit(emitter, "\\", 1) == -1)
+				return -1;
+			start = i;
+		}
+	}
+	if (mm_emit(emitter, s + start, len - start) == -1)
+		return -1;
+
+	return literal ? 0 : mm_emit(emitter, "\"", 1);
+}
+
+static int
+mm_imap_number(struct mm_emitter *emitter, size_t number)
+{
+	char buf[32];
+
+	snprintf(buf, sizeof(buf), "%lu", (unsigned long)number);
+	return mm_emit_transient(emitter, buf, strlen(buf));
+}
+
+/*
+ * Gets the size of the body of a part: from where the parser found it if 
+ * it has not been changed since, or of the body as it is written 
+ * otherwise. Bodies flagged with MM_MIMEPART_ENCODE and bodies stored in
+ * files are counted as they are encoded when written, which fails if the
+ * file cannot be read.
+ */
+static int
+mm_imap_octets(struct mm_mimepart *part, size_t *octets)
+{
+	if (part->src_hdrlen > 0 && !(part->dirty & MM_DIRTY_BODY)
+	    && part->src_length >= part->src_hdrlen) {
+		*octets = part->src_length - part->src_hdrlen;
+		return 0;
+	}
+
+	if (!(part->flags & MM_MIMEPART_ENCODE) && !MM_MIMEPART_HASFILE(part)) {
+		*octets = part->length;
+		return 0;
+	}
+
+	return mm_emit_bodysize(part, octets);
+}
+
+/*
+ * Gets the number of lines of the body of a part, as counted by the parser
+ * if it has not been changed since, counting them otherwise
+ */
+static size_t
+mm_imap_lines(struct mm_mimepart *part)
+{
+	char buf[MM_IMAP_CHUNKSIZE];
+	const char *p, *end;
+	size_t lines, pos, nread;
+	int fd, last;
+
+	if (part->lines >= 0 && !(part->dirty & MM_DIRTY_BODY))
+		return part->lines;
+
+	lines = 0;
+	last = '\n';
+	if (MM_MIMEPART_HASFILE(part)) {
+		if ((fd = mm_mimepart_openbody(part)) == -1)
+			return 0;
+		for (pos = 0; pos < part->length; pos += nread) {
+			if (mm_mimepart_readbody(part, fd, pos, buf, 
+			    sizeof(buf), &nread) == -1 || nread == 0)
+				break;
+			for (p = buf; (p = memchr(p, '\n', buf + nread - p)) 
+			    != NULL; p++)
+				lines++;
+			last = buf[nread - 1];
+		}
+		mm_mimepart_closebody(part, fd);
+	} else if (part->body != NULL && part->length > 0) {
+		end = part->body + part->length;
+		for (p = part->body; (p = memchr(p, '\n', end - p)) != NULL; 
+		    p++)
+			lines++;
+		last = end[-1];
+	}
+
+	return last == '\n' ? lines : lines + 1;
+}
@@ -42,6 +42,7 @@ int mm_errno;
 struct mm_error_data mm_error;
 static int mm_initialized;
 struct mm_codecs codecs;
+u_int32_t codecs_generation;
 
 int
 mm_library_init(void)
@@ -52,6 +53,7 @@ mm_library_init(void)
 	mm_initialized = 1;
 
 	SLIST_INIT(&codecs);
+	codecs_generation = 1;
 
 	mm_error_init();
 
@@ -60,6 +60,195 @@ char *xstrdup(const char *);
 
 char *xstrsep(char **, const char *);
 
+/** @} */
+
+/**
+ * @{
+ * @name Storage for header fields and parameters
+ */
+
+/* What of a header field or parameter is held in storage */
+enum mm_stored_flags
+{
+	MM_STORED_OBJECT = (1L << 0),
+	MM_STORED_NAME = (1L << 1),
+	MM_STORED_VALUE = (1L << 2)
+};
+
+void mm_arena_init(struct mm_arena *);
+void mm_arena_free(struct mm_arena *);
+void *mm_arena_alloc(struct mm_arena *, size_t);
+char *mm_arena_strdup(struct mm_arena *, const char *);
+void mm_arena_release(struct mm_arena *, void *, size_t);
+void mm_arena_strfree(struct mm_arena *, char *);
+
+/** @} */
+
+/**
+ * @{
+ * @name Serializing MiniMIME objects
+ */
+
+/*
+ * Receives the bytes of a serialized object, see mm_emitter.c
+ */
+struct mm_emitter
+{
+	int (*emit)(struct mm_emitter *, const char *, size_t);
+	size_t length;
+
+	/* Buffer emitter */
+	char *buf;
+	size_t size;
+
+	/* Scatter-gather emitter */
+	int fd;
+	struct iovec *iov;
+	int iovcnt;
+
+	/* Sink emitter, stages data in buf */
+	struct mm_sink *sink;
+	size_t fill;
+
+	/* Encoded payload cache of the context being emitted, if any */
+	struct mm_cache *cache;
+
+	/* Optional, called before each header section and body emitted and
+	 * after each body. Returning 1 before a body makes the emitter emit
+	 * it as is, without encoding it. */
+	int (*mark)(struct mm_emitter *, struct mm_mimepart *, int);
+	void *arg;
+};
+
+/* What an emitter is about to emit when its mark function is called */
+enum mm_emit_marks
+{
+	MM_EMIT_HEADERS,
+	MM_EMIT_BODY,
+	MM_EMIT_BODYEND
+};
+
+/* Size of the work buffer for bodies encoded on the fly */
+#define MM_EMITTER_CHUNKSIZE 4096
+
+/*
+ * State of encoding data which is passed in pieces, see mm_emit_encode()
+ */
+struct mm_emitter_encoder
+{
+	struct mm_codec *codec;
+
+	/* Data the codec left for the next piece */
+	char in[MM_EMITTER_CHUNKSIZE];
+	size_t have;
+
+	int col;
+};
+
+void mm_emitter_count(struct mm_emitter *);
+void mm_emitter_buffer(struct mm_emitter *, char *, size_t);
+int mm_emitter_writev(struct mm_emitter *, int);
+void mm_emitter_sink(struct mm_emitter *, struct mm_sink *);
+int mm_emitter_flush(struct mm_emitter *);
+void mm_emitter_close(struct mm_emitter *);
+int mm_emit(struct mm_emitter *, const char *, size_t);
+int mm_emit_transient(struct mm_emitter *, const char *, size_t);
+int mm_emit_string(struct mm_emitter *, const char *);
+int mm_emit_value(struct mm_emitter *, size_t *, const char *);
+int mm_emit_header(struct mm_emitter *, const char *, const char *);
+int mm_emit_params(struct mm_emitter *, struct mm_content *, size_t *);
+int mm_emit_contenttype(struct mm_emitter *, struct mm_content *);
+int mm_emit_headers(struct mm_emitter *, struct mm_mimepart *);
+int mm_emit_headersection(struct mm_emitter *, struct mm_mimepart *, int);
+int mm_emit_body(struct mm_emitter *, struct mm_mimepart *);
+int mm_emit_bodysize(struct mm_mimepart *, size_t *);
+void mm_emitter_encoder_init(struct mm_emitter_encoder *, struct mm_codec *);
+int mm_emit_encode(struct mm_emitter *, struct mm_emitter_encoder *, 
+    const char *, size_t, int);
+int mm_emit_mimepart(struct mm_emitter *, struct mm_mimepart *, int);
+int mm_emit_prepare(MM_CTX *, int);
+int mm_emit_context(struct mm_emitter *, MM_CTX *, int);
+
+/** @} */
+
+/**
+ * @{
+ * @name Bodies stored in files
+ */
+#define MM_MIMEPART_HASFILE(part) \
+	((part)->body_path != NULL || (part)->body_fd != -1)
+
+int mm_mimepart_openbody(struct mm_mimepart *);
+void mm_mimepart_closebody(struct mm_mimepart *, int);
+int mm_mimepart_readbody(struct mm_mimepart *, int, size_t, char *, size_t,
+    size_t *);
+
+/** @} */
+
+/**
+ * @{
+ * @name Structured header field values
+ */
+
+/*
+ * The pieces of an address, "Name <@route:local@domain>" or 
+ * "local@domain (Name)". at is NULL if there is no domain.
+ */
+struct mm_addrspan
+{
+	const char *name;
+	const char *name_end;
+	const char *route;
+	const char *route_end;
+	const char *mailbox;
+	const char *at;
+	const char *end;
+};
+
+const char *mm_header_scan(const char *, const char *, const char *);
+int mm_header_splitaddress(const char *, const char *, struct mm_addrspan *);
+void mm_header_dropcache(struct mm_mimeheader *);
+
+/** @} */
+
+/**
+ * @{
+ * @name Charset and parameter helpers
+ */
+size_t mm_charset_convert(const char *, size_t, const char *, size_t, char *);
+int mm_rfc2231_assemble(struct mm_params *, struct mm_params *, int);
+int mm_rfc2231_isattrchar(int);
+size_t mm_rfc2231_encodedlength(const char *);
+void mm_content_paramchanged(struct mm_content *);
+
+/** @} */
+
+/**
+ * @{
+ * @name Encoded payload cache
+ */
+struct mm_body *mm_cache_encode(struct mm_cache *, struct mm_mimepart *,
+    struct mm_codec *);
+
+/** @} */
+
+/**
+ * @{
+ * @name Trees of MIME parts
+ */
+struct mm_mimepart *mm_context_nextpart(MM_CTX *, struct mm_mimepart *);
+
+/** @} */
+
+/**
+ * @{
+ * @name Message sources
+ */
+struct mm_body *mm_body_fromfile(FILE *);
+void mm_body_attachsource(MM_CTX *, struct mm_body *);
+
+/** @} */
+
 /* THIS FILE IS INTENTIONALLY LEFT BLANK */
 
 #endif /* ! _MM_INTERNAL_H_INCLUDED */
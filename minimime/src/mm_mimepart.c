@@ -39,10 +39,23 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <ctype.h>
+#include <errno.h>
 #include <assert.h>
 
 #include "mm_internal.h"
 
+static void mm_mimepart_releasebody(struct mm_mimepart *, int);
+static struct mm_headerindex *mm_mimepart_getindex(struct mm_mimepart *);
+static struct mm_headerchain *mm_mimepart_getchain(struct mm_headerindex *,
+    const char *, u_int32_t);
+static void mm_mimepart_indexheader(struct mm_headerindex *, 
+    struct mm_mimeheader *);
+static void mm_mimepart_unindexheader(struct mm_mimepart *, 
+    struct mm_mimeheader *);
+static u_int32_t mm_mimepart_hashname(const char *);
+static void mm_mimepart_growchildindex(struct mm_mimepart *);
+static char *mm_mimepart_rundecoder(struct mm_mimepart *, struct mm_codec *);
+
 /** @file mm_mimepart.c
  *
  * This module contains functions for manipulating MIME header objects.
@@ -78,12 +91,16 @@ mm_mimepart_new(void)
 	part = (struct mm_mimepart *)xmalloc(sizeof(struct mm_mimepart));
 
 	TAILQ_INIT(&part->headers);
+	part->hindex = NULL;
+	mm_arena_init(&part->store);
 
 	part->opaque_length = 0;
 	part->opaque_body = NULL;
 	
 	part->length = 0;
 	part->body = NULL;
+	part->lines = -1;
+	part->shared = NULL;
 	
 	part->type = NULL;
 
@@ -94,6 +111,27 @@ mm_mimepart_new(void)
 	part->read_date = NULL;
 	part->disposition_size = NULL;
 
+	part->flags = MM_MIMEPART_NONE;
+
+	part->body_path = NULL;
+	part->body_fd = -1;
+	part->body_offset = 0;
+
+	part->source = NULL;
+	part->src_offset = 0;
+	part->src_hdrlen = 0;
+	part->src_length = 0;
+	part->src_headers = 0;
+	part->dirty = MM_DIRTY_NONE;
+	part->encoded = NULL;
+	part->encoded_codec = NULL;
+
+	part->parent = NULL;
+	TAILQ_INIT(&part->children);
+	part->childindex = NULL;
+	part->nchildren = 0;
+	part->childindex_size = 0;
+
 	return part;
 }
 
@@ -105,14 +143,15 @@ mm_mimepart_new(void)
  *
  * This function creates a new MIME part object from a file. The object should
  * be freed using mm_mimepart_free() later on. This function does NOT set the
- * Content-Type and neither does any encoding work.
+ * Content-Type and neither does any encoding work. The whole file is read
+ * into memory, see mm_mimepart_setbodyfile() for large files.
  */
 struct mm_mimepart *
 mm_mimepart_fromfile(const char *filename)
 {
 	int fd;
 	char *data;
-	size_t r;
+	ssize_t r;
 	struct stat st;
 	struct mm_mimepart *part;
 
@@ -129,10 +168,11 @@ mm_mimepart_fromfile(const char *filename)
 		return NULL;
 	}
 
-	data = xmalloc(st.st_size);
+	data = xmalloc(st.st_size + 1);
 	r = read(fd, data, st.st_size);
 	if (r != st.st_size) {
 		mm_errno = MM_ERROR_ERRNO;
+		xfree(data);
 		close(fd);
 		return(NULL);
 	}
@@ -153,27 +193,34 @@ mm_mimepart_fromfile(const char *filename)
  *
  * @param part A pointer to an allocated mm_mimepart object
  * @see mm_mimepart_new
+ *
+ * The MIME parts nested in the part are freed as well.
  */
 void
 mm_mimepart_free(struct mm_mimepart *part)
 {
 	struct mm_mimeheader *header;
+	struct mm_mimepart *child;
 
 	assert(part != NULL);
 
-	TAILQ_FOREACH(header, &part->headers, next) {
-		mm_mimeheader_free(header);
-		TAILQ_REMOVE(&part->headers, header, next);
+	while ((child = TAILQ_FIRST(&part->children)) != NULL) {
+		TAILQ_REMOVE(&part->children, child, next);
+		mm_mimepart_free(child);
+	}
+	if (part->childindex != NULL) {
+		xfree(part->childindex);
+		part->childindex = NULL;
 	}
 
-	if (part->opaque_body != NULL) {
-		xfree(part->opaque_body);
-		part->opaque_body = NULL;
-		part->body = NULL;
-	} else if (part->body != NULL) {
-		xfree(part->body);
-		part->body = NULL;
+	mm_mimepart_reindexheaders(part);
+	while ((header = TAILQ_FIRST(&part->headers)) != NULL) {
+		TAILQ_REMOVE(&part->headers, header, next);
+		mm_mimeheader_free(header);
 	}
+	mm_arena_free(&part->store);
+
+	mm_mimepart_releasebody(part, 1);
 
 	if (part->type != NULL) {
 		mm_content_free(part->type);
@@ -202,7 +249,12 @@ mm_mimepart_free(struct mm_mimepart *part)
 	}
 	if (part->disposition_size != NULL) {
 		xfree(part->disposition_size);
-		part->read_date = NULL;
+		part->disposition_size = NULL;
+	}
+
+	if (part->source != NULL) {
+		mm_body_unref(part->source);
+		part->source = NULL;
 	}
 
 	xfree(part);
@@ -234,30 +286,128 @@ mm_mimepart_attachheader(struct mm_mimepart *part, struct mm_mimeheader *header)
 		TAILQ_INSERT_TAIL(&part->headers, header, next);
 	}
 
+	if (part->hindex != NULL)
+		mm_mimepart_indexheader(part->hindex, header);
+
 	return(0);
 }
 
 /**
- * Retrieves the number of MIME headers available in a MIME part
+ * Adds a header field to a MIME part
  *
  * @param part A valid MIME part object
- * @return The number of MIME headers within the MIME part
+ * @param name The name of the header field
+ * @param value The value of the header field
+ * @return The new header field
+ *
+ * Like mm_mimepart_attachheader() with a header field from 
+ * mm_mimeheader_generate(), but the header field, its name and its value
+ * are kept in the storage of the MIME part instead of being allocated one
+ * by one. The storage grows in blocks, which keeps the header fields of a
+ * part close together in memory, and is released with the part. The 
+ * header field belongs to the MIME part, and must not be attached to
+ * another one. When it is freed, or its value replaced, the memory is
+ * given back to the storage and reused for later header fields, so the
+ * storage does not grow when header fields are removed (see 
+ * mm_mimepart_removeheader()) and added again.
  */
-int
-mm_mimepart_countheaders(struct mm_mimepart *part)
+struct mm_mimeheader *
+mm_mimepart_addheader(struct mm_mimepart *part, const char *name, 
+    const char *value)
 {
-	int found;
 	struct mm_mimeheader *header;
 
+	assert(part != NULL);
+	assert(name != NULL && value != NULL);
+
+	header = mm_arena_alloc(&part->store, sizeof(struct mm_mimeheader));
+	header->name = mm_arena_strdup(&part->store, name);
+	header->value = mm_arena_strdup(&part->store, value);
+	header->decoded = NULL;
+	header->src_offset = 0;
+	header->src_length = 0;
+	header->source = NULL;
+	header->samename = NULL;
+	header->stored = MM_STORED_OBJECT | MM_STORED_NAME | MM_STORED_VALUE;
+	header->store = &part->store;
+	header->cache = NULL;
+
+	mm_mimepart_attachheader(part, header);
+
+	return header;
+}
+
+/**
+ * Removes a header field from a MIME part and frees it
+ *
+ * @param part A valid MIME part object
+ * @param header A header field of the part
+ * @return 0 on success
+ *
+ * The header field is taken out of the index of the part's header fields
+ * as well, so later lookups by name do not find it. It is not written out
+ * anymore, even for parsed messages whose source is kept.
+ */
+int
+mm_mimepart_removeheader(struct mm_mimepart *part, 
+    struct mm_mimeheader *header)
+{
+	assert(part != NULL);
+	assert(header != NULL);
+
+	TAILQ_REMOVE(&part->headers, header, next);
+	if (part->hindex != NULL)
+		mm_mimepart_unindexheader(part, header);
+	mm_mimeheader_free(header);
+
+	return 0;
+}
+
+/**
+ * Drops the index of the header fields of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @return Nothing
+ *
+ * Header fields are looked up by name through an index, which is built on 
+ * the first lookup and kept up to date by mm_mimepart_attachheader(). 
+ * Applications which change the headers list of a MIME part directly, or
+ * the name of a header field, must call this function afterwards. The 
+ * index is then built again on the next lookup.
+ */
+void
+mm_mimepart_reindexheaders(struct mm_mimepart *part)
+{
+	struct mm_headerchain *chain, *nxt;
+	int i;
+
 	assert(part != NULL);
 
-	found = 0;
+	if (part->hindex == NULL)
+		return;
 
-	TAILQ_FOREACH(header, &part->headers, next) {
-		found++;
+	for (i = 0; i < MM_HEADERINDEX_SIZE; i++) {
+		for (chain = part->hindex->hash[i]; chain != NULL; chain = nxt) {
+			nxt = chain->hnext;
+			xfree(chain);
+		}
 	}
+	xfree(part->hindex);
+	part->hindex = NULL;
+}
+
+/**
+ * Retrieves the number of MIME headers available in a MIME part
+ *
+ * @param part A valid MIME part object
+ * @return The number of MIME headers within the MIME part
+ */
+int
+mm_mimepart_countheaders(struct mm_mimepart *part)
+{
+	assert(part != NULL);
 
-	return found;
+	return mm_mimepart_getindex(part)->count;
 }
 
 /**
@@ -270,20 +420,17 @@ mm_mimepart_countheaders(struct mm_mimepart *part)
 int
 mm_mimepart_countheaderbyname(struct mm_mimepart *part, const char *name)
 {
-	int found;
-	struct mm_mimeheader *header;
+	struct mm_headerchain *chain;
 
 	assert(part != NULL);
+	assert(name != NULL);
 
-	found = 0;
-
-	TAILQ_FOREACH(header, &part->headers, next) {
-		if (strcasecmp(header->name, name) == 0) {
-			found++;
-		}
-	}
+	chain = mm_mimepart_getchain(mm_mimepart_getindex(part), name,
+	    mm_mimepart_hashname(name));
+	if (chain == NULL)
+		return 0;
 
-	return found;
+	return chain->count;
 }
 
 /**
@@ -300,22 +447,24 @@ mm_mimepart_countheaderbyname(struct mm_mimepart *part, const char *name)
 struct mm_mimeheader *
 mm_mimepart_getheaderbyname(struct mm_mimepart *part, const char *name, int idx)
 {
+	struct mm_headerchain *chain;
 	struct mm_mimeheader *header;
-	int curidx;
 
-	curidx = 0;
+	assert(part != NULL);
+	assert(name != NULL);
 
-	TAILQ_FOREACH(header, &part->headers, next) {
-		if (!strcasecmp(header->name, name)) {
-			if (curidx == idx)
-				return header;
-			else
-				curidx++;
-		}
-	}
+	chain = mm_mimepart_getchain(mm_mimepart_getindex(part), name,
+	    mm_mimepart_hashname(name));
+	if (chain == NULL || idx < 0 || idx >= chain->count)
+		return NULL;
 
-	/* Not found */
-	return NULL;
+	if (idx == chain->count - 1)
+		return chain->last;
+
+	for (header = chain->first; idx > 0; idx--)
+		header = header->samename;
+
+	return header;
 }
 
 /**
@@ -439,251 +588,1168 @@ mm_mimepart_getbody(struct mm_mimepart *part, int opaque)
  * This functions sets the body data for a given MIME part. The string pointed
  * to by data must be NUL-terminated. The data is copied into the MIME part's
  * body, and thus, the memory pointed to by data can be freed after the
- * operation. 
+ * operation. The previous body of the part is released after the data is
+ * copied, so data may point into it. To share a body between MIME parts
+ * without copying it, see mm_mimepart_attachbody().
  */
 void
 mm_mimepart_setbody(struct mm_mimepart *part, const char *data, int opaque)
 {
+	char *copy;
+	size_t length;
+
 	assert(part != NULL);
 	assert(data != NULL);
 
+	length = strlen(data);
+	copy = xstrdup(data);
+
 	if (opaque) {
-		part->opaque_body = xstrdup(data);
+		mm_mimepart_releasebody(part, 1);
+		part->opaque_body = copy;
+		part->opaque_length = length;
 		part->body = part->opaque_body;
 	} else {	
-		part->body = xstrdup(data);
+		mm_mimepart_releasebody(part, 0);
+		part->body = copy;
 	}
-	part->length = strlen(data);
+	part->length = length;
+	part->dirty |= MM_DIRTY_BODY;
 }
 
 /**
- * Gets the length of a given MIME part object
+ * Attaches a shared body to a MIME part
  *
  * @param part A valid MIME part object
- * @returns The size of the part's body in byte.
+ * @param body The body to attach
+ * @return 0 on success or -1 on failure
+ * @see mm_body_new
+ * @see mm_body_borrow
  *
- * This function returns the total length of the given MIME part's body. The
- * length does not include the headers of the MIME parts. If the function
- * returns 0, no body part is set currently.
+ * This function makes the MIME part refer to the given body object instead
+ * of a private copy of its data, and takes a reference to it, which is
+ * dropped when the part is freed or gets another body. The caller keeps its
+ * own reference. One body can so be attached to any number of MIME parts in
+ * any number of contexts. The previous body of the part is released.
+ *
+ * The data of shared bodies must not be changed. Borrowed bodies need not
+ * be NUL-terminated: bodies are always decoded by their length.
  */
-size_t
-mm_mimepart_getlength(struct mm_mimepart *part)
+int
+mm_mimepart_attachbody(struct mm_mimepart *part, struct mm_body *body)
 {
 	assert(part != NULL);
+	assert(body != NULL);
 
-	return part->length;
-}
+	/* Take the reference first, the part may have this body already */
+	mm_body_ref(body);
+	mm_mimepart_releasebody(part, 0);
 
+	part->shared = body;
+	part->body = body->data;
+	part->length = body->length;
+	part->dirty |= MM_DIRTY_BODY;
+
+	return 0;
+}
 
 /**
- * Decodes a MIME part according to it's encoding using MiniMIME codecs
+ * Gets the shared body of a MIME part
  *
- * @param A valid MIME part object
- * @return 0 if the MIME part could be successfully decoded or -1 if not
- * @note Sets mm_errno on error
+ * @param part A valid MIME part object
+ * @return The shared body of the part, or NULL if its body is not shared
+ * @see mm_mimepart_attachbody
  *
- * This function decodes the body of a MIME part with a registered decoder
- * according to it's Content-Transfer-Encoding header field. 
+ * The reference returned belongs to the part. Use mm_body_ref() to keep 
+ * the body around for longer than the part.
  */
-char *
-mm_mimepart_decode(struct mm_mimepart *part)
+struct mm_body *
+mm_mimepart_getbodyobj(struct mm_mimepart *part)
 {
-	extern struct mm_codecs codecs;
-	struct mm_codec *codec;
-	void *decoded;
-	
 	assert(part != NULL);
-	assert(part->type != NULL);
 
-	decoded = NULL;
+	return part->shared;
+}
 
-	/* No encoding associated */
-	if (part->type->encstring == NULL)
-		return NULL;
+/*
+ * Releases the body of a MIME part, its encoded form and its opaque body if
+ * opaque is set. Bodies pointing into the opaque body are released with it.
+ */
+static void
+mm_mimepart_releasebody(struct mm_mimepart *part, int opaque)
+{
+	if (part->shared != NULL) {
+		mm_body_unref(part->shared);
+		part->shared = NULL;
+	} else if (part->body != NULL && (part->opaque_body == NULL
+	    || part->body < part->opaque_body 
+	    || part->body > part->opaque_body + part->opaque_length)) {
+		xfree(part->body);
+	}
+	part->body = NULL;
+	part->length = 0;
+	part->lines = -1;
 
-	/* Loop through codecs and find a suitable one */
-	SLIST_FOREACH(codec, &codecs, next) {
-		if (!strcasecmp(part->type->encstring, codec->encoding)) {
-			decoded = codec->decoder((char *)part->body);
-			break;
-		}
+	if (part->body_path != NULL) {
+		xfree(part->body_path);
+		part->body_path = NULL;
 	}
+	part->body_fd = -1;
+	part->body_offset = 0;
 
-	return decoded;
+	if (part->encoded != NULL) {
+		mm_body_unref(part->encoded);
+		part->encoded = NULL;
+		part->encoded_codec = NULL;
+	}
+
+	if (opaque && part->opaque_body != NULL) {
+		xfree(part->opaque_body);
+		part->opaque_body = NULL;
+		part->opaque_length = 0;
+	}
 }
 
 /**
- * Creates an ASCII representation of the given MIME part
+ * Sets the body of a MIME part to a range of a file
  *
  * @param part A valid MIME part object
- * @param result Where to store the result
- * @param length Where to store the length of the result
- * @param opaque Whether to use the opaque MIME part
- * @returtn 0 on success or -1 on error.
- * @see mm_context_flatten
+ * @param path The name of the file
+ * @param offset Where the body starts in the file
+ * @param length The length of the body, or 0 for the rest of the file
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on error
+ * @see mm_mimepart_setbodyfd
  *
- * This function creates an ASCII representation of a given MIME part. It will
- * dynamically allocate the memory needed and stores the result in the memory
- * region pointed to by result. The length of the result will be stored in
- * length. If opaque is set to 1, mm_mimepart_flatten will store an opaque
- * version of the MIME part in result, which means no headers will be created
- * or sanitized. This is particulary useful if the part is digitally signed by
- * e.g. PGP, and the signature spans the header fields of the part in question.
- * 
+ * This function makes a MIME part refer to a file instead of holding its
+ * body in memory. The body is not read now. Instead, the file is opened
+ * when the part is written or flattened, and read and encoded according to
+ * the part's Content-Transfer-Encoding in chunks of fixed size, so that 
+ * even large attachments take little memory. The body is taken to be not
+ * encoded yet. The file must not be changed while the part refers to it.
+ * The body the part held before, including its opaque body, is released.
  */
 int
-mm_mimepart_flatten(struct mm_mimepart *part, char **result, size_t *length,
-    int opaque)
+mm_mimepart_setbodyfile(struct mm_mimepart *part, const char *path, 
+    off_t offset, size_t length)
 {
-	size_t part_length;
-	char *buf;
-	char *ct_hdr;
-
-	*result = NULL;
-	*length = 0;
-	buf = NULL;
-	ct_hdr = NULL;
-	part_length = 0;
-
-	if (opaque && part->opaque_body != NULL) {
-		part_length = strlen(part->opaque_body);
-		*result = xstrdup(part->opaque_body);
-		*length = part_length;
-		return(0);
-	} else {
-		if (part->type == NULL) {
-			return(-1);
-		}	
-		
-		ct_hdr = mm_content_tostring(part->type);
-		if (ct_hdr == NULL) {
-			return(-1);
-		}
-
-		part_length += strlen(ct_hdr) + 2;
-		part_length += strlen("\r\n") * 2;
-		part_length += strlen(part->body);
-	
-		if (part_length < 0) {
-			goto cleanup;
-		}	
-
-		buf = (char *) xmalloc(part_length);
-		if (buf == NULL) {
-			goto cleanup;
-		}
+	struct stat st;
 
-		snprintf(buf, part_length, 
-		    "%s\r\n\r\n%s\r\n",
-		     ct_hdr,
-		     part->body);
+	assert(part != NULL);
+	assert(path != NULL);
 
-		xfree(ct_hdr);
-		ct_hdr = NULL;
+	mm_errno = MM_ERROR_NONE;
 
-		*result = buf;
-		*length = part_length;
+	if (stat(path, &st) == -1) {
+		mm_errno = MM_ERROR_ERRNO;
+		return(-1);
+	}
+	if (offset < 0 || offset > st.st_size 
+	    || length > (size_t)(st.st_size - offset)) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("range exceeds file %s", path);
+		return(-1);
 	}
+	if (length == 0)
+		length = st.st_size - offset;
 
-	return(0);
+	/* The body in memory, opaque or not, is replaced by the file */
+	mm_mimepart_releasebody(part, 1);
+	part->body_path = xstrdup(path);
+	part->body_offset = offset;
+	part->length = length;
+	part->dirty |= MM_DIRTY_BODY;
 
-cleanup:
-	if (ct_hdr != NULL) {
-		xfree(ct_hdr);
-		ct_hdr = NULL;
-	}
-	if (buf != NULL) {
-		xfree(buf);
-		buf = NULL;
-	}
-	
-	*result = NULL;
-	*length = 0;
-	
-	return -1;
+	return(0);
 }
 
 /**
- * Sets the default Content-Type for a given MIME part
+ * Sets the body of a MIME part to a range of an open file
  *
  * @param part A valid MIME part object
- * @param part Whether the Content-Type should be for composite or not
+ * @param fd The file descriptor to read from
+ * @param offset Where the body starts in the file
+ * @param length The length of the body, or 0 for the rest of the file
  * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on error
+ * @see mm_mimepart_setbodyfile
  *
- * This function sets a default Content-Type according to RFC 2045 with a value
- * of "text/plain; charset="us-ascii"". This function should only be used if
- * the MIME part in question does not have a valid Content-Type specification.
+ * Like mm_mimepart_setbodyfile(), but reads the body from an open file
+ * descriptor, which must stay open as long as the part refers to it. The
+ * file offset of fd is not used, so the same descriptor can back the
+ * parts of many messages at once.
  */
 int
-mm_mimepart_setdefaultcontenttype(struct mm_mimepart *part, int composite)
+mm_mimepart_setbodyfd(struct mm_mimepart *part, int fd, off_t offset,
+    size_t length)
 {
-	struct mm_content *type;
-	struct mm_param *param;
+	struct stat st;
 
-	if (part == NULL) {
+	assert(part != NULL);
+	assert(fd >= 0);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (fstat(fd, &st) == -1) {
+		mm_errno = MM_ERROR_ERRNO;
 		return(-1);
 	}
-
-	if (part->type != NULL) {
-		mm_content_free(part->type);
-		part->type = NULL;
+	if (offset < 0 || offset > st.st_size 
+	    || length > (size_t)(st.st_size - offset)) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("range exceeds file");
+		return(-1);
 	}
+	if (length == 0)
+		length = st.st_size - offset;
 
-	type = mm_content_new();
-	if (composite) {
-		type->maintype = xstrdup("multipart");
-		type->subtype = xstrdup("mixed");
-	} else {
-		type->maintype = xstrdup("text");
-		type->subtype = xstrdup("plain");
-		param = mm_param_new();
-		param->name = xstrdup("charset");
-		param->value = xstrdup("us-ascii");
-		mm_content_attachparam(type, param);
-	}	
-
-	mm_mimepart_attachcontenttype(part, type);
+	mm_mimepart_releasebody(part, 1);
+	part->body_fd = fd;
+	part->body_offset = offset;
+	part->length = length;
+	part->dirty |= MM_DIRTY_BODY;
 
-	return (0);
+	return(0);
 }
 
-/** @{ 
- * @name Accessing the MIME part's Content-Type information
+/*
+ * Gets a file descriptor to read the file body of a MIME part from, which 
+ * must be released with mm_mimepart_closebody().
  */
+int
+mm_mimepart_openbody(struct mm_mimepart *part)
+{
+	int fd;
+
+	if (part->body_path == NULL)
+		return part->body_fd;
+
+	if ((fd = open(part->body_path, O_RDONLY)) == -1) {
+		mm_errno = MM_ERROR_ERRNO;
+		return -1;
+	}
+
+	return fd;
+}
 
-/**
- * Attaches a context type object to a MIME part
- *
- * @param part A valid MIME part object
- * @param ct The content type object to attach
- * @return Nothing
- *
- * This function attaches a Content-Type object to a MIME part. It does not
- * care whether the Content-Type suites the actual content in the MIME part,
- * so the programmer should take care of that.
- */
 void
-mm_mimepart_attachcontenttype(struct mm_mimepart *part, struct mm_content *ct)
+mm_mimepart_closebody(struct mm_mimepart *part, int fd)
 {
-	part->type = ct;
+	if (part->body_path != NULL && fd != -1)
+		close(fd);
+}
+
+/*
+ * Reads up to size bytes of the file body of a MIME part into buf, starting
+ * pos bytes into the body. Stores the number of bytes read in nread, which
+ * is only less than size at the end of the body.
+ */
+int
+mm_mimepart_readbody(struct mm_mimepart *part, int fd, size_t pos, char *buf,
+    size_t size, size_t *nread)
+{
+	ssize_t n;
+
+	*nread = 0;
+	if (pos >= part->length)
+		return 0;
+	if (size > part->length - pos)
+		size = part->length - pos;
+
+	while (*nread < size) {
+		n = pread(fd, buf + *nread, size - *nread, 
+		    part->body_offset + pos + *nread);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			mm_errno = MM_ERROR_ERRNO;
+			return -1;
+		}
+		if (n == 0) {
+			mm_errno = MM_ERROR_PROGRAM;
+			mm_error_setmsg("body file is shorter than expected");
+			return -1;
+		}
+		*nread += n;
+	}
+
+	return 0;
 }
 
 /**
- * Gets the Content-Type of a given MIME part object
+ * Gets the length of a given MIME part object
  *
  * @param part A valid MIME part object
- * @return The Content-Type object of the specified MIME part
+ * @returns The size of the part's body in byte.
  *
- * This function returns a pointer to the Content-Type object of the given
- * MIME part. This pointer might be set to NULL, indicating that there is
- * no Content-Type object for the given MIME part currently.
+ * This function returns the total length of the given MIME part's body. The
+ * length does not include the headers of the MIME parts. If the function
+ * returns 0, no body part is set currently.
  */
-struct mm_content *
-mm_mimepart_gettype(struct mm_mimepart *part)
+size_t
+mm_mimepart_getlength(struct mm_mimepart *part)
 {
 	assert(part != NULL);
 
-	return part->type;
+	return part->length;
 }
 
-/** @} */
+
+/**
+ * Decodes a MIME part according to it's encoding using MiniMIME codecs
+ *
+ * @param A valid MIME part object
+ * @return 0 if the MIME part could be successfully decoded or -1 if not
+ * @note Sets mm_errno on error
+ *
+ * This function decodes the body of a MIME part with a registered decoder
+ * according to it's Content-Transfer-Encoding header field. The decoder is
+ * resolved only once per part (see mm_content_getcodec()).
+ */
+char *
+mm_mimepart_decode(struct mm_mimepart *part)
+{
+	struct mm_codec *codec;
+	char *decoded;
+	size_t size, written;
+	
+	assert(part != NULL);
+	assert(part->type != NULL);
+
+	/* No encoding associated */
+	if (part->type->encoding == MM_ENCODING_NONE)
+		return NULL;
+
+	/* The body is not encoded yet */
+	if ((part->flags & MM_MIMEPART_ENCODE) || MM_MIMEPART_HASFILE(part))
+		return NULL;
+
+	codec = mm_content_getcodec(part->type);
+	if (codec == NULL || codec->decoder == NULL)
+		return NULL;
+
+	/* Bodies need not be NUL-terminated, decode them by length */
+	if (codec->decode_into != NULL) {
+		size = codec->decoded_size != NULL 
+		    ? codec->decoded_size(part->body, part->length)
+		    : part->length;
+		decoded = (char *)xmalloc(size + 1);
+		if (codec->decode_into(part->body, part->length, decoded, 
+		    size, &written) == -1) {
+			xfree(decoded);
+			return NULL;
+		}
+		decoded[written] = '\0';
+		return decoded;
+	}
+
+	return mm_mimepart_rundecoder(part, codec);
+}
+
+/**
+ * Gets the size of the decoded body of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @return The size of the decoded body in byte
+ *
+ * This function returns the size a buffer must have to hold the decoded
+ * body of the given MIME part, as decoded by mm_mimepart_decode_into().
+ * For the built-in codecs, the size is computed from the length of the
+ * encoded body and is an upper bound of the actual size. For bodies which
+ * are not encoded, the size is exact.
+ */
+size_t
+mm_mimepart_decoded_size(struct mm_mimepart *part)
+{
+	struct mm_codec *codec;
+	char *decoded;
+	size_t size;
+
+	assert(part != NULL);
+	assert(part->type != NULL);
+
+	if ((part->flags & MM_MIMEPART_ENCODE) || MM_MIMEPART_HASFILE(part))
+		return part->length;
+
+	if (part->body == NULL)
+		return 0;
+
+	codec = mm_content_getcodec(part->type);
+	if (codec == NULL || codec->decoder == NULL)
+		return part->length;
+
+	if (codec->decoded_size != NULL)
+		return codec->decoded_size(part->body, part->length);
+
+	/* A codec without a size kernel, we have to decode to know */
+	decoded = mm_mimepart_rundecoder(part, codec);
+	if (decoded == NULL)
+		return 0;
+	size = strlen(decoded);
+	xfree(decoded);
+
+	return size;
+}
+
+/**
+ * Gets the exact size of the decoded body of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @return The number of bytes mm_mimepart_decode_into() decodes the body to
+ * @see mm_mimepart_decoded_size
+ *
+ * Unlike mm_mimepart_decoded_size(), this function returns the exact size
+ * of the decoded body. For the built-in codecs, the encoded body is scanned
+ * once and nothing is decoded or allocated. Other codecs decode the body,
+ * with their decoder kernel if they have one. The result of a decoder 
+ * without kernel is a string, whose length ends at the first NUL.
+ */
+size_t
+mm_mimepart_decoded_length(struct mm_mimepart *part)
+{
+	struct mm_codec *codec;
+	char *decoded;
+	size_t size, bound;
+
+	assert(part != NULL);
+	assert(part->type != NULL);
+
+	if ((part->flags & MM_MIMEPART_ENCODE) || MM_MIMEPART_HASFILE(part))
+		return part->length;
+
+	if (part->body == NULL)
+		return 0;
+
+	codec = mm_content_getcodec(part->type);
+	if (codec == NULL || codec->decoder == NULL)
+		return part->length;
+
+	if (codec->decoded_length != NULL)
+		return codec->decoded_length(part->body, part->length);
+
+	/* A codec without a length kernel, we have to decode to know. The
+	 * decoder kernel tells how much it wrote, NULs included. */
+	if (codec->decode_into != NULL && codec->decoded_size != NULL) {
+		bound = codec->decoded_size(part->body, part->length);
+		decoded = (char *)xmalloc(bound + 1);
+		if (codec->decode_into(part->body, part->length, decoded, 
+		    bound, &size) == -1)
+			size = 0;
+		xfree(decoded);
+		return size;
+	}
+
+	/* A legacy decoder returns a string, which ends at the first NUL */
+	decoded = mm_mimepart_rundecoder(part, codec);
+	if (decoded == NULL)
+		return 0;
+	size = strlen(decoded);
+	xfree(decoded);
+
+	return size;
+}
+
+/**
+ * Decodes a MIME part into a caller supplied buffer
+ *
+ * @param part A valid MIME part object
+ * @param buf The buffer where to store the decoded body
+ * @param size The size of buf
+ * @param written Where to store the number of bytes decoded
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on error
+ * @see mm_mimepart_decoded_size
+ *
+ * This function decodes the body of a MIME part according to it's
+ * Content-Transfer-Encoding directly into the memory pointed to by buf,
+ * which must be large enough to hold mm_mimepart_decoded_size() bytes.
+ * Bodies which are not encoded are copied as-is. No memory is allocated,
+ * unless the part's codec does not provide a decoder kernel. The decoded
+ * data is not NUL-terminated.
+ */
+int
+mm_mimepart_decode_into(struct mm_mimepart *part, char *buf, size_t size,
+    size_t *written)
+{
+	struct mm_codec *codec;
+	char *decoded;
+	size_t length;
+	int fd, ret;
+
+	assert(part != NULL);
+	assert(part->type != NULL);
+	assert(written != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+	*written = 0;
+
+	/* Bodies in files are not encoded yet */
+	if (MM_MIMEPART_HASFILE(part)) {
+		if (part->length > size) {
+			mm_errno = MM_ERROR_CODEC;
+			mm_error_setmsg("output buffer too small");
+			return(-1);
+		}
+		if ((fd = mm_mimepart_openbody(part)) == -1)
+			return(-1);
+		ret = mm_mimepart_readbody(part, fd, 0, buf, part->length,
+		    written);
+		mm_mimepart_closebody(part, fd);
+		return(ret);
+	}
+
+	if (part->body == NULL)
+		return(0);
+
+	if (part->flags & MM_MIMEPART_ENCODE)
+		codec = NULL;
+	else
+		codec = mm_content_getcodec(part->type);
+	if (codec != NULL && codec->decode_into != NULL) {
+		return codec->decode_into(part->body, part->length, buf, size,
+		    written);
+	}
+
+	if (codec != NULL && codec->decoder != NULL) {
+		decoded = mm_mimepart_rundecoder(part, codec);
+		if (decoded == NULL) {
+			mm_errno = MM_ERROR_CODEC;
+			mm_error_setmsg("could not decode MIME part");
+			return(-1);
+		}
+		length = strlen(decoded);
+	} else {
+		decoded = NULL;
+		length = part->length;
+	}
+
+	if (length > size) {
+		if (decoded != NULL)
+			xfree(decoded);
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("output buffer too small");
+		return(-1);
+	}
+
+	if (decoded != NULL) {
+		memcpy(buf, decoded, length);
+		xfree(decoded);
+	} else {
+		memcpy(buf, part->body, length);
+	}
+	*written = length;
+
+	return(0);
+}
+
+/**
+ * Decodes a MIME part and converts it to UTF-8
+ *
+ * @param part A valid MIME part object
+ * @param length Where to store the length of the result, may be NULL
+ * @return The decoded body or NULL on failure
+ * @note Sets mm_errno on error
+ * @see mm_charset_open
+ *
+ * This function decodes the body of a MIME part according to it's
+ * Content-Transfer-Encoding like mm_mimepart_decode_into() and converts it
+ * from the charset given in the charset parameter of it's Content-Type to
+ * UTF-8. Both stages work on the same buffer, so there is no extra copy of
+ * the body. Text parts without a charset parameter are taken to be US-ASCII,
+ * other parts without one are only decoded. The result is NUL-terminated
+ * and must be freed by the caller.
+ */
+char *
+mm_mimepart_decode_utf8(struct mm_mimepart *part, size_t *length)
+{
+	struct mm_charset_state state;
+	const char *charset;
+	char *buf, *decoded;
+	size_t size, decoded_size, n, m;
+
+	assert(part != NULL);
+	assert(part->type != NULL);
+
+	decoded_size = mm_mimepart_decoded_size(part);
+
+	charset = mm_content_getparambyname(part->type, "charset");
+	if (charset == NULL && mm_content_istype(part->type, 
+	    MM_MEDIATYPE_TEXT, MM_MEDIASUBTYPE_ANY))
+		charset = "us-ascii";
+
+	if (charset == NULL) {
+		buf = (char *)xmalloc(decoded_size + 1);
+		if (mm_mimepart_decode_into(part, buf, decoded_size, &n) 
+		    == -1) {
+			xfree(buf);
+			return NULL;
+		}
+		buf[n] = '\0';
+		if (length != NULL)
+			*length = n;
+		return buf;
+	}
+
+	if (mm_charset_open(&state, charset) == -1)
+		return NULL;
+
+	/* The body is decoded into the end of the buffer and converted in
+	 * place towards it's start.
+	 */
+	size = mm_charset_toutf8_size(decoded_size);
+	buf = (char *)xmalloc(size + 1);
+	decoded = buf + size - decoded_size;
+
+	if (mm_mimepart_decode_into(part, decoded, decoded_size, &n) == -1
+	    || mm_charset_toutf8(&state, decoded, n, buf, size, &n) == -1
+	    || mm_charset_finish(&state, buf + n, size - n, &m) == -1) {
+		mm_charset_close(&state);
+		xfree(buf);
+		return NULL;
+	}
+	mm_charset_close(&state);
+
+	buf[n + m] = '\0';
+	if (length != NULL)
+		*length = n + m;
+
+	return buf;
+}
+
+/**
+ * Creates an ASCII representation of the given MIME part
+ *
+ * @param part A valid MIME part object
+ * @param result Where to store the result
+ * @param length Where to store the length of the result
+ * @param opaque Whether to use the opaque MIME part
+ * @returtn 0 on success or -1 on error.
+ * @see mm_context_flatten
+ *
+ * This function creates an ASCII representation of a given MIME part. It will
+ * dynamically allocate the memory needed and stores the result in the memory
+ * region pointed to by result. The length of the result will be stored in
+ * length. If opaque is set to 1, mm_mimepart_flatten will store an opaque
+ * version of the MIME part in result, which means no headers will be created
+ * or sanitized. This is particulary useful if the part is digitally signed by
+ * e.g. PGP, and the signature spans the header fields of the part in question.
+ * 
+ */
+int
+mm_mimepart_flatten(struct mm_mimepart *part, char **result, size_t *length,
+    int opaque)
+{
+	struct mm_emitter emitter;
+	char *buf;
+
+	*result = NULL;
+	*length = 0;
+
+	if (!(opaque && part->opaque_body != NULL) && part->type == NULL)
+		return(-1);
+
+	mm_emitter_count(&emitter);
+	if (mm_emit_mimepart(&emitter, part, opaque) == -1)
+		return(-1);
+
+	buf = (char *)xmalloc(emitter.length + 1);
+	mm_emitter_buffer(&emitter, buf, emitter.length);
+	if (mm_emit_mimepart(&emitter, part, opaque) == -1) {
+		xfree(buf);
+		return(-1);
+	}
+	buf[emitter.length] = '\0';
+
+	*result = buf;
+	*length = emitter.length;
+
+	return(0);
+}
+
+/**
+ * Writes an ASCII representation of the given MIME part to a sink
+ *
+ * @param part A valid MIME part object
+ * @param sink The sink to write to
+ * @param opaque Whether to use the opaque MIME part
+ * @return 0 on success or -1 on error
+ * @see mm_mimepart_flatten
+ * @see mm_context_write
+ *
+ * This function writes the same data mm_mimepart_flatten() would return to
+ * the given sink, using a fixed amount of memory regardless of the size of
+ * the part. Bodies of parts flagged with MM_MIMEPART_ENCODE are encoded
+ * while writing them.
+ */
+int
+mm_mimepart_write(struct mm_mimepart *part, struct mm_sink *sink, int opaque)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	assert(part != NULL);
+	assert(sink != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (!(opaque && part->opaque_body != NULL) && part->type == NULL)
+		return(-1);
+
+	mm_emitter_sink(&emitter, sink);
+	ret = mm_emit_mimepart(&emitter, part, opaque);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return(ret);
+}
+
+/**
+ * Sets the flags of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @param flags The flags to set, see enum mm_mimepart_flags
+ * @return Nothing
+ *
+ * If MM_MIMEPART_ENCODE is set, the body of the part is taken to be not
+ * encoded yet and is encoded according to the part's 
+ * Content-Transfer-Encoding when the part is flattened or written. This
+ * saves keeping an encoded copy of large bodies in memory.
+ */
+void
+mm_mimepart_setflags(struct mm_mimepart *part, int flags)
+{
+	assert(part != NULL);
+
+	part->flags = flags;
+}
+
+/**
+ * Gets the flags of a MIME part
+ *
+ * @param part A valid MIME part object
+ * @return The flags of the part, see enum mm_mimepart_flags
+ */
+int
+mm_mimepart_getflags(struct mm_mimepart *part)
+{
+	assert(part != NULL);
+
+	return part->flags;
+}
+
+/**
+ * Marks parts of a parsed MIME part as modified
+ *
+ * @param part A valid MIME part object
+ * @param dirty What has been modified, see enum mm_dirty_flags
+ * @return Nothing
+ * @see MM_PARSE_KEEPSOURCE
+ *
+ * If the source of a message is kept by the parser, header sections and
+ * bodies of MIME parts are written out verbatim unless they have been
+ * modified. MiniMIME functions which modify a MIME part mark it themselves.
+ * Applications which modify the members of a MIME part or its Content-Type
+ * directly must call this function afterwards, with MM_DIRTY_HEADERS for
+ * changes to header fields or the Content-Type and MM_DIRTY_BODY for
+ * changes to the body. Header fields appended to the part do not count as
+ * modifications.
+ */
+void
+mm_mimepart_setdirty(struct mm_mimepart *part, int dirty)
+{
+	assert(part != NULL);
+
+	part->dirty |= dirty;
+}
+
+/**
+ * Gets what has been modified in a parsed MIME part
+ *
+ * @param part A valid MIME part object
+ * @return The modifications, see enum mm_dirty_flags
+ */
+int
+mm_mimepart_getdirty(struct mm_mimepart *part)
+{
+	assert(part != NULL);
+
+	return part->dirty;
+}
+
+/**
+ * Sets the default Content-Type for a given MIME part
+ *
+ * @param part A valid MIME part object
+ * @param part Whether the Content-Type should be for composite or not
+ * @return 0 on success or -1 on failure
+ *
+ * This function sets a default Content-Type according to RFC 2045 with a value
+ * of "text/plain; charset="us-ascii"". This function should only be used if
+ * the MIME part in question does not have a valid Content-Type specification.
+ */
+int
+mm_mimepart_setdefaultcontenttype(struct mm_mimepart *part, int composite)
+{
+	struct mm_content *type;
+
+	if (part == NULL) {
+		return(-1);
+	}
+
+	if (part->type != NULL) {
+		mm_content_free(part->type);
+		part->type = NULL;
+	}
+
+	type = mm_content_new();
+	if (composite) {
+		mm_content_settype(type, "multipart/mixed");
+	} else {
+		mm_content_settype(type, "text/plain");
+		mm_content_addparam(type, "charset", "us-ascii");
+	}	
+
+	mm_mimepart_attachcontenttype(part, type);
+
+	return (0);
+}
+
+/** @{ 
+ * @name Accessing the MIME part's Content-Type information
+ */
+
+/**
+ * Attaches a context type object to a MIME part
+ *
+ * @param part A valid MIME part object
+ * @param ct The content type object to attach
+ * @return Nothing
+ *
+ * This function attaches a Content-Type object to a MIME part. It does not
+ * care whether the Content-Type suites the actual content in the MIME part,
+ * so the programmer should take care of that.
+ */
+void
+mm_mimepart_attachcontenttype(struct mm_mimepart *part, struct mm_content *ct)
+{
+	part->type = ct;
+	part->dirty |= MM_DIRTY_HEADERS;
+}
+
+/**
+ * Gets the Content-Type of a given MIME part object
+ *
+ * @param part A valid MIME part object
+ * @return The Content-Type object of the specified MIME part
+ *
+ * This function returns a pointer to the Content-Type object of the given
+ * MIME part. This pointer might be set to NULL, indicating that there is
+ * no Content-Type object for the given MIME part currently.
+ */
+struct mm_content *
+mm_mimepart_gettype(struct mm_mimepart *part)
+{
+	assert(part != NULL);
+
+	return part->type;
+}
+
+/** @} */
+
+/** @{
+ * @name Nesting MIME parts
+ */
+
+/**
+ * Nests a MIME part in another one
+ *
+ * @param parent A valid MIME part object
+ * @param child The MIME part object to nest
+ * @return 0 on success or -1 on failure. Sets mm_errno on failure.
+ *
+ * This function appends a MIME part to the parts nested in another one,
+ * which makes the latter a multipart entity. When it is written, the
+ * nested parts replace its body, each introduced by a boundary line. The
+ * boundary is taken from the "boundary" parameter of the parent's
+ * Content-Type, which mm_context_flatten() and mm_context_write()
+ * generate if needed. They also replace a Content-Type of the parent 
+ * which is not multipart by multipart/mixed.
+ *
+ * The child is freed together with the parent, and must neither be
+ * attached to a context nor nested in another part already. The MIME
+ * parts of a context are nested in its envelope by mm_context_attachpart().
+ * Parts nested in the envelope with this function follow them.
+ */
+int
+mm_mimepart_attachchild(struct mm_mimepart *parent, struct mm_mimepart *child)
+{
+	assert(parent != NULL);
+	assert(child != NULL);
+
+	if (child->parent != NULL || child == parent) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("MIME part is nested already");
+		return(-1);
+	}
+
+	TAILQ_INSERT_TAIL(&parent->children, child, next);
+	mm_mimepart_growchildindex(parent);
+	parent->childindex[parent->nchildren++] = child;
+	child->parent = parent;
+	parent->dirty |= MM_DIRTY_STRUCTURE;
+
+	return(0);
+}
+
+/**
+ * Deletes a MIME part nested in another one
+ *
+ * @param parent A valid MIME part object
+ * @param which The number of the nested MIME part to delete, starting at 0
+ * @param freemem Whether to free the memory associated with the deleted
+ *        MIME part
+ * @return 0 on success or -1 if there is no such MIME part
+ */
+int
+mm_mimepart_deletechild(struct mm_mimepart *parent, int which, int freemem)
+{
+	struct mm_mimepart *child;
+
+	assert(parent != NULL);
+
+	if (which < 0 || which >= parent->nchildren)
+		return(-1);
+
+	child = parent->childindex[which];
+	TAILQ_REMOVE(&parent->children, child, next);
+	memmove(&parent->childindex[which], &parent->childindex[which + 1],
+	    (parent->nchildren - which - 1) * sizeof(struct mm_mimepart *));
+	parent->nchildren--;
+	child->parent = NULL;
+	parent->dirty |= MM_DIRTY_STRUCTURE;
+
+	if (freemem)
+		mm_mimepart_free(child);
+
+	return(0);
+}
+
+/**
+ * Counts the MIME parts nested in a MIME part
+ *
+ * @param part A valid MIME part object
+ * @return The number of nested MIME parts
+ *
+ * The MIME parts of a context are not counted for its envelope, see
+ * mm_context_countparts() for these.
+ */
+int
+mm_mimepart_countchildren(struct mm_mimepart *part)
+{
+	assert(part != NULL);
+
+	return part->nchildren;
+}
+
+/**
+ * Gets a MIME part nested in another one
+ *
+ * @param part A valid MIME part object
+ * @param which The number of the nested MIME part, starting at 0
+ * @return The nested MIME part or NULL if there is no such part
+ */
+struct mm_mimepart *
+mm_mimepart_getchild(struct mm_mimepart *part, int which)
+{
+	assert(part != NULL);
+
+	if (which < 0 || which >= part->nchildren)
+		return NULL;
+
+	return part->childindex[which];
+}
+
+/**
+ * Gets the MIME part a MIME part is nested in
+ *
+ * @param part A valid MIME part object
+ * @return The parent MIME part, or NULL for envelopes and parts which are
+ *         not nested
+ */
+struct mm_mimepart *
+mm_mimepart_getparent(struct mm_mimepart *part)
+{
+	assert(part != NULL);
+
+	return part->parent;
+}
+
+/** @} */
+
+/*
+ * Gets the header index of a MIME part, building it first if needed
+ */
+static struct mm_headerindex *
+mm_mimepart_getindex(struct mm_mimepart *part)
+{
+	struct mm_mimeheader *header;
+
+	if (part->hindex != NULL)
+		return part->hindex;
+
+	part->hindex = (struct mm_headerindex *)xmalloc(
+	    sizeof(struct mm_headerindex));
+	memset(part->hindex, 0, sizeof(struct mm_headerindex));
+
+	TAILQ_FOREACH(header, &part->headers, next)
+		mm_mimepart_indexheader(part->hindex, header);
+
+	return part->hindex;
+}
+
+/*
+ * Finds the chain of header fields called name, whose hash is given
+ */
+static struct mm_headerchain *
+mm_mimepart_getchain(struct mm_headerindex *hindex, const char *name,
+    u_int32_t hash)
+{
+	struct mm_headerchain *chain;
+
+	for (chain = hindex->hash[hash % MM_HEADERINDEX_SIZE]; chain != NULL;
+	    chain = chain->hnext) {
+		if (chain->hash == hash && !strcasecmp(chain->first->name, name))
+			return chain;
+	}
+
+	return NULL;
+}
+
+/*
+ * Appends a header field to the chain of its name in the index
+ */
+static void
+mm_mimepart_indexheader(struct mm_headerindex *hindex, 
+    struct mm_mimeheader *header)
+{
+	struct mm_headerchain *chain;
+	u_int32_t hash;
+
+	header->samename = NULL;
+	hindex->count++;
+
+	hash = mm_mimepart_hashname(header->name);
+	chain = mm_mimepart_getchain(hindex, header->name, hash);
+	if (chain != NULL) {
+		chain->last->samename = header;
+		chain->last = header;
+		chain->count++;
+		return;
+	}
+
+	chain = (struct mm_headerchain *)xmalloc(sizeof(struct mm_headerchain));
+	chain->first = header;
+	chain->last = header;
+	chain->count = 1;
+	chain->hash = hash;
+	chain->hnext = hindex->hash[hash % MM_HEADERINDEX_SIZE];
+	hindex->hash[hash % MM_HEADERINDEX_SIZE] = chain;
+}
+
+/*
+ * Takes a header field out of the chain of its name in the index. If it
+ * is not found there, e.g. because its name was changed, the index is
+ * dropped and built again on the next lookup.
+ */
+static void
+mm_mimepart_unindexheader(struct mm_mimepart *part, 
+    struct mm_mimeheader *header)
+{
+	struct mm_headerchain *chain, **chainp;
+	struct mm_mimeheader *prev, *cur;
+	u_int32_t hash;
+
+	hash = mm_mimepart_hashname(header->name);
+	chain = mm_mimepart_getchain(part->hindex, header->name, hash);
+
+	prev = NULL;
+	if (chain != NULL) {
+		for (cur = chain->first; cur != NULL && cur != header; 
+		    cur = cur->samename)
+			prev = cur;
+	}
+	if (chain == NULL || cur == NULL) {
+		mm_mimepart_reindexheaders(part);
+		return;
+	}
+
+	part->hindex->count--;
+	if (--chain->count > 0) {
+		if (prev == NULL)
+			chain->first = header->samename;
+		else
+			prev->samename = header->samename;
+		if (chain->last == header)
+			chain->last = prev;
+		header->samename = NULL;
+		return;
+	}
+
+	for (chainp = &part->hindex->hash[hash % MM_HEADERINDEX_SIZE]; 
+	    *chainp != chain; chainp = &(*chainp)->hnext)
+		;
+	*chainp = chain->hnext;
+	xfree(chain);
+	header->samename = NULL;
+}
+
+/*
+ * Case insensitive hash of a header field name
+ */
+static u_int32_t
+mm_mimepart_hashname(const char *name)
+{
+	u_int32_t hash;
+
+	for (hash = 5381; *name != '\0'; name++)
+		hash = ((hash << 5) + hash) + tolower((unsigned char)*name);
+
+	return hash;
+}
+
+/*
+ * Makes room for one more nested MIME part in the child index of a part
+ */
+static void
+mm_mimepart_growchildindex(struct mm_mimepart *part)
+{
+	if (part->nchildren < part->childindex_size)
+		return;
+
+	part->childindex_size = part->childindex_size ? 
+	    part->childindex_size * 2 : 4;
+	part->childindex = (struct mm_mimepart **)xrealloc(part->childindex,
+	    part->childindex_size * sizeof(struct mm_mimepart *));
+}
+
+/*
+ * Decodes the body of a MIME part with the allocating decoder of a codec
+ * which has no decoder kernel. Such decoders stop at a NUL byte, but 
+ * bodies need not be NUL-terminated (see mm_body_borrow()) and parsed ones
+ * may point into the message, so the decoder gets a terminated copy.
+ */
+static char *
+mm_mimepart_rundecoder(struct mm_mimepart *part, struct mm_codec *codec)
+{
+	char *copy, *decoded;
+
+	copy = (char *)xmalloc(part->length + 1);
+	memcpy(copy, part->body, part->length);
+	copy[part->length] = '\0';
+
+	decoded = codec->decoder(copy);
+	xfree(copy);
+
+	return decoded;
+}
@@ -120,17 +120,17 @@ mm_mimeutil_genboundary(char *prefix, size_t length, char **result)
 		return(-1);
 	}	
 
-	*result = '\0';
+	**result = '\0';
 
 	if (prefix != NULL) {
-		strlcat(*result, prefix, total);
+		strlcat(*result, prefix, total + 1);
 	}
 
-	for (i = 0; i < length - 1; i++) {
+	for (i = 0; i < length; i++) {
 		pos = random() % strlen(boundary_charset);
-		*result[i + preflen] = boundary_charset[pos];
+		(*result)[i + preflen] = boundary_charset[pos];
 	}
-	*result[total] = '\0';
+	(*result)[total] = '\0';
 
 	return (0);
 }
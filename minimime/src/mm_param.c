@@ -83,6 +83,11 @@ mm_param_new(void)
 	
 	param->name = NULL;
 	param->value = NULL;
+	param->decoded = NULL;
+	param->segments = NULL;
+	param->stored = 0;
+	param->store = NULL;
+	param->content = NULL;
 
 	return param;
 }
@@ -97,17 +102,39 @@ mm_param_new(void)
 void
 mm_param_free(struct mm_param *param)
 {
+	struct mm_param *segment;
+
 	assert(param != NULL);
 
-	if (param->name != NULL) {
-		xfree(param->name);
-		param->name = NULL;
+	if (param->segments != NULL) {
+		while ((segment = TAILQ_FIRST(param->segments)) != NULL) {
+			TAILQ_REMOVE(param->segments, segment, next);
+			mm_param_free(segment);
+		}
+		xfree(param->segments);
+		param->segments = NULL;
 	}
-	if (param->value != NULL) {
-		xfree(param->value);
-		param->value = NULL;
+
+	if (param->decoded != NULL && param->decoded != param->value) {
+		xfree(param->decoded);
+		param->decoded = NULL;
 	}
-	xfree(param);
+	if (param->name != NULL && !(param->stored & MM_STORED_NAME))
+		xfree(param->name);
+	else if (param->name != NULL)
+		mm_arena_strfree(param->store, param->name);
+	param->name = NULL;
+	if (param->value != NULL && !(param->stored & MM_STORED_VALUE))
+		xfree(param->value);
+	else if (param->value != NULL)
+		mm_arena_strfree(param->store, param->value);
+	param->value = NULL;
+
+	/* Parameters in the storage of a Content-Type go back to it */
+	if (!(param->stored & MM_STORED_OBJECT))
+		xfree(param);
+	else
+		mm_arena_release(param->store, param, sizeof(struct mm_param));
 }
 
 /**
@@ -144,7 +171,10 @@ mm_param_generate(const char *name, const char *value)
  * @param param A valid MIME parameter object
  * @param name The new name of the parameter
  * @param copy If set to > 0, copy the value stored in name
- * @returns The address of the previous name for passing to free()
+ * @returns The address of the previous name for passing to free(), or
+ *          NULL if it was held in the storage of a Content-Type (see
+ *          mm_content_addparam()), which it is given back to, or if
+ *          name is the current name and copy is 0
  */
 char *
 mm_param_setname(struct mm_param *param, const char *name, int copy)
@@ -152,6 +182,10 @@ mm_param_setname(struct mm_param *param, const char *name, int copy)
 	char *retadr;
 	assert(param != NULL);
 
+	/* Nothing changes, and the name must not be released */
+	if (!copy && name == param->name)
+		return NULL;
+
 	retadr = param->name;
 
 	if (copy)
@@ -159,6 +193,16 @@ mm_param_setname(struct mm_param *param, const char *name, int copy)
 	else
 		param->name = (char *)name;
 
+	/* A name in the storage is given back to it */
+	if ((param->stored & MM_STORED_NAME) && retadr != NULL) {
+		mm_arena_strfree(param->store, retadr);
+		retadr = NULL;
+	}
+	param->stored &= ~MM_STORED_NAME;
+
+	if (param->content != NULL)
+		mm_content_paramchanged(param->content);
+
 	return retadr;	
 }
 
@@ -168,7 +212,13 @@ mm_param_setname(struct mm_param *param, const char *name, int copy)
  * @param param A valid MIME parameter object
  * @param name The new value for the parameter
  * @param copy If set to > 0, copy the value stored in value
- * @returns The address of the previous value for passing to free()
+ * @returns The address of the previous value for passing to free(), or
+ *          NULL if it was held in the storage of a Content-Type (see
+ *          mm_content_addparam()), which it is given back to, or if
+ *          value is the current value and copy is 0
+ *
+ * If the parameter is attached to a Content-Type, its charset is 
+ * classified again (see mm_content_getcharsetid()).
  */
 char *
 mm_param_setvalue(struct mm_param *param, const char *value, int copy)
@@ -176,13 +226,31 @@ mm_param_setvalue(struct mm_param *param, const char *value, int copy)
 	char *retadr;
 	assert(param != NULL);
 
+	/* Nothing changes, and the value must not be released */
+	if (!copy && value == param->value)
+		return NULL;
+
 	retadr = param->value;
 
+	if (param->decoded != NULL && param->decoded != param->value)
+		xfree(param->decoded);
+	param->decoded = NULL;
+
 	if (copy)
 		param->value = xstrdup(value);
 	else
 		param->value = (char *)value;
 
+	/* A value in the storage is given back to it */
+	if ((param->stored & MM_STORED_VALUE) && retadr != NULL) {
+		mm_arena_strfree(param->store, retadr);
+		retadr = NULL;
+	}
+	param->stored &= ~MM_STORED_VALUE;
+
+	if (param->content != NULL)
+		mm_content_paramchanged(param->content);
+
 	return retadr;	
 }
 
@@ -212,4 +280,95 @@ mm_param_getvalue(struct mm_param *param)
 	return param->value;
 }
 
+/**
+ * Decodes RFC 2047 encoded words in the value of a MIME parameter
+ *
+ * @param param A valid MIME parameter object
+ * @return 0 on success or -1 on failure
+ * @see mm_param_getdecoded
+ *
+ * Although not allowed by RFC 2047, some mail programs use encoded words in
+ * parameter values (most commonly for file names). This function decodes
+ * them into UTF-8 and stores the result within the parameter object. If
+ * the value does not contain any encoded words, no memory is allocated.
+ */
+int
+mm_param_decode(struct mm_param *param)
+{
+	char *decoded;
+
+	assert(param != NULL);
+	assert(param->value != NULL);
+
+	if (param->decoded != NULL)
+		return 0;
+
+	switch (mm_rfc2047_decode(param->value, &decoded)) {
+	case -1:
+		return -1;
+	case 0:
+		param->decoded = param->value;
+		break;
+	default:
+		param->decoded = decoded;
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * Gets the decoded value of a MIME parameter
+ *
+ * @param param A valid MIME parameter object
+ * @returns The parameter's value with encoded words decoded to UTF-8
+ *
+ * The value is decoded on first access and cached in the parameter object.
+ * If the value can not be decoded, the raw value is returned.
+ */
+const char *
+mm_param_getdecoded(struct mm_param *param)
+{
+	assert(param != NULL);
+
+	if (param->decoded == NULL && mm_param_decode(param) == -1)
+		return param->value;
+
+	return param->decoded;
+}
+
+/**
+ * Gets a raw segment of a parameter assembled according to RFC 2231
+ *
+ * @param param A valid MIME parameter object
+ * @param idx The number of the segment to get, starting at 0
+ * @returns The segment or NULL if there is no such segment
+ *
+ * Parameters which were split into several segments (name*0, name*1, ...)
+ * or which were percent encoded (name*) are reassembled by the parser into
+ * one parameter with an UTF-8 value. The raw segments are only kept if the
+ * message was parsed with the MM_PARSE_KEEPSEGMENTS flag, and only for
+ * Content-Type parameters.
+ */
+struct mm_param *
+mm_param_getsegment(struct mm_param *param, int idx)
+{
+	struct mm_param *segment;
+	int i;
+
+	assert(param != NULL);
+
+	if (param->segments == NULL)
+		return NULL;
+
+	i = 0;
+	TAILQ_FOREACH(segment, param->segments, next) {
+		if (i == idx)
+			return segment;
+		i++;
+	}
+
+	return NULL;
+}
+
 /** @} */
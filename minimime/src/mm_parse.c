@@ -47,7 +47,7 @@
 #include "mimeparser.h"
 #include "mimeparser.tab.h"
 
-void PARSER_initialize(MM_CTX *, int);
+int PARSER_initialize(MM_CTX *, int, int);
 void PARSER_setbuffer(const char *);
 void PARSER_setfp(FILE *);
 
@@ -76,18 +76,29 @@ void PARSER_setfp(FILE *);
  *	- MM_PARSE_STRICT: Do not tolerate MIME violations
  *	- MM_PARSE_LOOSE: Tolerate as much MIME violations as possible
  *
+ * If MM_PARSE_KEEPSOURCE is given in flags, a copy of text is kept in the
+ * context. MIME parts, header fields and the structure of the message which
+ * are not modified afterwards are then written out verbatim by 
+ * mm_context_flatten() and friends.
+ *
  * The context needs to be initialized before using mm_context_new() and may
  * be freed using mm_context_free().
  */
 int
 mm_parse_mem(MM_CTX *ctx, const char *text, int parsemode, int flags)
 {
-	PARSER_initialize(ctx, parsemode);
+	PARSER_initialize(ctx, parsemode, flags);
 	
 	PARSER_setbuffer(text);
 	PARSER_setfp(NULL);
 	
-	return mimeparser_yyparse();
+	if (mimeparser_yyparse() != 0)
+		return -1;
+
+	if (flags & MM_PARSE_KEEPSOURCE)
+		mm_body_attachsource(ctx, mm_body_new(text, strlen(text)));
+
+	return 0;
 }
 
 /**
@@ -110,12 +121,16 @@ mm_parse_mem(MM_CTX *ctx, const char *text, int parsemode, int flags)
  *	- MM_PARSE_STRICT: Do not tolerate MIME violations
  *	- MM_PARSE_LOOSE: Tolerate as much MIME violations as possible
  *
+ * If MM_PARSE_KEEPSOURCE is given in flags, the file is read into the
+ * context once parsed, see mm_parse_mem().
+ *
  * The context needs to be initialized before using mm_context_new() and may
  * be freed using mm_context_free().
  */
 int
 mm_parse_file(MM_CTX *ctx, const char *filename, int parsemode, int flags)
 {
+	struct mm_body *source;
 	FILE *fp;
 
 	if ((fp = fopen(filename, "r")) == NULL) {
@@ -124,7 +139,16 @@ mm_parse_file(MM_CTX *ctx, const char *filename, int parsemode, int flags)
 	}
 	
 	PARSER_setfp(fp);
-	PARSER_initialize(ctx, parsemode);
+	PARSER_initialize(ctx, parsemode, flags);
+
+	if (mimeparser_yyparse() != 0)
+		return -1;
+
+	if (flags & MM_PARSE_KEEPSOURCE) {
+		if ((source = mm_body_fromfile(fp)) == NULL)
+			return -1;
+		mm_body_attachsource(ctx, source);
+	}
 
-	return mimeparser_yyparse();
+	return 0;
 }
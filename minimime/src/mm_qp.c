@@ -0,0 +1,415 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_qp.c
+ *
+ * This module contains the Quoted-Printable codec (RFC 2045, section 6.7)
+ */
+
+static const char hex_qp[] = "0123456789ABCDEF";
+
+static int _mm_qp_decode(const char *, size_t, char *, size_t, size_t *, int);
+
+static int
+mm_qp_hexval(int c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+/** @{
+ * @name Quoted-Printable codec
+ */
+
+/**
+ * Decodes a Quoted-Printable encoded string
+ *
+ * @param data The NUL-terminated data to decode
+ * @return A newly allocated, NUL-terminated string holding the decoded data
+ *	or NULL on error.
+ * @ingroup codecs
+ */
+char *
+mm_qp_decode(char *data)
+{
+	char *buf;
+	size_t len, written;
+
+	assert(data != NULL);
+
+	len = strlen(data);
+
+	buf = (char *)xmalloc(mm_qp_decoded_size(data, len) + 1);
+	if (mm_qp_decode_into(data, len, buf, len, &written) == -1) {
+		xfree(buf);
+		return(NULL);
+	}
+	buf[written] = '\0';
+
+	return(buf);
+}
+
+/**
+ * Returns the maximum size of decoded Quoted-Printable data
+ *
+ * @param data The encoded data
+ * @param len The length of the encoded data
+ * @return The maximum number of bytes the data can decode to
+ * @ingroup codecs
+ */
+size_t
+mm_qp_decoded_size(const char *data, size_t len)
+{
+	return len;
+}
+
+/**
+ * Returns the exact size of decoded Quoted-Printable data
+ *
+ * @param data The encoded data
+ * @param len The length of the encoded data
+ * @return The number of bytes mm_qp_decode_into() decodes the data to
+ * @ingroup codecs
+ *
+ * The data is scanned once, nothing is decoded or allocated.
+ */
+size_t
+mm_qp_decoded_length(const char *data, size_t len)
+{
+	size_t written;
+
+	_mm_qp_decode(data, len, NULL, 0, &written, 0);
+
+	return written;
+}
+
+/**
+ * Decodes Quoted-Printable data into a caller supplied buffer
+ *
+ * @param data The encoded data
+ * @param len The length of the encoded data
+ * @param buf The buffer to store the decoded data in
+ * @param size The size of buf
+ * @param written Where to store the number of decoded bytes
+ * @return 0 on success or -1 if buf is too small
+ * @note Sets mm_errno on error
+ * @ingroup codecs
+ *
+ * Soft line breaks and trailing whitespace are removed. Malformed escape
+ * sequences are copied literally. No memory is allocated.
+ */
+int
+mm_qp_decode_into(const char *data, size_t len, char *buf, size_t size,
+    size_t *written)
+{
+	return _mm_qp_decode(data, len, buf, size, written, 0);
+}
+
+/**
+ * Decodes the "Q" encoding of RFC 2047 encoded words
+ *
+ * @param data The encoded text of the encoded word
+ * @param len The length of the encoded text
+ * @param buf The buffer to store the decoded data in
+ * @param size The size of buf
+ * @param written Where to store the number of decoded bytes
+ * @return 0 on success or -1 if buf is too small
+ * @note Sets mm_errno on error
+ * @ingroup codecs
+ *
+ * The "Q" encoding is a variant of Quoted-Printable for use in header
+ * fields, where an underscore represents a space and there are no line
+ * breaks.
+ */
+int
+mm_qp_decode_q(const char *data, size_t len, char *buf, size_t size,
+    size_t *written)
+{
+	return _mm_qp_decode(data, len, buf, size, written, 1);
+}
+
+/**
+ * Encodes data to Quoted-Printable
+ *
+ * @param data The data to encode
+ * @param len The length of the data
+ * @return A newly allocated, NUL-terminated string holding the encoded data
+ * @ingroup codecs
+ *
+ * Line breaks in the data are treated as hard line breaks and written as
+ * CRLF. Lines are broken with soft line breaks to not exceed the MIME
+ * recommended line length of 76 characters.
+ */
+char *
+mm_qp_encode(char *data, u_int32_t len)
+{
+	char *buf, *output;
+	unsigned char c;
+	u_int32_t i;
+	size_t size;
+	int col, literal;
+
+	assert(data != NULL);
+
+	size = (size_t)len * 3;
+	size += (size / (MM_QP_LINELEN - 1) + 1) * 3 + 1;
+	buf = (char *)xmalloc(size);
+	output = buf;
+	col = 0;
+
+	for (i = 0; i < len; i++) {
+		c = (unsigned char)data[i];
+
+		/* Hard line breaks */
+		if (c == '\r' && i + 1 < len && data[i + 1] == '\n')
+			i++, c = '\n';
+		if (c == '\n') {
+			*output++ = '\r';
+			*output++ = '\n';
+			col = 0;
+			continue;
+		}
+
+		if (c == ' ' || c == '\t') {
+			literal = (i + 1 < len && data[i + 1] != '\r' 
+			    && data[i + 1] != '\n');
+		} else {
+			literal = (c >= 33 && c <= 126 && c != '=');
+		}
+
+		if (col + (literal ? 1 : 3) > MM_QP_LINELEN - 1) {
+			*output++ = '=';
+			*output++ = '\r';
+			*output++ = '\n';
+			col = 0;
+		}
+
+		if (literal) {
+			*output++ = c;
+			col++;
+		} else {
+			*output++ = '=';
+			*output++ = hex_qp[c >> 4];
+			*output++ = hex_qp[c & 0x0f];
+			col += 3;
+		}
+	}
+
+	*output = '\0';
+	return(buf);
+}
+
+/**
+ * Encodes a chunk of data to Quoted-Printable
+ *
+ * @param data The data to encode
+ * @param len The length of the data
+ * @param final Whether this is the last chunk
+ * @param buf The buffer to store the encoded data in
+ * @param size The size of buf
+ * @param col The column of the output line, 0 for the first chunk
+ * @param consumed Where to store the number of bytes encoded
+ * @param written Where to store the number of characters stored in buf
+ * @return 0
+ * @ingroup codecs
+ *
+ * This is the streaming variant of mm_qp_encode(), producing the same
+ * output. Encoding stops when buf is full. Unless final is set, trailing
+ * whitespace and a trailing CR are left for the next chunk, since their
+ * encoding depends on what follows. The caller passes the data not
+ * consumed again with the next chunk.
+ */
+int
+mm_qp_encode_chunk(const char *data, size_t len, int final, char *buf,
+    size_t size, int *col, size_t *consumed, size_t *written)
+{
+	unsigned char c;
+	size_t i, w;
+	int literal;
+
+	assert(data != NULL || len == 0);
+	assert(col != NULL);
+
+	w = 0;
+
+	/* A character takes at most a soft line break and three characters */
+	for (i = 0; i < len && size - w >= 6; i++) {
+		c = (unsigned char)data[i];
+
+		if (!final && i + 1 == len && (c == '\r' || c == ' ' 
+		    || c == '\t'))
+			break;
+
+		/* Hard line breaks */
+		if (c == '\r' && i + 1 < len && data[i + 1] == '\n')
+			i++, c = '\n';
+		if (c == '\n') {
+			buf[w++] = '\r';
+			buf[w++] = '\n';
+			*col = 0;
+			continue;
+		}
+
+		if (c == ' ' || c == '\t') {
+			literal = (i + 1 < len && data[i + 1] != '\r' 
+			    && data[i + 1] != '\n');
+		} else {
+			literal = (c >= 33 && c <= 126 && c != '=');
+		}
+
+		if (*col + (literal ? 1 : 3) > MM_QP_LINELEN - 1) {
+			buf[w++] = '=';
+			buf[w++] = '\r';
+			buf[w++] = '\n';
+			*col = 0;
+		}
+
+		if (literal) {
+			buf[w++] = c;
+			(*col)++;
+		} else {
+			buf[w++] = '=';
+			buf[w++] = hex_qp[c >> 4];
+			buf[w++] = hex_qp[c & 0x0f];
+			*col += 3;
+		}
+	}
+
+	*consumed = i;
+	*written = w;
+
+	return 0;
+}
+
+/** @} */
+
+/*
+ * The actual decoder. If q is set, decode the RFC 2047 "Q" variant. If buf
+ * is NULL, only count the decoded bytes.
+ */
+static int
+_mm_qp_decode(const char *data, size_t len, char *buf, size_t size,
+    size_t *written, int q)
+{
+	const char *input, *end, *p;
+	size_t w;
+	int hi, lo;
+
+	assert(data != NULL);
+	assert(written != NULL);
+
+	input = data;
+	end = data + len;
+	w = 0;
+
+	while (input < end) {
+		if (*input == '=') {
+			if (input + 2 < end 
+			    && (hi = mm_qp_hexval(input[1])) != -1
+			    && (lo = mm_qp_hexval(input[2])) != -1) {
+				if (buf != NULL) {
+					if (w >= size)
+						goto toosmall;
+					buf[w] = (hi << 4) | lo;
+				}
+				w++;
+				input += 3;
+				continue;
+			}
+			/* Soft line break, possibly with trailing garbage */
+			for (p = input + 1; !q && p < end 
+			    && (*p == ' ' || *p == '\t');)
+				p++;
+			if (!q && p == end) {
+				input = p;
+				continue;
+			}
+			if (!q && (*p == '\n' || (*p == '\r' && p + 1 < end 
+			    && p[1] == '\n'))) {
+				input = p + (*p == '\r' ? 2 : 1);
+				continue;
+			}
+		} else if (!q && (*input == ' ' || *input == '\t')) {
+			/* Trailing whitespace is not part of the data */
+			for (p = input; p < end && (*p == ' ' || *p == '\t');)
+				p++;
+			if (p == end || *p == '\r' || *p == '\n') {
+				input = p;
+				continue;
+			}
+			/* Whitespace within a line is data, take all of it */
+			if (buf != NULL) {
+				if (size - w < (size_t)(p - input)) {
+					memcpy(buf + w, input, size - w);
+					w = size;
+					goto toosmall;
+				}
+				memcpy(buf + w, input, p - input);
+			}
+			w += p - input;
+			input = p;
+			continue;
+		}
+		if (buf != NULL) {
+			if (w >= size)
+				goto toosmall;
+			if (q && *input == '_')
+				buf[w] = ' ';
+			else
+				buf[w] = *input;
+		}
+		w++;
+		input++;
+	}
+
+	*written = w;
+	return(0);
+
+toosmall:
+	*written = w;
+	mm_errno = MM_ERROR_CODEC;
+	mm_error_setmsg("quoted-printable: output buffer too small");
+	return(-1);
+}
@@ -0,0 +1,524 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_rewrite.c
+ *
+ * Rewriting changes the header fields of a parsed message without 
+ * serializing it again. Insertions, deletions and replacements of header
+ * fields are recorded as edits of byte ranges of the message source, and
+ * the output is spliced together from the unchanged ranges of the source
+ * and the edits. Only the header fields edited are generated, so the cost
+ * of a rewrite does not depend on the size of the message.
+ *
+ * Edits are made to header fields kept as struct mm_mimeheader. The 
+ * Content-Type, Content-Transfer-Encoding, Content-Disposition and 
+ * MIME-Version fields are parsed into the MIME part instead, so they can
+ * not be replaced or deleted, nor be inserted before. Changing them means
+ * changing the MIME part and writing the message out again with 
+ * mm_context_flatten(), which copies the unchanged header fields of a 
+ * message parsed with MM_PARSE_KEEPSOURCE from the source.
+ */
+
+static int mm_rewrite_add(struct mm_rewrite *, size_t, size_t, 
+    const char *, const char *, int);
+static int mm_rewrite_crlf(struct mm_rewrite *, size_t);
+static int mm_rewrite_emit(struct mm_emitter *, struct mm_rewrite *);
+static int mm_rewrite_check(struct mm_rewrite *, struct mm_mimeheader *);
+
+/** @{
+ * @name Rewriting parsed messages
+ */
+
+/**
+ * Starts rewriting a parsed message
+ *
+ * @param ctx A context parsed with MM_PARSE_KEEPSOURCE
+ * @return A new rewrite or NULL if ctx has no source
+ * @note Sets mm_errno on failure
+ *
+ * The header fields and MIME parts of ctx tell where edits go, but are not
+ * changed. The rewrite keeps a reference to the message source, so ctx may
+ * be freed once all edits are made.
+ */
+struct mm_rewrite *
+mm_rewrite_new(MM_CTX *ctx)
+{
+	struct mm_rewrite *rw;
+
+	assert(ctx != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (ctx->source == NULL) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("message source not kept");
+		return NULL;
+	}
+
+	rw = (struct mm_rewrite *)xmalloc(sizeof(struct mm_rewrite));
+	rw->source = ctx->source;
+	mm_body_ref(rw->source);
+	TAILQ_INIT(&rw->edits);
+	rw->splices = NULL;
+	rw->nsplices = 0;
+
+	return rw;
+}
+
+/**
+ * Frees a rewrite
+ *
+ * @param rw A valid rewrite
+ * @return Nothing
+ */
+void
+mm_rewrite_free(struct mm_rewrite *rw)
+{
+	struct mm_rewrite_edit *edit;
+
+	assert(rw != NULL);
+
+	while ((edit = TAILQ_FIRST(&rw->edits)) != NULL) {
+		TAILQ_REMOVE(&rw->edits, edit, next);
+		if (edit->data != NULL)
+			xfree(edit->data);
+		xfree(edit);
+	}
+	if (rw->splices != NULL)
+		xfree(rw->splices);
+	mm_body_unref(rw->source);
+	xfree(rw);
+}
+
+/**
+ * Inserts a header field
+ *
+ * @param rw A valid rewrite
+ * @param part The MIME part to insert the header field into
+ * @param before The parsed header field of part to insert before, or NULL
+ *        to insert at the end of the header section. Content-Type and
+ *        the other fields parsed into the MIME part can not be given.
+ * @param name The name of the header field
+ * @param value The value of the header field
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ *
+ * To prepend a header field, such as Received, insert it before the first
+ * header field of the envelope. Header fields inserted at the same place
+ * appear in the order they were inserted. The header field is folded like
+ * generated header fields are, and ends in the same line break, CRLF or 
+ * LF, as before or the header section of part.
+ */
+int
+mm_rewrite_insert(struct mm_rewrite *rw, struct mm_mimepart *part,
+    struct mm_mimeheader *before, const char *name, const char *value)
+{
+	size_t offset, end;
+
+	assert(rw != NULL);
+	assert(part != NULL);
+	assert(name != NULL && value != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (before != NULL) {
+		if (mm_rewrite_check(rw, before) == -1)
+			return -1;
+		offset = before->src_offset;
+		end = before->src_offset + before->src_length;
+	} else {
+		if (part->source != rw->source || part->src_hdrlen == 0) {
+			mm_errno = MM_ERROR_PROGRAM;
+			mm_error_setmsg("MIME part not parsed from source");
+			return -1;
+		}
+
+		/* Before the empty line ending the header section */
+		end = part->src_offset + part->src_hdrlen;
+		offset = end - ((part->src_hdrlen >= 2 
+		    && mm_rewrite_crlf(rw, end)) ? 2 : 1);
+	}
+
+	return mm_rewrite_add(rw, offset, 0, name, value, 
+	    mm_rewrite_crlf(rw, end));
+}
+
+/**
+ * Deletes a header field
+ *
+ * @param rw A valid rewrite
+ * @param hdr The parsed header field to delete
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ *
+ * Content-Type, Content-Transfer-Encoding, Content-Disposition and 
+ * MIME-Version are not header field objects and can not be deleted, see
+ * the description of this file.
+ */
+int
+mm_rewrite_delete(struct mm_rewrite *rw, struct mm_mimeheader *hdr)
+{
+	assert(rw != NULL);
+	assert(hdr != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (mm_rewrite_check(rw, hdr) == -1)
+		return -1;
+
+	return mm_rewrite_add(rw, hdr->src_offset, hdr->src_length, NULL, 
+	    NULL, 0);
+}
+
+/**
+ * Replaces the value of a header field
+ *
+ * @param rw A valid rewrite
+ * @param hdr The parsed header field to replace
+ * @param value The new value of the header field
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ *
+ * The new header field ends in the line break the old one ended in.
+ * Content-Type, Content-Transfer-Encoding, Content-Disposition and 
+ * MIME-Version are not header field objects and can not be replaced, see
+ * the description of this file.
+ */
+int
+mm_rewrite_replace(struct mm_rewrite *rw, struct mm_mimeheader *hdr, 
+    const char *value)
+{
+	assert(rw != NULL);
+	assert(hdr != NULL);
+	assert(value != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (mm_rewrite_check(rw, hdr) == -1)
+		return -1;
+
+	return mm_rewrite_add(rw, hdr->src_offset, hdr->src_length, 
+	    hdr->name, value, 
+	    mm_rewrite_crlf(rw, hdr->src_offset + hdr->src_length));
+}
+
+/**
+ * Gets the pieces a rewritten message consists of
+ *
+ * @param rw A valid rewrite
+ * @param splices Where to store the pieces
+ * @param count Where to store the number of pieces
+ * @return 0 on success or -1 on failure
+ *
+ * The pieces are ranges of the message source, which have their offset
+ * set, and the header fields generated for the edits, which have an
+ * offset of -1. Applications which have the original message in a file
+ * can copy the ranges of the source from there, e.g. with sendfile(2).
+ * The pieces belong to the rewrite and stay valid until it is edited 
+ * again or freed.
+ */
+int
+mm_rewrite_getsplices(struct mm_rewrite *rw, struct mm_splice **splices,
+    int *count)
+{
+	struct mm_rewrite_edit *edit;
+	struct mm_splice *splice;
+	size_t pos;
+	int n;
+
+	assert(rw != NULL);
+
+	if (rw->splices == NULL) {
+		n = 1;
+		TAILQ_FOREACH(edit, &rw->edits, next)
+			n += 2;
+		rw->splices = (struct mm_splice *)xmalloc(n 
+		    * sizeof(struct mm_splice));
+
+		splice = rw->splices;
+		pos = 0;
+		TAILQ_FOREACH(edit, &rw->edits, next) {
+			if (edit->offset > pos) {
+				splice->data = rw->source->data + pos;
+				splice->length = edit->offset - pos;
+				splice->offset = pos;
+				splice++;
+			}
+			if (edit->datalen > 0) {
+				splice->data = edit->data;
+				splice->length = edit->datalen;
+				splice->offset = -1;
+				splice++;
+			}
+			pos = edit->offset + edit->length;
+		}
+		if (rw->source->length > pos) {
+			splice->data = rw->source->data + pos;
+			splice->length = rw->source->length - pos;
+			splice->offset = pos;
+			splice++;
+		}
+		rw->nsplices = splice - rw->splices;
+	}
+
+	*splices = rw->splices;
+	*count = rw->nsplices;
+
+	return 0;
+}
+
+/**
+ * Creates the rewritten message in memory
+ *
+ * @param rw A valid rewrite
+ * @param flat Where to store the message
+ * @param length Where to store the length of the message
+ * @return 0 on success or -1 on failure
+ *
+ * The message is stored in a single allocation and NUL-terminated.
+ */
+int
+mm_rewrite_flatten(struct mm_rewrite *rw, char **flat, size_t *length)
+{
+	struct mm_emitter emitter;
+	char *message;
+
+	assert(rw != NULL);
+
+	mm_emitter_count(&emitter);
+	mm_rewrite_emit(&emitter, rw);
+
+	message = (char *)xmalloc(emitter.length + 1);
+	mm_emitter_buffer(&emitter, message, emitter.length);
+	mm_rewrite_emit(&emitter, rw);
+	message[emitter.length] = '\0';
+
+	*flat = message;
+	*length = emitter.length;
+
+	return 0;
+}
+
+/**
+ * Writes the rewritten message to a file descriptor
+ *
+ * @param rw A valid rewrite
+ * @param fd The file descriptor to write to
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ *
+ * The unchanged ranges of the source and the edits are written with
+ * writev(2) without being copied.
+ */
+int
+mm_rewrite_write_fd(struct mm_rewrite *rw, int fd)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	assert(rw != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	mm_emitter_writev(&emitter, fd);
+	ret = mm_rewrite_emit(&emitter, rw);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return ret;
+}
+
+/**
+ * Writes the rewritten message to a sink
+ *
+ * @param rw A valid rewrite
+ * @param sink The sink to write to
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ */
+int
+mm_rewrite_write(struct mm_rewrite *rw, struct mm_sink *sink)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	assert(rw != NULL);
+	assert(sink != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	mm_emitter_sink(&emitter, sink);
+	ret = mm_rewrite_emit(&emitter, rw);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return ret;
+}
+
+/** @} */
+
+/*
+ * Checks that a header field can be edited: it was parsed from the source
+ * of the rewrite and has not been modified since
+ */
+static int
+mm_rewrite_check(struct mm_rewrite *rw, struct mm_mimeheader *hdr)
+{
+	if (hdr->source != rw->source || hdr->src_length == 0 
+	    || hdr->src_offset + hdr->src_length > rw->source->length) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("header field not parsed from source");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Tells whether the line of the source which ends at offset ends in CRLF 
+ * rather than a bare LF
+ */
+static int
+mm_rewrite_crlf(struct mm_rewrite *rw, size_t offset)
+{
+	return offset >= 2 && offset <= rw->source->length
+	    && rw->source->data[offset - 2] == '\r';
+}
+
+/*
+ * Records an edit replacing length bytes at offset by the header field
+ * name: value, or by nothing if name is NULL. The line breaks of the header
+ * field are CRLF if crlf is set, LF otherwise. Edits are kept sorted by
+ * offset, and may not overlap.
+ */
+static int
+mm_rewrite_add(struct mm_rewrite *rw, size_t offset, size_t length, 
+    const char *name, const char *value, int crlf)
+{
+	struct mm_rewrite_edit *edit, *prev;
+	struct mm_emitter emitter;
+	size_t i, n;
+
+	/* 
+	 * Most edits are made in order, so search from the end. Insertions go
+	 * after insertions at the same offset, but before a deletion or 
+	 * replacement there.
+	 */
+	TAILQ_FOREACH_REVERSE(prev, &rw->edits, mm_rewrite_edits, next) {
+		if (prev->offset < offset || (prev->offset == offset 
+		    && (prev->length == 0 || length > 0)))
+			break;
+	}
+	if ((prev != NULL && prev->offset + prev->length > offset)
+	    || (length > 0 && (edit = (prev != NULL) ? TAILQ_NEXT(prev, next)
+	    : TAILQ_FIRST(&rw->edits)) != NULL 
+	    && edit->offset < offset + length)) {
+		mm_errno = MM_ERROR_PROGRAM;
+		mm_error_setmsg("header field edited twice");
+		return -1;
+	}
+
+	edit = (struct mm_rewrite_edit *)xmalloc(
+	    sizeof(struct mm_rewrite_edit));
+	edit->offset = offset;
+	edit->length = length;
+	edit->data = NULL;
+	edit->datalen = 0;
+
+	if (name != NULL) {
+		mm_emitter_count(&emitter);
+		mm_emit_header(&emitter, name, value);
+		edit->datalen = emitter.length;
+		edit->data = (char *)xmalloc(edit->datalen);
+		mm_emitter_buffer(&emitter, edit->data, edit->datalen);
+		mm_emit_header(&emitter, name, value);
+
+		if (!crlf) {
+			for (i = n = 0; i < edit->datalen; i++) {
+				if (edit->data[i] == '\r' 
+				    && i + 1 < edit->datalen
+				    && edit->data[i + 1] == '\n')
+					continue;
+				edit->data[n++] = edit->data[i];
+			}
+			edit->datalen = n;
+		}
+	}
+
+	if (prev != NULL)
+		TAILQ_INSERT_AFTER(&rw->edits, prev, edit, next);
+	else
+		TAILQ_INSERT_HEAD(&rw->edits, edit, next);
+
+	if (rw->splices != NULL) {
+		xfree(rw->splices);
+		rw->splices = NULL;
+		rw->nsplices = 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits the rewritten message
+ */
+static int
+mm_rewrite_emit(struct mm_emitter *emitter, struct mm_rewrite *rw)
+{
+	struct mm_rewrite_edit *edit;
+	size_t pos;
+
+	pos = 0;
+	TAILQ_FOREACH(edit, &rw->edits, next) {
+		if (mm_emit(emitter, rw->source->data + pos, 
+		    edit->offset - pos) == -1)
+			return -1;
+		if (edit->data != NULL 
+		    && mm_emit(emitter, edit->data, edit->datalen) == -1)
+			return -1;
+		pos = edit->offset + edit->length;
+	}
+
+	return mm_emit(emitter, rw->source->data + pos, 
+	    rw->source->length - pos);
+}
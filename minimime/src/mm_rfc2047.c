@@ -0,0 +1,238 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_rfc2047.c
+ *
+ * This module decodes RFC 2047 encoded words in header field values and
+ * MIME parameters.
+ */
+
+struct mm_encword
+{
+	const char *charset;
+	size_t charset_len;
+	int encoding;
+	const char *text;
+	size_t text_len;
+	const char *end;
+};
+
+static int mm_rfc2047_parseword(const char *, struct mm_encword *);
+
+/** @{
+ * @name Decoding RFC 2047 encoded words
+ */
+
+/**
+ * Decodes all RFC 2047 encoded words in a string
+ *
+ * @param value The NUL-terminated string to decode
+ * @param result Where to store a pointer to the decoded string
+ * @return 1 if the string was decoded, 0 if it does not contain any encoded
+ *	words or -1 on error.
+ * @ingroup mimeutil
+ *
+ * This function decodes encoded words of the form =?charset?B?...?= or
+ * =?charset?Q?...?= within a header field value into a newly allocated,
+ * NUL-terminated UTF-8 string, which must be freed by the caller. Whitespace
+ * between adjacent encoded words is removed and folded lines are unfolded.
+ * If the string does not contain any encoded words, nothing is allocated,
+ * result is set to NULL and 0 is returned. This check is a single scan for
+ * the "=?" sequence, so calling this function on plain values is cheap.
+ */
+int
+mm_rfc2047_decode(const char *value, char **result)
+{
+	struct mm_encword word;
+	const char *p, *q, *charset;
+	char *buf, *output, *scratch;
+	size_t len, scratch_len, charset_len, n;
+	int inword;
+
+	assert(value != NULL);
+	assert(result != NULL);
+
+	*result = NULL;
+
+	/* The fast path: nothing to decode */
+	if (strstr(value, "=?") == NULL)
+		return 0;
+
+	/* One allocation for the output and a scratch area, which collects
+	 * the decoded bytes of adjacent encoded words of the same charset
+	 * before they are converted (multibyte characters may be split
+	 * across encoded words).
+	 */
+	len = strlen(value);
+	buf = (char *)xmalloc(len * MM_CHARSET_MAXEXPAND + 1 + len);
+	output = buf;
+	scratch = buf + len * MM_CHARSET_MAXEXPAND + 1;
+	scratch_len = 0;
+	charset = NULL;
+	charset_len = 0;
+	inword = 0;
+
+#define FLUSH() do { \
+	if (scratch_len > 0) { \
+		output += mm_charset_convert(charset, charset_len, scratch, \
+		    scratch_len, output); \
+		scratch_len = 0; \
+	} \
+} while (0)
+
+	p = value;
+	while (*p != '\0') {
+		if (p[0] == '=' && p[1] == '?' 
+		    && mm_rfc2047_parseword(p, &word) == 0) {
+			if (charset != NULL && (charset_len != word.charset_len
+			    || strncasecmp(charset, word.charset, 
+			    charset_len))) {
+				FLUSH();
+			}
+			charset = word.charset;
+			charset_len = word.charset_len;
+
+			if (word.encoding == 'B') {
+				if (mm_base64_decode_into(word.text, 
+				    word.text_len, scratch + scratch_len,
+				    len - scratch_len, &n) == -1)
+					goto cleanup;
+			} else {
+				if (mm_qp_decode_q(word.text, word.text_len,
+				    scratch + scratch_len, len - scratch_len,
+				    &n) == -1)
+					goto cleanup;
+			}
+			scratch_len += n;
+			p = word.end;
+			inword = 1;
+			continue;
+		}
+
+		if (inword) {
+			/* Whitespace between adjacent encoded words is
+			 * not displayed.
+			 */
+			for (q = p; *q == ' ' || *q == '\t' || *q == '\r' 
+			    || *q == '\n'; q++)
+				;
+			if (q != p && q[0] == '=' && q[1] == '?'
+			    && mm_rfc2047_parseword(q, &word) == 0) {
+				p = q;
+				continue;
+			}
+			FLUSH();
+			inword = 0;
+		}
+
+		/* Unfold folded lines */
+		if ((*p == '\r' && p[1] == '\n' && (p[2] == ' ' 
+		    || p[2] == '\t')) || (*p == '\n' && (p[1] == ' ' 
+		    || p[1] == '\t'))) {
+			p += (*p == '\r') ? 2 : 1;
+			continue;
+		}
+
+		*output++ = *p++;
+	}
+	FLUSH();
+#undef FLUSH
+
+	*output = '\0';
+	*result = buf;
+
+	return 1;
+
+cleanup:
+	xfree(buf);
+	return -1;
+}
+
+/** @} */
+
+/*
+ * Parses an encoded word at the start of p into word. Returns 0 if a valid
+ * encoded word was found, -1 otherwise.
+ */
+static int
+mm_rfc2047_parseword(const char *p, struct mm_encword *word)
+{
+	const char *s;
+
+	if (p[0] != '=' || p[1] != '?')
+		return -1;
+
+	/* charset, optionally followed by an RFC 2231 language tag */
+	word->charset = s = p + 2;
+	while (*s != '\0' && *s != '?' && *s != ' ' && *s != '\t' 
+	    && *s != '\r' && *s != '\n')
+		s++;
+	if (*s != '?' || s == word->charset)
+		return -1;
+	word->charset_len = s - word->charset;
+	if ((p = memchr(word->charset, '*', word->charset_len)) != NULL)
+		word->charset_len = p - word->charset;
+
+	/* encoding */
+	s++;
+	if (*s == 'B' || *s == 'b') {
+		word->encoding = 'B';
+	} else if (*s == 'Q' || *s == 'q') {
+		word->encoding = 'Q';
+	} else {
+		return -1;
+	}
+	if (*++s != '?')
+		return -1;
+
+	/* encoded text, which may not contain whitespace */
+	word->text = ++s;
+	while (*s != '\0' && !(s[0] == '?' && s[1] == '=')) {
+		if (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+			return -1;
+		s++;
+	}
+	if (*s == '\0')
+		return -1;
+	word->text_len = s - word->text;
+	word->end = s + 2;
+
+	return 0;
+}
@@ -0,0 +1,332 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_rfc2231.c
+ *
+ * This module reassembles MIME parameters which were split into several
+ * segments or encoded according to RFC 2231, i.e. parameters of the form
+ *
+ *	name*0="first part"; name*1*=%E4rest
+ *	name*=iso-8859-1'de'%E4%F6%FC
+ *
+ * into a single logical parameter with an UTF-8 value. On output, values
+ * which can't be sent as quoted string are encoded the other way round, as
+ *
+ *	name*=utf-8''%C3%A4
+ */
+
+struct mm_segment
+{
+	struct mm_param *param;
+	size_t base_len;
+	long index;
+	int extended;
+	size_t order;
+};
+
+static int mm_rfc2231_parsename(struct mm_segment *);
+static int mm_rfc2231_compare(const void *, const void *);
+static size_t mm_rfc2231_unescape(const char *, char *);
+
+/** @{
+ * @name Reassembling RFC 2231 parameters
+ */
+
+/**
+ * Reassembles RFC 2231 parameter segments into logical parameters
+ *
+ * @param segments The list of parameter segments to reassemble
+ * @param result The list to append the logical parameters to
+ * @param keep Whether to keep the raw segments in the logical parameters
+ * @return 0 on success or -1 on failure
+ *
+ * All parameters in segments are sorted by their name and segment number,
+ * and each run of segments with the same name is concatenated, percent
+ * decoded and converted to UTF-8 in one go. The resulting parameters have
+ * their decoded value already set. If keep is set, the segments are moved
+ * to the resulting parameters (see mm_param_getsegment()), otherwise they
+ * are freed. Parameters with a name that isn't a valid RFC 2231 name are
+ * moved to result unchanged. In any case, segments is empty on return.
+ */
+int
+mm_rfc2231_assemble(struct mm_params *segments, struct mm_params *result,
+    int keep)
+{
+	struct mm_segment *seg;
+	struct mm_param *param;
+	const char *charset, *value, *s;
+	char *scratch;
+	size_t n, i, j, k, len, total, charset_len, scratch_len;
+
+	assert(segments != NULL);
+	assert(result != NULL);
+
+	n = 0;
+	total = 0;
+	TAILQ_FOREACH(param, segments, next) {
+		total += strlen(param->value);
+		n++;
+	}
+	if (n == 0)
+		return 0;
+
+	/* One allocation for the segment table and a scratch area holding
+	 * the unescaped bytes of one logical parameter.
+	 */
+	seg = (struct mm_segment *)xmalloc(n * sizeof(struct mm_segment) 
+	    + total);
+	scratch = (char *)(seg + n);
+
+	n = 0;
+	while ((param = TAILQ_FIRST(segments)) != NULL) {
+		TAILQ_REMOVE(segments, param, next);
+		seg[n].param = param;
+		seg[n].order = n;
+		if (mm_rfc2231_parsename(&seg[n]) == -1) {
+			TAILQ_INSERT_TAIL(result, param, next);
+			continue;
+		}
+		n++;
+	}
+
+	qsort(seg, n, sizeof(struct mm_segment), mm_rfc2231_compare);
+
+	for (i = 0; i < n; i = j) {
+		for (j = i + 1; j < n && seg[j].base_len == seg[i].base_len
+		    && !strncasecmp(seg[j].param->name, seg[i].param->name,
+		    seg[i].base_len); j++)
+			;
+
+		charset = NULL;
+		charset_len = 0;
+		scratch_len = 0;
+		for (k = i; k < j; k++) {
+			/* Duplicate segment numbers: the first one wins */
+			if (k > i && seg[k].index == seg[k - 1].index)
+				continue;
+
+			value = seg[k].param->value;
+			if (!seg[k].extended) {
+				len = strlen(value);
+				memcpy(scratch + scratch_len, value, len);
+				scratch_len += len;
+				continue;
+			}
+
+			/* The first segment starts with charset'language' */
+			if (k == i && (s = strchr(value, '\'')) != NULL
+			    && strchr(s + 1, '\'') != NULL) {
+				charset = value;
+				charset_len = s - value;
+				value = strchr(s + 1, '\'') + 1;
+			}
+			scratch_len += mm_rfc2231_unescape(value, 
+			    scratch + scratch_len);
+		}
+
+		param = mm_param_new();
+		param->name = (char *)xmalloc(seg[i].base_len + 1);
+		memcpy(param->name, seg[i].param->name, seg[i].base_len);
+		param->name[seg[i].base_len] = '\0';
+
+		param->value = (char *)xmalloc(scratch_len 
+		    * MM_CHARSET_MAXEXPAND + 1);
+		len = mm_charset_convert(charset != NULL ? charset : "",
+		    charset_len, scratch, scratch_len, param->value);
+		param->value[len] = '\0';
+		param->decoded = param->value;
+
+		if (keep) {
+			param->segments = (struct mm_params *)
+			    xmalloc(sizeof(struct mm_params));
+			TAILQ_INIT(param->segments);
+			for (k = i; k < j; k++)
+				TAILQ_INSERT_TAIL(param->segments, 
+				    seg[k].param, next);
+		} else {
+			for (k = i; k < j; k++)
+				mm_param_free(seg[k].param);
+		}
+
+		TAILQ_INSERT_TAIL(result, param, next);
+	}
+
+	xfree(seg);
+
+	return 0;
+}
+
+/**
+ * Tells whether a character may appear unescaped in an RFC 2231 value
+ *
+ * @param c The character
+ * @return 1 if c is an attribute-char of RFC 2231, 0 otherwise
+ */
+int
+mm_rfc2231_isattrchar(int c)
+{
+	if (c <= ' ' || c >= 127)
+		return 0;
+
+	return strchr("*'%()<>@,;:\\\"/[]?=", c) == NULL;
+}
+
+/**
+ * Gets the length of a parameter value encoded according to RFC 2231
+ *
+ * @param value The UTF-8 parameter value
+ * @return The length of the encoded value, including the utf-8'' prefix,
+ *	or 0 if the value can be sent as quoted string
+ *
+ * Values holding 8-bit or control characters can't be sent as quoted
+ * string, they have to be written as name*=utf-8''value with every byte
+ * but attribute-chars percent encoded.
+ */
+size_t
+mm_rfc2231_encodedlength(const char *value)
+{
+	const unsigned char *p;
+	size_t len;
+	int plain;
+
+	assert(value != NULL);
+
+	plain = 1;
+	len = 0;
+	for (p = (const unsigned char *)value; *p != '\0'; p++) {
+		if ((*p < ' ' && *p != '\t') || *p >= 127)
+			plain = 0;
+		len += mm_rfc2231_isattrchar(*p) ? 1 : 3;
+	}
+	if (plain)
+		return 0;
+
+	return len + 7;
+}
+
+/** @} */
+
+/*
+ * Splits the name of a parameter segment into base name, segment number
+ * and whether the segment is percent encoded. Returns -1 if the name is
+ * not a valid RFC 2231 name.
+ */
+static int
+mm_rfc2231_parsename(struct mm_segment *seg)
+{
+	const char *name, *star;
+	char *end;
+
+	name = seg->param->name;
+	if ((star = strchr(name, '*')) == NULL || star == name)
+		return -1;
+
+	seg->base_len = star - name;
+	seg->index = 0;
+	seg->extended = 0;
+
+	/* name* */
+	if (star[1] == '\0') {
+		seg->extended = 1;
+		return 0;
+	}
+
+	/* name*N or name*N* */
+	if (!isdigit((unsigned char)star[1]))
+		return -1;
+	seg->index = strtol(star + 1, &end, 10);
+	if (*end == '*') {
+		seg->extended = 1;
+		end++;
+	}
+	if (*end != '\0')
+		return -1;
+
+	return 0;
+}
+
+static int
+mm_rfc2231_compare(const void *a, const void *b)
+{
+	const struct mm_segment *s1, *s2;
+	size_t len;
+	int ret;
+
+	s1 = (const struct mm_segment *)a;
+	s2 = (const struct mm_segment *)b;
+
+	len = s1->base_len < s2->base_len ? s1->base_len : s2->base_len;
+	if ((ret = strncasecmp(s1->param->name, s2->param->name, len)) != 0)
+		return ret;
+	if (s1->base_len != s2->base_len)
+		return s1->base_len < s2->base_len ? -1 : 1;
+	if (s1->index != s2->index)
+		return s1->index < s2->index ? -1 : 1;
+
+	/* Keep duplicate segments in their original order */
+	return s1->order < s2->order ? -1 : 1;
+}
+
+/*
+ * Decodes %XX escapes in value into output and returns the number of bytes
+ * stored. Invalid escapes are copied as-is.
+ */
+static size_t
+mm_rfc2231_unescape(const char *value, char *output)
+{
+	static const char hex[] = "0123456789abcdef";
+	const char *p, *h, *l;
+	char *orig;
+
+	orig = output;
+	for (p = value; *p != '\0'; p++) {
+		if (*p == '%' && p[1] != '\0' && p[2] != '\0'
+		    && (h = strchr(hex, tolower((unsigned char)p[1]))) != NULL
+		    && (l = strchr(hex, tolower((unsigned char)p[2]))) != NULL) {
+			*output++ = ((h - hex) << 4) | (l - hex);
+			p += 2;
+		} else {
+			*output++ = *p;
+		}
+	}
+
+	return output - orig;
+}
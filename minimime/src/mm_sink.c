@@ -0,0 +1,172 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_sink.c
+ *
+ * Built-in sinks for mm_context_write() and mm_mimepart_write()
+ */
+
+static int mm_sink_dofile(struct mm_sink *, const char *, size_t);
+static int mm_sink_dofd(struct mm_sink *, const char *, size_t);
+static int mm_sink_dobuffer(struct mm_sink *, const char *, size_t);
+
+/** @{
+ * @name Sinks for serialized messages
+ *
+ * A sink receives a serialized message piece by piece. Besides the sinks
+ * built in, applications can write messages anywhere by setting the write
+ * member of a struct mm_sink to their own function, which may use the arg
+ * member to find its state.
+ */
+
+/**
+ * Initializes a sink writing to a stdio stream
+ *
+ * @param sink The sink to initialize
+ * @param file The stream to write to
+ * @return Nothing
+ * @ingroup mimeutil
+ */
+void
+mm_sink_file(struct mm_sink *sink, FILE *file)
+{
+	assert(sink != NULL);
+	assert(file != NULL);
+
+	memset(sink, 0, sizeof(struct mm_sink));
+	sink->write = mm_sink_dofile;
+	sink->arg = file;
+	sink->fd = -1;
+}
+
+/**
+ * Initializes a sink writing to a file descriptor
+ *
+ * @param sink The sink to initialize
+ * @param fd The file descriptor to write to
+ * @return Nothing
+ * @ingroup mimeutil
+ */
+void
+mm_sink_fd(struct mm_sink *sink, int fd)
+{
+	assert(sink != NULL);
+
+	memset(sink, 0, sizeof(struct mm_sink));
+	sink->write = mm_sink_dofd;
+	sink->fd = fd;
+}
+
+/**
+ * Initializes a sink collecting the message in memory
+ *
+ * @param sink The sink to initialize
+ * @return Nothing
+ * @ingroup mimeutil
+ *
+ * The message is stored NUL-terminated in the buf member of the sink, which
+ * grows as needed. Its length is stored in the length member. The caller
+ * must free buf.
+ */
+void
+mm_sink_buffer(struct mm_sink *sink)
+{
+	assert(sink != NULL);
+
+	memset(sink, 0, sizeof(struct mm_sink));
+	sink->write = mm_sink_dobuffer;
+	sink->fd = -1;
+}
+
+/** @} */
+
+static int
+mm_sink_dofile(struct mm_sink *sink, const char *data, size_t len)
+{
+	if (fwrite(data, 1, len, (FILE *)sink->arg) != len) {
+		mm_errno = MM_ERROR_ERRNO;
+		return -1;
+	}
+
+	return 0;
+}
+
+static int
+mm_sink_dofd(struct mm_sink *sink, const char *data, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write(sink->fd, data, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			mm_errno = MM_ERROR_ERRNO;
+			return -1;
+		}
+		data += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static int
+mm_sink_dobuffer(struct mm_sink *sink, const char *data, size_t len)
+{
+	size_t size;
+
+	if (sink->length + len + 1 > sink->size) {
+		size = sink->size > 0 ? sink->size : 4096;
+		while (size < sink->length + len + 1)
+			size *= 2;
+		sink->buf = (char *)xrealloc(sink->buf, size);
+		sink->size = size;
+	}
+
+	memcpy(sink->buf + sink->length, data, len);
+	sink->length += len;
+	sink->buf[sink->length] = '\0';
+
+	return 0;
+}
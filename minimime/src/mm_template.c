@@ -0,0 +1,655 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_template.c
+ *
+ * Message templates serialize a context once and render any number of
+ * personalized messages from it. Slots are marked in header field values
+ * and text bodies as ${name}, where name consists of letters, digits, '_',
+ * '-' and '.'. When the template is built, the context is serialized with
+ * all bodies encoded, the markers are cut out of the result and their 
+ * positions are remembered. Rendering a message only copies or points to
+ * the pre-serialized data and inserts the values of the slots.
+ *
+ * Text bodies which are encoded on output are the exception: slots are
+ * found in them before they are encoded, so they are kept unencoded in the
+ * template, and encoded together with the values of their slots whenever
+ * a message is rendered.
+ */
+
+/* A range of the serialized message, whether it may contain slots, and
+ * the codec of a body kept unencoded */
+struct mm_template_region
+{
+	size_t offset;
+	int slots;
+	struct mm_codec *codec;
+};
+
+struct mm_template_regions
+{
+	struct mm_template_region *region;
+	int count;
+	int size;
+
+	/* Set if a body to encode has a codec without streaming kernel */
+	int error;
+};
+
+static int mm_template_mark(struct mm_emitter *, struct mm_mimepart *, int);
+static void mm_template_scan(struct mm_template *, 
+    struct mm_template_regions *);
+static size_t mm_template_marker(struct mm_template *, size_t, size_t);
+static int mm_template_emit(struct mm_emitter *, struct mm_template *, 
+    const char **);
+static int mm_template_emitrange(struct mm_emitter *, struct mm_template *,
+    struct mm_emitter_encoder *, int *, size_t, size_t);
+static int mm_template_endbody(struct mm_emitter *, struct mm_template *,
+    struct mm_emitter_encoder *, int *);
+
+/** @{
+ * @name Building messages from templates
+ */
+
+/**
+ * Creates a message template from a context
+ *
+ * @param ctx A valid MiniMIME context
+ * @param flags Flags that affect the flattening process
+ * @return A new template or NULL on failure
+ * @note Sets mm_errno on failure
+ * @see mm_context_flatten
+ *
+ * This function serializes the message of ctx like mm_context_flatten()
+ * does, and finds the slots marked as ${name} in its header fields and in
+ * the bodies of its text parts. Bodies of other parts are never searched,
+ * and encoded only once here, however many messages are rendered. The 
+ * template does not refer to ctx, which may be freed or changed after.
+ *
+ * Values are inserted as given, so they must be valid at the place of their
+ * slot, e.g. encoded with RFC 2047 in header fields. Header fields are 
+ * folded before values are inserted. Text bodies flagged with 
+ * MM_MIMEPART_ENCODE or stored in files are an exception: they are 
+ * encoded together with the values of their slots for every message, so
+ * their codec must have a streaming kernel. In bodies which are encoded
+ * already, values are inserted as given.
+ */
+struct mm_template *
+mm_template_new(MM_CTX *ctx, int flags)
+{
+	struct mm_template *tpl;
+	struct mm_template_regions regions;
+	struct mm_emitter emitter;
+	size_t size;
+
+	assert(ctx != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	if (mm_emit_prepare(ctx, flags) == -1)
+		return NULL;
+
+	mm_emitter_count(&emitter);
+	if (mm_emit_context(&emitter, ctx, flags) == -1)
+		return NULL;
+	size = emitter.length;
+
+	tpl = (struct mm_template *)xmalloc(sizeof(struct mm_template));
+	tpl->data = (char *)xmalloc(size + 1);
+	tpl->length = 0;
+	tpl->slots = NULL;
+	tpl->nslots = 0;
+	tpl->names = NULL;
+	tpl->nnames = 0;
+	tpl->bodies = NULL;
+	tpl->nbodies = 0;
+
+	regions.region = NULL;
+	regions.count = 0;
+	regions.size = 0;
+	regions.error = 0;
+
+	mm_emitter_buffer(&emitter, tpl->data, size);
+	emitter.mark = mm_template_mark;
+	emitter.arg = &regions;
+	if (mm_emit_context(&emitter, ctx, flags) == -1) {
+		if (regions.region != NULL)
+			xfree(regions.region);
+		mm_template_free(tpl);
+		return NULL;
+	}
+	tpl->length = emitter.length;
+
+	if (regions.error) {
+		if (regions.region != NULL)
+			xfree(regions.region);
+		mm_template_free(tpl);
+		mm_errno = MM_ERROR_CODEC;
+		mm_error_setmsg("codec of a text body can't encode in chunks");
+		return NULL;
+	}
+
+	mm_template_scan(tpl, &regions);
+	tpl->data[tpl->length] = '\0';
+
+	if (regions.region != NULL)
+		xfree(regions.region);
+
+	return tpl;
+}
+
+/**
+ * Frees a message template
+ *
+ * @param tpl A valid message template
+ * @return Nothing
+ */
+void
+mm_template_free(struct mm_template *tpl)
+{
+	int i;
+
+	assert(tpl != NULL);
+
+	for (i = 0; i < tpl->nnames; i++)
+		xfree(tpl->names[i]);
+	if (tpl->names != NULL)
+		xfree(tpl->names);
+	if (tpl->slots != NULL)
+		xfree(tpl->slots);
+	if (tpl->bodies != NULL)
+		xfree(tpl->bodies);
+	xfree(tpl->data);
+	xfree(tpl);
+}
+
+/**
+ * Gets the number of distinct slots of a template
+ *
+ * @param tpl A valid message template
+ * @return The number of slots. The values passed to the render functions
+ *         are indexed by slot number, from 0 to the number returned less 1.
+ */
+int
+mm_template_countslots(struct mm_template *tpl)
+{
+	assert(tpl != NULL);
+
+	return tpl->nnames;
+}
+
+/**
+ * Looks up a slot by its name
+ *
+ * @param tpl A valid message template
+ * @param name The name of the slot, without ${}
+ * @return The number of the slot or -1 if the template has no such slot
+ */
+int
+mm_template_getslot(struct mm_template *tpl, const char *name)
+{
+	int i;
+
+	assert(tpl != NULL);
+	assert(name != NULL);
+
+	for (i = 0; i < tpl->nnames; i++) {
+		if (!strcmp(tpl->names[i], name))
+			return i;
+	}
+
+	return -1;
+}
+
+/**
+ * Gets the name of a slot
+ *
+ * @param tpl A valid message template
+ * @param idx The number of the slot
+ * @return The name of the slot or NULL if there is no such slot
+ */
+const char *
+mm_template_getslotname(struct mm_template *tpl, int idx)
+{
+	assert(tpl != NULL);
+
+	if (idx < 0 || idx >= tpl->nnames)
+		return NULL;
+
+	return tpl->names[idx];
+}
+
+/**
+ * Renders a message from a template into memory
+ *
+ * @param tpl A valid message template
+ * @param values The values of the slots, indexed by slot number
+ * @param flat Where to store the message
+ * @param length Where to store the length of the message
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ * @see mm_template_getslot
+ *
+ * The message is stored in a single allocation of exactly its size, and is
+ * NUL-terminated. Slots with a NULL value are left empty. If a value can
+ * not be encoded, nothing is stored.
+ */
+int
+mm_template_render(struct mm_template *tpl, const char **values, 
+    char **flat, size_t *length)
+{
+	struct mm_emitter emitter;
+	char *message;
+
+	assert(tpl != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	*flat = NULL;
+	*length = 0;
+
+	mm_emitter_count(&emitter);
+	if (mm_template_emit(&emitter, tpl, values) == -1)
+		return -1;
+
+	message = (char *)xmalloc(emitter.length + 1);
+	mm_emitter_buffer(&emitter, message, emitter.length);
+	if (mm_template_emit(&emitter, tpl, values) == -1) {
+		xfree(message);
+		return -1;
+	}
+	message[emitter.length] = '\0';
+
+	*flat = message;
+	*length = emitter.length;
+
+	return 0;
+}
+
+/**
+ * Writes a message rendered from a template to a file descriptor
+ *
+ * @param tpl A valid message template
+ * @param values The values of the slots, indexed by slot number
+ * @param fd The file descriptor to write to
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ *
+ * The message is not built in memory. The pre-serialized parts of the
+ * template and the values of the slots are gathered and written with 
+ * writev(2), in one call per about IOV_MAX / 2 slots. Bodies which are 
+ * encoded as they are written, such as slots in base64 bodies, are
+ * encoded in chunks into a reused buffer, so each chunk is written out 
+ * with everything gathered before it, and such templates take a call 
+ * per chunk.
+ */
+int
+mm_template_write_fd(struct mm_template *tpl, const char **values, int fd)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	assert(tpl != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	mm_emitter_writev(&emitter, fd);
+	ret = mm_template_emit(&emitter, tpl, values);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return ret;
+}
+
+/**
+ * Writes a message rendered from a template to a sink
+ *
+ * @param tpl A valid message template
+ * @param values The values of the slots, indexed by slot number
+ * @param sink The sink to write to
+ * @return 0 on success or -1 on failure
+ * @note Sets mm_errno on failure
+ * @see mm_context_write
+ */
+int
+mm_template_write(struct mm_template *tpl, const char **values, 
+    struct mm_sink *sink)
+{
+	struct mm_emitter emitter;
+	int ret;
+
+	assert(tpl != NULL);
+	assert(sink != NULL);
+
+	mm_errno = MM_ERROR_NONE;
+
+	mm_emitter_sink(&emitter, sink);
+	ret = mm_template_emit(&emitter, tpl, values);
+	if (ret == 0)
+		ret = mm_emitter_flush(&emitter);
+	mm_emitter_close(&emitter);
+
+	return ret;
+}
+
+/** @} */
+
+/*
+ * Remembers where header sections and bodies start and end while the 
+ * template is serialized. Header sections and the bodies of text parts may
+ * contain slots, the remaining bodies may not. Text bodies which would be
+ * encoded are asked for as is.
+ */
+static int
+mm_template_mark(struct mm_emitter *emitter, struct mm_mimepart *part, 
+    int what)
+{
+	struct mm_template_regions *regions;
+	struct mm_template_region *region;
+	struct mm_codec *codec;
+
+	regions = (struct mm_template_regions *)emitter->arg;
+	if (regions->count == regions->size) {
+		regions->size = regions->size ? regions->size * 2 : 16;
+		regions->region = (struct mm_template_region *)xrealloc(
+		    regions->region, regions->size 
+		    * sizeof(struct mm_template_region));
+	}
+
+	region = &regions->region[regions->count++];
+	region->offset = emitter->length;
+	region->slots = 1;
+	region->codec = NULL;
+
+	if (what != MM_EMIT_BODY || part->type == NULL)
+		return 0;
+
+	if (!mm_content_istype(part->type, MM_MEDIATYPE_TEXT, 
+	    MM_MEDIASUBTYPE_ANY)) {
+		region->slots = 0;
+		return 0;
+	}
+
+	if (!(part->flags & MM_MIMEPART_ENCODE) && !MM_MIMEPART_HASFILE(part))
+		return 0;
+	if ((codec = mm_content_getcodec(part->type)) == NULL)
+		return 0;
+	if (codec->encode_chunk == NULL) {
+		regions->error = 1;
+		return 0;
+	}
+
+	region->codec = codec;
+	return 1;
+}
+
+/*
+ * Finds the slot markers in the regions of the serialized message which 
+ * may contain slots, and cuts them out. The data is moved down in place.
+ */
+static void
+mm_template_scan(struct mm_template *tpl, struct mm_template_regions *regions)
+{
+	size_t rpos, wpos, end, next, len;
+	int i, body;
+
+	for (i = 0; i < regions->count; i++) {
+		if (regions->region[i].codec != NULL)
+			tpl->nbodies++;
+	}
+	if (tpl->nbodies > 0)
+		tpl->bodies = (struct mm_template_body *)xmalloc(
+		    tpl->nbodies * sizeof(struct mm_template_body));
+
+	rpos = wpos = 0;
+	body = -1;
+	for (i = 0; i < regions->count; i++) {
+		end = (i + 1 < regions->count) ? regions->region[i + 1].offset 
+		    : tpl->length;
+		if (!regions->region[i].slots)
+			continue;
+
+		/* Move the data up to here, which has no slots */
+		next = regions->region[i].offset;
+		memmove(tpl->data + wpos, tpl->data + rpos, next - rpos);
+		wpos += next - rpos;
+		rpos = next;
+
+		if (regions->region[i].codec != NULL) {
+			body++;
+			tpl->bodies[body].start = wpos;
+			tpl->bodies[body].codec = regions->region[i].codec;
+		}
+
+		while (rpos < end) {
+			next = rpos;
+			while (next + 1 < end && (tpl->data[next] != '$' 
+			    || tpl->data[next + 1] != '{'))
+				next++;
+			if (next + 1 >= end)
+				next = end;
+
+			memmove(tpl->data + wpos, tpl->data + rpos, 
+			    next - rpos);
+			wpos += next - rpos;
+			rpos = next;
+			if (rpos == end)
+				break;
+
+			len = mm_template_marker(tpl, rpos, end);
+			if (len == 0) {
+				/* Not a slot, keep the '$' */
+				tpl->data[wpos++] = tpl->data[rpos++];
+				continue;
+			}
+
+			tpl->slots[tpl->nslots - 1].offset = wpos;
+			if (regions->region[i].codec != NULL)
+				tpl->slots[tpl->nslots - 1].body = body;
+			rpos += len;
+		}
+
+		if (regions->region[i].codec != NULL)
+			tpl->bodies[body].end = wpos;
+	}
+
+	memmove(tpl->data + wpos, tpl->data + rpos, tpl->length - rpos);
+	tpl->length = wpos + tpl->length - rpos;
+}
+
+/*
+ * Parses the slot marker at pos, which starts with "${", and adds a slot
+ * for it. Returns the length of the marker or 0 if there is no valid one.
+ */
+static size_t
+mm_template_marker(struct mm_template *tpl, size_t pos, size_t end)
+{
+	const char *name;
+	size_t len;
+	int idx;
+
+	name = tpl->data + pos + 2;
+	len = 0;
+	while (pos + 2 + len < end && (isalnum((unsigned char)name[len]) 
+	    || name[len] == '_' || name[len] == '-' || name[len] == '.'))
+		len++;
+	if (len == 0 || pos + 2 + len >= end || name[len] != '}')
+		return 0;
+
+	for (idx = 0; idx < tpl->nnames; idx++) {
+		if (strlen(tpl->names[idx]) == len 
+		    && !strncmp(tpl->names[idx], name, len))
+			break;
+	}
+	if (idx == tpl->nnames) {
+		tpl->names = (char **)xrealloc(tpl->names, 
+		    (tpl->nnames + 1) * sizeof(char *));
+		tpl->names[idx] = (char *)xmalloc(len + 1);
+		memcpy(tpl->names[idx], name, len);
+		tpl->names[idx][len] = '\0';
+		tpl->nnames++;
+	}
+
+	/* The slot array has room for a power of two slots */
+	if ((tpl->nslots & (tpl->nslots - 1)) == 0) {
+		tpl->slots = (struct mm_template_slot *)xrealloc(tpl->slots,
+		    (tpl->nslots ? tpl->nslots * 2 : 1) 
+		    * sizeof(struct mm_template_slot));
+	}
+	tpl->slots[tpl->nslots].index = idx;
+	tpl->slots[tpl->nslots].offset = 0;
+	tpl->slots[tpl->nslots].body = -1;
+	tpl->nslots++;
+
+	return len + 3;
+}
+
+/*
+ * Emits a message rendered from a template
+ */
+static int
+mm_template_emit(struct mm_emitter *emitter, struct mm_template *tpl, 
+    const char **values)
+{
+	struct mm_emitter_encoder enc;
+	const char *value;
+	size_t pos;
+	int i, body;
+
+	pos = 0;
+	body = 0;
+	if (tpl->nbodies > 0)
+		mm_emitter_encoder_init(&enc, tpl->bodies[0].codec);
+
+	for (i = 0; i < tpl->nslots; i++) {
+		if (mm_template_emitrange(emitter, tpl, &enc, &body, pos, 
+		    tpl->slots[i].offset) == -1)
+			return -1;
+		pos = tpl->slots[i].offset;
+
+		value = (values != NULL) ? values[tpl->slots[i].index] : NULL;
+		if (value == NULL)
+			continue;
+		if (tpl->slots[i].body == -1) {
+			if (mm_emit_string(emitter, value) == -1)
+				return -1;
+			continue;
+		}
+		while (body < tpl->slots[i].body) {
+			if (mm_template_endbody(emitter, tpl, &enc, &body) 
+			    == -1)
+				return -1;
+		}
+		if (mm_emit_encode(emitter, &enc, value, strlen(value), 0) 
+		    == -1)
+			return -1;
+	}
+
+	if (mm_template_emitrange(emitter, tpl, &enc, &body, pos, 
+	    tpl->length) == -1)
+		return -1;
+	while (body < tpl->nbodies) {
+		if (mm_template_endbody(emitter, tpl, &enc, &body) == -1)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Emits the data of a template from offset from up to offset to. The data 
+ * of the bodies kept unencoded is passed to their encoder. *body is the 
+ * number of the first body which has not been ended yet.
+ */
+static int
+mm_template_emitrange(struct mm_emitter *emitter, struct mm_template *tpl,
+    struct mm_emitter_encoder *enc, int *body, size_t from, size_t to)
+{
+	struct mm_template_body *b;
+	size_t stop;
+
+	while (from < to) {
+		b = (*body < tpl->nbodies) ? &tpl->bodies[*body] : NULL;
+
+		if (b != NULL && from >= b->start) {
+			/* The body ends before what is left */
+			if (from >= b->end) {
+				if (mm_template_endbody(emitter, tpl, enc, 
+				    body) == -1)
+					return -1;
+				continue;
+			}
+			stop = (to < b->end) ? to : b->end;
+			if (mm_emit_encode(emitter, enc, tpl->data + from, 
+			    stop - from, 0) == -1)
+				return -1;
+			from = stop;
+			continue;
+		}
+
+		stop = (b != NULL && b->start < to) ? b->start : to;
+		if (mm_emit(emitter, tpl->data + from, stop - from) == -1)
+			return -1;
+		from = stop;
+	}
+
+	return 0;
+}
+
+/*
+ * Ends the body numbered *body, i.e. encodes what its encoder has left, and
+ * gets the encoder ready for the next body
+ */
+static int
+mm_template_endbody(struct mm_emitter *emitter, struct mm_template *tpl,
+    struct mm_emitter_encoder *enc, int *body)
+{
+	if (mm_emit_encode(emitter, enc, NULL, 0, 1) == -1)
+		return -1;
+
+	(*body)++;
+	if (*body < tpl->nbodies)
+		mm_emitter_encoder_init(enc, tpl->bodies[*body].codec);
+
+	return 0;
+}
@@ -359,7 +359,7 @@ mm_addchars(char *input, char *add, u_int16_t linelength)
 	u_int32_t i;
 	u_int32_t l;
 	u_int32_t j;
-	u_int16_t addcrlf;
+	u_int32_t addcrlf;
 	char *output;
 	char *orig;
 	
@@ -369,7 +369,7 @@ mm_addchars(char *input, char *add, u_int16_t linelength)
 
 	addcrlf = len / linelength;
 
-	output = (char *)xmalloc(len + (addcrlf * strlen(add)));
+	output = (char *)xmalloc(len + (addcrlf * strlen(add)) + 1);
 	orig = output;
 	
 	for (i = 0, l = 0; i < len; i++, l++) {
@@ -0,0 +1,629 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_view.c
+ *
+ * A message view is a read-only alternative to parsing a message into a
+ * context. The message is scanned twice with the same code: the first 
+ * scan counts its MIME parts, header fields and Content-Type parameters,
+ * the second one stores them in arrays which are allocated in one block
+ * together with the view. Entries refer to the message by offset and 
+ * length instead of holding copies, so a view is freed with one call to
+ * free() and walking it touches little memory.
+ *
+ * MIME parts are stored in depth first order, each followed by the parts
+ * nested in it. The first part is the message itself.
+ */
+
+/* How deep multipart entities are looked into */
+#define MM_VIEW_MAXDEPTH 32
+
+/*
+ * Scanning state. While counting, view is NULL and nothing is stored.
+ */
+struct mm_viewscan
+{
+	const char *data;
+	struct mm_view *view;
+
+	int nparts;
+	int nheaders;
+	int nparams;
+};
+
+static int mm_view_scanpart(struct mm_viewscan *, size_t, size_t, int, int);
+static void mm_view_scantype(struct mm_viewscan *, struct mm_viewpart *,
+    size_t, size_t, struct mm_viewspan *);
+static void mm_view_addheader(struct mm_viewscan *, size_t, size_t, size_t,
+    size_t);
+static size_t mm_view_line(const char *, size_t, size_t, size_t *);
+static int mm_view_isdelimiter(const char *, size_t, size_t, 
+    struct mm_viewspan *, int *);
+static int mm_view_spaneq(struct mm_view *, struct mm_viewspan *, 
+    const char *);
+
+/** @{
+ * @name Message views
+ */
+
+/**
+ * Creates a view of a message
+ *
+ * @param data The message
+ * @param length The length of the message
+ * @param flags See enum mm_view_flags
+ * @return A new view, which must be freed with mm_view_free()
+ *
+ * This function scans the header sections and multipart structure of a
+ * message. Unless MM_VIEW_COPY is given, the view refers to the message,
+ * which must be kept around unchanged as long as the view is used. With
+ * MM_VIEW_COPY, the message is copied into the view's memory. Header 
+ * field values are given as found in the message, including any folding
+ * line breaks, and quoted parameter values without the quotes but with
+ * their quoted pairs, such as \\", as they are.
+ */
+struct mm_view *
+mm_view_new(const char *data, size_t length, int flags)
+{
+	struct mm_viewscan scan;
+	struct mm_view *view;
+	size_t size;
+	char *mem;
+
+	assert(data != NULL);
+
+	scan.data = data;
+	scan.view = NULL;
+	scan.nparts = scan.nheaders = scan.nparams = 0;
+	mm_view_scanpart(&scan, 0, length, -1, 0);
+
+	size = sizeof(struct mm_view) 
+	    + scan.nparts * sizeof(struct mm_viewpart)
+	    + scan.nheaders * sizeof(struct mm_viewheader)
+	    + scan.nparams * sizeof(struct mm_viewparam);
+	if (flags & MM_VIEW_COPY)
+		size += length + 1;
+
+	mem = xmalloc(size);
+	view = (struct mm_view *)mem;
+	mem += sizeof(struct mm_view);
+	view->parts = (struct mm_viewpart *)mem;
+	mem += scan.nparts * sizeof(struct mm_viewpart);
+	view->headers = (struct mm_viewheader *)mem;
+	mem += scan.nheaders * sizeof(struct mm_viewheader);
+	view->params = (struct mm_viewparam *)mem;
+	mem += scan.nparams * sizeof(struct mm_viewparam);
+
+	if (flags & MM_VIEW_COPY) {
+		memcpy(mem, data, length);
+		mem[length] = '\0';
+		data = mem;
+	}
+	view->data = data;
+	view->length = length;
+	view->nparts = scan.nparts;
+	view->nheaders = scan.nheaders;
+	view->nparams = scan.nparams;
+
+	scan.data = data;
+	scan.view = view;
+	scan.nparts = scan.nheaders = scan.nparams = 0;
+	mm_view_scanpart(&scan, 0, length, -1, 0);
+
+	return view;
+}
+
+/**
+ * Frees a message view
+ *
+ * @param view A view created with mm_view_new()
+ * @return Nothing
+ */
+void
+mm_view_free(struct mm_view *view)
+{
+	assert(view != NULL);
+
+	xfree(view);
+}
+
+/**
+ * Counts the MIME parts of a message view
+ *
+ * @param view A valid message view
+ * @return The number of MIME parts, including the message itself
+ */
+int
+mm_view_countparts(struct mm_view *view)
+{
+	assert(view != NULL);
+
+	return view->nparts;
+}
+
+/**
+ * Gets a MIME part of a message view
+ *
+ * @param view A valid message view
+ * @param which The number of the MIME part, 0 for the message itself
+ * @return The MIME part or NULL if there is no such part
+ */
+const struct mm_viewpart *
+mm_view_getpart(struct mm_view *view, int which)
+{
+	assert(view != NULL);
+
+	if (which < 0 || which >= view->nparts)
+		return NULL;
+
+	return &view->parts[which];
+}
+
+/**
+ * Gets a header field of a MIME part of a message view by position
+ *
+ * @param view A valid message view
+ * @param which The number of the MIME part
+ * @param idx The position of the header field in the part's header section
+ * @return The header field or NULL if there is no such field
+ */
+const struct mm_viewheader *
+mm_view_getheader(struct mm_view *view, int which, int idx)
+{
+	assert(view != NULL);
+
+	if (which < 0 || which >= view->nparts || idx < 0 
+	    || idx >= view->parts[which].nheaders)
+		return NULL;
+
+	return &view->headers[view->parts[which].headers + idx];
+}
+
+/**
+ * Gets the value of a header field of a MIME part of a message view
+ *
+ * @param view A valid message view
+ * @param which The number of the MIME part
+ * @param name The name of the header field, compared case insensitively
+ * @param idx Which of the header fields of that name to get, starting at 0
+ * @param length Where to store the length of the value
+ * @return A pointer to the value in the message, which is not
+ *         NUL-terminated, or NULL if there is no such header field
+ */
+const char *
+mm_view_getheadervalue(struct mm_view *view, int which, const char *name,
+    int idx, size_t *length)
+{
+	struct mm_viewpart *part;
+	struct mm_viewheader *hdr;
+	int i;
+
+	assert(view != NULL);
+	assert(name != NULL);
+	assert(length != NULL);
+
+	if (which < 0 || which >= view->nparts)
+		return NULL;
+
+	part = &view->parts[which];
+	for (i = 0; i < part->nheaders; i++) {
+		hdr = &view->headers[part->headers + i];
+		if (mm_view_spaneq(view, &hdr->name, name) && idx-- == 0) {
+			*length = hdr->value.length;
+			return view->data + hdr->value.offset;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Gets the value of a Content-Type parameter of a MIME part of a message
+ * view
+ *
+ * @param view A valid message view
+ * @param which The number of the MIME part
+ * @param name The name of the parameter, compared case insensitively
+ * @param length Where to store the length of the value
+ * @return A pointer to the value in the message, which is not 
+ *         NUL-terminated, or NULL if there is no such parameter
+ *
+ * A quoted value is given without the quotes, but is not unquoted: 
+ * backslashes escaping quotes and backslashes are part of the value.
+ */
+const char *
+mm_view_getparamvalue(struct mm_view *view, int which, const char *name,
+    size_t *length)
+{
+	struct mm_viewpart *part;
+	struct mm_viewparam *param;
+	int i;
+
+	assert(view != NULL);
+	assert(name != NULL);
+	assert(length != NULL);
+
+	if (which < 0 || which >= view->nparts)
+		return NULL;
+
+	part = &view->parts[which];
+	for (i = 0; i < part->nparams; i++) {
+		param = &view->params[part->params + i];
+		if (mm_view_spaneq(view, &param->name, name)) {
+			*length = param->value.length;
+			return view->data + param->value.offset;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Gets the body of a MIME part of a message view
+ *
+ * @param view A valid message view
+ * @param which The number of the MIME part
+ * @param length Where to store the length of the body
+ * @return A pointer to the body in the message, or NULL if there is no
+ *         such part
+ *
+ * The body of a multipart entity includes the parts nested in it.
+ */
+const char *
+mm_view_getbody(struct mm_view *view, int which, size_t *length)
+{
+	struct mm_viewpart *part;
+
+	assert(view != NULL);
+	assert(length != NULL);
+
+	if (which < 0 || which >= view->nparts)
+		return NULL;
+
+	part = &view->parts[which];
+	*length = part->length - part->hdrlen;
+	return view->data + part->offset + part->hdrlen;
+}
+
+/** @} */
+
+/*
+ * Scans the MIME part between start and end and the parts nested in it. 
+ * Returns the number of the part.
+ */
+static int
+mm_view_scanpart(struct mm_viewscan *scan, size_t start, size_t end, 
+    int parent, int depth)
+{
+	struct mm_viewpart part;
+	struct mm_viewspan boundary;
+	const char *d;
+	size_t pos, next, eol, colon, name_end, value, ctype, ctype_end;
+	size_t hdr_name, hdr_name_end, hdr_value, hdr_value_end, child_start;
+	int which, child, prev, closed, inside;
+
+	d = scan->data;
+	which = scan->nparts++;
+
+	part.offset = start;
+	part.headers = scan->nheaders;
+	part.nheaders = 0;
+	part.params = scan->nparams;
+	part.nparams = 0;
+	part.type.offset = part.subtype.offset = start;
+	part.type.length = part.subtype.length = 0;
+	part.parent = parent;
+	part.children = -1;
+	part.nchildren = 0;
+	part.next = -1;
+
+	/* The header section, up to the first empty line. A header field
+	 * is stored once all of its continuation lines have been seen. */
+	ctype = ctype_end = 0;
+	hdr_name = hdr_name_end = hdr_value = hdr_value_end = 0;
+	pos = start;
+	while (pos < end) {
+		eol = mm_view_line(d, pos, end, &next);
+		if (eol > pos && (d[pos] == ' ' || d[pos] == '\t')) {
+			/* Skipped if there is no header field to continue */
+			if (hdr_name_end > hdr_name)
+				hdr_value_end = eol;
+			pos = next;
+			continue;
+		}
+		if (hdr_name_end > hdr_name) {
+			mm_view_addheader(scan, hdr_name, hdr_name_end, 
+			    hdr_value, hdr_value_end);
+			if (ctype_end == 0 && hdr_name_end - hdr_name == 12
+			    && !strncasecmp(d + hdr_name, "Content-Type", 12)) {
+				ctype = hdr_value;
+				ctype_end = hdr_value_end;
+			}
+			hdr_name = hdr_name_end = 0;
+		}
+		if (eol == pos) {
+			pos = next;
+			break;
+		}
+
+		/* Lines which are not header fields are skipped */
+		for (colon = pos; colon < eol && d[colon] != ':'; colon++)
+			;
+		if (colon < eol) {
+			for (name_end = colon; name_end > pos 
+			    && (d[name_end - 1] == ' ' || d[name_end - 1] == '\t');
+			    name_end--)
+				;
+			for (value = colon + 1; value < eol 
+			    && (d[value] == ' ' || d[value] == '\t'); value++)
+				;
+			hdr_name = pos;
+			hdr_name_end = name_end;
+			hdr_value = value;
+			hdr_value_end = eol;
+		}
+		pos = next;
+	}
+	if (hdr_name_end > hdr_name) {
+		mm_view_addheader(scan, hdr_name, hdr_name_end, hdr_value, 
+		    hdr_value_end);
+		if (ctype_end == 0 && hdr_name_end - hdr_name == 12
+		    && !strncasecmp(d + hdr_name, "Content-Type", 12)) {
+			ctype = hdr_value;
+			ctype_end = hdr_value_end;
+		}
+	}
+	part.nheaders = scan->nheaders - part.headers;
+	part.hdrlen = pos - start;
+	part.length = end - start;
+
+	boundary.offset = 0;
+	boundary.length = 0;
+	if (ctype_end > 0)
+		mm_view_scantype(scan, &part, ctype, ctype_end, &boundary);
+	part.nparams = scan->nparams - part.params;
+
+	/* The parts of a multipart entity are found between delimiter lines
+	 * of its boundary. The line break before a delimiter belongs to it.
+	 */
+	if (boundary.length > 0 && depth < MM_VIEW_MAXDEPTH
+	    && part.type.length == 9 
+	    && !strncasecmp(d + part.type.offset, "multipart", 9)) {
+		prev = -1;
+		inside = 0;
+		closed = 0;
+		child_start = 0;
+		for (pos = start + part.hdrlen; pos < end && !closed; 
+		    pos = next) {
+			eol = mm_view_line(d, pos, end, &next);
+			if (!mm_view_isdelimiter(d, pos, eol, &boundary, 
+			    &closed))
+				continue;
+			if (inside) {
+				if (pos > child_start && d[pos - 1] == '\n')
+					pos--;
+				if (pos > child_start && d[pos - 1] == '\r')
+					pos--;
+				child = mm_view_scanpart(scan, child_start, 
+				    pos, which, depth + 1);
+				if (prev == -1)
+					part.children = child;
+				else if (scan->view != NULL)
+					scan->view->parts[prev].next = child;
+				prev = child;
+				part.nchildren++;
+			}
+			inside = 1;
+			child_start = next;
+		}
+		if (inside && !closed) {
+			child = mm_view_scanpart(scan, child_start, end, which,
+			    depth + 1);
+			if (prev == -1)
+				part.children = child;
+			else if (scan->view != NULL)
+				scan->view->parts[prev].next = child;
+			part.nchildren++;
+		}
+	}
+	part.end = scan->nparts;
+
+	if (scan->view != NULL)
+		scan->view->parts[which] = part;
+
+	return which;
+}
+
+/*
+ * Scans a Content-Type value for the type, the subtype and the 
+ * parameters, and finds the boundary parameter. Quoted values are stored
+ * raw, from after the opening quote up to the closing one.
+ */
+static void
+mm_view_scantype(struct mm_viewscan *scan, struct mm_viewpart *part, 
+    size_t pos, size_t end, struct mm_viewspan *boundary)
+{
+	struct mm_viewparam *param;
+	const char *d;
+	size_t name, name_end, value, value_end;
+
+	d = scan->data;
+
+	part->type.offset = pos;
+	while (pos < end && d[pos] != '/' && d[pos] != ';' && d[pos] != ' ' 
+	    && d[pos] != '\t' && d[pos] != '\r' && d[pos] != '\n')
+		pos++;
+	part->type.length = pos - part->type.offset;
+	if (pos < end && d[pos] == '/') {
+		part->subtype.offset = ++pos;
+		while (pos < end && d[pos] != ';' && d[pos] != ' ' 
+		    && d[pos] != '\t' && d[pos] != '\r' && d[pos] != '\n')
+			pos++;
+		part->subtype.length = pos - part->subtype.offset;
+	}
+
+	for (;;) {
+		while (pos < end && d[pos] != ';')
+			pos++;
+		if (pos++ >= end)
+			break;
+		while (pos < end && (d[pos] == ' ' || d[pos] == '\t' 
+		    || d[pos] == '\r' || d[pos] == '\n'))
+			pos++;
+		name = pos;
+		while (pos < end && d[pos] != '=' && d[pos] != ';' 
+		    && d[pos] != ' ' && d[pos] != '\t')
+			pos++;
+		name_end = pos;
+		while (pos < end && (d[pos] == ' ' || d[pos] == '\t'))
+			pos++;
+		if (pos >= end || d[pos] != '=' || name_end == name)
+			continue;
+		pos++;
+		while (pos < end && (d[pos] == ' ' || d[pos] == '\t'))
+			pos++;
+
+		if (pos < end && d[pos] == '"') {
+			value = ++pos;
+			while (pos < end && d[pos] != '"') {
+				if (d[pos] == '\\' && pos + 1 < end)
+					pos++;
+				pos++;
+			}
+			value_end = pos;
+		} else {
+			value = pos;
+			while (pos < end && d[pos] != ';' && d[pos] != ' ' 
+			    && d[pos] != '\t' && d[pos] != '\r' 
+			    && d[pos] != '\n')
+				pos++;
+			value_end = pos;
+		}
+
+		if (name_end - name == 8 
+		    && !strncasecmp(d + name, "boundary", 8)) {
+			boundary->offset = value;
+			boundary->length = value_end - value;
+		}
+
+		if (scan->view != NULL) {
+			param = &scan->view->params[scan->nparams];
+			param->name.offset = name;
+			param->name.length = name_end - name;
+			param->value.offset = value;
+			param->value.length = value_end - value;
+		}
+		scan->nparams++;
+	}
+}
+
+static void
+mm_view_addheader(struct mm_viewscan *scan, size_t name, size_t name_end,
+    size_t value, size_t value_end)
+{
+	struct mm_viewheader *hdr;
+
+	if (scan->view != NULL) {
+		hdr = &scan->view->headers[scan->nheaders];
+		hdr->name.offset = name;
+		hdr->name.length = name_end - name;
+		hdr->value.offset = value;
+		hdr->value.length = value_end - value;
+	}
+	scan->nheaders++;
+}
+
+/*
+ * Finds the end of the line starting at pos, without its line break, and
+ * where the next line starts
+ */
+static size_t
+mm_view_line(const char *d, size_t pos, size_t end, size_t *next)
+{
+	const char *nl;
+	size_t eol;
+
+	nl = memchr(d + pos, '\n', end - pos);
+	if (nl == NULL) {
+		*next = end;
+		return end;
+	}
+
+	*next = nl - d + 1;
+	eol = nl - d;
+	if (eol > pos && d[eol - 1] == '\r')
+		eol--;
+
+	return eol;
+}
+
+/*
+ * Checks whether a line is a delimiter line of a boundary, and whether it
+ * closes the multipart entity
+ */
+static int
+mm_view_isdelimiter(const char *d, size_t pos, size_t eol, 
+    struct mm_viewspan *boundary, int *closed)
+{
+	if (eol - pos < boundary->length + 2 || d[pos] != '-' 
+	    || d[pos + 1] != '-' 
+	    || memcmp(d + pos + 2, d + boundary->offset, boundary->length))
+		return 0;
+
+	pos += boundary->length + 2;
+	*closed = 0;
+	if (eol - pos >= 2 && d[pos] == '-' && d[pos + 1] == '-') {
+		*closed = 1;
+		pos += 2;
+	}
+	while (pos < eol && (d[pos] == ' ' || d[pos] == '\t'))
+		pos++;
+
+	return pos == eol;
+}
+
+static int
+mm_view_spaneq(struct mm_view *view, struct mm_viewspan *span, 
+    const char *s)
+{
+	return strlen(s) == span->length
+	    && !strncasecmp(view->data + span->offset, s, span->length);
+}
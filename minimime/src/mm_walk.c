@@ -0,0 +1,210 @@
+/*
+ * $Id$
+ *
+ * MiniMIME - a library for handling MIME messages
+ *
+ * Copyright (C) 2003 Jann Fischer <rezine@mistrust.net>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the author nor the names of the contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY JANN FISCHER AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL JANN FISCHER OR THE VOICES IN HIS HEAD
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "mm_internal.h"
+
+/** @file mm_walk.c
+ *
+ * Walks over a tree of MIME parts visit every part nested in a root part,
+ * in depth first or in breadth first order. They need no memory besides 
+ * the walk state: the way back up the tree is taken through the parent
+ * of each part. The MIME parts of a context are walked as nested in its
+ * envelope, followed by the parts nested in the envelope itself.
+ */
+
+static struct mm_mimepart *mm_walk_firstchild(struct mm_walk *, 
+    struct mm_mimepart *);
+static struct mm_mimepart *mm_walk_advance(struct mm_walk *, 
+    struct mm_mimepart *, int *, int);
+
+/** @{
+ * @name Walking trees of MIME parts
+ */
+
+/**
+ * Starts a walk over a tree of MIME parts
+ *
+ * @param walk The walk state to initialize
+ * @param ctx The MiniMIME context the tree belongs to, or NULL for a tree
+ *        of parts not attached to a context
+ * @param root The MIME part to start at, or NULL for the envelope of ctx
+ * @param order MM_WALK_DEPTHFIRST or MM_WALK_BREADTHFIRST
+ * @return Nothing
+ *
+ * The walk returns root first, and then the parts nested in it in the
+ * given order. Depth first walks take time proportional to the number of
+ * parts. Breadth first walks go through the upper levels of the tree again
+ * for each level, and take time proportional to the number of parts times
+ * the depth of the tree. The tree must not be changed during a walk.
+ */
+void
+mm_walk_init(struct mm_walk *walk, MM_CTX *ctx, struct mm_mimepart *root,
+    int order)
+{
+	assert(walk != NULL);
+	assert(ctx != NULL || root != NULL);
+
+	if (root == NULL)
+		root = mm_context_getpart(ctx, 0);
+
+	walk->ctx = ctx;
+	walk->root = root;
+	walk->order = order;
+	walk->current = NULL;
+	walk->depth = 0;
+	walk->level = 0;
+	walk->deeper = 0;
+}
+
+/**
+ * Gets the next MIME part of a walk
+ *
+ * @param walk A walk state initialized with mm_walk_init()
+ * @return The next MIME part, or NULL at the end of the walk
+ */
+struct mm_mimepart *
+mm_walk_next(struct mm_walk *walk)
+{
+	struct mm_mimepart *part;
+
+	assert(walk != NULL);
+
+	if (walk->root == NULL)
+		return NULL;
+
+	if (walk->current == NULL) {
+		part = walk->root;
+	} else if (walk->order == MM_WALK_DEPTHFIRST) {
+		part = mm_walk_advance(walk, walk->current, &walk->depth, 
+		    INT_MAX);
+	} else {
+		/* The next part on the current level, or the first part on
+		 * the next one */
+		part = walk->current;
+		for (;;) {
+			part = mm_walk_advance(walk, part, &walk->depth, 
+			    walk->level);
+			if (part == NULL) {
+				if (!walk->deeper)
+					break;
+				walk->level++;
+				walk->deeper = 0;
+				walk->depth = 0;
+				part = walk->root;
+			} else if (walk->depth == walk->level) {
+				break;
+			}
+		}
+	}
+
+	if (part == NULL) {
+		walk->root = NULL;
+		walk->current = NULL;
+		return NULL;
+	}
+
+	if (mm_walk_firstchild(walk, part) != NULL)
+		walk->deeper = 1;
+	walk->current = part;
+
+	return part;
+}
+
+/**
+ * Gets the depth of the MIME part returned last by a walk
+ *
+ * @param walk A walk state initialized with mm_walk_init()
+ * @return How deep the part is nested below the root of the walk, 0 for
+ *         the root itself
+ */
+int
+mm_walk_depth(struct mm_walk *walk)
+{
+	assert(walk != NULL);
+
+	return walk->depth;
+}
+
+/** @} */
+
+/*
+ * Gets the first part nested in a part. Those of a context's envelope are
+ * the context's other parts, followed by its own nested parts.
+ */
+static struct mm_mimepart *
+mm_walk_firstchild(struct mm_walk *walk, struct mm_mimepart *part)
+{
+	if (walk->ctx != NULL && part == mm_context_getpart(walk->ctx, 0))
+		return mm_context_nextpart(walk->ctx, part);
+
+	return TAILQ_FIRST(&part->children);
+}
+
+/*
+ * Gets the part following a part in depth first order, without going 
+ * deeper than maxdepth below the root. *depth is the depth of the part,
+ * and is updated to the depth of the part returned.
+ */
+static struct mm_mimepart *
+mm_walk_advance(struct mm_walk *walk, struct mm_mimepart *part, int *depth,
+    int maxdepth)
+{
+	struct mm_mimepart *next;
+
+	if (*depth < maxdepth 
+	    && (next = mm_walk_firstchild(walk, part)) != NULL) {
+		(*depth)++;
+		return next;
+	}
+
+	/* Siblings are linked through the list of parts they are in */
+	while (part != walk->root) {
+		if (walk->ctx != NULL 
+		    && part->parent == mm_context_getpart(walk->ctx, 0))
+			next = mm_context_nextpart(walk->ctx, part);
+		else
+			next = TAILQ_NEXT(part, next);
+		if (next != NULL)
+			return next;
+		part = part->parent;
+		(*depth)--;
+	}
+
+	return NULL;
+}
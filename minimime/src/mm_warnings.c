@@ -40,49 +40,71 @@
 
 #include "mm_internal.h"
 
+static const char *mm_warning_strings[] = {
+	"no warning",
+	"invalid header field",
+	"duplicate parameter",
+	"invalid parameter value",
+	"invalid parameter",
+};
+
+/** @{
+ * @name Warnings of the parser
+ *
+ * In loose parsing mode (MM_PARSE_LOOSE), the parser accepts messages 
+ * which do not conform to the standards, and records what it found wrong
+ * with them as warnings in the context. A warning holds a code, the number
+ * of the MIME part and where in the message the problem was found; the
+ * text describing it is made only when asked for with mm_warning_format().
+ * Applications which have no use for warnings turn their collection off 
+ * with mm_context_setwarnings().
+ */
+
 /**
- * Attaches a warning message to a context
+ * Attaches a warning to a context
  *
  * @param ctx A valid MiniMIME context object
- * @param type The type of the warning
- * @param fmt The warning message as format string
+ * @param code The code of the warning, see enum mm_warning_code
+ * @param part The number of the MIME part the warning is about, or -1
+ * @param offset Where in the message the problem was found
+ * @param lineno The line of the message the problem was found on
+ * @return Nothing
+ *
+ * Warnings are appended in constant time. Nothing is done if the context
+ * does not collect warnings.
  */
 void
-mm_warning_add(MM_CTX *ctx, int type, const char *fmt, ...)
+mm_warning_add(MM_CTX *ctx, int code, int part, size_t offset, int lineno)
 {
 	struct mm_warning *warning;
-	char buf[1024];
-	va_list ap;
 
 	assert(ctx != NULL);
 
-	va_start(ap, fmt);
-	vsnprintf(buf, sizeof buf, fmt, ap);
-	va_end(ap);
+	if (!ctx->collectwarnings)
+		return;
 
 	warning = (struct mm_warning *)xmalloc(sizeof(struct mm_warning));
-	warning->message = xstrdup(buf);
-	warning->type = type;
+	warning->warning = code;
+	warning->part = part;
+	warning->offset = offset;
+	warning->lineno = lineno;
 
-	if (SLIST_EMPTY(&ctx->warnings)) {
+	if (ctx->lastwarning == NULL)
 		SLIST_INSERT_HEAD(&ctx->warnings, warning, next);
-	} else {
-		struct mm_warning *last, *after;
-
-		after = NULL;
-
-		SLIST_FOREACH(last, &ctx->warnings, next) {
-			if (last != NULL) {
-				after = last;
-			}
-		}
-		
-		assert(after != NULL);
-
-		SLIST_INSERT_AFTER(after, warning, next);
-	}
+	else
+		SLIST_INSERT_AFTER(ctx->lastwarning, warning, next);
+	ctx->lastwarning = warning;
+	ctx->nwarnings++;
 }
 
+/**
+ * Iterates over the warnings of a context
+ *
+ * @param ctx A valid MiniMIME context object
+ * @param last Holds the state of the iteration, must point to NULL before
+ *        the first call
+ * @return The next warning, or NULL if there are no more
+ */
 struct mm_warning *
 mm_warning_next(MM_CTX *ctx, struct mm_warning **last)
 {
@@ -97,3 +119,44 @@ mm_warning_next(MM_CTX *ctx, struct mm_warning **last)
 	*last = warning;
 	return warning;
 }
+
+/**
+ * Describes a warning code
+ *
+ * @param code The code of a warning, see enum mm_warning_code
+ * @return A static string describing the warning
+ */
+const char *
+mm_warning_string(int code)
+{
+	if (code < 0 || code >= (int)(sizeof(mm_warning_strings) 
+	    / sizeof(mm_warning_strings[0])))
+		return "unknown warning";
+
+	return mm_warning_strings[code];
+}
+
+/**
+ * Formats a warning as text
+ *
+ * @param warning A valid warning
+ * @param buf Where to store the text
+ * @param size The size of buf
+ * @return The length of the whole text, as snprintf(3)
+ */
+int
+mm_warning_format(struct mm_warning *warning, char *buf, size_t size)
+{
+	assert(warning != NULL);
+
+	if (warning->part < 0)
+		return snprintf(buf, size, "line %u, offset %lu: %s",
+		    (unsigned int)warning->lineno, (unsigned long)warning->offset,
+		    mm_warning_string(warning->warning));
+
+	return snprintf(buf, size, "line %u, offset %lu, part %d: %s",
+	    (unsigned int)warning->lineno, (unsigned long)warning->offset,
+	    warning->part, mm_warning_string(warning->warning));
+}
+
+/** @} */
@@ -19,7 +19,7 @@ M_ERRORS=0
 M_INVALID=""
 for f in ${DIRECTORY}/${FILES}; do
 	if [ -f "${f}" ]; then
-		TESTS=$((TESTS + 2))
+		TESTS=$((TESTS + 3))
 		echo -n "Running PARSER test for $f (file)... "
 		output=`./tests/parse $f 2>&1`
 		[ $? != 0 ] && {
@@ -29,6 +29,15 @@ for f in ${DIRECTORY}/${FILES}; do
 		} || {
 			echo "PASSED"
 		}
+		echo -n "Running PASSTHROUGH test for $f... "
+		output=`./tests/parse -k $f 2>&1`
+		[ $? != 0 ] && {
+			echo "FAILED ($output)"
+			F_ERRORS=$((F_ERRORS + 1))
+			F_INVALID="${F_INVALID} ${f} "
+		} || {
+			echo "PASSED"
+		}
 		echo -n "Running PARSER test for $f (memory)... "
 		output=`./tests/parse -m $f 2>&1`
 		[ $? != 0 ] && {
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+/*
+ * MiniMIME test program - attachments.c
+ *
+ * Lists the attachments of a message built of nested, encoded and file
+ * backed MIME parts, and checks their sizes against the flattened message
+ * and their decoded sizes, also for a codec without a length kernel
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "mm.h"
+
+/* The attachments in depth first order, and their numbers */
+const char *filenames[] = { 
+	"data.bin", "hex.bin", "a.txt", "b.txt", "notes.txt" 
+};
+const int numbers[] = { 2, 3, 4, 5, -1 };
+const size_t decoded[] = { 100, 4, 1, 2, 30 };
+
+const char notes[] = "Some notes\r\nstored in a file\r\n";
+
+void
+fail(const char *what)
+{
+	printf("ERROR: %s\n", what);
+	exit(1);
+}
+
+/*
+ * A codec for pairs of hex digits, whose decoded data holds NULs. It has
+ * a decoder kernel, but no kernel for the exact decoded size.
+ */
+char *
+hex_decode(char *data)
+{
+	return strdup("");
+}
+
+size_t
+hex_decoded_size(const char *data, size_t length)
+{
+	return length / 2;
+}
+
+int
+hex_decode_into(const char *data, size_t length, char *buf, size_t size,
+    size_t *written)
+{
+	unsigned int c;
+	size_t i;
+
+	for (i = 0; i + 1 < length && i / 2 < size; i += 2) {
+		if (sscanf(data + i, "%2x", &c) != 1)
+			return -1;
+		buf[i / 2] = (char)c;
+	}
+	*written = i / 2;
+
+	return 0;
+}
+
+struct mm_mimepart *
+mkpart(const char *type, const char *encoding, const char *name)
+{
+	struct mm_mimepart *part;
+	struct mm_content *ct;
+
+	part = mm_mimepart_new();
+	ct = mm_content_new();
+	mm_content_settype(ct, type);
+	if (encoding != NULL)
+		mm_content_setencoding(ct, encoding);
+	if (name != NULL)
+		mm_content_attachparam(ct, mm_param_generate("name", name));
+	mm_mimepart_attachcontenttype(part, ct);
+
+	return part;
+}
+
+/*
+ * Finds the body of an attachment in the flattened message and checks that
+ * it has the encoded size of the manifest
+ */
+void
+checkbody(const char *data, struct mm_attachment *a)
+{
+	const char *p;
+
+	p = strstr(data, a->filename);
+	if (p == NULL || (p = strstr(p, "\r\n\r\n")) == NULL)
+		fail("attachment not in the flattened message");
+	p += 4;
+	if (strlen(p) < a->encoded_size + 4 
+	    || strncmp(p + a->encoded_size, "\r\n--", 4))
+		fail("encoded size does not match the flattened message");
+}
+
+int
+main(void)
+{
+	MM_CTX *ctx;
+	struct mm_mimepart *envelope, *part;
+	struct mm_attachment *list;
+	struct mm_body *body;
+	struct mm_codec *codec;
+	char path[] = "/tmp/attachments.XXXXXX";
+	char bin[100], *data;
+	size_t length;
+	int fd, i, count;
+
+	mm_library_init();
+	mm_codec_registerdefaultcodecs();
+	mm_codec_register("x-hex", NULL, hex_decode);
+	codec = mm_codec_lookup(MM_ENCODING_UNKNOWN, "x-hex");
+	codec->decoded_size = hex_decoded_size;
+	codec->decode_into = hex_decode_into;
+
+	for (i = 0; i < (int)sizeof(bin); i++)
+		bin[i] = (char)i;
+	fd = mkstemp(path);
+	if (fd == -1 || write(fd, notes, sizeof(notes) - 1) 
+	    != (ssize_t)sizeof(notes) - 1)
+		fail("can not write the body file");
+	close(fd);
+
+	/* A text part, a binary attachment encoded when written and a file
+	 * backed attachment nested in the envelope */
+	ctx = mm_context_new();
+	envelope = mm_mimepart_new();
+	mm_context_attachpart(ctx, envelope);
+	mm_envelope_setheader(ctx, "From", "foo@bar.com");
+
+	part = mkpart("text/plain", NULL, NULL);
+	mm_mimepart_setbody(part, "Not an attachment", 1);
+	mm_context_attachpart(ctx, part);
+
+	part = mkpart("application/octet-stream", "base64", filenames[0]);
+	body = mm_body_new(bin, sizeof(bin));
+	if (mm_mimepart_attachbody(part, body) == -1)
+		fail(mm_error_string());
+	mm_body_unref(body);
+	mm_mimepart_setflags(part, MM_MIMEPART_ENCODE);
+	mm_context_attachpart(ctx, part);
+
+	part = mkpart("application/octet-stream", "x-hex", filenames[1]);
+	mm_mimepart_setbody(part, "00410042", 1);
+	mm_context_attachpart(ctx, part);
+
+	/* More attachments than the manifest has room for at first */
+	part = mkpart("text/plain", NULL, filenames[2]);
+	mm_mimepart_setbody(part, "a", 1);
+	mm_context_attachpart(ctx, part);
+	part = mkpart("text/plain", NULL, filenames[3]);
+	mm_mimepart_setbody(part, "bb", 1);
+	mm_context_attachpart(ctx, part);
+
+	part = mkpart("text/plain", NULL, filenames[4]);
+	if (mm_mimepart_setbodyfile(part, path, 0, sizeof(notes) - 1) == -1
+	    || mm_mimepart_attachchild(envelope, part) == -1)
+		fail(mm_error_string());
+
+	if (mm_context_attachments(ctx, &list, &count) == -1)
+		fail(mm_error_string());
+	if (count != sizeof(numbers) / sizeof(numbers[0]))
+		fail("wrong number of attachments");
+
+	if (mm_context_flatten(ctx, &data, &length, 0) == -1)
+		fail(mm_error_string());
+
+	for (i = 0; i < count; i++) {
+		printf("%d %s %s/%s, %lu bytes (%lu decoded)\n", list[i].number,
+		    list[i].filename, list[i].maintype, list[i].subtype,
+		    (unsigned long)list[i].encoded_size,
+		    (unsigned long)list[i].decoded_size);
+		if (list[i].filename == NULL 
+		    || strcmp(list[i].filename, filenames[i]))
+			fail("attachments in the wrong order");
+		if (list[i].number != numbers[i])
+			fail("attachment has the wrong number");
+		checkbody(data, &list[i]);
+		if (list[i].decoded_size != decoded[i])
+			fail("wrong decoded size");
+	}
+	if (list[0].encoded_size <= list[0].decoded_size)
+		fail("binary attachment is not encoded");
+
+	printf("Attachment manifest is right\n");
+
+	free(list);
+	free(data);
+	mm_context_free(ctx);
+	unlink(path);
+
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test programs - bench.c
+ *
+ * Helpers shared by the benchmarks: the test message, error reporting and
+ * the table of results. Allocations are counted by the wrappers in 
+ * alloccount.c, which every benchmark is linked with.
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <err.h>
+
+#include "mm.h"
+#include "bench.h"
+
+void
+print_error(void)
+{
+	fprintf(stderr, "ERROR: %s\n", mm_error_string());
+}
+
+/*
+ * Creates a multipart message with nparts text parts, each of which has
+ * an X-Part header field with its number
+ */
+char *
+create_message(int nparts)
+{
+	char *message, *p;
+	size_t size;
+	int i;
+
+	size = 256 + nparts * 256;
+	message = p = malloc(size);
+	if (message == NULL)
+		err(1, "malloc");
+
+	p += sprintf(p, "From: sender@example.org\r\n"
+	    "To: recipient@example.org\r\n"
+	    "Subject: A message with %d parts\r\n"
+	    "MIME-Version: 1.0\r\n"
+	    "Content-Type: multipart/mixed; boundary=\"b0undary\"\r\n"
+	    "\r\n", nparts);
+	for (i = 0; i < nparts; i++) {
+		p += sprintf(p, "--b0undary\r\n"
+		    "Content-Type: text/plain; charset=\"us-ascii\"\r\n"
+		    "Content-Disposition: inline\r\n"
+		    "X-Part: %d\r\n"
+		    "\r\n"
+		    "This is the body of part number %d.\r\n", i, i);
+	}
+	sprintf(p, "--b0undary--\r\n");
+
+	return message;
+}
+
+/*
+ * Prints the heading of the table of results, unit is what the size of
+ * the tested messages is counted in
+ */
+void
+print_columns(const char *unit)
+{
+	char count[16], per[16];
+
+	snprintf(count, sizeof(count), "%ss", unit);
+	snprintf(per, sizeof(per), "usec/%s", unit);
+	printf("%-12s %8s %14s %12s %12s\n", "what", count, "allocs/round",
+	    "usec/round", per);
+}
+
+/*
+ * Prints the allocations and time taken by ROUNDS rounds for a message
+ * of size n
+ */
+void
+print_result(const char *what, int n, struct timeval *start, 
+    struct timeval *end, unsigned long allocs)
+{
+	double usecs;
+
+	usecs = (end->tv_sec - start->tv_sec) * 1000000.0
+	    + (end->tv_usec - start->tv_usec);
+	printf("%-12s %8d %14.1f %12.1f %12.3f\n", what, n, 
+	    (double)allocs / ROUNDS, usecs / ROUNDS, usecs / ROUNDS / n);
+}
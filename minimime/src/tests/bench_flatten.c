@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - bench_flatten.c
+ *
+ * Measures how many allocations and how much time flattening a message 
+ * with 1, 10, 100 and 1000 MIME parts takes. The time per part should 
+ * stay about the same. The flattened message is checked to hold all the
+ * parts.
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "mm.h"
+#include "alloccount.h"
+#include "bench.h"
+
+const char *progname;
+
+/*
+ * Counts the parts of a flattened message which kept their X-Part header
+ * field
+ */
+int
+count_parts(const char *data, size_t length)
+{
+	struct mm_view *view;
+	size_t len;
+	int i, found;
+
+	view = mm_view_new(data, length, 0);
+	found = 0;
+	for (i = 1; i < mm_view_countparts(view); i++) {
+		if (mm_view_getheadervalue(view, i, "X-Part", 0, &len) != NULL)
+			found++;
+	}
+	mm_view_free(view);
+
+	return found;
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int sizes[] = { 1, 10, 100, 1000 };
+	MM_CTX *ctx;
+	struct timeval start, end;
+	unsigned long allocs;
+	char *message, *data;
+	size_t length;
+	int i, j, found;
+
+	progname = argv[0];
+
+	mm_library_init();
+
+	print_columns("part");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		message = create_message(sizes[i]);
+		ctx = mm_context_new();
+		if (mm_parse_mem(ctx, message, MM_PARSE_LOOSE, 0) == -1) {
+			print_error();
+			exit(1);
+		}
+
+		allocs = allocations;
+		gettimeofday(&start, NULL);
+		for (j = 0; j < ROUNDS; j++) {
+			if (mm_context_flatten(ctx, &data, &length, 0) == -1) {
+				print_error();
+				exit(1);
+			}
+			free(data);
+		}
+		gettimeofday(&end, NULL);
+		print_result("flatten", sizes[i], &start, &end, 
+		    allocations - allocs);
+
+		if (mm_context_flatten(ctx, &data, &length, 0) == -1) {
+			print_error();
+			exit(1);
+		}
+		found = count_parts(data, length);
+		if (found != sizes[i])
+			errx(1, "flatten: found %d of %d parts", found, 
+			    sizes[i]);
+		free(data);
+
+		mm_context_free(ctx);
+		free(message);
+	}
+
+	exit(0);
+}
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - bench_headers.c
+ *
+ * Measures how many allocations and how much time serializing header 
+ * fields takes, for envelopes with 1 to 1000 header fields and for 
+ * Content-Type fields with 1 to 1000 parameters. The number of allocations
+ * per call should not depend on the number of header fields. The results
+ * are checked to hold all the header fields and parameters.
+ *
+ * Allocations are counted by the wrappers in alloccount.c.
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "mm.h"
+#include "alloccount.h"
+#include "bench.h"
+
+const char *progname;
+
+MM_CTX *
+create_envelope(int nheaders)
+{
+	MM_CTX *ctx;
+	struct mm_mimepart *part;
+	int i;
+
+	ctx = mm_context_new();
+
+	part = mm_mimepart_new();
+	mm_context_attachpart(ctx, part);
+
+	for (i = 0; i < nheaders; i++) {
+		mm_envelope_setheader(ctx, "X-Header", "header field number %d "
+		    "with a value which is long enough to be folded once it "
+		    "is serialized", i);
+	}
+
+	return ctx;
+}
+
+struct mm_content *
+create_contenttype(int nparams)
+{
+	struct mm_content *ct;
+	struct mm_param *param;
+	char buf[32];
+	int i;
+
+	ct = mm_content_new();
+	mm_content_settype(ct, "multipart/mixed");
+
+	for (i = 0; i < nparams; i++) {
+		param = mm_param_new();
+		snprintf(buf, sizeof(buf), "param%d", i);
+		param->name = strdup(buf);
+		snprintf(buf, sizeof(buf), "value-%d", i);
+		param->value = strdup(buf);
+		mm_content_attachparam(ct, param);
+	}
+
+	return ct;
+}
+
+/*
+ * Counts how often s occurs in data
+ */
+int
+count(const char *data, const char *s)
+{
+	int n;
+
+	for (n = 0; (data = strstr(data, s)) != NULL; n++)
+		data++;
+
+	return n;
+}
+
+int
+main(int argc, char **argv)
+{
+	static const int sizes[] = { 1, 10, 100, 1000 };
+	MM_CTX *ctx;
+	struct mm_content *ct;
+	struct timeval start, end;
+	unsigned long allocs;
+	char *data;
+	size_t length;
+	int i, j, found;
+
+	progname = argv[0];
+
+	mm_library_init();
+
+	print_columns("field");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		ctx = create_envelope(sizes[i]);
+
+		allocs = allocations;
+		gettimeofday(&start, NULL);
+		for (j = 0; j < ROUNDS; j++) {
+			if (mm_envelope_getheaders(ctx, &data, &length) 
+			    == -1) {
+				print_error();
+				exit(1);
+			}
+			if (j < ROUNDS - 1)
+				free(data);
+		}
+		gettimeofday(&end, NULL);
+		print_result("getheaders", sizes[i], &start, &end, 
+		    allocations - allocs);
+
+		found = count(data, "X-Header: header field number ");
+		free(data);
+		if (found != sizes[i])
+			errx(1, "getheaders: found %d of %d header fields", 
+			    found, sizes[i]);
+
+		mm_context_free(ctx);
+	}
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		ct = create_contenttype(sizes[i]);
+
+		allocs = allocations;
+		gettimeofday(&start, NULL);
+		for (j = 0; j < ROUNDS; j++) {
+			data = mm_content_tostring(ct);
+			if (data == NULL) {
+				print_error();
+				exit(1);
+			}
+			if (j < ROUNDS - 1)
+				free(data);
+		}
+		gettimeofday(&end, NULL);
+		print_result("tostring", sizes[i], &start, &end, 
+		    allocations - allocs);
+
+		found = count(data, "=\"value-");
+		free(data);
+		if (found != sizes[i])
+			errx(1, "tostring: found %d of %d parameters", found,
+			    sizes[i]);
+
+		mm_content_free(ct);
+	}
+
+	exit(0);
+}
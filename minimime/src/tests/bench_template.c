@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - bench_template.c
+ *
+ * Compares building and flattening a new context for every personalized
+ * message with rendering the messages from a template. The message has a
+ * text part with slots and an attachment of ATTACHMENT_SIZE bytes, which
+ * is encoded for every message in the first case and only once in the
+ * second. Each round makes MESSAGES messages, the last one is checked to
+ * be personalized and to hold the encoded attachment.
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "mm.h"
+#include "alloccount.h"
+#include "bench.h"
+
+#define ATTACHMENT_SIZE 65536
+#define MESSAGES 50
+
+/* The start of the attachment in base64 */
+#define ATTACHMENT_BASE64 "YWJjZGVmZ2hpamtsbW5vcHFyc3R1dnd4eXph"
+
+const char *progname;
+
+MM_CTX *
+create_mailing(const char *name, const char *email, const char *code, 
+    const char *attachment)
+{
+	MM_CTX *ctx;
+	struct mm_mimepart *part;
+	struct mm_content *ct;
+	char *body;
+
+	ctx = mm_context_new();
+
+	part = mm_mimepart_new();
+	mm_context_attachpart(ctx, part);
+	mm_envelope_setheader(ctx, "From", "news@example.org");
+	mm_envelope_setheader(ctx, "To", "%s <%s>", name, email);
+	mm_envelope_setheader(ctx, "Subject", "Your code, %s", name);
+
+	part = mm_mimepart_new();
+	ct = mm_content_new();
+	mm_content_settype(ct, "text/plain");
+	mm_mimepart_attachcontenttype(part, ct);
+	asprintf(&body, "Dear %s,\r\n\r\nyour code is %s.\r\n", name, code);
+	mm_mimepart_setbody(part, body, 0);
+	free(body);
+	mm_context_attachpart(ctx, part);
+
+	part = mm_mimepart_new();
+	ct = mm_content_new();
+	mm_content_settype(ct, "application/octet-stream");
+	mm_content_setencoding(ct, "base64");
+	mm_mimepart_attachcontenttype(part, ct);
+	mm_mimepart_setbody(part, attachment, 0);
+	mm_mimepart_setflags(part, MM_MIMEPART_ENCODE);
+	mm_context_attachpart(ctx, part);
+
+	return ctx;
+}
+
+/*
+ * Sets the personal values of message number i
+ */
+void
+personalize(int i, char *name, char *email, char *code)
+{
+	snprintf(name, 32, "User %d", i);
+	snprintf(email, 64, "user%d@example.org", i);
+	snprintf(code, 16, "%08d", i * 7919);
+}
+
+/*
+ * Checks that a message holds the personal values and the attachment
+ */
+void
+check_message(const char *what, const char *data, const char *name,
+    const char *email, const char *code)
+{
+	char subject[64];
+
+	snprintf(subject, sizeof(subject), "Subject: Your code, %s", name);
+	if (strstr(data, subject) == NULL || strstr(data, email) == NULL
+	    || strstr(data, code) == NULL)
+		errx(1, "%s: message is not personalized", what);
+	if (strstr(data, ATTACHMENT_BASE64) == NULL)
+		errx(1, "%s: attachment is not encoded", what);
+}
+
+int
+main(int argc, char **argv)
+{
+	MM_CTX *ctx;
+	struct mm_template *tpl;
+	struct timeval start, end;
+	unsigned long allocs;
+	char attachment[ATTACHMENT_SIZE + 1];
+	char name[32], email[64], code[16];
+	const char *values[3];
+	char *data;
+	size_t length;
+	int i, j, slot_name, slot_email, slot_code;
+
+	progname = argv[0];
+
+	mm_library_init();
+	mm_codec_registerdefaultcodecs();
+
+	for (i = 0; i < ATTACHMENT_SIZE; i++)
+		attachment[i] = 'a' + i % 26;
+	attachment[ATTACHMENT_SIZE] = '\0';
+
+	print_columns("message");
+
+	data = NULL;
+	allocs = allocations;
+	gettimeofday(&start, NULL);
+	for (j = 0; j < ROUNDS; j++) {
+		for (i = 0; i < MESSAGES; i++) {
+			personalize(i, name, email, code);
+			ctx = create_mailing(name, email, code, attachment);
+			free(data);
+			if (mm_context_flatten(ctx, &data, &length, 0) == -1) {
+				print_error();
+				exit(1);
+			}
+			mm_context_free(ctx);
+		}
+	}
+	gettimeofday(&end, NULL);
+	print_result("context", MESSAGES, &start, &end, allocations - allocs);
+	check_message("context", data, name, email, code);
+	free(data);
+	data = NULL;
+
+	allocs = allocations;
+	gettimeofday(&start, NULL);
+	ctx = create_mailing("${name}", "${email}", "${code}", attachment);
+	tpl = mm_template_new(ctx, 0);
+	if (tpl == NULL) {
+		print_error();
+		exit(1);
+	}
+	mm_context_free(ctx);
+
+	slot_name = mm_template_getslot(tpl, "name");
+	slot_email = mm_template_getslot(tpl, "email");
+	slot_code = mm_template_getslot(tpl, "code");
+	if (slot_name == -1 || slot_email == -1 || slot_code == -1)
+		errx(1, "template slots not found");
+
+	for (j = 0; j < ROUNDS; j++) {
+		for (i = 0; i < MESSAGES; i++) {
+			personalize(i, name, email, code);
+			values[slot_name] = name;
+			values[slot_email] = email;
+			values[slot_code] = code;
+			free(data);
+			if (mm_template_render(tpl, values, &data, &length) 
+			    == -1) {
+				print_error();
+				exit(1);
+			}
+		}
+	}
+	gettimeofday(&end, NULL);
+	print_result("template", MESSAGES, &start, &end, 
+	    allocations - allocs);
+	check_message("template", data, name, email, code);
+	free(data);
+
+	mm_template_free(tpl);
+
+	exit(0);
+}
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - bench_view.c
+ *
+ * Compares parsing multipart messages with 1 to 1000 MIME parts into a 
+ * context with making a message view of them: allocations and time to 
+ * create, look up a header field of every part, and free the result. A
+ * view should take one allocation regardless of the size of the message.
+ *
+ * The message comes from create_message() in bench.c.
+ */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+
+#include "mm.h"
+#include "alloccount.h"
+#include "bench.h"
+
+const char *progname;
+
+int
+main(int argc, char **argv)
+{
+	static const int sizes[] = { 1, 10, 100, 1000 };
+	MM_CTX *ctx;
+	struct mm_view *view;
+	struct mm_mimepart *part;
+	struct timeval start, end;
+	unsigned long allocs;
+	char *message;
+	size_t length;
+	int i, j, k, found;
+
+	progname = argv[0];
+
+	mm_library_init();
+	mm_codec_registerdefaultcodecs();
+
+	print_columns("part");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		message = create_message(sizes[i]);
+
+		found = 0;
+		allocs = allocations;
+		gettimeofday(&start, NULL);
+		for (j = 0; j < ROUNDS; j++) {
+			ctx = mm_context_new();
+			if (mm_parse_mem(ctx, message, MM_PARSE_LOOSE, 0) 
+			    == -1) {
+				print_error();
+				exit(1);
+			}
+			for (k = 1; (part = mm_context_getpart(ctx, k)) 
+			    != NULL; k++) {
+				if (mm_mimepart_getheadervalue(part, "X-Part", 
+				    0) != NULL)
+					found++;
+			}
+			mm_context_free(ctx);
+		}
+		gettimeofday(&end, NULL);
+		print_result("parse", sizes[i], &start, &end, 
+		    allocations - allocs);
+		if (found != sizes[i] * ROUNDS)
+			errx(1, "parse: found %d header fields", found);
+
+		found = 0;
+		allocs = allocations;
+		gettimeofday(&start, NULL);
+		for (j = 0; j < ROUNDS; j++) {
+			view = mm_view_new(message, strlen(message), 0);
+			for (k = 1; k < mm_view_countparts(view); k++) {
+				if (mm_view_getheadervalue(view, k, "X-Part", 
+				    0, &length) != NULL)
+					found++;
+			}
+			mm_view_free(view);
+		}
+		gettimeofday(&end, NULL);
+		print_result("view", sizes[i], &start, &end, 
+		    allocations - allocs);
+		if (found != sizes[i] * ROUNDS)
+			errx(1, "view: found %d header fields", found);
+
+		free(message);
+	}
+
+	exit(0);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - content.c
+ *
+ * Checks how Content-Type objects are written out
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+
+void
+fail(const char *what)
+{
+	printf("ERROR: %s\n", what);
+	exit(1);
+}
+
+int
+main(void)
+{
+	struct mm_content *ct;
+	struct mm_param *param;
+	char *s;
+
+	mm_library_init();
+
+	/* Quotes and backslashes in values are escaped as quoted pairs */
+	ct = mm_content_new();
+	mm_content_settype(ct, "text/plain");
+	mm_content_addparam(ct, "title", "say \"hi\" \\o/");
+	s = mm_content_tostring(ct);
+	if (s == NULL || strcmp(s, 
+	    "Content-Type: text/plain; title=\"say \\\"hi\\\" \\\\o/\""))
+		fail("quotes in a parameter value are not escaped");
+	free(s);
+	mm_content_free(ct);
+
+	/* Media types and charsets are classified as they change */
+	ct = mm_content_new();
+	if (mm_content_settype(ct, "text") != -1)
+		fail("a type without subtype is taken");
+	if (!mm_content_istype(ct, MM_MEDIATYPE_TEXT, MM_MEDIASUBTYPE_ANY))
+		fail("the main type of an invalid type is not classified");
+	mm_content_settype(ct, "TEXT/html");
+	if (!mm_content_istype(ct, MM_MEDIATYPE_TEXT, MM_MEDIASUBTYPE_HTML)
+	    || mm_content_istype(ct, MM_MEDIATYPE_TEXT, MM_MEDIASUBTYPE_PLAIN)
+	    || mm_content_istype(ct, MM_MEDIATYPE_IMAGE, MM_MEDIASUBTYPE_ANY))
+		fail("text/html is not classified");
+	mm_content_settype(ct, "multipart/mixed");
+	if (!mm_content_istype(ct, MM_MEDIATYPE_MULTIPART, 
+	    MM_MEDIASUBTYPE_MIXED))
+		fail("multipart/mixed is not classified");
+	mm_content_settype(ct, "x-foo/bar");
+	if (!mm_content_istype(ct, MM_MEDIATYPE_OTHER, MM_MEDIASUBTYPE_OTHER))
+		fail("an unknown type is classified");
+
+	if (mm_content_getcharsetid(ct) != MM_CHARSETID_NONE)
+		fail("charset without charset parameter");
+	param = mm_content_addparam(ct, "charset", "US-ASCII");
+	if (mm_content_getcharsetid(ct) != MM_CHARSETID_USASCII)
+		fail("attached charset is not classified");
+	mm_param_setvalue(param, "utf-8", 1);
+	if (mm_content_getcharsetid(ct) != MM_CHARSETID_UTF8)
+		fail("changed charset is not classified");
+	mm_param_setvalue(param, "latin1", 1);
+	if (mm_content_getcharsetid(ct) != MM_CHARSETID_ISO8859_1)
+		fail("charset alias is not classified");
+	mm_param_setvalue(param, "x-unknown", 1);
+	if (mm_content_getcharsetid(ct) != MM_CHARSETID_OTHER)
+		fail("unknown charset is not classified");
+	mm_param_setname(param, "format", 1);
+	if (mm_content_getcharsetid(ct) != MM_CHARSETID_NONE)
+		fail("renamed charset is still classified");
+	mm_content_free(ct);
+
+	printf("Content-Types are right\n");
+
+	return 0;
+}
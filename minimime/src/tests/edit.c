@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - edit.c
+ *
+ * Edits header fields of a parsed message and checks that everything else
+ * is written out as it was parsed, and removes header fields
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+
+const char *message =
+	"From: foo@bar.com\n"
+	"Subject: edit test\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"b\"\n"
+	"\n"
+	"--b\n"
+	"Content-Type: text/plain; charset=\"us-ascii\"\n"
+	"Content-ID: <one@bar.com>\n"
+	"Content-Disposition: attachment; filename=\"one.txt\"\n"
+	"Content-Description: first\n"
+	"\n"
+	"one\n"
+	"--b--\n";
+
+/* The message with the Subject and Content-ID edited, and a parameter 
+ * added to the Content-Type of the part */
+const char *edited =
+	"From: foo@bar.com\n"
+	"Subject: edited\r\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"b\"\n"
+	"\n"
+	"--b\n"
+	"Content-Type: text/plain; charset=\"us-ascii\"; format=\"flowed\"\r\n"
+	"Content-ID: <two@bar.com>\r\n"
+	"Content-Disposition: attachment; filename=\"one.txt\"\n"
+	"Content-Description: first\n"
+	"\n"
+	"one\n"
+	"--b--\n";
+
+/* The edited message with the Content-Description of the part removed */
+const char *removed =
+	"From: foo@bar.com\n"
+	"Subject: edited\r\n"
+	"MIME-Version: 1.0\n"
+	"Content-Type: multipart/mixed; boundary=\"b\"\n"
+	"\n"
+	"--b\n"
+	"Content-Type: text/plain; charset=\"us-ascii\"; format=\"flowed\"\r\n"
+	"Content-ID: <two@bar.com>\r\n"
+	"Content-Disposition: attachment; filename=\"one.txt\"\n"
+	"\n"
+	"one\n"
+	"--b--\n";
+
+void
+fail(const char *what)
+{
+	printf("ERROR: %s\n", what);
+	exit(1);
+}
+
+void
+check(MM_CTX *ctx, const char *expected, const char *what)
+{
+	char *data;
+	size_t length;
+
+	if (mm_context_flatten(ctx, &data, &length, 0) == -1)
+		fail(mm_error_string());
+	if (length != strlen(expected) || memcmp(data, expected, length)) {
+		printf("%s", data);
+		fail(what);
+	}
+	free(data);
+}
+
+int
+main(void)
+{
+	MM_CTX *ctx;
+	struct mm_mimepart *part;
+	struct mm_mimeheader *a, *b, *c;
+	struct mm_param *param;
+
+	mm_library_init();
+
+	ctx = mm_context_new();
+	if (mm_parse_mem(ctx, message, MM_PARSE_STRICT, MM_PARSE_KEEPSOURCE)
+	    == -1)
+		fail(mm_error_string());
+	check(ctx, message, "unmodified message is not written out as is");
+
+	/* Only the fields edited are generated */
+	part = mm_context_getpart(ctx, 0);
+	if (mm_mimeheader_setvalue(mm_mimepart_getheaderbyname(part, 
+	    "Subject", 0), "edited") == -1)
+		fail(mm_error_string());
+	part = mm_context_getpart(ctx, 1);
+	if (mm_mimeheader_setvalue(mm_mimepart_getheaderbyname(part, 
+	    "Content-ID", 0), "<two@bar.com>") == -1
+	    || (param = mm_content_addparam(part->type, "format", "flowed")) 
+	    == NULL)
+		fail(mm_error_string());
+	check(ctx, edited, "edited message is wrong");
+
+	/* Setting a parameter to its own value changes nothing */
+	if (mm_param_setvalue(param, param->value, 0) != NULL
+	    || mm_param_setname(param, param->name, 0) != NULL)
+		fail("own value of a parameter is given back");
+	check(ctx, edited, "own value of a parameter is lost");
+
+	/* A removed header field is neither found nor written out */
+	if (mm_mimepart_getheadervalue(part, "Content-Description", 0) == NULL)
+		fail("Content-Description not found");
+	mm_mimepart_removeheader(part, 
+	    mm_mimepart_getheaderbyname(part, "Content-Description", 0));
+	if (mm_mimepart_getheaderbyname(part, "Content-Description", 0) 
+	    != NULL || mm_mimepart_countheaders(part) != 1)
+		fail("removed header field is found");
+	check(ctx, removed, "removed header field is written out");
+
+	mm_context_free(ctx);
+
+	/* Header fields of the same name stay in order */
+	part = mm_mimepart_new();
+	a = mm_mimepart_addheader(part, "X-Test", "a");
+	b = mm_mimepart_addheader(part, "x-test", "b");
+	c = mm_mimepart_addheader(part, "X-TEST", "c");
+	if (mm_mimepart_getheaderbyname(part, "X-Test", 2) != c)
+		fail("header fields not found by name");
+	mm_mimepart_removeheader(part, b);
+	if (mm_mimepart_countheaderbyname(part, "X-Test") != 2
+	    || mm_mimepart_getheaderbyname(part, "X-Test", 0) != a
+	    || mm_mimepart_getheaderbyname(part, "X-Test", 1) != c)
+		fail("wrong header fields after removing the middle one");
+	mm_mimepart_removeheader(part, c);
+	b = mm_mimepart_addheader(part, "X-Test", "b");
+	if (mm_mimepart_getheaderbyname(part, "X-Test", 1) != b
+	    || mm_mimepart_countheaders(part) != 2)
+		fail("wrong header fields after removing the last one");
+	mm_mimepart_removeheader(part, a);
+	mm_mimepart_removeheader(part, b);
+	if (mm_mimepart_countheaderbyname(part, "X-Test") != 0
+	    || mm_mimepart_countheaders(part) != 0
+	    || mm_mimepart_getheaderbyname(part, "X-Test", 0) != NULL)
+		fail("removed header fields are found");
+	mm_mimepart_free(part);
+
+	printf("Edited message is right\n");
+
+	return 0;
+}
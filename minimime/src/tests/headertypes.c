@@ -0,0 +1,219 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - headertypes.c
+ *
+ * Checks the parsing of dates, message IDs and address lists
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+
+/* A date, what it is in seconds and its zone, or -1 if it is invalid */
+static const struct {
+	const char *value;
+	long when;
+	int zone;
+} dates[] = {
+	{ "Sun, 24 Aug 2003 15:49:15 +0200", 1061732955, 120 },
+	{ "24 Aug 2003 13:49:15 -0000", 1061732955, 0 },
+	{ "Sun (day), 24 (x) Aug 2003 15:49:15 +0200 (CEST)", 1061732955, 
+	    120 },
+	{ "Sun, 24 Aug 03 15:49 EDT", 1061754540, -240 },
+	{ "Thu, 1 Jan 70 00:00:00 GMT", 0, 0 },
+	{ "Fri, 13 Feb 109 23:31:30 UT", 1234567890, 0 },
+	{ "31 Dec 49 23:59:59 Z", 2524607999L, 0 },
+	{ "31 Dec 99 18:59:59 EST", 946684799, -300 },
+	{ "31-Dec-1999 23:59:59 +0000", 946684799, 0 },
+	{ "29 Feb 2004 00:00 +0000", 1078012800, 0 },
+	{ "29 Feb 2003 00:00 +0000", -1, 0 },
+	{ "31 Feb 2004 00:00 +0000", -1, 0 },
+	{ "31 Apr 2004 00:00 +0000", -1, 0 },
+	{ "1 Jan 2004 00:00 +9999", -1, 0 },
+	{ "1 Jan 2004 00:00 +0260", -1, 0 },
+	{ "1 Jan 2004 24:00 +0000", -1, 0 },
+	{ "1 Foo 2004 00:00 +0000", -1, 0 },
+	{ "blahblah", -1, 0 },
+	{ NULL, 0, 0 }
+};
+
+/* An address list and its addresses as "name|mailbox|group;..." */
+static const struct {
+	const char *value;
+	const char *addresses;
+} lists[] = {
+	{ "Jann Fischer <rezine@criminology.de>", 
+	    "Jann Fischer|rezine@criminology.de|-;" },
+	{ "\"Fischer, Jann\" <rezine@x.de>, b@y.de",
+	    "Fischer, Jann|rezine@x.de|-;-|b@y.de|-;" },
+	{ "\"a \\\"b\\\"\" <q@r.de>", "a \"b\"|q@r.de|-;" },
+	{ "a@b.de (Alice)", "Alice|a@b.de|-;" },
+	{ "Route <@relay.de,@r2.de:a@b.de>", "Route|a@b.de|-;" },
+	{ "team: a@b.de, Bob <b@b.de>;, c@d.de",
+	    "-|a@b.de|team;Bob|b@b.de|team;-|c@d.de|-;" },
+	{ "undisclosed-recipients:;", "" },
+	{ "Name <", "" },
+	{ "Name <>, a@b.de", "-|a@b.de|-;" },
+	{ " , ,a@b.de,", "-|a@b.de|-;" },
+	{ NULL, NULL }
+};
+
+/* A header field value and its message IDs as "id;..." */
+static const struct {
+	const char *value;
+	const char *ids;
+} msgids[] = {
+	{ "<1@a.de>", "1@a.de;" },
+	{ "<1@a.de> (x <2@b.de>) \"<3@c.de>\" <4@\r\n d.de>", "1@a.de;4@d.de;" },
+	{ "<>, <1@a.de", "" },
+	{ NULL, NULL }
+};
+
+void
+fail(const char *what, const char *value)
+{
+	printf("ERROR: %s: %s\n", what, value);
+	exit(1);
+}
+
+static void
+checkdate(struct mm_mimeheader *header, long when, int zone)
+{
+	time_t t;
+	int z;
+
+	if (mm_mimeheader_getdate(header, &t, &z) == -1) {
+		if (when != -1)
+			fail("valid date not parsed", header->value);
+		return;
+	}
+	if (when == -1)
+		fail("invalid date parsed", header->value);
+	if ((long)t != when || z != zone)
+		fail("wrong date", header->value);
+}
+
+static void
+checkaddresses(struct mm_mimeheader *header, const char *expect)
+{
+	const struct mm_address *a;
+	char buf[1024];
+	int count, i;
+
+	if (mm_mimeheader_getaddresses(header, &a, &count) == -1)
+		fail("address list not parsed", header->value);
+
+	buf[0] = '\0';
+	for (i = 0; i < count; i++) {
+		snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), 
+		    "%s|%s|%s;", a[i].name ? a[i].name : "-", a[i].mailbox,
+		    a[i].group ? a[i].group : "-");
+	}
+	if (strcmp(buf, expect)) {
+		printf("got %s\n", buf);
+		fail("wrong addresses", header->value);
+	}
+}
+
+static void
+checkmsgids(struct mm_mimeheader *header, const char *expect)
+{
+	const char * const *ids;
+	char buf[1024];
+	int count, i;
+
+	if (mm_mimeheader_getmsgids(header, &ids, &count) == -1)
+		fail("message IDs not parsed", header->value);
+
+	buf[0] = '\0';
+	for (i = 0; i < count; i++)
+		snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), 
+		    "%s;", ids[i]);
+	if (strcmp(buf, expect)) {
+		printf("got %s\n", buf);
+		fail("wrong message IDs", header->value);
+	}
+}
+
+int
+main(void)
+{
+	struct mm_mimeheader *header;
+	int i;
+
+	mm_library_init();
+
+	for (i = 0; dates[i].value != NULL; i++) {
+		header = mm_mimeheader_generate("Date", dates[i].value);
+		checkdate(header, dates[i].when, dates[i].zone);
+		/* Asked again, the kept value is used */
+		checkdate(header, dates[i].when, dates[i].zone);
+		mm_mimeheader_free(header);
+	}
+
+	for (i = 0; lists[i].value != NULL; i++) {
+		header = mm_mimeheader_generate("To", lists[i].value);
+		checkaddresses(header, lists[i].addresses);
+		checkaddresses(header, lists[i].addresses);
+		mm_mimeheader_free(header);
+	}
+
+	for (i = 0; msgids[i].value != NULL; i++) {
+		header = mm_mimeheader_generate("References", msgids[i].value);
+		checkmsgids(header, msgids[i].ids);
+		checkmsgids(header, msgids[i].ids);
+		mm_mimeheader_free(header);
+	}
+
+	/* Setting the value drops the parsed one */
+	header = mm_mimeheader_generate("Date", dates[0].value);
+	checkdate(header, dates[0].when, dates[0].zone);
+	mm_mimeheader_setvalue(header, dates[3].value);
+	checkdate(header, dates[3].when, dates[3].zone);
+	mm_mimeheader_setvalue(header, "blahblah");
+	checkdate(header, -1, 0);
+	mm_mimeheader_setvalue(header, lists[1].value);
+	checkaddresses(header, lists[1].addresses);
+	mm_mimeheader_setvalue(header, lists[5].value);
+	checkaddresses(header, lists[5].addresses);
+	/* A parsed value of another type is replaced */
+	mm_mimeheader_setvalue(header, msgids[1].value);
+	checkmsgids(header, msgids[1].ids);
+	checkaddresses(header, "-|1@a.de|-;");
+	mm_mimeheader_free(header);
+
+	printf("Structured header field values are right\n");
+
+	return 0;
+}
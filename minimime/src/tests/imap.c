@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - imap.c
+ *
+ * Parses the test messages and checks the IMAP BODYSTRUCTURE and ENVELOPE
+ * generated for each of them
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+
+struct expected
+{
+	const char *file;
+	const char *bodystructure;
+	const char *envelope;
+};
+
+/* A multipart entity whose parts cannot be found without a boundary */
+const char *noboundary =
+	"Content-Type: multipart/mixed; boundary=\"outer\"\n"
+	"\n"
+	"--outer\n"
+	"Content-Type: multipart/alternative\n"
+	"\n"
+	"text\n"
+	"--outer--\n";
+
+const struct expected expected[] = {
+	{ "test1.txt",
+	    "((\"application\" \"pgp-encrypted\" NIL NIL NIL \"7BIT\" 11 "
+	    "NIL NIL NIL NIL)(\"application\" \"octet-stream\" NIL NIL "
+	    "NIL \"7BIT\" 1093 NIL NIL NIL NIL) \"encrypted\" "
+	    "(\"protocol\" \"application/pgp-encrypted\" \"boundary\" "
+	    "\"=.2S1ZDSX8ir3lbt\") NIL NIL NIL)",
+	    "(\"Sun, 24 Aug 2003 15:49:15 +0200\" \"Test\" ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"hannover.ccc.de\")) ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"hannover.ccc.de\")) ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"hannover.ccc.de\")) ((NIL NIL "
+	    "\"test\" \"mistrust.net\")) NIL NIL NIL "
+	    "\"<20030824154915.12cb3f85.rezine@hannover.ccc.de>\")" },
+	{ "test2.txt",
+	    "((\"application\" \"pgp-encrypted\" NIL NIL NIL \"7BIT\" 11 "
+	    "NIL NIL NIL NIL)(\"application\" \"octet-stream\" NIL NIL "
+	    "NIL \"7BIT\" 1093 NIL NIL NIL NIL) \"encrypted\" "
+	    "(\"protocol\" \"application/pgp-encrypted\" \"boundary\" "
+	    "\"=.2S1ZDSX8ir3lbt\") NIL NIL NIL)",
+	    "(\"Sun, 24 Aug 2003 15:49:15 +0200\" \"Test\" ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"hannover.ccc.de\")) ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"hannover.ccc.de\")) ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"hannover.ccc.de\")) ((NIL NIL "
+	    "\"test\" \"mistrust.net\")) NIL NIL NIL "
+	    "\"<20030824154915.12cb3f85.rezine@hannover.ccc.de>\")" },
+	{ "test3.txt",
+	    "((\"plain\" \"text\" NIL NIL NIL \"7BIT\" 18 NIL NIL NIL "
+	    "NIL) \"mixed\" (\"boundary\" \"abcd\") NIL NIL NIL)",
+	    "(\"blahblah\" \"Foobar\" ((\"Jann Fischer\" NIL \"rezine\" "
+	    "\"criminology.de\")) ((\"Jann Fischer\" NIL \"rezine\" "
+	    "\"criminology.de\")) ((\"Jann Fischer\" NIL \"rezine\" "
+	    "\"criminology.de\")) ((\"cipherlist\" NIL \"cipherlist\" "
+	    "\"mistrust.net\")) NIL NIL NIL NIL)" },
+	{ "test4.txt",
+	    "((\"text\" \"html\" NIL NIL NIL \"7BIT\" 6123 117 NIL NIL "
+	    "NIL NIL)(\"text\" \"plain\" (\"charset\" \"iso-8859-1\") NIL "
+	    "NIL \"quoted-printable\" 84 3 NIL (\"inline\" NIL) NIL NIL) "
+	    "\"mixed\" (\"boundary\" "
+	    "\"===============14807035762661644==\") NIL NIL NIL)",
+	    "(\"Mon, 1 Dec 2003 15:30:57 +0800\" \"[CCC511] "
+	    "http://lists.hannover.ccc.de\" ((\"Vanessa Lintner\" NIL "
+	    "\"reply\" \"seekercenter.net\")) ((NIL NIL \"511-bounces\" "
+	    "\"hannover.ccc.de\")) ((\"Vanessa Lintner\" NIL \"vanessa\" "
+	    "\"seekercenter.net\")(\"Oeffentliche Mailingliste des C3H\" "
+	    "NIL \"511\" \"hannover.ccc.de\")) ((NIL NIL \"511\" "
+	    "\"hannover.ccc.de\")) NIL NIL NIL "
+	    "\"<20031201072912.3F93ABC7C@gost.hannover.ccc.de>\")" },
+	{ "test5.txt",
+	    "((\"text\" \"plain\" (\"charset\" \"US-ASCII\") NIL NIL "
+	    "\"7bit\" 101 5 NIL NIL NIL NIL)(\"application\" "
+	    "\"octet-stream\" (\"name\" \"bar.c\") NIL NIL \"base64\" 114 "
+	    "NIL (\"attachment\" (\"FILENAME\" \"bar.c\")) NIL NIL) "
+	    "\"mixed\" (\"boundary\" "
+	    "\"Multipart_Wed__24_Dec_2003_13:35:11_+0100_00148800\") NIL "
+	    "NIL NIL)",
+	    "(\"Wed, 24 Dec 2003 13:35:11 +0100\" \"Test\" ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"criminology.de\")) ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"criminology.de\")) ((\"Jann "
+	    "Fischer\" NIL \"rezine\" \"criminology.de\")) ((NIL NIL "
+	    "\"rezine\" \"mistrust.net\")) NIL NIL NIL "
+	    "\"<20031224133511.5f4b6d9b.rezine@criminology.de>\")" },
+	{ "test6.txt",
+	    "((\"text\" \"plain\" NIL NIL NIL \"7BIT\" 14 2 NIL NIL NIL "
+	    "NIL) \"mixed\" (\"boundary\" \"abcde\") NIL NIL NIL)",
+	    "(\"Foobar\" NIL ((NIL NIL \"Me\" \"\")) ((NIL NIL \"Me\" "
+	    "\"\")) ((NIL NIL \"Me\" \"\")) ((NIL NIL \"There\" \"\")) "
+	    "NIL NIL NIL NIL)" },
+	{ "test7.txt",
+	    "((\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL "
+	    "\"7BIT\" 551 13 NIL NIL NIL NIL)(\"message\" "
+	    "\"delivery-status\" NIL NIL NIL \"7BIT\" 288 NIL NIL NIL "
+	    "NIL)(\"message\" \"rfc822\" NIL NIL NIL \"7BIT\" 368 (\"Tue, "
+	    "11 Mar 2003 20:18:36 +0100 (CET)\" \"Test\" ((\"Jann "
+	    "Fischer\" NIL \"jfi\" \"\")) ((\"Jann Fischer\" NIL \"jfi\" "
+	    "\"\")) ((\"Jann Fischer\" NIL \"jfi\" \"\")) ((NIL NIL "
+	    "\"rezine\" \"kommunism.us\")) NIL NIL NIL "
+	    "\"<200303111918.h2BJIawm025679@chaos.verfassungsschutz.de>\""
+	    ") (\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL "
+	    "\"7BIT\" 5 1 NIL NIL NIL NIL) 11 NIL NIL NIL NIL) \"report\" "
+	    "(\"report-type\" \"delivery-status\" \"boundary\" "
+	    "\"h2BNU1vr029177.1047425701/chaos.verfassungsschutz.de\") "
+	    "NIL NIL NIL)",
+	    "(\"Wed, 12 Mar 2003 00:35:01 +0100 (CET)\" \"Warning: could "
+	    "not send message for past 4 hours\" ((\"Mail Delivery "
+	    "Subsystem\" NIL \"MAILER-DAEMON\" "
+	    "\"chaos.verfassungsschutz.de\")) ((\"Mail Delivery "
+	    "Subsystem\" NIL \"MAILER-DAEMON\" "
+	    "\"chaos.verfassungsschutz.de\")) ((\"Mail Delivery "
+	    "Subsystem\" NIL \"MAILER-DAEMON\" "
+	    "\"chaos.verfassungsschutz.de\")) ((NIL NIL \"jfi\" "
+	    "\"chaos.verfassungsschutz.de\")) NIL NIL NIL "
+	    "\"<200303112335.h2BNU1vr029177@chaos.verfassungsschutz.de>\""
+	    ")" },
+	{ "test8.txt",
+	    "((\"text\" \"plain\" (\"charset\" \"ISO-8859-1\") NIL NIL "
+	    "\"quoted-printable\" 96 2 NIL NIL NIL NIL)(\"application\" "
+	    "\"octet-stream\" (\"name\" \"=?UTF-8?Q?Stra=C3=9Fe.txt?=\") "
+	    "NIL NIL \"base64\" 13 NIL (\"attachment\" NIL) NIL NIL) "
+	    "\"mixed\" (\"boundary\" \"encwords\") NIL NIL NIL)",
+	    "(\"Mon, 14 Jun 2004 10:12:03 +0200\" "
+	    "{67}\r\n=?UTF-8?B?R3LDvMOfZSBhdXMg?=\n =?UTF-8?Q?K=C3=B6ln?= "
+	    "(encoded words) ((\"=?ISO-8859-1?Q?J=F6rg_M=FCller?=\" NIL "
+	    "\"joerg\" \"example.org\")) "
+	    "((\"=?ISO-8859-1?Q?J=F6rg_M=FCller?=\" NIL \"joerg\" "
+	    "\"example.org\")) ((\"=?ISO-8859-1?Q?J=F6rg_M=FCller?=\" NIL "
+	    "\"joerg\" \"example.org\")) ((NIL NIL \"rezine\" "
+	    "\"mistrust.net\")) NIL NIL NIL "
+	    "\"<20040614101203.3a1f@example.org>\")" },
+	{ "test9.txt",
+	    "((\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL "
+	    "\"7BIT\" 61 1 NIL NIL NIL NIL)(\"application\" "
+	    "\"octet-stream\" (\"name\" {51}\r\nSehr lange Dateinamen "
+	    "m\303\274ssen aufgeteilt werden.txt) NIL NIL \"base64\" 13 "
+	    "NIL (\"attachment\" (\"FILENAME\" {51}\r\nSehr lange "
+	    "Dateinamen m\303\274ssen aufgeteilt werden.txt)) NIL NIL) "
+	    "\"mixed\" (\"boundary\" \"rfc2231\") NIL NIL NIL)",
+	    "(\"Tue, 15 Jun 2004 18:40:11 +0200\" \"RFC 2231 parameters\" "
+	    "((\"Jann Fischer\" NIL \"rezine\" \"mistrust.net\")) "
+	    "((\"Jann Fischer\" NIL \"rezine\" \"mistrust.net\")) "
+	    "((\"Jann Fischer\" NIL \"rezine\" \"mistrust.net\")) ((NIL "
+	    "NIL \"rezine\" \"mistrust.net\")) NIL NIL NIL "
+	    "\"<20040615184011.7c2e@mistrust.net>\")" },
+	{ "test10.txt",
+	    "(((\"text\" \"plain\" (\"charset\" \"us-ascii\") NIL NIL "
+	    "\"7BIT\" 10 1 NIL NIL NIL NIL)(\"text\" \"html\" "
+	    "(\"charset\" \"us-ascii\") NIL NIL \"7BIT\" 16 1 NIL NIL NIL "
+	    "NIL) \"alternative\" (\"boundary\" \"inner\") NIL NIL "
+	    "NIL)(\"message\" \"rfc822\" NIL NIL NIL \"7BIT\" 296 (NIL "
+	    "\"Forwarded\" ((\"Jann Fischer\" NIL \"rezine\" "
+	    "\"criminology.de\")) ((\"Jann Fischer\" NIL \"rezine\" "
+	    "\"criminology.de\")) ((\"Jann Fischer\" NIL \"rezine\" "
+	    "\"criminology.de\")) NIL NIL NIL NIL NIL) ((\"text\" "
+	    "\"plain\" NIL NIL NIL \"7BIT\" 14 1 NIL NIL NIL "
+	    "NIL)(\"application\" \"octet-stream\" NIL NIL NIL \"base64\" "
+	    "28 NIL NIL NIL NIL) \"mixed\" (\"boundary\" \"forwarded\") "
+	    "NIL NIL NIL) 14 NIL NIL NIL NIL) \"mixed\" (\"boundary\" "
+	    "\"outer\") NIL NIL NIL)",
+	    "(\"Sun, 24 Aug 2003 15:49:15 +0200\" \"Nested MIME parts\" "
+	    "((\"Jann Fischer\" NIL \"rezine\" \"criminology.de\")) "
+	    "((\"Jann Fischer\" NIL \"rezine\" \"criminology.de\")) "
+	    "((\"Jann Fischer\" NIL \"rezine\" \"criminology.de\")) "
+	    "((\"cipherlist\" NIL \"cipherlist\" \"mistrust.net\")) NIL "
+	    "NIL NIL NIL)" },
+};
+
+void
+fail(const char *file, const char *what)
+{
+	printf("ERROR: %s: %s\n", file, what);
+	exit(1);
+}
+
+/* Checks data items twice, once generated into a buffer too small */
+void
+check(MM_CTX *ctx, const char *file, const char *item, const char *want)
+{
+	char buf[4096];
+	size_t length, wantlen;
+	int ret;
+
+	wantlen = strlen(want);
+	if (!strcmp(item, "BODYSTRUCTURE"))
+		ret = mm_imap_bodystructure(ctx, NULL, buf, 1, &length, 0);
+	else
+		ret = mm_imap_envelope(ctx, buf, 1, &length);
+	if (ret != -1 || length != wantlen)
+		fail(file, "wrong size needed");
+
+	if (!strcmp(item, "BODYSTRUCTURE"))
+		ret = mm_imap_bodystructure(ctx, NULL, buf, sizeof(buf), 
+		    &length, 0);
+	else
+		ret = mm_imap_envelope(ctx, buf, sizeof(buf), &length);
+	if (ret == -1)
+		fail(file, mm_error_string());
+	if (length != wantlen || memcmp(buf, want, length)) {
+		printf("%s: %s is %.*s\n", file, item, (int)length, buf);
+		fail(file, "wrong data item");
+	}
+}
+
+int
+main(int argc, char **argv)
+{
+	MM_CTX *ctx;
+	const char *directory;
+	char path[1024];
+	size_t i;
+
+	directory = argc > 1 ? argv[1] : "tests/messages";
+
+	mm_library_init();
+	mm_codec_registerdefaultcodecs();
+
+	for (i = 0; i < sizeof(expected) / sizeof(expected[0]); i++) {
+		snprintf(path, sizeof(path), "%s/%s", directory, 
+		    expected[i].file);
+		ctx = mm_context_new();
+		if (mm_parse_file(ctx, path, MM_PARSE_LOOSE, 0) == -1)
+			fail(path, mm_error_string());
+		check(ctx, path, "BODYSTRUCTURE", expected[i].bodystructure);
+		check(ctx, path, "ENVELOPE", expected[i].envelope);
+		mm_context_free(ctx);
+	}
+
+	printf("IMAP data items of %lu messages are right\n", 
+	    (unsigned long)i);
+
+	ctx = mm_context_new();
+	if (mm_parse_mem(ctx, noboundary, MM_PARSE_LOOSE, 0) == -1)
+		fail("noboundary", mm_error_string());
+	if (mm_imap_bodystructure(ctx, NULL, path, sizeof(path), &i, 0) 
+	    != -1 || mm_errno != MM_ERROR_MIME)
+		fail("noboundary", "multipart entity described as a body");
+	mm_context_free(ctx);
+
+	return 0;
+}
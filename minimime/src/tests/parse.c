@@ -51,13 +51,89 @@ usage(void)
 {
 	fprintf(stderr,
 	    "MiniMIME test suite\n"
-	    "Usage: %s [-m] <filename>\n\n"
+	    "Usage: %s [-km] <filename>\n\n"
+	    "   -k            : keep the source, check the reconstruction\n"
+	    "                   and a rewrite\n"
 	    "   -m            : use memory based scanning\n\n",
 	    progname
 	);
 	exit(1);
 }
 
+/*
+ * Inserts a header field before the header field hdr of a message parsed 
+ * from orig (edit 0), replaces hdr (1) or deletes it (2), and checks that 
+ * the rewritten message is the source with just that change. The header 
+ * fields generated have the line break of hdr.
+ */
+void
+rewrite(MM_CTX *ctx, struct mm_mimepart *part, struct mm_mimeheader *hdr,
+    int edit, const char *orig, size_t orig_len)
+{
+	struct mm_rewrite *rw;
+	struct mm_mimeheader *other;
+	char *out, *expected;
+	const char *eol;
+	size_t out_len, len, end;
+	int ret;
+
+	end = hdr->src_offset + hdr->src_length;
+	eol = (end >= 2 && orig[end - 2] == '\r') ? "\r\n" : "\n";
+
+	expected = (char *)malloc(orig_len + strlen(hdr->name) + 64);
+	if (expected == NULL)
+		err(1, "malloc");
+	memcpy(expected, orig, hdr->src_offset);
+	len = hdr->src_offset;
+
+	rw = mm_rewrite_new(ctx);
+	if (rw == NULL) {
+		printf("ERROR: %s\n", mm_error_string());
+		exit(1);
+	}
+	switch (edit) {
+	case 0:
+		ret = mm_rewrite_insert(rw, part, hdr, "Received", 
+		    "by parse test");
+		len += sprintf(expected + len, "Received: by parse test%s", 
+		    eol);
+		end = hdr->src_offset;
+		break;
+	case 1:
+		ret = mm_rewrite_replace(rw, hdr, "replaced by parse test");
+		len += sprintf(expected + len, "%s: replaced by parse test%s",
+		    hdr->name, eol);
+		break;
+	default:
+		ret = mm_rewrite_delete(rw, hdr);
+		break;
+	}
+	if (ret == -1) {
+		printf("ERROR: %s\n", mm_error_string());
+		exit(1);
+	}
+	memcpy(expected + len, orig + end, orig_len - end);
+	len += orig_len - end;
+
+	mm_rewrite_flatten(rw, &out, &out_len);
+	if (out_len != len || memcmp(out, expected, len)) {
+		printf("ERROR: rewritten message is wrong (edit %d)\n", edit);
+		exit(1);
+	}
+
+	/* Header fields which were not parsed from the source are refused */
+	other = mm_mimeheader_generate("X-Other", "value");
+	if (mm_rewrite_delete(rw, other) != -1) {
+		printf("ERROR: rewrite of a foreign header field\n");
+		exit(1);
+	}
+	mm_mimeheader_free(other);
+
+	free(out);
+	free(expected);
+	mm_rewrite_free(rw);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -71,13 +147,17 @@ main(int argc, char **argv)
 	int fd;
 	char *buf;
 	int scan_mode = 0;
+	int flags = 0;
 
 	progname = strdup(argv[0]);
 
 	lastheader = NULL;
 
-	while ((i = getopt(argc, argv, "m")) != -1) {
+	while ((i = getopt(argc, argv, "km")) != -1) {
 		switch(i) {
+		case 'k':
+			flags |= MM_PARSE_KEEPSOURCE;
+			break;
 		case 'm':
 			scan_mode = 1;
 			break;
@@ -110,7 +190,7 @@ main(int argc, char **argv)
 
 		/* Parse a file into our context */
 		if (scan_mode == 0) {
-			i = mm_parse_file(ctx, argv[0], MM_PARSE_LOOSE, 0);
+			i = mm_parse_file(ctx, argv[0], MM_PARSE_LOOSE, flags);
 		} else {
 			if (stat(argv[0], &st) == -1) {
 				err(1, "stat");
@@ -120,7 +200,7 @@ main(int argc, char **argv)
 				err(1, "open");
 			}
 
-			buf = (char *)malloc(st.st_size);
+			buf = (char *)malloc(st.st_size + 1);
 			if (buf == NULL) {
 				err(1, "malloc");
 			}	
@@ -132,7 +212,7 @@ main(int argc, char **argv)
 			close(fd);
 			buf[st.st_size] = '\0';
 			
-			i = mm_parse_mem(ctx, buf, MM_PARSE_LOOSE, 0);
+			i = mm_parse_mem(ctx, buf, MM_PARSE_LOOSE, flags);
 		}
 
 		if (i == -1 || mm_errno != MM_ERROR_NONE) {	
@@ -224,6 +304,44 @@ main(int argc, char **argv)
 
 			mm_context_flatten(ctx, &env, &env_len, 0);
 			printf("%s", env);
+
+			/* Unmodified messages are written out verbatim */
+			if (flags & MM_PARSE_KEEPSOURCE) {
+				char *orig;
+
+				if (stat(argv[0], &st) == -1)
+					err(1, "stat");
+				if ((fd = open(argv[0], O_RDONLY)) == -1)
+					err(1, "open");
+				orig = (char *)malloc(st.st_size + 1);
+				if (orig == NULL)
+					err(1, "malloc");
+				if (read(fd, orig, st.st_size) != st.st_size)
+					err(1, "read");
+				close(fd);
+
+				if (env_len != (size_t)st.st_size
+				    || memcmp(env, orig, env_len)) {
+					printf("ERROR: reconstructed message "
+					    "differs from the source\n");
+					exit(1);
+				}
+				printf("Reconstructed message matches the "
+				    "source\n");
+
+				/* Edits of the first header field are spliced
+				 * in */
+				part = mm_context_getpart(ctx, 0);
+				header = TAILQ_FIRST(&part->headers);
+				if (header != NULL) {
+					for (i = 0; i < 3; i++)
+						rewrite(ctx, part, header, i,
+						    orig, env_len);
+					printf("Rewritten messages are "
+					    "right\n");
+				}
+				free(orig);
+			}
 			free(env);
 
 		} while (0);	
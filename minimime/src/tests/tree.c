@@ -0,0 +1,221 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - tree.c
+ *
+ * Builds a tree of nested MIME parts, walks it and flattens it, and parses
+ * one
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+
+/* The parts of the tree in depth first and in breadth first order */
+const char *depthfirst[] = { 
+	"envelope", "one", "two", "two.one", "two.two", "two.two.one", "three"
+};
+const int depths[] = { 0, 1, 1, 2, 2, 3, 1 };
+const char *breadthfirst[] = {
+	"envelope", "one", "two", "three", "two.one", "two.two", "two.two.one"
+};
+
+/* A multipart entity and a multipart message nested in a message */
+const char *nested =
+	"From: foo@bar.com\n"
+	"Content-Type: multipart/mixed; boundary=\"outer\"\n"
+	"\n"
+	"--outer\n"
+	"Content-Type: multipart/alternative; boundary=\"inner\"\n"
+	"\n"
+	"--inner\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"one.one\n"
+	"--inner\n"
+	"Content-Type: text/html\n"
+	"\n"
+	"one.two\n"
+	"--inner--\n"
+	"--outer\n"
+	"Content-Type: message/rfc822\n"
+	"\n"
+	"Subject: two\n"
+	"Content-Type: multipart/mixed; boundary=\"forwarded\"\n"
+	"\n"
+	"--forwarded\n"
+	"Content-Type: text/plain\n"
+	"\n"
+	"two.one\n"
+	"--forwarded--\n"
+	"--outer--\n";
+
+struct mm_mimepart *
+mkpart(const char *body)
+{
+	struct mm_mimepart *part;
+	struct mm_content *ct;
+
+	part = mm_mimepart_new();
+	ct = mm_content_new();
+	mm_content_settype(ct, "text/plain");
+	mm_mimepart_attachcontenttype(part, ct);
+	mm_mimepart_setbody(part, body, 1);
+
+	return part;
+}
+
+void
+fail(const char *what)
+{
+	printf("ERROR: %s\n", what);
+	exit(1);
+}
+
+void
+walk(MM_CTX *ctx, int order, const char **expected)
+{
+	struct mm_walk walk;
+	struct mm_mimepart *part;
+	int i;
+
+	mm_walk_init(&walk, ctx, NULL, order);
+	for (i = 0; (part = mm_walk_next(&walk)) != NULL; i++) {
+		if (i >= 7 || strcmp(part->body, expected[i]))
+			fail("walk visits the wrong part");
+		if (order == MM_WALK_DEPTHFIRST 
+		    && mm_walk_depth(&walk) != depths[i])
+			fail("walk returns the wrong depth");
+	}
+	if (i != 7)
+		fail("walk misses parts");
+}
+
+int
+main(void)
+{
+	MM_CTX *ctx;
+	struct mm_mimepart *envelope, *two, *twotwo, *part;
+	char *data;
+	size_t length;
+
+	mm_library_init();
+
+	/* The envelope holds two parts of the context and one nested in it.
+	 * The second part of the context has a Content-Type which does not 
+	 * allow nested parts yet. */
+	ctx = mm_context_new();
+	envelope = mm_mimepart_new();
+	mm_mimepart_setbody(envelope, "envelope", 1);
+	mm_context_attachpart(ctx, envelope);
+	mm_envelope_setheader(ctx, "From", "foo@bar.com");
+	mm_context_attachpart(ctx, mkpart("one"));
+	two = mkpart("two");
+	mm_context_attachpart(ctx, two);
+	if (mm_mimepart_attachchild(envelope, mkpart("three")) == -1)
+		fail(mm_error_string());
+
+	twotwo = mkpart("two.two");
+	if (mm_mimepart_attachchild(two, mkpart("two.one")) == -1
+	    || mm_mimepart_attachchild(two, twotwo) == -1
+	    || mm_mimepart_attachchild(twotwo, mkpart("two.two.one")) == -1)
+		fail(mm_error_string());
+	if (mm_mimepart_attachchild(two, twotwo) != -1)
+		fail("part nested twice");
+
+	walk(ctx, MM_WALK_DEPTHFIRST, depthfirst);
+	walk(ctx, MM_WALK_BREADTHFIRST, breadthfirst);
+
+	part = mm_context_getpartbypath(ctx, "3");
+	if (part == NULL || strcmp(part->body, "three"))
+		fail("section 3 is not the part nested in the envelope");
+
+	/* A body can be set to itself */
+	mm_mimepart_setbody(part, mm_mimepart_getbody(part, 1), 1);
+	mm_mimepart_setbody(part, part->body, 0);
+	if (strcmp(part->body, "three") || part->length != 5)
+		fail("body set to itself is lost");
+	part = mm_context_getpartbypath(ctx, "2.2.1");
+	if (part == NULL || strcmp(part->body, "two.two.one"))
+		fail("section 2.2.1 is wrong");
+
+	if (mm_context_flatten(ctx, &data, &length, 0) == -1)
+		fail(mm_error_string());
+
+	/* Parts with nested parts are written as multipart entities */
+	if (two->type->mediatype != MM_MEDIATYPE_MULTIPART
+	    || mm_content_getparambyname(two->type, "boundary") == NULL
+	    || twotwo->type->mediatype != MM_MEDIATYPE_MULTIPART)
+		fail("nested parts in a part which is not multipart");
+	if (strstr(data, "\r\n\r\ntwo\r\n") != NULL
+	    || strstr(data, "\r\n\r\nthree\r\n") == NULL
+	    || strstr(data, "\r\n\r\ntwo.two.one\r\n") == NULL)
+		fail("flattened message is wrong");
+
+	printf("%s", data);
+	printf("Tree of MIME parts is right\n");
+
+	free(data);
+	mm_context_free(ctx);
+
+	/* Parsed nested MIME parts are linked to the enclosing ones */
+	ctx = mm_context_new();
+	if (mm_parse_mem(ctx, nested, MM_PARSE_STRICT, MM_PARSE_KEEPSOURCE) 
+	    == -1)
+		fail(mm_error_string());
+	two = mm_context_getpartbypath(ctx, "1");
+	part = mm_context_getpartbypath(ctx, "1.2");
+	if (two == NULL || two->nchildren != 2 || part == NULL 
+	    || part->parent != two || strcmp(part->body, "one.two"))
+		fail("section 1.2 of the parsed message is wrong");
+	part = mm_context_getpartbypath(ctx, "2.1");
+	if (part == NULL || strcmp(part->body, "two.one")
+	    || part->parent == NULL || part->parent->parent 
+	    != mm_context_getpartbypath(ctx, "2"))
+		fail("section 2.1 of the parsed message is wrong");
+	if (mm_context_getpartbypath(ctx, "1.3") != NULL
+	    || mm_context_getpartbypath(ctx, "2.2") != NULL)
+		fail("parsed message has too many parts");
+
+	/* and are written out as they were parsed */
+	if (mm_context_flatten(ctx, &data, &length, 0) == -1)
+		fail(mm_error_string());
+	if (length != strlen(nested) || memcmp(data, nested, length))
+		fail("parsed message is not written out as is");
+
+	printf("Parsed tree of MIME parts is right\n");
+
+	free(data);
+	mm_context_free(ctx);
+
+	return 0;
+}
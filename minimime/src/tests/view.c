@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2004 Jann Fischer. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MiniMIME test program - view.c
+ *
+ * Checks message views of a nested message, with LF and CRLF line breaks
+ */
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "mm.h"
+
+/* The parts of test10.txt, the bodies are given without CR */
+static const struct {
+	const char *type;
+	const char *subtype;
+	int parent;
+	int children;
+	int nchildren;
+	int next;
+	int end;
+	const char *head;
+	const char *tail;
+} parts[] = {
+	{ "multipart", "mixed", -1, 1, 2, -1, 5, 
+	    "This is the preamble of the message.\n--outer\n",
+	    "--outer--\nThis is the postamble of the message.\n" },
+	{ "multipart", "alternative", 0, 2, 2, 4, 4,
+	    "This is the preamble of the alternatives.\n--inner\n",
+	    "--inner--\nThis is the postamble of the alternatives." },
+	{ "text", "plain", 1, -1, 0, 3, 3, "Plain text", "Plain text" },
+	{ "text", "html", 1, -1, 0, -1, 4, 
+	    "<p>HTML text</p>", "<p>HTML text</p>" },
+	{ "message", "rfc822", 0, -1, 0, -1, 5, 
+	    "From: Jann Fischer <rezine@criminology.de>\nSubject: Forwarded\n",
+	    "Rm9yd2FyZGVkIGF0dGFjaG1lbnQ=\n--forwarded--" }
+};
+
+/* Parameters and header fields which are not where they are expected */
+static const char odd[] =
+    " leading: whitespace before the first field\r\n"
+    "\tand its continuation\r\n"
+    "Subject: first\r\n"
+    "not a header field\r\n"
+    " continues nothing\r\n"
+    "subject: second,\r\n"
+    " folded\r\n"
+    "Content-Type: text/plain; name=\"a \\\"b\\\" c\";\r\n"
+    "\tcharset=utf-8 ; format = \"flowed\"\r\n"
+    "\r\n"
+    "Body\r\n";
+
+void
+fail(const char *file, const char *what)
+{
+	printf("ERROR: %s: %s\n", file, what);
+	exit(1);
+}
+
+/* Compares a span of the message to a string */
+static int
+spaneq(struct mm_view *view, const struct mm_viewspan *span, const char *s)
+{
+	return span->length == strlen(s) 
+	    && !memcmp(view->data + span->offset, s, span->length);
+}
+
+/* Compares the start or the end of a body, leaving out CRs */
+static int
+bodyeq(const char *body, size_t length, const char *s, int tail)
+{
+	char *buf;
+	size_t i, n, slen;
+	int ret;
+
+	buf = malloc(length + 1);
+	for (i = n = 0; i < length; i++)
+		if (body[i] != '\r')
+			buf[n++] = body[i];
+	slen = strlen(s);
+	ret = n >= slen && !memcmp(tail ? buf + n - slen : buf, s, slen);
+	free(buf);
+
+	/* Line breaks before a delimiter line belong to the delimiter */
+	if (tail && length > 0 && body[length - 1] != s[slen - 1])
+		ret = 0;
+
+	return ret;
+}
+
+static void
+check(struct mm_view *view, const char *what)
+{
+	const struct mm_viewpart *part;
+	const char *body, *value;
+	size_t length;
+	int i;
+
+	if (mm_view_countparts(view) != sizeof(parts) / sizeof(parts[0]))
+		fail(what, "wrong number of parts");
+
+	for (i = 0; i < mm_view_countparts(view); i++) {
+		part = mm_view_getpart(view, i);
+		if (!spaneq(view, &part->type, parts[i].type)
+		    || !spaneq(view, &part->subtype, parts[i].subtype))
+			fail(what, "wrong Content-Type");
+		if (part->parent != parts[i].parent
+		    || part->children != parts[i].children
+		    || part->nchildren != parts[i].nchildren
+		    || part->next != parts[i].next || part->end != parts[i].end)
+			fail(what, "wrong links between parts");
+
+		body = mm_view_getbody(view, i, &length);
+		if (body != view->data + part->offset + part->hdrlen 
+		    || part->offset + part->length > view->length)
+			fail(what, "body out of range");
+		if (!bodyeq(body, length, parts[i].head, 0)
+		    || !bodyeq(body, length, parts[i].tail, 1)) {
+			printf("part %d is [%.*s]\n", i, (int)length, body);
+			fail(what, "wrong body");
+		}
+	}
+
+	if (mm_view_getpart(view, 5) != NULL 
+	    || mm_view_getpart(view, -1) != NULL
+	    || mm_view_getbody(view, 5, &length) != NULL)
+		fail(what, "part out of range");
+
+	value = mm_view_getparamvalue(view, 1, "BOUNDARY", &length);
+	if (value == NULL || length != 5 || memcmp(value, "inner", 5))
+		fail(what, "wrong boundary");
+	value = mm_view_getheadervalue(view, 0, "subject", 0, &length);
+	if (value == NULL || length != 17 
+	    || memcmp(value, "Nested MIME parts", 17))
+		fail(what, "wrong Subject");
+	if (mm_view_getheadervalue(view, 4, "Subject", 0, &length) != NULL)
+		fail(what, "header field of a nested message found");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct mm_view *view;
+	const struct mm_viewheader *hdr;
+	const char *directory, *value;
+	char path[1024], *lf, *crlf;
+	size_t length, i, n;
+	FILE *fp;
+
+	directory = argc > 1 ? argv[1] : "tests/messages";
+	snprintf(path, sizeof(path), "%s/test10.txt", directory);
+
+	mm_library_init();
+
+	if ((fp = fopen(path, "r")) == NULL)
+		fail(path, "can not open");
+	lf = malloc(8192);
+	length = fread(lf, 1, 8191, fp);
+	fclose(fp);
+	lf[length] = '\0';
+
+	crlf = malloc(length * 2 + 1);
+	for (i = n = 0; i < length; i++) {
+		if (lf[i] == '\n')
+			crlf[n++] = '\r';
+		crlf[n++] = lf[i];
+	}
+	crlf[n] = '\0';
+
+	view = mm_view_new(lf, length, MM_VIEW_NONE);
+	check(view, "LF");
+	mm_view_free(view);
+
+	view = mm_view_new(crlf, n, MM_VIEW_NONE);
+	check(view, "CRLF");
+	mm_view_free(view);
+
+	/* A copied view does not refer to the message */
+	view = mm_view_new(crlf, n, MM_VIEW_COPY);
+	memset(crlf, 'x', n);
+	check(view, "copied CRLF");
+	mm_view_free(view);
+
+	free(lf);
+	free(crlf);
+
+	/* Lines starting with whitespace continue nothing before a field */
+	view = mm_view_new(odd, strlen(odd), MM_VIEW_NONE);
+	if (mm_view_getpart(view, 0)->nheaders != 3)
+		fail("odd", "wrong number of header fields");
+	hdr = mm_view_getheader(view, 0, 0);
+	if (!spaneq(view, &hdr->name, "Subject")
+	    || !spaneq(view, &hdr->value, "first"))
+		fail("odd", "wrong first header field");
+	hdr = mm_view_getheader(view, 0, 1);
+	if (!spaneq(view, &hdr->value, "second,\r\n folded"))
+		fail("odd", "wrong folded header field");
+	value = mm_view_getheadervalue(view, 0, "Subject", 1, &length);
+	if (value != view->data + hdr->value.offset)
+		fail("odd", "wrong second Subject");
+	if (mm_view_getheader(view, 0, 3) != NULL)
+		fail("odd", "header field out of range");
+
+	/* Quoted values are given raw, with their quoted pairs */
+	value = mm_view_getparamvalue(view, 0, "name", &length);
+	if (value == NULL || length != 9 || memcmp(value, "a \\\"b\\\" c", 9))
+		fail("odd", "wrong quoted parameter value");
+	value = mm_view_getparamvalue(view, 0, "charset", &length);
+	if (value == NULL || length != 5 || memcmp(value, "utf-8", 5))
+		fail("odd", "wrong parameter value");
+	value = mm_view_getparamvalue(view, 0, "format", &length);
+	if (value == NULL || length != 6 || memcmp(value, "flowed", 6))
+		fail("odd", "wrong spaced parameter value");
+	value = mm_view_getbody(view, 0, &length);
+	if (length != 6 || memcmp(value, "Body\r\n", 6))
+		fail("odd", "wrong body");
+	mm_view_free(view);
+
+	printf("Message views are right\n");
+
+	return 0;
+}